@@ -0,0 +1,428 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include "module.h"
+
+/*
+    Loads haproxy.so the way the agent does and calls item keys in a loop,
+    reporting per key the latency percentiles of a call, the system calls
+    and the memory allocations it makes.
+
+    The system calls are counted by wrapping the libc functions the module
+    uses for its sockets (socket, connect, fcntl, getsockopt, send, read,
+    write, recv, poll, close) and the allocations by wrapping malloc, calloc
+    and realloc: the bench is linked with -rdynamic, so the module resolves
+    these names to the wrappers below. Calls made by the background refresh
+    thread (RefreshInterval) are counted too, with the key being measured.
+*/
+
+#define ERROR        -1
+#define RED          "\x1B[31m"
+#define GRN          "\x1B[32m"
+#define RESET        "\x1B[0m"
+
+#define MAX_PARAMS   16
+
+static unsigned long syscalls = 0;
+static unsigned long allocs = 0;
+static unsigned long allocBytes = 0;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    __sync_fetch_and_add(&allocs, 1);
+    __sync_fetch_and_add(&allocBytes, size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    __sync_fetch_and_add(&allocs, 1);
+    __sync_fetch_and_add(&allocBytes, nmemb * size);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    __sync_fetch_and_add(&allocs, 1);
+    __sync_fetch_and_add(&allocBytes, size);
+    return __libc_realloc(ptr, size);
+}
+
+/* the libc function of the wrapper */
+#define REAL(name)                                                              \
+    static __typeof__(&name) real = NULL;                                       \
+    if (NULL == real)                                                           \
+        real = (__typeof__(&name))dlsym(RTLD_NEXT, #name);                      \
+    __sync_fetch_and_add(&syscalls, 1)
+
+int socket(int domain, int type, int protocol)
+{
+    REAL(socket);
+    return real(domain, type, protocol);
+}
+
+int connect(int sock, const struct sockaddr *addr, socklen_t addrLen)
+{
+    REAL(connect);
+    return real(sock, addr, addrLen);
+}
+
+int fcntl(int fd, int cmd, ...)
+{
+    va_list args;
+    void *arg;
+
+    va_start(args, cmd);
+    arg = va_arg(args, void *);
+    va_end(args);
+
+    {
+        REAL(fcntl);
+        return real(fd, cmd, arg);
+    }
+}
+
+int getsockopt(int sock, int level, int name, void *value, socklen_t *len)
+{
+    REAL(getsockopt);
+    return real(sock, level, name, value, len);
+}
+
+ssize_t send(int sock, const void *buf, size_t len, int flags)
+{
+    REAL(send);
+    return real(sock, buf, len, flags);
+}
+
+ssize_t recv(int sock, void *buf, size_t len, int flags)
+{
+    REAL(recv);
+    return real(sock, buf, len, flags);
+}
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+    REAL(read);
+    return real(fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count)
+{
+    REAL(write);
+    return real(fd, buf, count);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    REAL(poll);
+    return real(fds, nfds, timeout);
+}
+
+int close(int fd)
+{
+    REAL(close);
+    return real(fd);
+}
+
+void help(void)
+{
+    int i = 0;
+    const char *message[] = {
+        "Usage:",
+        "       bench [options] \"haproxy.stat[/tmp/haproxy.sock, be0, srv1, scur]\" ...",
+        "Options:",
+        "       -m <module>   the module (./haproxy.so)",
+        "       -n <n>        calls of each key (1000)",
+        "       -w <n>        calls before measuring (10)",
+        "       -i <ms>       interval between the calls (0)",
+        "       -t <s>        item timeout (3)",
+        "       -v            print the value of the last call",
+        NULL
+    };
+
+    while (message[i] != NULL)
+    {
+        printf(GRN "%s\n" RESET, message[i]);
+        i++;
+    }
+}
+
+/******************************************************************************
+* Splits key[p1,"p 2",...] the way the agent does (no nested arrays).        *
+*                                                                            *
+* Return value: 0 or ERROR - the key is malformed                            *
+******************************************************************************/
+static int parseKey(char *key, AGENT_REQUEST *request)
+{
+    char *p, *param, *out;
+
+    memset(request, 0, sizeof(AGENT_REQUEST));
+    request->key = key;
+    request->params = (char **)malloc(MAX_PARAMS * sizeof(char *));
+
+    if (NULL == (p = strchr(key, '[')))
+        return 0;
+
+    *p++ = '\0';
+
+    while (1)
+    {
+        if (MAX_PARAMS == request->nparam)
+            return ERROR;
+
+        while (' ' == *p)
+            p++;
+
+        param = out = p;
+
+        if ('"' == *p)
+        {
+            for (p++; '"' != *p; p++)
+            {
+                if ('\0' == *p)
+                    return ERROR;
+
+                if ('\\' == *p && '"' == p[1])
+                    p++;
+
+                *out++ = *p;
+            }
+
+            p++;
+
+            while (' ' == *p)
+                p++;
+        }
+        else
+        {
+            while ('\0' != *p && ',' != *p && ']' != *p)
+                *out++ = *p++;
+
+            while (out > param && ' ' == out[-1])
+                out--;
+        }
+
+        request->params[request->nparam++] = param;
+
+        if (',' == *p)
+        {
+            *out = '\0';
+            p++;
+            continue;
+        }
+
+        if (']' != *p || '\0' != p[1])
+            return ERROR;
+
+        *out = '\0';
+        return 0;
+    }
+}
+
+static int compare(const void *a, const void *b)
+{
+    double da = *(const double *)a, db = *(const double *)b;
+
+    return da < db ? -1 : da > db;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    const char *modulePath = "./haproxy.so";
+    int calls = 1000, warmup = 10, intervalMs = 0, timeout = 3, verbose = 0;
+    void *module;
+    int (*moduleInit)(void);
+    int (*moduleUninit)(void);
+    ZBX_METRIC *(*moduleItemList)(void);
+    void (*moduleItemTimeout)(int);
+    ZBX_METRIC *metrics, *metric;
+    AGENT_REQUEST request;
+    AGENT_RESULT result;
+    double *latency, start;
+    unsigned long sys, alloc, bytes;
+    int opt, i, k, fails, ret = EXIT_SUCCESS;
+    char *key, *error;
+
+    while (ERROR != (opt = getopt(argc, argv, "m:n:w:i:t:vh")))
+    {
+        switch (opt)
+        {
+            case 'm':
+                modulePath = optarg;
+                break;
+            case 'n':
+                calls = atoi(optarg);
+                break;
+            case 'w':
+                warmup = atoi(optarg);
+                break;
+            case 'i':
+                intervalMs = atoi(optarg);
+                break;
+            case 't':
+                timeout = atoi(optarg);
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                help();
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind == argc || 0 >= calls)
+    {
+        help();
+        return EXIT_FAILURE;
+    }
+
+    if (NULL == (module = dlopen(modulePath, RTLD_NOW)))
+    {
+        printf(RED "Cannot load %s: %s\n" RESET, modulePath, dlerror());
+        return EXIT_FAILURE;
+    }
+
+    *(void **)&moduleInit = dlsym(module, "zbx_module_init");
+    *(void **)&moduleUninit = dlsym(module, "zbx_module_uninit");
+    *(void **)&moduleItemList = dlsym(module, "zbx_module_item_list");
+    *(void **)&moduleItemTimeout = dlsym(module, "zbx_module_item_timeout");
+
+    if (NULL == moduleInit || NULL == moduleItemList)
+    {
+        printf(RED "%s is not a Zabbix module\n" RESET, modulePath);
+        return EXIT_FAILURE;
+    }
+
+    if (NULL != moduleItemTimeout)
+        moduleItemTimeout(timeout);
+
+    if (ZBX_MODULE_OK != moduleInit())
+    {
+        printf(RED "%s\n" RESET, "Cannot initialize the module");
+        return EXIT_FAILURE;
+    }
+
+    metrics = moduleItemList();
+    latency = (double *)malloc(calls * sizeof(double));
+
+    printf(GRN "%-48s %6s %5s %9s %9s %9s %9s %9s %9s %11s\n" RESET, "key", "calls", "fail", "p50 us", "p90 us",
+           "p99 us", "max us", "syscalls", "allocs", "bytes");
+
+    for (k = optind; k < argc; k++)
+    {
+        key = strdup(argv[k]);
+
+        if (ERROR == parseKey(key, &request))
+        {
+            printf(RED "Cannot parse %s\n" RESET, argv[k]);
+            ret = EXIT_FAILURE;
+            goto next;
+        }
+
+        for (metric = metrics; NULL != metric->key; metric++)
+        {
+            if (0 == strcmp(metric->key, request.key))
+                break;
+        }
+
+        if (NULL == metric->key)
+        {
+            printf(RED "Unknown key %s\n" RESET, request.key);
+            ret = EXIT_FAILURE;
+            goto next;
+        }
+
+        fails = 0;
+        error = NULL;
+        sys = alloc = bytes = 0;
+
+        for (i = -warmup; i < calls; i++)
+        {
+            memset(&result, 0, sizeof(result));
+
+            if (0 <= i)
+            {
+                sys -= syscalls;
+                alloc -= allocs;
+                bytes -= allocBytes;
+            }
+
+            start = now();
+
+            if (SYSINFO_RET_OK != metric->function(&request, &result) && 0 <= i)
+                fails++;
+
+            if (0 <= i)
+            {
+                latency[i] = (now() - start) * 1e6;
+                sys += syscalls;
+                alloc += allocs;
+                bytes += allocBytes;
+            }
+
+            if (i == calls - 1)
+            {
+                if (NULL != result.msg)
+                    error = strdup(result.msg);
+
+                if (0 != verbose && 0 != (result.type & AR_UINT64))
+                    printf("%llu\n", (unsigned long long)result.ui64);
+                else if (0 != verbose && 0 != (result.type & AR_DOUBLE))
+                    printf("%f\n", result.dbl);
+                else if (0 != verbose && 0 != (result.type & AR_STRING))
+                    printf("%s\n", result.str);
+                else if (0 != verbose && 0 != (result.type & AR_TEXT))
+                    printf("%s\n", result.text);
+            }
+
+            free(result.str);
+            free(result.text);
+            free(result.msg);
+
+            if (0 != intervalMs)
+                usleep(intervalMs * 1000);
+        }
+
+        qsort(latency, calls, sizeof(double), compare);
+
+        printf("%-48.48s %6d %5d %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %11.0f\n", argv[k], calls, fails,
+               latency[calls / 2], latency[calls * 90 / 100], latency[calls * 99 / 100], latency[calls - 1],
+               (double)sys / calls, (double)alloc / calls, (double)bytes / calls);
+
+        if (NULL != error)
+        {
+            printf(RED "    %s\n" RESET, error);
+            free(error);
+        }
+next:
+        free(request.params);
+        free(key);
+    }
+
+    free(latency);
+
+    if (NULL != moduleUninit)
+        moduleUninit();
+
+    return ret;
+}
@@ -0,0 +1,1055 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/*
+    A stand-in for the stats socket of HAProxy, to test and benchmark the
+    module without HAProxy. It listens on a UNIX or TCP socket and answers
+    show stat (also filtered: show stat <iid> <type> <sid>), show stat typed,
+    show info, show info typed, show pools and show activity, in the classic
+    (one command, then close) and the interactive ("prompt") mode, with ';'
+    separated commands and the "@<n> " prefix of the master CLI.
+
+    The responses are generated for -f frontends and -b backends of -s
+    servers each, the counters grow with every command answered. They can
+    be delayed (-d) and written in chunks (-c, -C) to look like a busy or
+    remote HAProxy.
+
+    With -R the commands are forwarded to a real HAProxy and its responses
+    are saved to the -r directory, one file per command ("show stat 3 -1 -1"
+    - show_stat_3_-1_-1.txt); with -r alone the saved responses are replayed
+    and the commands having none are generated.
+*/
+
+#define ERROR        -1
+#define RED          "\x1B[31m"
+#define GRN          "\x1B[32m"
+#define RESET        "\x1B[0m"
+#define PROMPT       "> "
+
+typedef struct
+{
+    char   *data;
+    size_t len;
+    size_t alloc;
+}
+buffer_t;
+
+/* a row of show stat */
+typedef struct
+{
+    int  proxy;     /* number of the frontend or the backend */
+    int  server;    /* number of the server, -1 - FRONTEND or BACKEND */
+    int  iid;
+    int  sid;
+    int  type;      /* 0 - frontend, 1 - backend, 2 - server */
+}
+row_t;
+
+/* how a field gets its value */
+enum
+{
+    K_EMPTY,
+    K_NUMBER,       /* by the nature */
+    K_BYTES,
+    K_PXNAME,
+    K_SVNAME,
+    K_STATUS,
+    K_WEIGHT,
+    K_PID,
+    K_IID,
+    K_SID,
+    K_TYPE,
+    K_CHECK,
+    K_ADDR,
+    K_MODE,
+    K_ALGO
+};
+
+typedef struct
+{
+    const char *name;
+    char       nature;      /* as in the typed output */
+    int        kind;
+}
+field_t;
+
+/* the fields of HAProxy 1.9 */
+static const field_t statFields[] = {
+    {"pxname", 'O', K_PXNAME}, {"svname", 'O', K_SVNAME}, {"qcur", 'G', K_NUMBER}, {"qmax", 'M', K_NUMBER},
+    {"scur", 'G', K_NUMBER}, {"smax", 'M', K_NUMBER}, {"slim", 'L', K_NUMBER}, {"stot", 'C', K_NUMBER},
+    {"bin", 'C', K_BYTES}, {"bout", 'C', K_BYTES}, {"dreq", 'C', K_NUMBER}, {"dresp", 'C', K_NUMBER},
+    {"ereq", 'C', K_NUMBER}, {"econ", 'C', K_NUMBER}, {"eresp", 'C', K_NUMBER}, {"wretr", 'C', K_NUMBER},
+    {"wredis", 'C', K_NUMBER}, {"status", 'O', K_STATUS}, {"weight", 'a', K_WEIGHT}, {"act", 'G', K_NUMBER},
+    {"bck", 'G', K_NUMBER}, {"chkfail", 'C', K_NUMBER}, {"chkdown", 'C', K_NUMBER}, {"lastchg", 'A', K_NUMBER},
+    {"downtime", 'D', K_NUMBER}, {"qlimit", 'L', K_EMPTY}, {"pid", 'O', K_PID}, {"iid", 'O', K_IID},
+    {"sid", 'O', K_SID}, {"throttle", 'O', K_EMPTY}, {"lbtot", 'C', K_NUMBER}, {"tracked", 'O', K_EMPTY},
+    {"type", 'O', K_TYPE}, {"rate", 'R', K_NUMBER}, {"rate_lim", 'L', K_NUMBER}, {"rate_max", 'M', K_NUMBER},
+    {"check_status", 'O', K_CHECK}, {"check_code", 'O', K_EMPTY}, {"check_duration", 'D', K_NUMBER},
+    {"hrsp_1xx", 'C', K_NUMBER}, {"hrsp_2xx", 'C', K_NUMBER}, {"hrsp_3xx", 'C', K_NUMBER},
+    {"hrsp_4xx", 'C', K_NUMBER}, {"hrsp_5xx", 'C', K_NUMBER}, {"hrsp_other", 'C', K_NUMBER},
+    {"hanafail", 'C', K_NUMBER}, {"req_rate", 'R', K_NUMBER}, {"req_rate_max", 'M', K_NUMBER},
+    {"req_tot", 'C', K_NUMBER}, {"cli_abrt", 'C', K_NUMBER}, {"srv_abrt", 'C', K_NUMBER},
+    {"comp_in", 'C', K_BYTES}, {"comp_out", 'C', K_BYTES}, {"comp_byp", 'C', K_BYTES}, {"comp_rsp", 'C', K_NUMBER},
+    {"lastsess", 'A', K_NUMBER}, {"last_chk", 'O', K_EMPTY}, {"last_agt", 'O', K_EMPTY}, {"qtime", 'a', K_NUMBER},
+    {"ctime", 'a', K_NUMBER}, {"rtime", 'a', K_NUMBER}, {"ttime", 'a', K_NUMBER}, {"agent_status", 'O', K_EMPTY},
+    {"agent_code", 'O', K_EMPTY}, {"agent_duration", 'D', K_EMPTY}, {"check_desc", 'O', K_EMPTY},
+    {"agent_desc", 'O', K_EMPTY}, {"check_rise", 'O', K_EMPTY}, {"check_fall", 'O', K_EMPTY},
+    {"check_health", 'O', K_EMPTY}, {"agent_rise", 'O', K_EMPTY}, {"agent_fall", 'O', K_EMPTY},
+    {"agent_health", 'O', K_EMPTY}, {"addr", 'O', K_ADDR}, {"cookie", 'O', K_EMPTY}, {"mode", 'O', K_MODE},
+    {"algo", 'O', K_ALGO}, {"conn_rate", 'R', K_NUMBER}, {"conn_rate_max", 'M', K_NUMBER},
+    {"conn_tot", 'C', K_NUMBER}, {"intercepted", 'C', K_NUMBER}, {"dcon", 'C', K_NUMBER},
+    {"dses", 'C', K_NUMBER}, {"wrew", 'C', K_NUMBER}, {"connect", 'C', K_NUMBER}, {"reuse", 'C', K_NUMBER},
+    {"cache_lookups", 'C', K_NUMBER}, {"cache_hits", 'C', K_NUMBER}, {"srv_icur", 'G', K_NUMBER},
+    {"src_ilim", 'L', K_EMPTY}, {"qtime_max", 'M', K_NUMBER}, {"ctime_max", 'M', K_NUMBER},
+    {"rtime_max", 'M', K_NUMBER}, {"ttime_max", 'M', K_NUMBER}
+};
+
+/* show info, a NULL text is a number of the nature */
+static const struct
+{
+    const char *name;
+    char       nature;
+    const char *text;
+}
+infoFields[] = {
+    {"Name", 'O', "HAProxy"}, {"Version", 'O', "1.9.8"}, {"Release_date", 'O', "2019/05/13"},
+    {"Nbthread", 'O', NULL}, {"Nbproc", 'O', "1"}, {"Process_num", 'O', "1"}, {"Pid", 'O', NULL},
+    {"Uptime", 'D', NULL}, {"Uptime_sec", 'D', NULL}, {"Memmax_MB", 'L', "0"}, {"PoolAlloc_MB", 'G', NULL},
+    {"PoolUsed_MB", 'G', NULL}, {"PoolFailed", 'C', NULL}, {"Ulimit-n", 'L', "200039"},
+    {"Maxsock", 'L', "200039"}, {"Maxconn", 'L', "100000"}, {"Hard_maxconn", 'L', "100000"},
+    {"CurrConns", 'G', NULL}, {"CumConns", 'C', NULL}, {"CumReq", 'C', NULL}, {"MaxSslConns", 'L', "0"},
+    {"CurrSslConns", 'G', NULL}, {"CumSslConns", 'C', NULL}, {"Maxpipes", 'L', "0"}, {"PipesUsed", 'G', NULL},
+    {"PipesFree", 'G', NULL}, {"ConnRate", 'R', NULL}, {"ConnRateLimit", 'L', "0"}, {"MaxConnRate", 'M', NULL},
+    {"SessRate", 'R', NULL}, {"SessRateLimit", 'L', "0"}, {"MaxSessRate", 'M', NULL}, {"SslRate", 'R', NULL},
+    {"SslRateLimit", 'L', "0"}, {"MaxSslRate", 'M', NULL}, {"SslFrontendKeyRate", 'R', NULL},
+    {"SslFrontendMaxKeyRate", 'M', NULL}, {"SslFrontendSessionReuse_pct", 'a', NULL},
+    {"SslBackendKeyRate", 'R', NULL}, {"SslBackendMaxKeyRate", 'M', NULL}, {"SslCacheLookups", 'C', NULL},
+    {"SslCacheMisses", 'C', NULL}, {"CompressBpsIn", 'R', NULL}, {"CompressBpsOut", 'R', NULL},
+    {"CompressBpsRateLim", 'L', "0"}, {"ZlibMemUsage", 'G', NULL}, {"MaxZlibMemUsage", 'M', NULL},
+    {"Tasks", 'G', NULL}, {"Run_queue", 'G', NULL}, {"Idle_pct", 'a', NULL}, {"node", 'O', NULL},
+    {"description", 'O', ""}
+};
+
+static const char *pools[] = {"cache_st", "pipe", "email_alert", "dns_resolut", "dns_answer_", "buffer",
+                              "connection", "stream", "requri", "capture", "task", "session"};
+
+static const char *activity[] = {"loops", "wake_cache", "wake_tasks", "wake_signal", "poll_exp", "poll_drop",
+                                 "poll_dead", "poll_skip", "fd_skip", "fd_lock", "fd_del", "conn_dead", "stream",
+                                 "empty_rq", "long_rq"};
+
+static int frontends = 1;
+static int backends = 10;
+static int servers = 10;
+static int threads = 4;
+static int delayMs = 0;
+static size_t chunkSize = 0;
+static int chunkPauseUs = 0;
+static const char *dir = NULL;
+static const char *upstream = NULL;
+static int verbose = 0;
+
+static time_t started;
+static unsigned long long served = 0;
+
+void help(void)
+{
+    int i = 0;
+    const char *message[] = {
+        "Usage:",
+        "       fakehaproxy [options] /tmp/haproxy.sock",
+        "or",
+        "       fakehaproxy [options] 127.0.0.1 9999",
+        "Options:",
+        "       -f <n>        frontends (1)",
+        "       -b <n>        backends (10)",
+        "       -s <n>        servers of each backend (10)",
+        "       -t <n>        threads in show info and show activity (4)",
+        "       -d <ms>       delay before each response",
+        "       -c <bytes>    write the responses in chunks of that size",
+        "       -C <us>       pause between the chunks",
+        "       -r <dir>      replay the responses saved in dir",
+        "       -R <socket>   record: forward the commands to HAProxy (/run/haproxy/admin.sock",
+        "                     or 127.0.0.1:9999) and save its responses to the -r dir",
+        "       -v            print the commands",
+        NULL
+    };
+
+    while (message[i] != NULL)
+    {
+        printf(GRN "%s\n" RESET, message[i]);
+        i++;
+    }
+}
+
+/******************************************************************************
+******************************************************************************/
+static void bufReserve(buffer_t *buf, size_t len)
+{
+    if (buf->len + len + 1 <= buf->alloc)
+        return;
+
+    while (buf->len + len + 1 > buf->alloc)
+        buf->alloc = (0 == buf->alloc ? BUFSIZ : buf->alloc * 2);
+
+    if (NULL == (buf->data = realloc(buf->data, buf->alloc)))
+    {
+        printf(RED "%s\n" RESET, "Cannot allocate memory");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void bufAdd(buffer_t *buf, const char *str, size_t len)
+{
+    bufReserve(buf, len);
+    memcpy(buf->data + buf->len, str, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+}
+
+static void bufStr(buffer_t *buf, const char *str)
+{
+    bufAdd(buf, str, strlen(str));
+}
+
+static void bufUint(buffer_t *buf, unsigned long long value)
+{
+    char tmp[24];
+    int i = sizeof(tmp);
+
+    do
+    {
+        tmp[--i] = '0' + value % 10;
+        value /= 10;
+    }
+    while (0 != value);
+
+    bufAdd(buf, tmp + i, sizeof(tmp) - i);
+}
+
+static void bufPrintf(buffer_t *buf, const char *format, ...)
+{
+    va_list args;
+    int len;
+
+    va_start(args, format);
+    len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    bufReserve(buf, len);
+
+    va_start(args, format);
+    vsnprintf(buf->data + buf->len, len + 1, format, args);
+    va_end(args);
+
+    buf->len += len;
+}
+
+/******************************************************************************
+* A number of the nature, the counters grow with the commands answered.      *
+******************************************************************************/
+static unsigned long long number(char nature, int a, int b, int field, unsigned long long n)
+{
+    switch (nature)
+    {
+        case 'C':
+            return n * (unsigned long long)((a + b) % 13 + 1) * (field % 5 + 1);
+        case 'G':
+            return (unsigned long long)(a * 31 + b * 7 + field) % 20;
+        case 'M':
+            return 100 + field;
+        case 'L':
+            return 1000;
+        case 'R':
+            return (unsigned long long)(a + b + field) % 10;
+        case 'a':
+            return (unsigned long long)(b + field) % 50;
+        case 'A':
+            return (unsigned long long)(time(NULL) - started);
+        default:
+            return (unsigned long long)(field % 3);
+    }
+}
+
+/******************************************************************************
+* Appends the value of the field of the row.                                 *
+*                                                                            *
+* Return value: 0 - the field is empty, 1 - a string, 2 - a 32 bit number,   *
+*               3 - a 64 bit number                                          *
+******************************************************************************/
+static int statValue(buffer_t *buf, int field, const row_t *row, unsigned long long n)
+{
+    const field_t *f = &statFields[field];
+
+    switch (f->kind)
+    {
+        case K_NUMBER:
+            bufUint(buf, number(f->nature, row->iid, row->sid, field, n));
+            return 'C' == f->nature ? 3 : 2;
+        case K_BYTES:
+            bufUint(buf, 1500 * number(f->nature, row->iid, row->sid, field, n));
+            return 3;
+        case K_PXNAME:
+            bufPrintf(buf, "%s%d", 0 == row->type ? "fe" : "be", row->proxy);
+            return 1;
+        case K_SVNAME:
+            if (-1 == row->server)
+                bufStr(buf, 0 == row->type ? "FRONTEND" : "BACKEND");
+            else
+                bufPrintf(buf, "srv%d", row->server);
+            return 1;
+        case K_STATUS:
+            bufStr(buf, 0 == row->type ? "OPEN" : (2 == row->type && 0 == row->sid % 10 ? "DOWN" : "UP"));
+            return 1;
+        case K_WEIGHT:
+            if (0 == row->type)
+                return 0;
+            bufUint(buf, 2 == row->type ? 1 : (unsigned long long)servers);
+            return 2;
+        case K_PID:
+            bufStr(buf, "1");
+            return 2;
+        case K_IID:
+            bufUint(buf, row->iid);
+            return 2;
+        case K_SID:
+            bufUint(buf, row->sid);
+            return 2;
+        case K_TYPE:
+            bufUint(buf, row->type);
+            return 2;
+        case K_CHECK:
+            if (2 != row->type)
+                return 0;
+            bufStr(buf, 0 == row->sid % 10 ? "L4CON" : "L4OK");
+            return 1;
+        case K_ADDR:
+            if (2 != row->type)
+                return 0;
+            bufPrintf(buf, "10.%d.%d.%d:80", row->proxy / 256 % 256, row->proxy % 256, row->sid % 256);
+            return 1;
+        case K_MODE:
+            bufStr(buf, "http");
+            return 1;
+        case K_ALGO:
+            if (1 != row->type)
+                return 0;
+            bufStr(buf, "roundrobin");
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/******************************************************************************
+* Calls the callback for the rows in HAProxy order: the frontends, then the  *
+* servers of each backend followed by the backend.                           *
+******************************************************************************/
+static void statRows(void (*callback)(buffer_t *, const row_t *, unsigned long long, void *), buffer_t *buf,
+                     unsigned long long n, void *arg)
+{
+    row_t row;
+    int p, s;
+
+    for (p = 0; p < frontends; p++)
+    {
+        row.proxy = p;
+        row.server = -1;
+        row.iid = 2 + p;
+        row.sid = 0;
+        row.type = 0;
+        callback(buf, &row, n, arg);
+    }
+
+    for (p = 0; p < backends; p++)
+    {
+        row.proxy = p;
+        row.iid = 2 + frontends + p;
+        row.type = 2;
+
+        for (s = 0; s < servers; s++)
+        {
+            row.server = s;
+            row.sid = s + 1;
+            callback(buf, &row, n, arg);
+        }
+
+        row.server = -1;
+        row.sid = 0;
+        row.type = 1;
+        callback(buf, &row, n, arg);
+    }
+}
+
+/* show stat <iid> <type> <sid>, -1 - any */
+typedef struct
+{
+    int iid;
+    int type;
+    int sid;
+}
+filter_t;
+
+static void statCsvRow(buffer_t *buf, const row_t *row, unsigned long long n, void *arg)
+{
+    const filter_t *filter = (const filter_t *)arg;
+    int field;
+
+    if (NULL != filter && ((-1 != filter->iid && filter->iid != row->iid) ||
+            (-1 != filter->type && 0 == (filter->type & (1 << row->type))) ||
+            (-1 != filter->sid && filter->sid != row->sid)))
+    {
+        return;
+    }
+
+    for (field = 0; field < (int)(sizeof(statFields) / sizeof(statFields[0])); field++)
+    {
+        statValue(buf, field, row, n);
+        bufAdd(buf, ",", 1);
+    }
+
+    bufAdd(buf, "\n", 1);
+}
+
+static void statTypedRow(buffer_t *buf, const row_t *row, unsigned long long n, void *arg)
+{
+    static const char *types[] = {"str", "u32", "u64"};
+    size_t start, typePos;
+    int field, type;
+    char head[64];
+
+    (void)arg;
+
+    for (field = 0; field < (int)(sizeof(statFields) / sizeof(statFields[0])); field++)
+    {
+        start = buf->len;
+        snprintf(head, sizeof(head), "%c.%d.%d.%d.", "FBS"[row->type], row->iid, row->sid, field);
+        bufStr(buf, head);
+        bufStr(buf, statFields[field].name);
+        bufStr(buf, ".1:M");
+        bufAdd(buf, &statFields[field].nature, 1);
+        bufStr(buf, "P:");
+
+        /* the type is known once the value is written */
+        typePos = buf->len;
+        bufAdd(buf, "xxx:", 4);
+
+        if (0 == (type = statValue(buf, field, row, n)))
+        {
+            buf->len = start;
+            continue;
+        }
+
+        memcpy(buf->data + typePos, types[type - 1], 3);
+        bufAdd(buf, "\n", 1);
+    }
+
+    bufAdd(buf, "\n", 1);
+}
+
+static void showStat(buffer_t *buf, const char *args, unsigned long long n)
+{
+    filter_t filter;
+    int field;
+
+    if (3 == sscanf(args, "%d %d %d", &filter.iid, &filter.type, &filter.sid))
+    {
+        bufStr(buf, "# ");
+
+        for (field = 0; field < (int)(sizeof(statFields) / sizeof(statFields[0])); field++)
+        {
+            bufStr(buf, statFields[field].name);
+            bufAdd(buf, ",", 1);
+        }
+
+        bufAdd(buf, "\n", 1);
+        statRows(statCsvRow, buf, n, &filter);
+        bufAdd(buf, "\n", 1);
+        return;
+    }
+
+    if (0 == strcmp(args, "typed"))
+    {
+        statRows(statTypedRow, buf, n, NULL);
+        return;
+    }
+
+    bufStr(buf, "# ");
+
+    for (field = 0; field < (int)(sizeof(statFields) / sizeof(statFields[0])); field++)
+    {
+        bufStr(buf, statFields[field].name);
+        bufAdd(buf, ",", 1);
+    }
+
+    bufAdd(buf, "\n", 1);
+    statRows(statCsvRow, buf, n, NULL);
+    bufAdd(buf, "\n", 1);
+}
+
+/******************************************************************************
+******************************************************************************/
+static void infoValue(buffer_t *buf, int i, unsigned long long n)
+{
+    long uptime = (long)(time(NULL) - started);
+    const char *name = infoFields[i].name;
+
+    if (NULL != infoFields[i].text)
+        bufStr(buf, infoFields[i].text);
+    else if (0 == strcmp(name, "Nbthread"))
+        bufUint(buf, threads);
+    else if (0 == strcmp(name, "Pid"))
+        bufUint(buf, getpid());
+    else if (0 == strcmp(name, "Uptime"))
+        bufPrintf(buf, "%ldd %ldh%02ldm%02lds", uptime / 86400, uptime / 3600 % 24, uptime / 60 % 60, uptime % 60);
+    else if (0 == strcmp(name, "Uptime_sec"))
+        bufUint(buf, uptime);
+    else if (0 == strcmp(name, "node"))
+        bufStr(buf, "fakehaproxy");
+    else
+        bufUint(buf, number(infoFields[i].nature, 1, i, i, n));
+}
+
+static void showInfo(buffer_t *buf, const char *args, unsigned long long n)
+{
+    int i, typed = (0 == strcmp(args, "typed"));
+
+    for (i = 0; i < (int)(sizeof(infoFields) / sizeof(infoFields[0])); i++)
+    {
+        if (0 != typed)
+        {
+            bufPrintf(buf, "%d.%s.1:%c%cP:%s:", i, infoFields[i].name, 'O' == infoFields[i].nature ? 'C' : 'M',
+                      infoFields[i].nature, NULL == infoFields[i].text &&
+                      0 != strcmp(infoFields[i].name, "Uptime") && 0 != strcmp(infoFields[i].name, "node") ?
+                      "u32" : "str");
+        }
+        else
+            bufPrintf(buf, "%s: ", infoFields[i].name);
+
+        infoValue(buf, i, n);
+        bufAdd(buf, "\n", 1);
+    }
+
+    bufAdd(buf, "\n", 1);
+}
+
+static void showPools(buffer_t *buf, unsigned long long n)
+{
+    unsigned long long allocated, used, totalAllocated = 0, totalUsed = 0;
+    int i, size;
+
+    bufStr(buf, "Dumping pools usage. Use SIGQUIT to flush them.\n");
+
+    for (i = 0; i < (int)(sizeof(pools) / sizeof(pools[0])); i++)
+    {
+        size = 16 * (i + 1);
+        allocated = 10 * i + n % 7;
+        used = 7 * i + n % 5;
+        totalAllocated += allocated * size;
+        totalUsed += used * size;
+
+        bufPrintf(buf, "  - Pool %s (%d bytes) : %llu allocated (%llu bytes), %llu used, %d failures, %d users, "
+                  "@%p=%02d%s\n", pools[i], size, allocated, allocated * size, used, i % 2, 1 + i % 3,
+                  (void *)&pools[i], i, 0 != i % 2 ? " [SHARED]" : "");
+    }
+
+    bufPrintf(buf, "Total: %d pools, %llu bytes allocated, %llu used.\n\n", (int)(sizeof(pools) / sizeof(pools[0])),
+              totalAllocated, totalUsed);
+}
+
+static void showActivity(buffer_t *buf, unsigned long long n)
+{
+    struct timespec now;
+    unsigned long long value, sum;
+    int i, t;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    bufPrintf(buf, "thread_id: 1\ndate_now: %ld.%06ld\n", (long)now.tv_sec, now.tv_nsec / 1000);
+
+    for (i = 0; i < (int)(sizeof(activity) / sizeof(activity[0])); i++)
+    {
+        for (sum = 0, t = 0; t < threads; t++)
+            sum += (i * 13 % 97) * (t + 1) + n;
+
+        bufPrintf(buf, "%s: %llu", activity[i], sum);
+
+        if (1 < threads)
+        {
+            bufStr(buf, " [");
+
+            for (t = 0; t < threads; t++)
+            {
+                value = (i * 13 % 97) * (t + 1) + n;
+                bufAdd(buf, " ", 1);
+                bufUint(buf, value);
+            }
+
+            bufStr(buf, " ]");
+        }
+
+        bufAdd(buf, "\n", 1);
+    }
+
+    bufAdd(buf, "\n", 1);
+}
+
+/******************************************************************************
+* The file of the command in the -r directory.                               *
+******************************************************************************/
+static void replayPath(const char *cmd, char *path, size_t size)
+{
+    size_t offset;
+
+    offset = snprintf(path, size, "%s/", dir);
+
+    for (; '\0' != *cmd && offset < size - 5; cmd++)
+    {
+        if (('a' <= *cmd && 'z' >= *cmd) || ('A' <= *cmd && 'Z' >= *cmd) || ('0' <= *cmd && '9' >= *cmd) ||
+                '-' == *cmd || '.' == *cmd)
+        {
+            path[offset++] = *cmd;
+        }
+        else
+            path[offset++] = '_';
+    }
+
+    strcpy(path + offset, ".txt");
+}
+
+/******************************************************************************
+* Return value: 0 - the saved response is appended, ERROR - there is none    *
+******************************************************************************/
+static int replay(buffer_t *buf, const char *cmd)
+{
+    char path[PATH_MAX];
+    FILE *file;
+    size_t ret;
+
+    replayPath(cmd, path, sizeof(path));
+
+    if (NULL == (file = fopen(path, "r")))
+        return ERROR;
+
+    do
+    {
+        bufReserve(buf, BUFSIZ);
+        ret = fread(buf->data + buf->len, 1, BUFSIZ, file);
+        buf->len += ret;
+    }
+    while (ret > 0);
+
+    buf->data[buf->len] = '\0';
+    fclose(file);
+
+    return 0;
+}
+
+/******************************************************************************
+* Connects to the socket: a path or host:port.                               *
+******************************************************************************/
+static int connectTo(const char *address)
+{
+    struct sockaddr_storage addr;
+    struct sockaddr_un *addrUn = (struct sockaddr_un *)&addr;
+    struct sockaddr_in *addrIn = (struct sockaddr_in *)&addr;
+    struct sockaddr_in6 *addrIn6 = (struct sockaddr_in6 *)&addr;
+    const char *colon = strrchr(address, ':');
+    char host[INET6_ADDRSTRLEN];
+    socklen_t addrLen;
+    int sock;
+
+    memset(&addr, 0, sizeof(addr));
+
+    if ('/' == *address || NULL == colon || colon - address >= (int)sizeof(host))
+    {
+        addrUn->sun_family = AF_UNIX;
+        strncpy(addrUn->sun_path, address, sizeof(addrUn->sun_path) - 1);
+        addrLen = sizeof(struct sockaddr_un);
+    }
+    else
+    {
+        memcpy(host, address, colon - address);
+        host[colon - address] = '\0';
+
+        if (1 == inet_pton(AF_INET, host, &addrIn->sin_addr))
+        {
+            addrIn->sin_family = AF_INET;
+            addrIn->sin_port = htons(atoi(colon + 1));
+            addrLen = sizeof(struct sockaddr_in);
+        }
+        else if (1 == inet_pton(AF_INET6, host, &addrIn6->sin6_addr))
+        {
+            addrIn6->sin6_family = AF_INET6;
+            addrIn6->sin6_port = htons(atoi(colon + 1));
+            addrLen = sizeof(struct sockaddr_in6);
+        }
+        else
+            return ERROR;
+    }
+
+    if (ERROR == (sock = socket(addr.ss_family, SOCK_STREAM, 0)))
+        return ERROR;
+
+    if (ERROR == connect(sock, (struct sockaddr *)&addr, addrLen))
+    {
+        close(sock);
+        return ERROR;
+    }
+
+    return sock;
+}
+
+/******************************************************************************
+* Sends the command to HAProxy in the classic mode and saves the response.   *
+*                                                                            *
+* Return value: 0 - the response is appended, ERROR - HAProxy is down        *
+******************************************************************************/
+static int record(buffer_t *buf, const char *cmd)
+{
+    char path[PATH_MAX];
+    FILE *file;
+    size_t start = buf->len;
+    ssize_t ret;
+    int sock;
+
+    if (ERROR == (sock = connectTo(upstream)))
+        return ERROR;
+
+    if (ERROR == write(sock, cmd, strlen(cmd)) || ERROR == write(sock, "\n", 1))
+    {
+        close(sock);
+        return ERROR;
+    }
+
+    do
+    {
+        bufReserve(buf, BUFSIZ);
+
+        if (0 < (ret = read(sock, buf->data + buf->len, BUFSIZ)))
+            buf->len += ret;
+    }
+    while (ret > 0 || (ERROR == ret && EINTR == errno));
+
+    buf->data[buf->len] = '\0';
+    close(sock);
+
+    replayPath(cmd, path, sizeof(path));
+
+    if (NULL == (file = fopen(path, "w")))
+    {
+        printf(RED "Cannot write %s\n" RESET, path);
+        return 0;
+    }
+
+    fwrite(buf->data + start, 1, buf->len - start, file);
+    fclose(file);
+
+    return 0;
+}
+
+/******************************************************************************
+* Appends the response to the command.                                       *
+******************************************************************************/
+static void respond(buffer_t *buf, const char *cmd)
+{
+    unsigned long long n = __sync_add_and_fetch(&served, 1);
+
+    if (NULL != upstream && 0 == record(buf, cmd))
+        return;
+
+    if (NULL != dir && NULL == upstream && 0 == replay(buf, cmd))
+        return;
+
+    if (0 == strcmp(cmd, "show stat"))
+        showStat(buf, "", n);
+    else if (0 == strncmp(cmd, "show stat ", 10))
+        showStat(buf, cmd + 10, n);
+    else if (0 == strcmp(cmd, "show info"))
+        showInfo(buf, "", n);
+    else if (0 == strncmp(cmd, "show info ", 10))
+        showInfo(buf, cmd + 10, n);
+    else if (0 == strcmp(cmd, "show pools"))
+        showPools(buf, n);
+    else if (0 == strcmp(cmd, "show activity"))
+        showActivity(buf, n);
+    else
+        bufStr(buf, "Unknown command.\n\n");
+}
+
+/******************************************************************************
+******************************************************************************/
+static int writeAll(int sock, const char *data, size_t len)
+{
+    size_t sent = 0, size;
+    ssize_t ret;
+
+    while (sent < len)
+    {
+        size = len - sent;
+
+        if (0 != chunkSize && size > chunkSize)
+            size = chunkSize;
+
+        if (ERROR == (ret = write(sock, data + sent, size)))
+        {
+            if (EINTR == errno)
+                continue;
+
+            return ERROR;
+        }
+
+        sent += ret;
+
+        if (0 != chunkPauseUs && sent < len)
+            usleep(chunkPauseUs);
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+* Serves a connection: a line of ';' separated commands at a time, until the *
+* client quits or, out of the interactive mode, after the first line.        *
+******************************************************************************/
+static void *serve(void *arg)
+{
+    int sock = (int)(long)arg;
+    int prompt = 0, quit = 0;
+    buffer_t in = {NULL, 0, 0}, out = {NULL, 0, 0};
+    char *line, *nl, *cmd, *next, *end;
+    ssize_t ret;
+
+    while (0 == quit)
+    {
+        bufReserve(&in, BUFSIZ);
+
+        if (0 >= (ret = read(sock, in.data + in.len, BUFSIZ)))
+        {
+            if (ERROR == ret && EINTR == errno)
+                continue;
+
+            break;
+        }
+
+        in.len += ret;
+        in.data[in.len] = '\0';
+
+        while (0 == quit && NULL != (nl = memchr(in.data, '\n', in.len)))
+        {
+            *nl = '\0';
+            line = in.data;
+            out.len = 0;
+
+            if (0 != verbose)
+                printf("%s\n", line);
+
+            for (cmd = line; NULL != cmd; cmd = next)
+            {
+                if (NULL != (next = strchr(cmd, ';')))
+                    *next++ = '\0';
+
+                while (' ' == *cmd || '\t' == *cmd)
+                    cmd++;
+
+                /* the process of the master CLI */
+                if ('@' == *cmd)
+                {
+                    while ('\0' != *cmd && ' ' != *cmd)
+                        cmd++;
+
+                    while (' ' == *cmd)
+                        cmd++;
+                }
+
+                for (end = cmd + strlen(cmd); end > cmd && (' ' == end[-1] || '\r' == end[-1]); end--)
+                    ;
+                *end = '\0';
+
+                if (0 == strcmp(cmd, "quit"))
+                {
+                    quit = 1;
+                    break;
+                }
+
+                if (0 == strcmp(cmd, "prompt"))
+                {
+                    if (0 != (prompt = !prompt))
+                        bufStr(&out, "\n" PROMPT);
+
+                    continue;
+                }
+
+                respond(&out, cmd);
+
+                if (0 != prompt)
+                    bufStr(&out, PROMPT);
+            }
+
+            in.len -= nl + 1 - in.data;
+            memmove(in.data, nl + 1, in.len);
+
+            if (0 != delayMs)
+                usleep(delayMs * 1000);
+
+            if (ERROR == writeAll(sock, out.data, out.len))
+                quit = 1;
+
+            if (0 == prompt)
+                quit = 1;
+        }
+    }
+
+    free(in.data);
+    free(out.data);
+    close(sock);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    char *socketPath = NULL;
+    struct sockaddr_storage addr;
+    struct sockaddr_un *addrUn = (struct sockaddr_un *)&addr;
+    struct sockaddr_in *addrIn = (struct sockaddr_in *)&addr;
+    struct sockaddr_in6 *addrIn6 = (struct sockaddr_in6 *)&addr;
+    socklen_t addrLen;
+    pthread_t thread;
+    pthread_attr_t attr;
+    int sock, client, opt, on = 1;
+
+    while (ERROR != (opt = getopt(argc, argv, "f:b:s:t:d:c:C:r:R:vh")))
+    {
+        switch (opt)
+        {
+            case 'f':
+                frontends = atoi(optarg);
+                break;
+            case 'b':
+                backends = atoi(optarg);
+                break;
+            case 's':
+                servers = atoi(optarg);
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'd':
+                delayMs = atoi(optarg);
+                break;
+            case 'c':
+                chunkSize = (size_t)atol(optarg);
+                break;
+            case 'C':
+                chunkPauseUs = atoi(optarg);
+                break;
+            case 'r':
+                dir = optarg;
+                break;
+            case 'R':
+                upstream = optarg;
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                help();
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind < 1 || argc - optind > 2 || (NULL != upstream && NULL == dir) || 0 >= threads)
+    {
+        help();
+        return EXIT_FAILURE;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+
+    if (argc - optind == 1)
+    {
+        /*  Unix domain socket  */
+        socketPath = argv[optind];
+        addrUn->sun_family = AF_UNIX;
+        strncpy(addrUn->sun_path, socketPath, sizeof(addrUn->sun_path) - 1);
+        addrLen = sizeof(struct sockaddr_un);
+        unlink(socketPath);
+    }
+    else if (1 == inet_pton(AF_INET, argv[optind], &addrIn->sin_addr))
+    {
+        addrIn->sin_family = AF_INET;
+        addrIn->sin_port = htons(atoi(argv[optind + 1]));
+        addrLen = sizeof(struct sockaddr_in);
+    }
+    else if (1 == inet_pton(AF_INET6, argv[optind], &addrIn6->sin6_addr))
+    {
+        addrIn6->sin6_family = AF_INET6;
+        addrIn6->sin6_port = htons(atoi(argv[optind + 1]));
+        addrLen = sizeof(struct sockaddr_in6);
+    }
+    else
+    {
+        help();
+        return EXIT_FAILURE;
+    }
+
+    if (NULL != upstream)
+        mkdir(dir, 0755);
+
+    signal(SIGPIPE, SIG_IGN);
+    started = time(NULL);
+
+    sock = socket(addr.ss_family, SOCK_STREAM, 0);
+    if (sock < 0)
+    {
+        printf(RED "%s\n" RESET, "Cannot create socket");
+        exit(EXIT_FAILURE);
+    }
+
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    if (ERROR == bind(sock, (struct sockaddr *)&addr, addrLen) || ERROR == listen(sock, 128))
+    {
+        printf(RED "Cannot listen: %s\n" RESET, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    if (NULL != socketPath)
+        chmod(socketPath, 0666);
+
+    printf(GRN "Listening, %d frontends, %d backends of %d servers\n" RESET, frontends, backends, servers);
+    fflush(stdout);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    while (1)
+    {
+        if (ERROR == (client = accept(sock, NULL, NULL)))
+        {
+            if (EINTR == errno || ECONNABORTED == errno)
+                continue;
+
+            printf(RED "Cannot accept: %s\n" RESET, strerror(errno));
+            break;
+        }
+
+        if (0 != pthread_create(&thread, &attr, serve, (void *)(long)client))
+            close(client);
+    }
+
+    close(sock);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,856 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include "haproxy.h"
+
+/*
+    Runs the parsers of the module (built in with it from ../src) on payloads
+    of 1k, 10k and 100k rows and reports the time per row, the throughput and
+    the allocations per run of each: the CSV splitting, the show stat index,
+    the LLD and the JSON of haproxy.stat.map, show stat typed, show info,
+    show pools and show activity. The last three have no such sizes in real
+    life, they are run at a large but real size: every show info field, 64
+    pools and 64 threads.
+
+    The payloads are generated or, with -r, read from the responses saved by
+    "fakehaproxy -R" (show_stat.txt, show_stat_typed.txt, show_info.txt,
+    show_pools.txt, show_activity.txt), which are then run at their size.
+
+    The parsers allocate in an arena of the payload which is reset before
+    every run, as the cache reuses the arenas of its entries, so a parser
+    allocates nothing once the arena has grown to size.
+
+    The results are compared with the baseline file: a run is a regression
+    if its time per row exceeds the baseline by more than the tolerance (-t)
+    or it allocates more; -u writes the results as the new baseline. Times
+    depend on the machine, so keep the baseline of the one running the
+    checks; the allocations do not.
+
+    With -v the CSV splitting is checked instead: edge cases and random
+    payloads, copied at every offset of a 32-byte block so that their lines
+    cross the block boundaries, are split by the block (SIMD) loop and by
+    the scalar one, which must give the same fields and skip to the same
+    places.
+*/
+
+#define ERROR        -1
+#define RED          "\x1B[31m"
+#define GRN          "\x1B[32m"
+#define RESET        "\x1B[0m"
+
+#define MAX_BASELINES    64
+#define MAX_PAYLOADS     16
+
+#define VERIFY_RANDOM    1000
+#define VERIFY_MAXLEN    256
+#define VERIFY_OFFSETS   32
+
+typedef struct
+{
+    char   *data;
+    size_t len;
+    const char *cmd;
+    int    size;       /* rows asked for, 0 - saved or of a fixed size */
+    int    rows;       /* rows of the statistics, lines of a saved one */
+    void   *parsed;    /* for the cases working on the parsed payload */
+    haproxy_arena_t *arena;    /* the payload is parsed into */
+}
+payload_t;
+
+typedef struct
+{
+    const char *name;
+    const char *payload;    /* the command of the payload */
+    void       (*run)(payload_t *);
+}
+case_t;
+
+typedef struct
+{
+    char   name[64];
+    int    rows;
+    double nsPerRow;
+    double allocs;
+}
+baseline_t;
+
+static unsigned long allocs = 0;
+
+/* generated once for all the cases */
+static payload_t payloads[MAX_PAYLOADS];
+static int npayloads = 0;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    allocs++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    allocs++;
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    allocs++;
+    return __libc_realloc(ptr, size);
+}
+
+#define INFO_FIELD(id, name, nature)    name,
+static const char *infoNames[] = {HAPROXY_INFO_FIELDS};
+#undef INFO_FIELD
+
+void help(void)
+{
+    int i = 0;
+    const char *message[] = {
+        "Usage:",
+        "       parsebench [options]",
+        "Options:",
+        "       -b <file>     baseline (parsebench.baseline)",
+        "       -u            write the results to the baseline",
+        "       -t <pct>      tolerance of the time per row (20)",
+        "       -T <ms>       time of each case (200)",
+        "       -r <dir>      run on the responses saved by fakehaproxy -R instead",
+        "       -c <name>     run the cases starting with name only",
+        "       -v            check the SIMD CSV splitting against the scalar one",
+        NULL
+    };
+
+    while (message[i] != NULL)
+    {
+        printf(GRN "%s\n" RESET, message[i]);
+        i++;
+    }
+}
+
+/******************************************************************************
+* Payloads                                                                   *
+******************************************************************************/
+static void add(payload_t *p, size_t *alloc, const char *format, ...)
+{
+    va_list args;
+    int len;
+
+    va_start(args, format);
+    len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    while (p->len + len + 1 > *alloc)
+    {
+        *alloc = (0 == *alloc ? 65536 : *alloc * 2);
+        p->data = __libc_realloc(p->data, *alloc);
+    }
+
+    va_start(args, format);
+    vsnprintf(p->data + p->len, len + 1, format, args);
+    va_end(args);
+
+    p->len += len;
+}
+
+/* the value of a field of a row, NULL - empty */
+static const char *statValue(int field, int row, int type, char *buf, size_t size)
+{
+    switch (field)
+    {
+        case HAPROXY_STAT_PXNAME:
+            snprintf(buf, size, "be%d", row / 10);
+            return buf;
+        case HAPROXY_STAT_SVNAME:
+            if (HAPROXY_TYPE_BACKEND == type)
+                return "BACKEND";
+            snprintf(buf, size, "srv%d", row % 10);
+            return buf;
+        case HAPROXY_STAT_STATUS:
+            return "UP";
+        case HAPROXY_STAT_IID:
+            snprintf(buf, size, "%d", 3 + row / 10);
+            return buf;
+        case HAPROXY_STAT_SID:
+            snprintf(buf, size, "%d", HAPROXY_TYPE_BACKEND == type ? 0 : 1 + row % 10);
+            return buf;
+        case HAPROXY_STAT_TYPE:
+            snprintf(buf, size, "%d", type);
+            return buf;
+        case HAPROXY_STAT_MODE:
+            return "http";
+        case HAPROXY_STAT_ADDR:
+            if (HAPROXY_TYPE_SERVER != type)
+                return NULL;
+            snprintf(buf, size, "10.0.%d.%d:80", row / 2560 % 256, row / 10 % 256);
+            return buf;
+    }
+
+    if (HAPROXY_NATURE_OUTPUT == haproxy_stat_field_nature(field))
+        return NULL;
+
+    snprintf(buf, size, "%d", (row * 7 + field) * (HAPROXY_NATURE_COUNTER == haproxy_stat_field_nature(field) ?
+             1000 : 1) % 100000);
+
+    return buf;
+}
+
+/* backends of 9 servers, a row of every 10 is the backend */
+static void genStat(payload_t *p, int rows, int typed)
+{
+    static const char natures[] = "OCGRLMaAD";
+    size_t alloc = 0;
+    const char *value;
+    char buf[32];
+    int r, f, type;
+
+    if (0 == typed)
+    {
+        add(p, &alloc, "# ");
+
+        for (f = 0; f < HAPROXY_STAT_FIELD_COUNT; f++)
+            add(p, &alloc, "%s,", haproxy_stat_field_name(f));
+
+        add(p, &alloc, "\n");
+    }
+
+    for (r = 0; r < rows; r++)
+    {
+        type = (9 == r % 10 ? HAPROXY_TYPE_BACKEND : HAPROXY_TYPE_SERVER);
+
+        for (f = 0; f < HAPROXY_STAT_FIELD_COUNT; f++)
+        {
+            value = statValue(f, r, type, buf, sizeof(buf));
+
+            if (0 == typed)
+                add(p, &alloc, "%s,", NULL == value ? "" : value);
+            else if (NULL != value)
+            {
+                add(p, &alloc, "%c.%d.%d.%d.%s.1:M%cP:%s:%s\n", HAPROXY_TYPE_BACKEND == type ? 'B' : 'S',
+                    3 + r / 10, HAPROXY_TYPE_BACKEND == type ? 0 : 1 + r % 10, f, haproxy_stat_field_name(f),
+                    natures[haproxy_stat_field_nature(f)],
+                    '0' <= *value && '9' >= *value ? "u64" : "str", value);
+            }
+        }
+
+        add(p, &alloc, "\n");
+    }
+
+    add(p, &alloc, "\n");
+    p->rows = rows;
+}
+
+static void genInfo(payload_t *p)
+{
+    size_t alloc = 0;
+    int i;
+
+    for (i = 0; i < (int)ARRSIZE(infoNames); i++)
+    {
+        if (HAPROXY_NATURE_OUTPUT == haproxy_info_field_nature(i))
+            add(p, &alloc, "%s: %s\n", infoNames[i], 0 == i ? "HAProxy" : "1.9.8");
+        else
+            add(p, &alloc, "%s: %d\n", infoNames[i], i * 1000);
+    }
+
+    add(p, &alloc, "\n");
+    p->rows = (int)ARRSIZE(infoNames);
+}
+
+static void genPools(payload_t *p, int rows)
+{
+    size_t alloc = 0;
+    int i;
+
+    add(p, &alloc, "Dumping pools usage. Use SIGQUIT to flush them.\n");
+
+    for (i = 0; i < rows; i++)
+    {
+        add(p, &alloc, "  - Pool pool%d (%d bytes) : %d allocated (%d bytes), %d used, 0 failures, 1 users, "
+            "@0x55d1c8a2b0c0=%02d [SHARED]\n", i, 16 * (i + 1), 10 * i, 160 * i * (i + 1), 7 * i, i % 100);
+    }
+
+    add(p, &alloc, "Total: %d pools, 0 bytes allocated, 0 used.\n\n", rows);
+    p->rows = rows + 2;
+}
+
+static void genActivity(payload_t *p, int threads)
+{
+    static const char *counters[] = {"loops", "wake_cache", "wake_tasks", "wake_signal", "poll_exp",
+                                     "poll_drop", "poll_dead", "poll_skip", "fd_skip", "fd_lock", "fd_del",
+                                     "conn_dead", "stream", "empty_rq", "long_rq"};
+    size_t alloc = 0;
+    int i, t;
+
+    add(p, &alloc, "thread_id: 1\ndate_now: 1560000000.000000\n");
+
+    for (i = 0; i < (int)ARRSIZE(counters); i++)
+    {
+        add(p, &alloc, "%s: %d [", counters[i], i * threads);
+
+        for (t = 0; t < threads; t++)
+            add(p, &alloc, " %d", i * 1000 + t);
+
+        add(p, &alloc, " ]\n");
+    }
+
+    add(p, &alloc, "\n");
+    p->rows = (int)ARRSIZE(counters) + 2;
+}
+
+/******************************************************************************
+* Return value: 0 or ERROR - there is no such file                           *
+******************************************************************************/
+static int readPayload(payload_t *p, const char *dir, const char *cmd)
+{
+    char path[1024], *c;
+    size_t alloc = 0, ret;
+    FILE *file;
+
+    snprintf(path, sizeof(path), "%s/%s.txt", dir, cmd);
+
+    for (c = path + strlen(dir) + 1; '\0' != *c; c++)
+    {
+        if (' ' == *c)
+            *c = '_';
+    }
+
+    if (NULL == (file = fopen(path, "r")))
+        return ERROR;
+
+    do
+    {
+        if (p->len + BUFSIZ + 1 > alloc)
+        {
+            alloc = (0 == alloc ? 65536 : alloc * 2);
+            p->data = __libc_realloc(p->data, alloc);
+        }
+
+        ret = fread(p->data + p->len, 1, BUFSIZ, file);
+        p->len += ret;
+    }
+    while (ret > 0);
+
+    p->data[p->len] = '\0';
+    fclose(file);
+
+    for (c = p->data; c < p->data + p->len; c++)
+    {
+        if ('\n' == *c)
+            p->rows++;
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+* Return value: the payload of the command or NULL if it is not saved        *
+******************************************************************************/
+static payload_t *getPayload(const char *cmd, int size, const char *dir)
+{
+    payload_t *p;
+    int i;
+
+    for (i = 0; i < npayloads; i++)
+    {
+        if (0 == strcmp(payloads[i].cmd, cmd) && payloads[i].size == size)
+            return &payloads[i];
+    }
+
+    if (MAX_PAYLOADS == npayloads)
+        return NULL;
+
+    p = &payloads[npayloads];
+    memset(p, 0, sizeof(payload_t));
+    p->cmd = cmd;
+    p->size = size;
+    p->arena = haproxy_arena_create(0);
+
+    if (NULL != dir)
+    {
+        if (ERROR == readPayload(p, dir, cmd))
+            return NULL;
+    }
+    else if (0 == strcmp(cmd, "show stat"))
+        genStat(p, size, 0);
+    else if (0 == strcmp(cmd, "show stat typed"))
+        genStat(p, size, 1);
+    else if (0 == strcmp(cmd, "show info"))
+        genInfo(p);
+    else if (0 == strcmp(cmd, "show pools"))
+        genPools(p, 64);
+    else
+        genActivity(p, 64);
+
+    npayloads++;
+
+    return p;
+}
+
+/******************************************************************************
+* Cases                                                                      *
+******************************************************************************/
+static void csvSplit(payload_t *p)
+{
+    haproxy_field_t fields[HAPROXY_CSV_MAX_FIELDS];
+    const char *line = p->data, *end = p->data + p->len;
+    int nfields;
+
+    while (NULL != line && line < end)
+        line = haproxy_csv_line(line, end, fields, HAPROXY_CSV_MAX_FIELDS, &nfields);
+}
+
+static void statParse(payload_t *p)
+{
+    haproxy_arena_reset(p->arena);
+    haproxy_stat_parse(p->data, p->len, p->arena);
+}
+
+static void statDiscovery(payload_t *p)
+{
+    struct zbx_json j;
+
+    zbx_json_init(&j, ZBX_JSON_STAT_BUF_LEN);
+    haproxy_stat_discovery(p->data, p->len, HAPROXY_TYPE_SERVER, &j);
+    zbx_json_free(&j);
+}
+
+static void statMap(payload_t *p)
+{
+    struct zbx_json j;
+
+    if (NULL == p->parsed)
+        p->parsed = haproxy_stat_parse(p->data, p->len, p->arena);
+
+    zbx_json_init(&j, ZBX_JSON_STAT_BUF_LEN);
+    haproxy_stat_map((const haproxy_stat_t *)p->parsed, &j);
+    zbx_json_free(&j);
+}
+
+static void typedParse(payload_t *p)
+{
+    haproxy_arena_reset(p->arena);
+    haproxy_typed_parse(p->data, p->len, p->arena);
+}
+
+static void infoParse(payload_t *p)
+{
+    haproxy_arena_reset(p->arena);
+    haproxy_info_parse(p->data, p->len, p->arena);
+}
+
+static void infoJson(payload_t *p)
+{
+    struct zbx_json j;
+
+    if (NULL == p->parsed)
+        p->parsed = haproxy_info_parse(p->data, p->len, p->arena);
+
+    zbx_json_init(&j, ZBX_JSON_STAT_BUF_LEN);
+    haproxy_info_json((const haproxy_info_t *)p->parsed, &j);
+    zbx_json_free(&j);
+}
+
+static void poolsParse(payload_t *p)
+{
+    haproxy_arena_reset(p->arena);
+    haproxy_pools_parse(p->data, p->len, p->arena);
+}
+
+static void poolsDiscovery(payload_t *p)
+{
+    struct zbx_json j;
+
+    if (NULL == p->parsed)
+        p->parsed = haproxy_pools_parse(p->data, p->len, p->arena);
+
+    zbx_json_init(&j, ZBX_JSON_STAT_BUF_LEN);
+    haproxy_pools_discovery((const haproxy_pools_t *)p->parsed, &j);
+    zbx_json_free(&j);
+}
+
+static void activityParse(payload_t *p)
+{
+    haproxy_arena_reset(p->arena);
+    haproxy_activity_parse(p->data, p->len, p->arena);
+}
+
+static const case_t cases[] = {
+    {"csv.split",       "show stat",        csvSplit},
+    {"stat.parse",      "show stat",        statParse},
+    {"stat.discovery",  "show stat",        statDiscovery},
+    {"stat.map",        "show stat",        statMap},
+    {"typed.parse",     "show stat typed",  typedParse},
+    {"info.parse",      "show info",        infoParse},
+    {"info.json",       "show info",        infoJson},
+    {"pools.parse",     "show pools",       poolsParse},
+    {"pools.discovery", "show pools",       poolsDiscovery},
+    {"activity.parse",  "show activity",    activityParse}
+};
+
+static void freeParsed(const case_t *c, payload_t *p)
+{
+    haproxy_arena_reset(p->arena);
+    p->parsed = NULL;
+}
+
+/******************************************************************************
+* Baseline                                                                   *
+******************************************************************************/
+static int readBaseline(const char *path, baseline_t *baselines)
+{
+    char line[256];
+    FILE *file;
+    int n = 0;
+
+    if (NULL == (file = fopen(path, "r")))
+        return 0;
+
+    while (n < MAX_BASELINES && NULL != fgets(line, sizeof(line), file))
+    {
+        if ('#' == *line)
+            continue;
+
+        if (4 == sscanf(line, "%63s %d %lf %lf", baselines[n].name, &baselines[n].rows, &baselines[n].nsPerRow,
+                        &baselines[n].allocs))
+        {
+            n++;
+        }
+    }
+
+    fclose(file);
+
+    return n;
+}
+
+static const baseline_t *findBaseline(const baseline_t *baselines, int n, const char *name, int rows)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (0 == strcmp(baselines[i].name, name) && baselines[i].rows == rows)
+            return &baselines[i];
+    }
+
+    return NULL;
+}
+
+static int compare(const void *a, const void *b)
+{
+    double da = *(const double *)a, db = *(const double *)b;
+
+    return da < db ? -1 : da > db;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/******************************************************************************
+* Runs the case until the time is up (at least 3 times), the median is kept. *
+******************************************************************************/
+static void measure(const case_t *c, payload_t *p, double seconds, baseline_t *result)
+{
+    double times[1000], start, end, total = 0;
+    unsigned long before;
+    int n = 0;
+
+    /* the parsed payload and the first allocations are not measured, the
+       second run merges the chunks the arena has grown to */
+    c->run(p);
+    c->run(p);
+
+    before = allocs;
+    c->run(p);
+    result->allocs = (double)(allocs - before);
+
+    while ((3 > n || total < seconds) && n < (int)ARRSIZE(times))
+    {
+        start = now();
+        c->run(p);
+        end = now();
+        times[n++] = end - start;
+        total += end - start;
+    }
+
+    qsort(times, n, sizeof(double), compare);
+
+    result->rows = p->rows;
+    result->nsPerRow = times[n / 2] * 1e9 / p->rows;
+}
+
+/******************************************************************************
+* CSV check                                                                  *
+******************************************************************************/
+static void printEscaped(const char *data, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        if ('\n' == data[i])
+            printf("\\n");
+        else if ('\r' == data[i])
+            printf("\\r");
+        else
+            putchar(data[i]);
+    }
+}
+
+static int verifyFailed(const char *what, const char *data, size_t len, int offset, int arg)
+{
+    printf(RED "%s differs (offset %d, %d) on \"" RESET, what, offset, arg);
+    printEscaped(data, len);
+    printf(RED "\"\n" RESET);
+
+    return 1;
+}
+
+/* splits the payload at data with both loops, returns 1 if they differ */
+static int verifyAt(const char *data, size_t len, int offset)
+{
+    static const int maxFields[] = {1, 2, 3, 17, HAPROXY_CSV_MAX_FIELDS};
+    haproxy_field_t fields[HAPROXY_CSV_MAX_FIELDS], scalar[HAPROXY_CSV_MAX_FIELDS];
+    const char *end = data + len, *line, *next, *nextScalar;
+    int nfields, nscalar, m, f, n;
+    size_t i;
+
+    for (m = 0; m < (int)ARRSIZE(maxFields); m++)
+    {
+        for (line = data; line < end; line = next)
+        {
+            next = haproxy_csv_line(line, end, fields, maxFields[m], &nfields);
+            nextScalar = haproxy_csv_line_scalar(line, end, scalar, maxFields[m], &nscalar);
+
+            if (next != nextScalar || nfields != nscalar)
+                return verifyFailed("csv line", data, len, offset, maxFields[m]);
+
+            for (f = 0; f < nfields; f++)
+            {
+                if (fields[f].ptr != scalar[f].ptr || fields[f].len != scalar[f].len)
+                    return verifyFailed("csv field", data, len, offset, maxFields[m]);
+            }
+        }
+    }
+
+    for (i = 0; i <= len; i++)
+    {
+        /* within a block and past one */
+        for (n = 0; n <= 40; n = (8 > n ? n + 1 : n + 16))
+        {
+            if (haproxy_csv_skip(data + i, end, n) != haproxy_csv_skip_scalar(data + i, end, n))
+                return verifyFailed("csv skip", data, len, offset, n);
+        }
+    }
+
+    return 0;
+}
+
+static int verifyPayload(const char *data, size_t len)
+{
+    static char buf[VERIFY_OFFSETS + VERIFY_MAXLEN];
+    int offset;
+
+    for (offset = 0; offset < VERIFY_OFFSETS; offset++)
+    {
+        memcpy(buf + offset, data, len);
+
+        if (0 != verifyAt(buf + offset, len, offset))
+            return 1;
+    }
+
+    return 0;
+}
+
+static int verifyCsv(void)
+{
+    static const char *cases[] = {
+        "",
+        "\n",
+        ",",
+        ",,,,\n",
+        "a,b,c,\n",
+        "a,b,c",
+        "a,b,c,",
+        "a,b,c,\r\n",
+        "a,b,c,\r\nd,e,f,\r\n",
+        "\"a,b\",c,\n",
+        "\"a\nb\",\"c,\"\",d\",\n",
+        "# pxname,svname,qcur,\nfe,FRONTEND,,\nbe,srv1,0,\n",
+        "a,b,c,\n\n\nd,e,\n",
+        "\r\n\r\n,\r\n",
+    };
+    static const char alphabet[] = "ab0,,,,\n\r\"";
+    char data[VERIFY_MAXLEN];
+    size_t len, i;
+    int failed = 0, checked = 0, c;
+
+    for (c = 0; c < (int)ARRSIZE(cases); c++, checked++)
+        failed += verifyPayload(cases[c], strlen(cases[c]));
+
+    /* a line of every length around the blocks, with and without a comma before the newline */
+    for (len = 1; len < 3 * VERIFY_OFFSETS && len + 8 < sizeof(data); len++, checked += 2)
+    {
+        memset(data, 'x', len);
+        memcpy(data + len, "\ny,z,\n", 6);
+        failed += verifyPayload(data, len + 6);
+        data[len - 1] = ',';
+        failed += verifyPayload(data, len + 5);
+    }
+
+    srand(1);
+
+    for (c = 0; c < VERIFY_RANDOM; c++, checked++)
+    {
+        len = (size_t)rand() % (sizeof(data) + 1);
+
+        for (i = 0; i < len; i++)
+            data[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+
+        failed += verifyPayload(data, len);
+    }
+
+    if (0 != failed)
+    {
+        printf(RED "%d of %d payloads differ\n" RESET, failed, checked);
+        return EXIT_FAILURE;
+    }
+
+    printf(GRN "%d payloads split the same at %d offsets\n" RESET, checked, VERIFY_OFFSETS);
+
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    static const int sizes[] = {1000, 10000, 100000};
+    const char *baselinePath = "parsebench.baseline", *dir = NULL, *only = NULL;
+    baseline_t baselines[MAX_BASELINES], results[MAX_BASELINES];
+    const baseline_t *base;
+    payload_t *payload;
+    FILE *file;
+    double tolerance = 20, seconds = 0.2, mbs;
+    int nbaselines, nresults = 0, update = 0, regressions = 0, opt, i, s, nsizes;
+
+    while (ERROR != (opt = getopt(argc, argv, "b:ut:T:r:c:vh")))
+    {
+        switch (opt)
+        {
+            case 'b':
+                baselinePath = optarg;
+                break;
+            case 'u':
+                update = 1;
+                break;
+            case 't':
+                tolerance = atof(optarg);
+                break;
+            case 'T':
+                seconds = atof(optarg) / 1000;
+                break;
+            case 'r':
+                dir = optarg;
+                break;
+            case 'c':
+                only = optarg;
+                break;
+            case 'v':
+                return verifyCsv();
+            default:
+                help();
+                return EXIT_FAILURE;
+        }
+    }
+
+    nbaselines = readBaseline(baselinePath, baselines);
+
+    printf(GRN "%-16s %8s %12s %10s %10s %10s\n" RESET, "case", "rows", "ns/row", "MB/s", "allocs", "baseline");
+
+    for (i = 0; i < (int)ARRSIZE(cases); i++)
+    {
+        if (NULL != only && 0 != strncmp(cases[i].name, only, strlen(only)))
+            continue;
+
+        /* the sized payloads are the ones of show stat */
+        nsizes = (NULL == dir && 0 == strncmp(cases[i].payload, "show stat", 9) ? (int)ARRSIZE(sizes) : 1);
+
+        for (s = 0; s < nsizes && nresults < MAX_BASELINES; s++)
+        {
+            if (NULL == (payload = getPayload(cases[i].payload, 1 < nsizes ? sizes[s] : 0, dir)))
+            {
+                printf("%-16s %8s\n", cases[i].name, "-");
+                continue;
+            }
+
+            strcpy(results[nresults].name, cases[i].name);
+            measure(&cases[i], payload, seconds, &results[nresults]);
+            freeParsed(&cases[i], payload);
+
+            mbs = payload->len / (results[nresults].nsPerRow * payload->rows / 1e9) / 1e6;
+
+            printf("%-16s %8d %12.1f %10.1f %10.0f", cases[i].name, payload->rows, results[nresults].nsPerRow, mbs,
+                   results[nresults].allocs);
+
+            if (NULL == (base = findBaseline(baselines, nbaselines, cases[i].name, payload->rows)))
+                printf(" %10s\n", "-");
+            else if (results[nresults].nsPerRow > base->nsPerRow * (1 + tolerance / 100) ||
+                    results[nresults].allocs > base->allocs)
+            {
+                printf(RED " %+9.0f%% %s\n" RESET, (results[nresults].nsPerRow / base->nsPerRow - 1) * 100,
+                       results[nresults].allocs > base->allocs ? "allocs" : "time");
+                regressions++;
+            }
+            else
+                printf(" %+9.0f%%\n", (results[nresults].nsPerRow / base->nsPerRow - 1) * 100);
+
+            nresults++;
+        }
+    }
+
+    for (i = 0; i < npayloads; i++)
+    {
+        free(payloads[i].data);
+        haproxy_arena_destroy(payloads[i].arena);
+    }
+
+    if (0 != update)
+    {
+        if (NULL == (file = fopen(baselinePath, "w")))
+        {
+            printf(RED "Cannot write %s\n" RESET, baselinePath);
+            return EXIT_FAILURE;
+        }
+
+        fprintf(file, "# case rows ns/row allocs\n");
+
+        for (i = 0; i < nresults; i++)
+        {
+            fprintf(file, "%s %d %.1f %.0f\n", results[i].name, results[i].rows, results[i].nsPerRow,
+                    results[i].allocs);
+        }
+
+        fclose(file);
+        printf(GRN "Baseline written to %s\n" RESET, baselinePath);
+
+        return EXIT_SUCCESS;
+    }
+
+    if (0 != regressions)
+    {
+        printf(RED "%d regressions\n" RESET, regressions);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,240 @@
+#include "haproxy.h"
+
+/*
+    show activity - one line per counter with the per-thread values, 2.x
+    prints the total first and the threads in brackets (no brackets when
+    there is a single thread), 1.9 prints the threads only:
+    loops: 4417 [ 1108 1102 1103 1104 ]
+    loops: 1108 1102 1103 1104
+    https://cbonte.github.io/haproxy-dconv/1.9/management.html#show%20activity
+
+    The values of all counters are kept in one array, a counter refers to its
+    slice of it.
+*/
+
+/******************************************************************************
+* Parses the numbers in [p, end) into the values array.                      *
+*                                                                            *
+* Return value: number of values parsed                                      *
+******************************************************************************/
+static int parse_values(const char *p, const char *end, haproxy_activity_t *activity, int *integer)
+{
+    char buf[64], *next;
+    const char *token;
+    size_t len;
+    double value;
+    int n = 0;
+
+    *integer = 1;
+
+    while (p < end)
+    {
+        if (' ' == *p)
+        {
+            p++;
+            continue;
+        }
+
+        for (token = p; p < end && ' ' != *p; p++)
+            ;
+
+        if (sizeof(buf) <= (len = (size_t)(p - token)))
+            return 0;
+
+        memcpy(buf, token, len);
+        buf[len] = '\0';
+
+        value = strtod(buf, &next);
+
+        /* thread_id: 1 (1..4) */
+        if (next == buf)
+            break;
+
+        if (activity->nvalues == activity->values_alloc)
+        {
+            activity->values = (double *)haproxy_arena_realloc(activity->arena, activity->values,
+                                                               activity->values_alloc * sizeof(double),
+                                                               activity->values_alloc * 2 * sizeof(double));
+            activity->values_alloc *= 2;
+        }
+
+        activity->values[activity->nvalues++] = value;
+        n++;
+
+        if (NULL != strpbrk(buf, ".eE"))
+            *integer = 0;
+    }
+
+    return n;
+}
+
+/******************************************************************************
+* Parses show activity output into the arena, the result points into the    *
+* data so the data must outlive it.                                          *
+*                                                                            *
+* Return value: the parsed response or NULL if there are no counters         *
+******************************************************************************/
+haproxy_activity_t *haproxy_activity_parse(const char *data, size_t len, haproxy_arena_t *arena)
+{
+    const char *end = data + len, *p = data, *eol, *sep, *open, *close;
+    haproxy_activity_t *activity;
+    haproxy_activity_counter_t *counter;
+    int nlines = 1;
+
+    /* a counter per line at most */
+    for (p = data; NULL != (p = (const char *)memchr(p, '\n', (size_t)(end - p))); p++)
+        nlines++;
+
+    activity = (haproxy_activity_t *)haproxy_arena_alloc(arena, sizeof(haproxy_activity_t));
+    memset(activity, 0, sizeof(haproxy_activity_t));
+    activity->arena = arena;
+    activity->counters = (haproxy_activity_counter_t *)haproxy_arena_alloc(arena, nlines *
+                                                                           sizeof(haproxy_activity_counter_t));
+    activity->values_alloc = 256;
+    activity->values = (double *)haproxy_arena_alloc(arena, activity->values_alloc * sizeof(double));
+
+    for (p = data; p < end; p = eol + 1)
+    {
+        if (NULL == (eol = (const char *)memchr(p, '\n', (size_t)(end - p))))
+            eol = end;
+
+        if (NULL == (sep = (const char *)memchr(p, ':', (size_t)(eol - p))) || sep == p)
+            continue;
+
+        counter = &activity->counters[activity->ncounters];
+        counter->name.ptr = p;
+        counter->name.len = (size_t)(sep - p);
+        counter->offset = activity->nvalues;
+
+        /* the per-thread values are in brackets, the total before them is not kept */
+        if (NULL != (open = (const char *)memchr(sep, '[', (size_t)(eol - sep))) &&
+                NULL != (close = (const char *)memchr(open, ']', (size_t)(eol - open))))
+        {
+            counter->nthreads = parse_values(open + 1, close, activity, &counter->integer);
+        }
+        else
+            counter->nthreads = parse_values(sep + 1, eol, activity, &counter->integer);
+
+        if (0 == counter->nthreads)
+        {
+            activity->nvalues = counter->offset;
+            continue;
+        }
+
+        activity->ncounters++;
+    }
+
+    if (0 == activity->ncounters)
+        return NULL;
+
+    return activity;
+}
+
+/******************************************************************************
+******************************************************************************/
+static void *activity_parse(const char *data, size_t len, haproxy_arena_t *arena)
+{
+    return haproxy_activity_parse(data, len, arena);
+}
+
+/******************************************************************************
+* Return value: parsed show activity snapshot, it is parsed on first use and *
+*               freed with the snapshot; NULL if it cannot be parsed         *
+******************************************************************************/
+const haproxy_activity_t *haproxy_activity_get(haproxy_snapshot_t *snapshot)
+{
+    return (const haproxy_activity_t *)haproxy_snapshot_parsed(snapshot, activity_parse);
+}
+
+/******************************************************************************
+* Return value: the counter or NULL if HAProxy did not report it             *
+******************************************************************************/
+const haproxy_activity_counter_t *haproxy_activity_find(const haproxy_activity_t *activity, const char *name)
+{
+    size_t len = strlen(name);
+    int i;
+
+    for (i = 0; i < activity->ncounters; i++)
+    {
+        if (activity->counters[i].name.len == len && 0 == memcmp(activity->counters[i].name.ptr, name, len))
+            return &activity->counters[i];
+    }
+
+    return NULL;
+}
+
+/******************************************************************************
+* Aggregates per-thread values (of a counter or rates of a counter): sum,    *
+* max, min, avg, stddev (population) or thread=N - the value of thread N     *
+* (1 - first). Sum, max, min and thread=N of integers are integers.          *
+*                                                                            *
+* Return value: SUCCEED - the aggregation is known, FAIL - otherwise, the    *
+*               error is set                                                 *
+******************************************************************************/
+int haproxy_activity_aggregate(const double *v, int n, int integer, const char *mode, haproxy_value_t *value,
+                               char **error)
+{
+    double sum = 0, min = v[0], max = v[0], avg, var = 0;
+    char *last;
+    long thread;
+    int i;
+
+    memset(value, 0, sizeof(haproxy_value_t));
+
+    for (i = 0; i < n; i++)
+    {
+        sum += v[i];
+        min = MIN(min, v[i]);
+        max = MAX(max, v[i]);
+    }
+
+    avg = sum / n;
+
+    if (0 == strcmp(mode, "sum"))
+        value->dbl = sum;
+    else if (0 == strcmp(mode, "max"))
+        value->dbl = max;
+    else if (0 == strcmp(mode, "min"))
+        value->dbl = min;
+    else if (0 == strcmp(mode, "avg"))
+    {
+        value->type = HAPROXY_VALUE_DBL;
+        value->dbl = avg;
+        return SUCCEED;
+    }
+    else if (0 == strcmp(mode, "stddev"))
+    {
+        for (i = 0; i < n; i++)
+            var += (v[i] - avg) * (v[i] - avg);
+
+        value->type = HAPROXY_VALUE_DBL;
+        value->dbl = sqrt(var / n);
+        return SUCCEED;
+    }
+    else if (0 == strncmp(mode, "thread=", 7) && '\0' != mode[7] &&
+            (thread = strtol(mode + 7, &last, 10), '\0' == *last))
+    {
+        if (1 > thread || thread > n)
+        {
+            *error = zbx_dsprintf(*error, "Thread %ld out of range (%d threads)", thread, n);
+            return FAIL;
+        }
+
+        value->dbl = v[thread - 1];
+    }
+    else
+    {
+        *error = zbx_dsprintf(*error, "Invalid aggregation \"%s\"", mode);
+        return FAIL;
+    }
+
+    if (0 != integer)
+    {
+        value->type = HAPROXY_VALUE_INT;
+        value->i64 = (zbx_int64_t)value->dbl;
+    }
+    else
+        value->type = HAPROXY_VALUE_DBL;
+
+    return SUCCEED;
+}
@@ -0,0 +1,312 @@
+#include "haproxy.h"
+
+/*
+    Aggregates of a show stat field over a set of rows (the scope), computed
+    in a single pass over the parsed snapshot:
+    backends              - all backends (also frontends, servers, listeners)
+    servers:<pxname>      - servers of the backends matching the glob
+    <pxname>/<svname>     - rows matching both globs, e.g. "web-?/BACKEND"
+    Empty values (a field not applicable to the row) are skipped. Over show
+    stat typed the values are read from the column of the field.
+*/
+
+static const char *scope_types[] = {"frontends", "backends", "servers", "listeners"};
+
+typedef struct
+{
+    int         type;       /* HAPROXY_TYPE_*, -1 - any */
+    const char  *pxname;    /* glob, NULL - any */
+    const char  *svname;    /* glob, NULL - any */
+    char        *buf;
+}
+agg_scope_t;
+
+typedef struct
+{
+    double  sum;
+    double  min;
+    double  max;
+    int     count;
+    int     integer;    /* all values are integers */
+}
+agg_acc_t;
+
+/******************************************************************************
+* Return value: SUCCEED - the scope is valid, FAIL - otherwise               *
+******************************************************************************/
+static int scope_parse(const char *text, agg_scope_t *scope)
+{
+    const char *sep;
+    size_t len;
+    int i;
+
+    memset(scope, 0, sizeof(agg_scope_t));
+    scope->type = -1;
+
+    if (NULL != (sep = strchr(text, '/')))
+    {
+        scope->buf = zbx_strdup(NULL, text);
+        scope->buf[sep - text] = '\0';
+        scope->pxname = scope->buf;
+        scope->svname = scope->buf + (sep - text) + 1;
+
+        return SUCCEED;
+    }
+
+    len = (NULL != (sep = strchr(text, ':')) ? (size_t)(sep - text) : strlen(text));
+
+    for (i = 0; i < (int)ARRSIZE(scope_types); i++)
+    {
+        if (strlen(scope_types[i]) == len && 0 == strncmp(scope_types[i], text, len))
+        {
+            scope->type = i;
+
+            if (NULL != sep && '\0' != sep[1])
+                scope->pxname = sep + 1;
+
+            return SUCCEED;
+        }
+    }
+
+    return FAIL;
+}
+
+/******************************************************************************
+* Return value: 1 if the field matches the glob                              *
+******************************************************************************/
+static int name_match(const char *glob, const haproxy_field_t *name, char **buf, size_t *buf_alloc)
+{
+    size_t buf_offset = 0;
+
+    if (NULL == glob)
+        return 1;
+
+    if (NULL == strpbrk(glob, "*?["))
+        return strlen(glob) == name->len && 0 == memcmp(glob, name->ptr, name->len);
+
+    zbx_strncpy_alloc(buf, buf_alloc, &buf_offset, name->ptr, name->len);
+
+    return 0 == fnmatch(glob, *buf, 0);
+}
+
+/******************************************************************************
+* Return value: SUCCEED - the mode is valid, FAIL - otherwise (error set)    *
+******************************************************************************/
+static int agg_mode_check(const char *mode, char **error)
+{
+    if (0 != strcmp(mode, "sum") && 0 != strcmp(mode, "avg") && 0 != strcmp(mode, "max") &&
+            0 != strcmp(mode, "min") && 0 != strcmp(mode, "count"))
+    {
+        *error = zbx_dsprintf(*error, "Invalid aggregation \"%s\"", mode);
+        return FAIL;
+    }
+
+    return SUCCEED;
+}
+
+/******************************************************************************
+* Return value: 1 if the row is in the scope                                 *
+******************************************************************************/
+static int agg_row_match(const agg_scope_t *scope, const haproxy_stat_row_t *row, char **buf, size_t *buf_alloc)
+{
+    return name_match(scope->pxname, &row->pxname, buf, buf_alloc) &&
+            name_match(scope->svname, &row->svname, buf, buf_alloc);
+}
+
+/******************************************************************************
+******************************************************************************/
+static void agg_add(agg_acc_t *acc, const haproxy_value_t *value)
+{
+    double number;
+
+    if (HAPROXY_VALUE_INT == value->type)
+        number = (double)value->i64;
+    else if (HAPROXY_VALUE_DBL == value->type)
+    {
+        number = value->dbl;
+        acc->integer = 0;
+    }
+    else
+        return;
+
+    if (0 == acc->count++)
+        acc->min = acc->max = number;
+
+    acc->sum += number;
+    acc->min = MIN(acc->min, number);
+    acc->max = MAX(acc->max, number);
+}
+
+/******************************************************************************
+* Sum, avg, max, min or count (of the rows with a value). Sum, max and min   *
+* of integers are integers.                                                  *
+*                                                                            *
+* Return value: SUCCEED or FAIL with the error set                           *
+******************************************************************************/
+static int agg_result(const agg_acc_t *acc, const char *mode, const char *field, const char *scope_text,
+                      haproxy_value_t *result, char **error)
+{
+    memset(result, 0, sizeof(haproxy_value_t));
+
+    if (0 == strcmp(mode, "count"))
+    {
+        result->type = HAPROXY_VALUE_INT;
+        result->i64 = acc->count;
+        return SUCCEED;
+    }
+
+    if (0 == acc->count && 0 != strcmp(mode, "sum"))
+    {
+        *error = zbx_dsprintf(*error, "No values of \"%s\" in scope \"%s\"", field, scope_text);
+        return FAIL;
+    }
+
+    if (0 == strcmp(mode, "avg"))
+    {
+        result->type = HAPROXY_VALUE_DBL;
+        result->dbl = acc->sum / acc->count;
+        return SUCCEED;
+    }
+
+    if (0 == strcmp(mode, "sum"))
+        result->dbl = acc->sum;
+    else if (0 == strcmp(mode, "max"))
+        result->dbl = acc->max;
+    else
+        result->dbl = acc->min;
+
+    if (0 != acc->integer)
+    {
+        result->type = HAPROXY_VALUE_INT;
+        result->i64 = (zbx_int64_t)result->dbl;
+    }
+    else
+        result->type = HAPROXY_VALUE_DBL;
+
+    return SUCCEED;
+}
+
+/******************************************************************************
+* Aggregates the field over the rows in the scope: sum, avg, max, min or     *
+* count, see agg_result().                                                   *
+*                                                                            *
+* Return value: SUCCEED or FAIL with the error set                           *
+******************************************************************************/
+int haproxy_stat_aggregate(const haproxy_stat_t *stat, const char *scope_text, const char *field,
+                           const char *mode, haproxy_value_t *result, char **error)
+{
+    haproxy_field_t fields[HAPROXY_CSV_MAX_FIELDS];
+    haproxy_value_t value;
+    const haproxy_stat_row_t *row;
+    agg_scope_t scope;
+    agg_acc_t acc = {0, 0, 0, 0, 1};
+    char *buf = NULL;
+    size_t buf_alloc = 0;
+    int i, column, col_type, max_fields, nfields, ret = FAIL;
+
+    if (SUCCEED != agg_mode_check(mode, error))
+        return FAIL;
+
+    if (-1 == (column = haproxy_stat_column(stat, field)))
+    {
+        *error = zbx_dsprintf(*error, "Unknown field \"%s\"", field);
+        return FAIL;
+    }
+
+    if (SUCCEED != scope_parse(scope_text, &scope))
+    {
+        *error = zbx_dsprintf(*error, "Invalid scope \"%s\"", scope_text);
+        return FAIL;
+    }
+
+    col_type = stat->column[HAPROXY_STAT_TYPE];
+
+    if (-1 != scope.type && -1 == col_type)
+    {
+        *error = zbx_strdup(*error, "No type field in show stat output");
+        goto out;
+    }
+
+    max_fields = MAX(column, col_type) + 1;
+
+    for (i = 0; i < stat->nrows; i++)
+    {
+        row = &stat->rows[i];
+
+        if (!agg_row_match(&scope, row, &buf, &buf_alloc))
+            continue;
+
+        /* the row is split once, up to the last column needed */
+        haproxy_csv_line(row->line, row->line + row->len, fields, max_fields, &nfields);
+
+        if (-1 != scope.type && (nfields <= col_type || 1 != fields[col_type].len ||
+                scope.type != fields[col_type].ptr[0] - '0'))
+        {
+            continue;
+        }
+
+        if (nfields <= column || 0 == fields[column].len)
+            continue;
+
+        haproxy_value_parse(fields[column].ptr, fields[column].len, &value);
+        agg_add(&acc, &value);
+    }
+
+    ret = agg_result(&acc, mode, field, scope_text, result, error);
+out:
+    zbx_free(scope.buf);
+    zbx_free(buf);
+
+    return ret;
+}
+
+/******************************************************************************
+* Aggregates a field of show stat typed over the rows in the scope, as       *
+* haproxy_stat_aggregate(). The row type is the one of the object.           *
+*                                                                            *
+* Return value: SUCCEED or FAIL with the error set                           *
+******************************************************************************/
+int haproxy_typed_aggregate(const haproxy_typed_t *typed, const char *scope_text, const char *field,
+                            const char *mode, haproxy_value_t *result, char **error)
+{
+    haproxy_value_t value;
+    agg_scope_t scope;
+    agg_acc_t acc = {0, 0, 0, 0, 1};
+    char *buf = NULL;
+    size_t buf_alloc = 0;
+    int i, column, ret;
+
+    if (SUCCEED != agg_mode_check(mode, error))
+        return FAIL;
+
+    if (-1 == (column = haproxy_typed_column(typed, field)))
+    {
+        *error = zbx_dsprintf(*error, "Unknown field \"%s\"", field);
+        return FAIL;
+    }
+
+    if (SUCCEED != scope_parse(scope_text, &scope))
+    {
+        *error = zbx_dsprintf(*error, "Invalid scope \"%s\"", scope_text);
+        return FAIL;
+    }
+
+    for (i = 0; i < typed->index->nrows; i++)
+    {
+        if (-1 != scope.type && scope.type != typed->types[i])
+            continue;
+
+        if (!agg_row_match(&scope, &typed->index->rows[i], &buf, &buf_alloc))
+            continue;
+
+        if (SUCCEED == haproxy_typed_value(typed, column, i, &value))
+            agg_add(&acc, &value);
+    }
+
+    ret = agg_result(&acc, mode, field, scope_text, result, error);
+
+    zbx_free(scope.buf);
+    zbx_free(buf);
+
+    return ret;
+}
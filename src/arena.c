@@ -0,0 +1,205 @@
+#include "haproxy.h"
+
+/*
+    Bump allocator for the parsed responses. Everything a parser builds (the
+    rows, the hash buckets, the typed columns...) is carved out of the chunks
+    of one arena and released at once by haproxy_arena_reset(), there is no
+    free of single allocations.
+
+    An arena is meant to be reused: on reset the chunks are merged into one
+    chunk as large as all of them, so the next response of about the same
+    size is parsed without any malloc(). The cache keeps the arenas of the
+    released snapshots for the next snapshots of the same entry, see cache.c.
+
+    What is parsed into an arena may hold on to something outside of it (an
+    index holds the interned names of its rows, see symbol.c): such a parser
+    registers a cleanup, run when the arena is reset or destroyed.
+*/
+
+#define ARENA_ALIGN         16
+#define ARENA_CHUNK_MIN     4096
+
+struct haproxy_arena_chunk
+{
+    haproxy_arena_chunk_t   *next;
+    size_t                  size;
+    size_t                  used;
+    /* the memory follows, aligned to ARENA_ALIGN */
+};
+
+struct haproxy_arena_cleanup
+{
+    void                        (*func)(void *);
+    void                        *data;
+    haproxy_arena_cleanup_t     *next;
+};
+
+#define ARENA_CHUNK_HEADER  ((sizeof(haproxy_arena_chunk_t) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define ARENA_CHUNK_DATA(chunk)    ((char *)(chunk) + ARENA_CHUNK_HEADER)
+
+/******************************************************************************
+******************************************************************************/
+static haproxy_arena_chunk_t *arena_chunk_create(size_t size)
+{
+    haproxy_arena_chunk_t *chunk;
+
+    chunk = (haproxy_arena_chunk_t *)zbx_malloc(NULL, ARENA_CHUNK_HEADER + size);
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+
+    return chunk;
+}
+
+/******************************************************************************
+* Return value: an empty arena, its first chunk is allocated on first use    *
+*               with at least size bytes                                     *
+******************************************************************************/
+haproxy_arena_t *haproxy_arena_create(size_t size)
+{
+    haproxy_arena_t *arena;
+
+    arena = (haproxy_arena_t *)zbx_malloc(NULL, sizeof(haproxy_arena_t));
+    memset(arena, 0, sizeof(haproxy_arena_t));
+    arena->chunk_size = (ARENA_CHUNK_MIN > size ? ARENA_CHUNK_MIN : size);
+
+    return arena;
+}
+
+/******************************************************************************
+* Return value: size bytes aligned to ARENA_ALIGN, valid until the arena is  *
+*               reset or destroyed                                           *
+******************************************************************************/
+void *haproxy_arena_alloc(haproxy_arena_t *arena, size_t size)
+{
+    haproxy_arena_chunk_t *chunk = arena->chunks;
+    size_t chunk_size;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if (NULL == chunk || chunk->size - chunk->used < size)
+    {
+        /* the chunks double, so a large response takes few of them */
+        chunk_size = (0 == arena->size ? arena->chunk_size : arena->size);
+
+        if (chunk_size < size)
+            chunk_size = size;
+
+        chunk = arena_chunk_create(chunk_size);
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->size += chunk_size;
+    }
+
+    arena->last = ARENA_CHUNK_DATA(chunk) + chunk->used;
+    chunk->used += size;
+    arena->used += size;
+
+    return arena->last;
+}
+
+/******************************************************************************
+* Grows an allocation of old_size bytes to size bytes. The last allocation   *
+* grows in place if its chunk has room, any other one is copied (the old     *
+* copy is wasted until the arena is reset). An allocation is never shrunk,   *
+* it is returned as is if size is not larger.                                *
+******************************************************************************/
+void *haproxy_arena_realloc(haproxy_arena_t *arena, void *ptr, size_t old_size, size_t size)
+{
+    haproxy_arena_chunk_t *chunk = arena->chunks;
+    size_t old_aligned, aligned;
+    void *copy;
+
+    if (NULL == ptr)
+        return haproxy_arena_alloc(arena, size);
+
+    if (size <= old_size)
+        return ptr;
+
+    old_aligned = (old_size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    aligned = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if (ptr == arena->last && chunk->size - chunk->used >= aligned - old_aligned)
+    {
+        chunk->used += aligned - old_aligned;
+        arena->used += aligned - old_aligned;
+        return ptr;
+    }
+
+    copy = haproxy_arena_alloc(arena, size);
+    memcpy(copy, ptr, old_size);
+
+    return copy;
+}
+
+/******************************************************************************
+* Registers func(data) to be called when the arena is reset or destroyed,    *
+* the last registered is called first.                                       *
+******************************************************************************/
+void haproxy_arena_cleanup(haproxy_arena_t *arena, void (*func)(void *), void *data)
+{
+    haproxy_arena_cleanup_t *cleanup;
+
+    cleanup = (haproxy_arena_cleanup_t *)haproxy_arena_alloc(arena, sizeof(haproxy_arena_cleanup_t));
+    cleanup->func = func;
+    cleanup->data = data;
+    cleanup->next = arena->cleanups;
+    arena->cleanups = cleanup;
+}
+
+/******************************************************************************
+******************************************************************************/
+static void arena_cleanups_run(haproxy_arena_t *arena)
+{
+    haproxy_arena_cleanup_t *cleanup;
+
+    for (cleanup = arena->cleanups; NULL != cleanup; cleanup = cleanup->next)
+        cleanup->func(cleanup->data);
+
+    arena->cleanups = NULL;
+}
+
+/******************************************************************************
+* Releases all allocations. The chunks are merged into one, so an arena      *
+* which has grown while parsing takes no malloc() the next time.             *
+******************************************************************************/
+void haproxy_arena_reset(haproxy_arena_t *arena)
+{
+    haproxy_arena_chunk_t *chunk, *next;
+
+    arena_cleanups_run(arena);
+
+    if (NULL != arena->chunks && NULL != arena->chunks->next)
+    {
+        for (chunk = arena->chunks; NULL != chunk; chunk = next)
+        {
+            next = chunk->next;
+            zbx_free(chunk);
+        }
+
+        arena->chunks = arena_chunk_create(arena->size);
+    }
+
+    if (NULL != arena->chunks)
+        arena->chunks->used = 0;
+
+    arena->last = NULL;
+    arena->used = 0;
+}
+
+/******************************************************************************
+******************************************************************************/
+void haproxy_arena_destroy(haproxy_arena_t *arena)
+{
+    haproxy_arena_chunk_t *chunk, *next;
+
+    arena_cleanups_run(arena);
+
+    for (chunk = arena->chunks; NULL != chunk; chunk = next)
+    {
+        next = chunk->next;
+        zbx_free(chunk);
+    }
+
+    zbx_free(arena);
+}
@@ -0,0 +1,862 @@
+#include "haproxy.h"
+
+/*
+    Responses are cached per (endpoint, command) for CacheTTL seconds, so the
+    keys sharing a command (e.g. "show stat" for haproxy.stat.csv and both
+    autodiscovery keys) cost a single request to HAProxy per interval.
+    A caller asking for an entry which is being fetched waits for that fetch
+    instead of sending the same command again.
+
+    With RefreshInterval the entries are refetched by a background thread
+    (the refresher) every RefreshInterval seconds +-10%, so item checks only
+    take the last snapshot and do not wait for HAProxy. An entry is fetched
+    by the caller only the first time and when its snapshot is older than
+    REFRESH_STALE intervals (the refresher is stuck). Entries no item has
+    asked for in REFRESH_IDLE intervals are dropped.
+
+    Without the refresher the callers drop the entries no item has asked
+    for in CACHE_IDLE TTLs (and at least CACHE_IDLE_MIN seconds, so that the
+    rates of items checked less often keep their previous response), at
+    most once per TTL. haproxy.stat.filter makes an entry per proxy or
+    server filtered, those of the names which are gone do not pile up.
+
+    The agent forks its processes after zbx_module_init() and threads do not
+    survive fork(), so the refresher is started by the first item check in
+    each process.
+
+    Whenever an entry is fetched, the other entries of the same endpoint
+    past half of their lifetime are fetched along with it: the commands are
+    sent in one line ("show info;show stat;...") over one connection and the
+    response is split back per command. Entries of an endpoint this way end
+    up refreshed together, with one round trip to HAProxy per interval.
+
+    Item checks served from a snapshot are counted as hits, those which
+    fetched the entry themselves as misses and those which waited for the
+    fetch of another caller as waits (and as hits, when it succeeded), see
+    modstats.c.
+
+    haproxy_cache_get_multi() looks a command up on many endpoints at once,
+    the entries to be fetched are fetched concurrently, one request per
+    endpoint, see haproxy_query_multi() in conn.c.
+
+    A snapshot is parsed into an arena (see arena.c). When the snapshot is
+    released its arena is reset and kept as a spare for the next snapshot
+    of the same entry, which is about the same size, so once the entries
+    are refreshed the parsed responses take no malloc() or free(). There are
+    at most as many spares as entries.
+*/
+
+#define REFRESH_STALE    3
+#define REFRESH_IDLE     10
+#define CACHE_IDLE       10
+#define CACHE_IDLE_MIN   900
+#define BATCH_MAX        8
+
+typedef struct
+{
+    haproxy_endpoint_t  endpoint;
+    char                *cmd;
+    haproxy_snapshot_t  *snapshot;     /* last successful response, NULL if none */
+    haproxy_snapshot_t  *previous;     /* the one before it, for rates */
+    int                 fetching;      /* 1 - request in flight */
+    int                 failed;        /* error of the last request, SYSINFO_RET_OK - none */
+    size_t              size_hint;     /* length of the last response */
+    zbx_uint64_t        generation;    /* incremented after every request */
+    double              last_used;     /* last haproxy_cache_get() */
+    double              next_refresh;  /* when the refresher fetches it next */
+    haproxy_modstats_t  *stats;        /* statistics of the command */
+}
+cache_entry_t;
+
+static cache_entry_t **entries = NULL;
+static int entries_num = 0;
+static int entries_alloc = 0;
+static int cache_ttl = 0;
+static int refresh_interval = 0;
+static double evict_next = 0;          /* when the callers drop the idle entries next */
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cache_fetched = PTHREAD_COND_INITIALIZER;
+
+/* arenas of the released snapshots */
+typedef struct
+{
+    haproxy_arena_t *arena;
+    const void      *owner;    /* the entry of the snapshot */
+}
+cache_spare_t;
+
+static cache_spare_t *spares = NULL;
+static int spares_num = 0;
+static int spares_alloc = 0;
+
+static pthread_t refresh_thread;
+static pid_t refresh_pid = 0;          /* process the refresher runs in, 0 - not started */
+static int refresh_stop = 0;
+static unsigned int refresh_seed;
+static pthread_cond_t refresh_wakeup = PTHREAD_COND_INITIALIZER;
+
+/******************************************************************************
+******************************************************************************/
+static haproxy_snapshot_t *snapshot_create(char *data, size_t len, double time, haproxy_modstats_t *stats,
+                                           const void *owner)
+{
+    haproxy_snapshot_t *snapshot;
+
+    snapshot = (haproxy_snapshot_t *)zbx_malloc(NULL, sizeof(haproxy_snapshot_t));
+    snapshot->data = data;
+    snapshot->len = len;
+    snapshot->time = time;
+    snapshot->refcount = 1;
+    snapshot->parsed = NULL;
+    snapshot->arena = NULL;
+    snapshot->owner = owner;
+    snapshot->stats = stats;
+    pthread_mutex_init(&snapshot->parsed_lock, NULL);
+
+    return snapshot;
+}
+
+/******************************************************************************
+* Keeps the arena of a released snapshot for the next snapshot of its entry, *
+* must be called with cache_lock held.                                       *
+******************************************************************************/
+static void spare_put(haproxy_arena_t *arena, const void *owner)
+{
+    if (spares_num >= entries_num)
+    {
+        haproxy_arena_destroy(arena);
+        return;
+    }
+
+    if (spares_num == spares_alloc)
+    {
+        spares_alloc = (0 == spares_alloc ? 8 : spares_alloc * 2);
+        spares = (cache_spare_t *)zbx_realloc(spares, spares_alloc * sizeof(cache_spare_t));
+    }
+
+    haproxy_arena_reset(arena);
+    spares[spares_num].arena = arena;
+    spares[spares_num].owner = owner;
+    spares_num++;
+}
+
+/******************************************************************************
+* Return value: the spare arena of the entry, else the largest spare or a    *
+*               new arena; must be called with cache_lock held               *
+******************************************************************************/
+static haproxy_arena_t *spare_get(const void *owner, size_t len)
+{
+    haproxy_arena_t *arena;
+    int i, found = -1;
+
+    for (i = 0; i < spares_num; i++)
+    {
+        if (NULL != owner && spares[i].owner == owner)
+        {
+            found = i;
+            break;
+        }
+
+        if (-1 == found || spares[i].arena->size > spares[found].arena->size)
+            found = i;
+    }
+
+    /* an index takes a fraction of the response, see stat.c */
+    if (-1 == found)
+        return haproxy_arena_create(len / 4);
+
+    arena = spares[found].arena;
+    spares[found] = spares[--spares_num];
+
+    return arena;
+}
+
+/******************************************************************************
+* Must be called with cache_lock held.                                       *
+******************************************************************************/
+static void snapshot_unref(haproxy_snapshot_t *snapshot)
+{
+    if (0 != --snapshot->refcount)
+        return;
+
+    if (NULL != snapshot->arena)
+        spare_put(snapshot->arena, snapshot->owner);
+
+    pthread_mutex_destroy(&snapshot->parsed_lock);
+    zbx_free(snapshot->data);
+    zbx_free(snapshot);
+}
+
+/******************************************************************************
+* Must be called with cache_lock held.                                       *
+******************************************************************************/
+static cache_entry_t *cache_entry_get(const haproxy_endpoint_t *endpoint, const char *cmd)
+{
+    cache_entry_t *entry;
+    int i;
+
+    for (i = 0; i < entries_num; i++)
+    {
+        entry = entries[i];
+
+        if (0 == strcmp(entry->cmd, cmd) && haproxy_endpoint_equal(&entry->endpoint, endpoint))
+            return entry;
+    }
+
+    if (entries_num == entries_alloc)
+    {
+        entries_alloc = (0 == entries_alloc ? 8 : entries_alloc * 2);
+        entries = (cache_entry_t **)zbx_realloc(entries, entries_alloc * sizeof(cache_entry_t *));
+    }
+
+    entry = (cache_entry_t *)zbx_malloc(NULL, sizeof(cache_entry_t));
+    memset(entry, 0, sizeof(cache_entry_t));
+    entry->endpoint = *endpoint;
+    entry->cmd = zbx_strdup(NULL, cmd);
+    entry->stats = haproxy_modstats_get(endpoint, cmd);
+    entries[entries_num++] = entry;
+
+    return entry;
+}
+
+/******************************************************************************
+******************************************************************************/
+void haproxy_cache_init(int ttl, int refresh)
+{
+    const char *__function_name = "haproxy_cache_init";
+
+    cache_ttl = ttl;
+    refresh_interval = refresh;
+
+    if (0 != refresh_interval && 0 == cache_ttl)
+    {
+        zabbix_log(LOG_LEVEL_WARNING,
+                   "Module: %s, function: %s - RefreshInterval is ignored with CacheTTL=0 (%s:%d)",
+                   MODULE_NAME, __function_name, __FILE__, __LINE__);
+        refresh_interval = 0;
+    }
+}
+
+/******************************************************************************
+* Return value: seconds until the next refresh, RefreshInterval +-10%        *
+*                                                                            *
+* Comment: must be called with cache_lock held                               *
+******************************************************************************/
+static double refresh_delay(void)
+{
+    return refresh_interval * (0.9 + 0.2 * rand_r(&refresh_seed) / RAND_MAX);
+}
+
+/******************************************************************************
+* Stores the result of a request, must be called with cache_lock held.       *
+******************************************************************************/
+static void cache_entry_update(cache_entry_t *entry, int ret, char *data, size_t len, double time)
+{
+    entry->fetching = 0;
+    entry->generation++;
+
+    if (SYSINFO_RET_OK == ret)
+    {
+        if (NULL != entry->previous)
+            snapshot_unref(entry->previous);
+
+        entry->previous = entry->snapshot;
+        entry->snapshot = snapshot_create(data, len, time, entry->stats, entry);
+        entry->size_hint = len;
+    }
+
+    entry->failed = ret;
+
+    if (0 != refresh_interval)
+        entry->next_refresh = time + refresh_delay();
+
+    pthread_cond_broadcast(&cache_fetched);
+}
+
+/******************************************************************************
+* Drops the entry, must be called with cache_lock held.                      *
+******************************************************************************/
+static void cache_entry_remove(int index)
+{
+    cache_entry_t *entry = entries[index];
+
+    if (NULL != entry->snapshot)
+        snapshot_unref(entry->snapshot);
+
+    if (NULL != entry->previous)
+        snapshot_unref(entry->previous);
+
+    zbx_free(entry->cmd);
+    zbx_free(entry);
+
+    entries[index] = entries[--entries_num];
+
+    while (spares_num > entries_num)
+        haproxy_arena_destroy(spares[--spares_num].arena);
+}
+
+/******************************************************************************
+* Drops the entries idle for CACHE_IDLE TTLs, once per TTL, when there is no *
+* refresher to do it. Must be called with cache_lock held.                   *
+******************************************************************************/
+static void cache_evict(double now)
+{
+    double idle = MAX(CACHE_IDLE * cache_ttl, CACHE_IDLE_MIN);
+    int i;
+
+    if (0 != refresh_interval || now < evict_next)
+        return;
+
+    evict_next = now + cache_ttl;
+
+    for (i = 0; i < entries_num; i++)
+    {
+        if (0 == entries[i]->fetching && now - entries[i]->last_used > idle)
+            cache_entry_remove(i--);
+    }
+}
+
+/******************************************************************************
+* Starts a batch with the entry and adds the other entries of the endpoint   *
+* whose snapshots are older than min_age. The entries are marked as being    *
+* fetched, must be called with cache_lock held.                              *
+*                                                                            *
+* Return value: number of entries in the batch                               *
+******************************************************************************/
+static int cache_batch_collect(cache_entry_t *entry, double now, double min_age, cache_entry_t **batch)
+{
+    cache_entry_t *other;
+    int i, n = 0;
+
+    entry->fetching = 1;
+    batch[n++] = entry;
+
+    /* the responses of a group of processes are merged per command */
+    if (0 != entry->endpoint.procs_first)
+        return n;
+
+    for (i = 0; i < entries_num && BATCH_MAX > n; i++)
+    {
+        other = entries[i];
+
+        if (0 != other->fetching || !haproxy_endpoint_equal(&other->endpoint, &entry->endpoint))
+            continue;
+
+        if (NULL != other->snapshot && now - other->snapshot->time < min_age)
+            continue;
+
+        other->fetching = 1;
+        batch[n++] = other;
+    }
+
+    return n;
+}
+
+/******************************************************************************
+* Fetches the batch in one request and stores the responses. Must be called  *
+* with cache_lock held, the lock is released for the request.                *
+*                                                                            *
+* Return value: SYSINFO_RET_OK, HAPROXY_RET_TIMEOUT or SYSINFO_RET_FAIL      *
+******************************************************************************/
+static int cache_batch_fetch(cache_entry_t **batch, int n, double now)
+{
+    const char *cmds[BATCH_MAX];
+    char *data = NULL, *sections[BATCH_MAX];
+    size_t offsets[BATCH_MAX], lens[BATCH_MAX], size_hint = 0;
+    int i, ret;
+
+    for (i = 0; i < n; i++)
+    {
+        cmds[i] = batch[i]->cmd;
+        size_hint += batch[i]->size_hint;
+        sections[i] = NULL;
+    }
+
+    pthread_mutex_unlock(&cache_lock);
+
+    if (1 == n)
+    {
+        offsets[0] = 0;
+        ret = haproxy_fetch(&batch[0]->endpoint, cmds[0], size_hint, &data, &lens[0]);
+    }
+    else
+        ret = haproxy_query_batch(&batch[0]->endpoint, cmds, n, size_hint, &data, offsets, lens);
+
+    if (SYSINFO_RET_OK == ret)
+    {
+        /* the first response keeps the buffer */
+        for (i = 1; i < n; i++)
+        {
+            sections[i] = (char *)zbx_malloc(NULL, lens[i] + 1);
+            memcpy(sections[i], data + offsets[i], lens[i]);
+            sections[i][lens[i]] = '\0';
+        }
+
+        if (0 != offsets[0])
+            memmove(data, data + offsets[0], lens[0]);
+
+        data[lens[0]] = '\0';
+        sections[0] = data;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+
+    for (i = 0; i < n; i++)
+        cache_entry_update(batch[i], ret, sections[i], lens[i], now);
+
+    return ret;
+}
+
+/******************************************************************************
+* Refetches the entries when their time comes, the earliest first.           *
+******************************************************************************/
+static void *refresh_run(void *arg)
+{
+    cache_entry_t *entry, *batch[BATCH_MAX];
+    struct timespec ts;
+    double now, next, idle = REFRESH_IDLE * refresh_interval;
+    int i, n;
+
+    ZBX_UNUSED(arg);
+
+    pthread_mutex_lock(&cache_lock);
+
+    while (0 == refresh_stop)
+    {
+        now = zbx_time();
+        next = now + refresh_interval;
+        entry = NULL;
+
+        for (i = 0; i < entries_num; i++)
+        {
+            if (0 != entries[i]->fetching)
+                continue;
+
+            if (now - entries[i]->last_used > idle)
+            {
+                cache_entry_remove(i--);
+                continue;
+            }
+
+            if (entries[i]->next_refresh < next)
+            {
+                entry = entries[i];
+                next = entry->next_refresh;
+            }
+        }
+
+        if (NULL == entry || next > now)
+        {
+            ts.tv_sec = (time_t)next;
+            ts.tv_nsec = (long)((next - (double)ts.tv_sec) * 1e9);
+            pthread_cond_timedwait(&refresh_wakeup, &cache_lock, &ts);
+            continue;
+        }
+
+        n = cache_batch_collect(entry, now, refresh_interval / 2.0, batch);
+        cache_batch_fetch(batch, n, now);
+    }
+
+    pthread_mutex_unlock(&cache_lock);
+
+    return NULL;
+}
+
+/******************************************************************************
+* Starts the refresher in this process, must be called with cache_lock held. *
+******************************************************************************/
+static void refresh_start(void)
+{
+    const char *__function_name = "refresh_start";
+    int err;
+
+    refresh_pid = getpid();
+    refresh_seed = (unsigned int)refresh_pid ^ (unsigned int)time(NULL);
+    refresh_stop = 0;
+
+    if (0 != (err = pthread_create(&refresh_thread, NULL, refresh_run, NULL)))
+    {
+        zabbix_log(LOG_LEVEL_WARNING, "Module: %s, function: %s - cannot start refresher: %s (%s:%d)",
+                   MODULE_NAME, __function_name, zbx_strerror(err), __FILE__, __LINE__);
+
+        /* items are fetched by callers once the snapshots get stale */
+        refresh_interval = 0;
+    }
+}
+
+/******************************************************************************
+* Takes the snapshots of the entry, must be called with cache_lock held.     *
+******************************************************************************/
+static void cache_entry_take(cache_entry_t *entry, haproxy_snapshot_t **snapshot, haproxy_snapshot_t **previous)
+{
+    entry->snapshot->refcount++;
+    *snapshot = entry->snapshot;
+
+    if (NULL != previous && NULL != (*previous = entry->previous))
+        entry->previous->refcount++;
+}
+
+/******************************************************************************
+* Returns the response to the command, either cached (not older than         *
+* CacheTTL, with the refresher - the last one) or fetched now, and the       *
+* response before it if previous is not NULL (NULL if there is none). The    *
+* snapshots must be released with haproxy_snapshot_release().                *
+*                                                                            *
+* Return value: SYSINFO_RET_OK, HAPROXY_RET_TIMEOUT or SYSINFO_RET_FAIL      *
+******************************************************************************/
+static int cache_get(const haproxy_endpoint_t *endpoint, const char *cmd, haproxy_snapshot_t **snapshot,
+                     haproxy_snapshot_t **previous)
+{
+    cache_entry_t *entry, *batch[BATCH_MAX];
+    zbx_uint64_t generation;
+    char *data = NULL;
+    size_t len;
+    double max_age;
+    int n, ret, waited = 0;
+    haproxy_modstats_t *stats;
+
+    if (0 == cache_ttl)
+    {
+        stats = haproxy_modstats_get(endpoint, cmd);
+        haproxy_modstats_add(stats, HAPROXY_MODSTATS_MISSES, 1);
+
+        if (SYSINFO_RET_OK != (ret = haproxy_fetch(endpoint, cmd, 0, &data, &len)))
+            return ret;
+
+        *snapshot = snapshot_create(data, len, zbx_time(), stats, NULL);
+
+        if (NULL != previous)
+            *previous = NULL;
+
+        return SYSINFO_RET_OK;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+
+    if (0 != refresh_interval && getpid() != refresh_pid)
+        refresh_start();
+
+    max_age = (0 != refresh_interval ? REFRESH_STALE * refresh_interval : cache_ttl);
+
+    cache_evict(zbx_time());
+
+    entry = cache_entry_get(endpoint, cmd);
+    entry->last_used = zbx_time();
+    generation = entry->generation;
+
+    while (1)
+    {
+        if (NULL != entry->snapshot && zbx_time() - entry->snapshot->time < max_age)
+        {
+            haproxy_modstats_add(entry->stats, HAPROXY_MODSTATS_HITS, 1);
+            haproxy_modstats_add(entry->stats, HAPROXY_MODSTATS_WAITS, waited);
+            cache_entry_take(entry, snapshot, previous);
+            pthread_mutex_unlock(&cache_lock);
+            return SYSINFO_RET_OK;
+        }
+
+        if (0 == entry->fetching)
+        {
+            /* the request we waited for has failed, do not repeat it, the */
+            /* refresher retries failed requests on its own                */
+            if ((generation != entry->generation || 0 != refresh_interval) && SYSINFO_RET_OK != entry->failed)
+            {
+                ret = entry->failed;
+                haproxy_modstats_add(entry->stats, HAPROXY_MODSTATS_WAITS, waited);
+                pthread_mutex_unlock(&cache_lock);
+                return ret;
+            }
+
+            break;
+        }
+
+        pthread_cond_wait(&cache_fetched, &cache_lock);
+        waited = 1;
+    }
+
+    haproxy_modstats_add(entry->stats, HAPROXY_MODSTATS_MISSES, 1);
+    haproxy_modstats_add(entry->stats, HAPROXY_MODSTATS_WAITS, waited);
+
+    n = cache_batch_collect(entry, zbx_time(), max_age / 2, batch);
+    ret = cache_batch_fetch(batch, n, zbx_time());
+
+    if (SYSINFO_RET_OK == ret)
+        cache_entry_take(entry, snapshot, previous);
+
+    if (0 != refresh_interval)
+        pthread_cond_signal(&refresh_wakeup);
+
+    pthread_mutex_unlock(&cache_lock);
+
+    return ret;
+}
+
+/******************************************************************************
+* Return value: SYSINFO_RET_OK, HAPROXY_RET_TIMEOUT or SYSINFO_RET_FAIL      *
+******************************************************************************/
+int haproxy_cache_get(const haproxy_endpoint_t *endpoint, const char *cmd, haproxy_snapshot_t **snapshot)
+{
+    return cache_get(endpoint, cmd, snapshot, NULL);
+}
+
+/******************************************************************************
+* Same as haproxy_cache_get(), the previous response (NULL if there is none  *
+* yet or the cache is disabled) is returned too.                             *
+******************************************************************************/
+int haproxy_cache_get_pair(const haproxy_endpoint_t *endpoint, const char *cmd, haproxy_snapshot_t **snapshot,
+                           haproxy_snapshot_t **previous)
+{
+    return cache_get(endpoint, cmd, snapshot, previous);
+}
+
+/******************************************************************************
+* Same as haproxy_cache_get() for the command on each of the endpoints, the  *
+* entries to be fetched are fetched at once with haproxy_query_multi(), so   *
+* the call takes as long as the slowest endpoint. Groups of processes are    *
+* not supported. The result for endpoint i is in rets[i], on success the     *
+* snapshot in snapshots[i].                                                  *
+******************************************************************************/
+void haproxy_cache_get_multi(const haproxy_endpoint_t *endpoints, int n, const char *cmd,
+                             haproxy_snapshot_t **snapshots, int *rets)
+{
+    cache_entry_t **fetched, *entry;
+    haproxy_request_t *requests;
+    int *waiting, i, nrequests = 0;
+    double max_age, now;
+
+    requests = (haproxy_request_t *)zbx_malloc(NULL, n * sizeof(haproxy_request_t));
+
+    if (0 == cache_ttl)
+    {
+        for (i = 0; i < n; i++)
+        {
+            haproxy_modstats_add(haproxy_modstats_get(&endpoints[i], cmd), HAPROXY_MODSTATS_MISSES, 1);
+            requests[i].endpoint = &endpoints[i];
+            requests[i].cmd = cmd;
+            requests[i].size_hint = 0;
+        }
+
+        haproxy_query_multi(requests, n);
+
+        for (i = 0; i < n; i++)
+        {
+            if (SYSINFO_RET_OK == (rets[i] = requests[i].ret))
+            {
+                snapshots[i] = snapshot_create(requests[i].data, requests[i].len, zbx_time(),
+                                               haproxy_modstats_get(&endpoints[i], cmd), NULL);
+            }
+        }
+
+        zbx_free(requests);
+        return;
+    }
+
+    fetched = (cache_entry_t **)zbx_malloc(NULL, n * sizeof(cache_entry_t *));
+    waiting = (int *)zbx_malloc(NULL, n * sizeof(int));
+
+    pthread_mutex_lock(&cache_lock);
+
+    if (0 != refresh_interval && getpid() != refresh_pid)
+        refresh_start();
+
+    max_age = (0 != refresh_interval ? REFRESH_STALE * refresh_interval : cache_ttl);
+    now = zbx_time();
+
+    cache_evict(now);
+
+    for (i = 0; i < n; i++)
+    {
+        entry = cache_entry_get(&endpoints[i], cmd);
+        entry->last_used = now;
+        waiting[i] = 0;
+
+        if (NULL != entry->snapshot && now - entry->snapshot->time < max_age)
+        {
+            haproxy_modstats_add(entry->stats, HAPROXY_MODSTATS_HITS, 1);
+            cache_entry_take(entry, &snapshots[i], NULL);
+            rets[i] = SYSINFO_RET_OK;
+        }
+        else if (0 != entry->fetching)
+        {
+            /* by another caller or an endpoint given twice */
+            waiting[i] = 1;
+        }
+        else if (0 != refresh_interval && SYSINFO_RET_OK != entry->failed)
+        {
+            /* the refresher retries failed requests on its own */
+            rets[i] = entry->failed;
+        }
+        else
+        {
+            haproxy_modstats_add(entry->stats, HAPROXY_MODSTATS_MISSES, 1);
+            entry->fetching = 1;
+            fetched[nrequests] = entry;
+            requests[nrequests].endpoint = &entry->endpoint;
+            requests[nrequests].cmd = entry->cmd;
+            requests[nrequests].size_hint = entry->size_hint;
+            nrequests++;
+            waiting[i] = 2;
+        }
+    }
+
+    pthread_mutex_unlock(&cache_lock);
+
+    if (0 != nrequests)
+        haproxy_query_multi(requests, nrequests);
+
+    pthread_mutex_lock(&cache_lock);
+
+    now = zbx_time();
+
+    for (i = 0; i < nrequests; i++)
+        cache_entry_update(fetched[i], requests[i].ret, requests[i].data, requests[i].len, now);
+
+    for (i = 0; i < n; i++)
+    {
+        if (0 == waiting[i])
+            continue;
+
+        entry = cache_entry_get(&endpoints[i], cmd);
+
+        if (1 == waiting[i])
+        {
+            while (0 != entry->fetching)
+                pthread_cond_wait(&cache_fetched, &cache_lock);
+
+            haproxy_modstats_add(entry->stats, HAPROXY_MODSTATS_WAITS, 1);
+        }
+
+        if (NULL != entry->snapshot && zbx_time() - entry->snapshot->time < max_age)
+        {
+            if (1 == waiting[i])
+                haproxy_modstats_add(entry->stats, HAPROXY_MODSTATS_HITS, 1);
+
+            cache_entry_take(entry, &snapshots[i], NULL);
+            rets[i] = SYSINFO_RET_OK;
+        }
+        else
+            rets[i] = (SYSINFO_RET_OK != entry->failed ? entry->failed : SYSINFO_RET_FAIL);
+    }
+
+    if (0 != refresh_interval)
+        pthread_cond_signal(&refresh_wakeup);
+
+    pthread_mutex_unlock(&cache_lock);
+
+    zbx_free(waiting);
+    zbx_free(fetched);
+    zbx_free(requests);
+}
+
+/******************************************************************************
+******************************************************************************/
+void haproxy_snapshot_release(haproxy_snapshot_t *snapshot)
+{
+    pthread_mutex_lock(&cache_lock);
+    snapshot_unref(snapshot);
+    pthread_mutex_unlock(&cache_lock);
+}
+
+/******************************************************************************
+* Releases the snapshot and returns its data for SET_STR_RESULT. The buffer  *
+* is handed over as is if nobody else holds the snapshot (the cache is       *
+* disabled), otherwise it is copied.                                         *
+******************************************************************************/
+char *haproxy_snapshot_detach(haproxy_snapshot_t *snapshot)
+{
+    char *data;
+
+    pthread_mutex_lock(&cache_lock);
+
+    if (1 == snapshot->refcount)
+    {
+        data = snapshot->data;
+        snapshot->data = NULL;
+        snapshot_unref(snapshot);
+    }
+    else
+    {
+        data = (char *)zbx_malloc(NULL, snapshot->len + 1);
+        memcpy(data, snapshot->data, snapshot->len + 1);
+        snapshot_unref(snapshot);
+    }
+
+    pthread_mutex_unlock(&cache_lock);
+
+    return data;
+}
+
+/******************************************************************************
+* Returns the parsed response, it is parsed by the first caller into the     *
+* arena of the snapshot and shared by all holders of the snapshot. The       *
+* parsing is timed in the statistics of the command.                         *
+*                                                                            *
+* Return value: the parsed response or NULL if it cannot be parsed           *
+******************************************************************************/
+void *haproxy_snapshot_parsed(haproxy_snapshot_t *snapshot,
+                              void *(*parse)(const char *, size_t, haproxy_arena_t *))
+{
+    void *parsed;
+    double start;
+
+    pthread_mutex_lock(&snapshot->parsed_lock);
+
+    if (NULL == snapshot->parsed)
+    {
+        start = zbx_time();
+
+        if (NULL == snapshot->arena)
+        {
+            pthread_mutex_lock(&cache_lock);
+            snapshot->arena = spare_get(snapshot->owner, snapshot->len);
+            pthread_mutex_unlock(&cache_lock);
+        }
+        else
+            haproxy_arena_reset(snapshot->arena);    /* of a failed attempt */
+
+        snapshot->parsed = parse(snapshot->data, snapshot->len, snapshot->arena);
+
+        haproxy_modstats_parse(snapshot->stats, zbx_time() - start);
+    }
+
+    parsed = snapshot->parsed;
+
+    pthread_mutex_unlock(&snapshot->parsed_lock);
+
+    return parsed;
+}
+
+/******************************************************************************
+******************************************************************************/
+void haproxy_cache_destroy(void)
+{
+    pthread_mutex_lock(&cache_lock);
+
+    if (0 != refresh_pid && getpid() == refresh_pid)
+    {
+        refresh_stop = 1;
+        pthread_cond_signal(&refresh_wakeup);
+        pthread_mutex_unlock(&cache_lock);
+
+        pthread_join(refresh_thread, NULL);
+
+        pthread_mutex_lock(&cache_lock);
+        refresh_pid = 0;
+    }
+
+    while (0 != entries_num)
+        cache_entry_remove(entries_num - 1);
+
+    zbx_free(entries);
+    entries_num = 0;
+    entries_alloc = 0;
+
+    while (0 != spares_num)
+        haproxy_arena_destroy(spares[--spares_num].arena);
+
+    zbx_free(spares);
+    spares_alloc = 0;
+
+    pthread_mutex_unlock(&cache_lock);
+}
@@ -0,0 +1,872 @@
+#include "haproxy.h"
+
+/*
+    Stats socket connections are kept open between item checks. Right after
+    connecting the socket is switched to interactive mode with "prompt", so
+    HAProxy does not close it after the first response and every response is
+    terminated by the "> " prompt (see send_command).
+    https://cbonte.github.io/haproxy-dconv/1.9/management.html#9.3-prompt
+
+    The pool is shared by the item checks and the refresher (see cache.c),
+    a connection is used by one of them at a time.
+
+    Every request is counted in the statistics of its commands (latency,
+    bytes, failures) and every connection opened in the statistics of the
+    endpoint, see modstats.c.
+
+    haproxy_query_multi() sends a command to many endpoints at once: the
+    sockets are non-blocking, connecting and the exchanges are driven by one
+    poll() loop until every request is done or past its deadline.
+*/
+
+typedef struct
+{
+    haproxy_endpoint_t  endpoint;
+    int                 sock;    /* -1 - not connected */
+    int                 busy;    /* 1 - handed out by conn_acquire() */
+}
+haproxy_conn_t;
+
+/* state of a request of haproxy_query_multi() */
+#define MULTI_CONNECT    0
+#define MULTI_PROMPT     1    /* switching a new connection to interactive mode */
+#define MULTI_QUERY      2
+#define MULTI_DONE       3
+#define MULTI_RESOLVE    4    /* waiting for the address, see haproxy_resolve_start() */
+
+typedef struct
+{
+    haproxy_request_t   *request;
+    haproxy_conn_t      *conn;
+    haproxy_modstats_t  *stats;       /* of the endpoint */
+    char                *text;        /* the command as sent */
+    int                 state;
+    int                 reused;       /* the connection was open before the request */
+    haproxy_exchange_t  exchange;
+    size_t              offset;       /* of the response in the exchange */
+    double              start;
+    double              deadline;     /* 0 - none */
+}
+multi_query_t;
+
+static haproxy_conn_t **conns = NULL;
+static int conns_num = 0;
+static int conns_alloc = 0;
+
+static pthread_mutex_t conn_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int conn_timeout = 0;    /* item timeout, seconds */
+
+/******************************************************************************
+******************************************************************************/
+static int address_parse(const char *param, haproxy_endpoint_t *endpoint)
+{
+    const haproxy_endpoint_t *named;
+    const char *port;
+    char *end;
+    size_t len;
+    long num;
+
+    /* a named endpoint followed by the processes: lb1@2 */
+    if (NULL != (named = haproxy_registry_find(param)))
+    {
+        if (0 != named->process || 0 != named->procs_first)
+            return SYSINFO_RET_FAIL;
+
+        *endpoint = *named;
+
+        return SYSINFO_RET_OK;
+    }
+
+    memset(endpoint, 0, sizeof(haproxy_endpoint_t));
+
+    if ('/' == *param)
+    {
+        endpoint->type = HAPROXY_ENDPOINT_UNIX;
+        zbx_strlcpy(endpoint->address, param, sizeof(endpoint->address));
+
+        return SYSINFO_RET_OK;
+    }
+
+    if (NULL == (port = strrchr(param, ':')) || (len = (size_t)(port - param)) >= sizeof(endpoint->address) ||
+            0 == len)
+    {
+        return SYSINFO_RET_FAIL;
+    }
+
+    num = strtol(port + 1, &end, 10);
+
+    if (end == port + 1 || '\0' != *end || 1 > num || 65535 < num)
+        return SYSINFO_RET_FAIL;
+
+    endpoint->port = (int)num;
+
+    /* [2001:db8::1]:9999 */
+    if ('[' == *param && ']' == port[-1] && 2 < len)
+    {
+        param++;
+        len -= 2;
+    }
+
+    endpoint->type = HAPROXY_ENDPOINT_NET;
+    memcpy(endpoint->address, param, len);
+    endpoint->address[len] = '\0';
+
+    return SYSINFO_RET_OK;
+}
+
+/******************************************************************************
+* Parses the processes after '@': "2" or "1-4" (HAProxy numbers them from 1) *
+*                                                                            *
+* Return value: SUCCEED or FAIL                                              *
+******************************************************************************/
+static int procs_parse(const char *text, int *first, int *last)
+{
+    char *end;
+
+    *first = (int)strtol(text, &end, 10);
+
+    if (end == text)
+        return FAIL;
+
+    if ('-' == *end)
+    {
+        text = end + 1;
+        *last = (int)strtol(text, &end, 10);
+
+        if (end == text)
+            return FAIL;
+    }
+    else
+        *last = *first;
+
+    if ('\0' != *end || 1 > *first || *first > *last || HAPROXY_PROCS_MAX <= *last - *first)
+        return FAIL;
+
+    return SUCCEED;
+}
+
+/******************************************************************************
+* Gets the stats socket from a single key parameter:                         *
+*     "/run/haproxy/stats.sock"      - UNIX socket                           *
+*     192.168.1.100:9999             - TCP socket                            *
+*     [2001:db8::1]:9999             - TCP socket, IPv6                      *
+*     haproxy.example.com:9999       - TCP socket, host name                 *
+*     lb1                            - named endpoint (see registry.c)       *
+* optionally followed by the HAProxy processes to query (see group.c):       *
+*     /run/haproxy/master.sock@2     - worker 2 through the master CLI       *
+*     /run/haproxy/master.sock@1-4   - workers 1 - 4 through the master CLI  *
+*     /run/haproxy/stats-*.sock@1-4  - stats-1.sock - stats-4.sock           *
+******************************************************************************/
+int haproxy_endpoint_parse(const char *param, haproxy_endpoint_t *endpoint)
+{
+    haproxy_endpoint_t group;
+    const haproxy_endpoint_t *named;
+    const char *at;
+    char *address;
+    int first = 0, last = 0, ret;
+
+    if (NULL == param || '\0' == *param)
+        return SYSINFO_RET_FAIL;
+
+    if (NULL != (named = haproxy_registry_find(param)))
+    {
+        *endpoint = *named;
+        return SYSINFO_RET_OK;
+    }
+
+    address = zbx_strdup(NULL, param);
+
+    if (NULL != (at = strrchr(param, '@')) && '0' <= at[1] && '9' >= at[1])
+    {
+        if (SUCCEED != procs_parse(at + 1, &first, &last))
+        {
+            zbx_free(address);
+            return SYSINFO_RET_FAIL;
+        }
+
+        address[at - param] = '\0';
+    }
+
+    if (NULL != strchr(address, '*'))
+    {
+        /* a socket per process, the address is kept as the template */
+        if (0 == first || strlen(address) >= sizeof(group.address))
+        {
+            ret = SYSINFO_RET_FAIL;
+        }
+        else
+        {
+            memset(&group, 0, sizeof(haproxy_endpoint_t));
+            group.type = ('/' == *address ? HAPROXY_ENDPOINT_UNIX : HAPROXY_ENDPOINT_NET);
+            zbx_strlcpy(group.address, address, sizeof(group.address));
+            group.procs_first = first;
+            group.procs_last = last;
+
+            if (first == last)
+                ret = haproxy_endpoint_member(&group, first, endpoint);
+            else
+            {
+                *endpoint = group;
+                ret = SYSINFO_RET_OK;
+            }
+        }
+    }
+    else if (SYSINFO_RET_OK == (ret = address_parse(address, endpoint)) && 0 != first)
+    {
+        if (first == last)
+            endpoint->process = first;
+        else
+        {
+            endpoint->procs_first = first;
+            endpoint->procs_last = last;
+        }
+    }
+
+    zbx_free(address);
+
+    return ret;
+}
+
+/******************************************************************************
+******************************************************************************/
+int haproxy_endpoint_equal(const haproxy_endpoint_t *a, const haproxy_endpoint_t *b)
+{
+    return a->type == b->type && a->port == b->port && a->process == b->process &&
+            a->procs_first == b->procs_first && a->procs_last == b->procs_last &&
+            0 == strcmp(a->address, b->address);
+}
+
+/******************************************************************************
+******************************************************************************/
+static void conn_close(haproxy_conn_t *conn)
+{
+    if (-1 != conn->sock)
+    {
+        close(conn->sock);
+        conn->sock = -1;
+    }
+}
+
+/******************************************************************************
+* An idle connection must not have anything to read. If it has, HAProxy has  *
+* closed it (stats timeout, reload) or the stream is out of sync.            *
+******************************************************************************/
+static int conn_is_stale(const haproxy_conn_t *conn)
+{
+    struct pollfd pfd;
+
+    pfd.fd = conn->sock;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    return 0 != poll(&pfd, 1, 0);
+}
+
+/******************************************************************************
+******************************************************************************/
+static int conn_open(haproxy_conn_t *conn, double deadline)
+{
+    const char *__function_name = "conn_open";
+    int ret;
+    char *data = NULL;
+    size_t len;
+
+    if (HAPROXY_ENDPOINT_UNIX == conn->endpoint.type)
+        ret = connect_unix(conn->endpoint.address, deadline, &conn->sock);
+    else
+        ret = connect_net(conn->endpoint.address, conn->endpoint.port, deadline, &conn->sock);
+
+    if (ret != SYSINFO_RET_OK)
+    {
+        conn->sock = -1;
+        return ret;
+    }
+
+    ret = send_command(conn->sock, "prompt", 0, deadline, &data, &len);
+    if (HAPROXY_RET_TRUNCATED == ret)
+        ret = SYSINFO_RET_FAIL;
+
+    if (ret != SYSINFO_RET_OK)
+    {
+        zabbix_log(LOG_LEVEL_DEBUG,
+                   "Module: %s, function: %s - Cannot switch to interactive mode (%s:%d)",
+                   MODULE_NAME, __function_name, __FILE__, __LINE__);
+        conn_close(conn);
+        return ret;
+    }
+    zbx_free(data);
+
+    return SYSINFO_RET_OK;
+}
+
+/******************************************************************************
+* Returns an idle connection to the endpoint, a new (not yet connected) one  *
+* is added to the pool if there is none.                                     *
+******************************************************************************/
+static haproxy_conn_t *conn_acquire(const haproxy_endpoint_t *endpoint)
+{
+    haproxy_conn_t *conn;
+    int i;
+
+    pthread_mutex_lock(&conn_lock);
+
+    for (i = 0; i < conns_num; i++)
+    {
+        conn = conns[i];
+
+        if (0 == conn->busy && haproxy_endpoint_equal(&conn->endpoint, endpoint))
+        {
+            conn->busy = 1;
+            pthread_mutex_unlock(&conn_lock);
+            return conn;
+        }
+    }
+
+    if (conns_num == conns_alloc)
+    {
+        conns_alloc = (0 == conns_alloc ? 8 : conns_alloc * 2);
+        conns = (haproxy_conn_t **)zbx_realloc(conns, conns_alloc * sizeof(haproxy_conn_t *));
+    }
+
+    conn = (haproxy_conn_t *)zbx_malloc(NULL, sizeof(haproxy_conn_t));
+    conn->endpoint = *endpoint;
+    conn->sock = -1;
+    conn->busy = 1;
+    conns[conns_num++] = conn;
+
+    pthread_mutex_unlock(&conn_lock);
+
+    return conn;
+}
+
+/******************************************************************************
+******************************************************************************/
+static void conn_release(haproxy_conn_t *conn)
+{
+    pthread_mutex_lock(&conn_lock);
+    conn->busy = 0;
+    pthread_mutex_unlock(&conn_lock);
+}
+
+/******************************************************************************
+* Opens a connection to the endpoint, switches it to interactive mode and    *
+* closes it, without the pool.                                               *
+*                                                                            *
+* Return value: SYSINFO_RET_OK, HAPROXY_RET_TIMEOUT or SYSINFO_RET_FAIL      *
+******************************************************************************/
+int haproxy_probe(const haproxy_endpoint_t *endpoint, int timeout)
+{
+    haproxy_conn_t conn;
+    int ret;
+
+    conn.endpoint = *endpoint;
+    conn.sock = -1;
+    conn.busy = 1;
+
+    if (SYSINFO_RET_OK == (ret = conn_open(&conn, zbx_time() + timeout)))
+        conn_close(&conn);
+
+    return ret;
+}
+
+/******************************************************************************
+* Sets the time a request (connecting included) may take, 0 - no limit.      *
+******************************************************************************/
+void haproxy_conn_timeout(int timeout)
+{
+    conn_timeout = timeout;
+}
+
+/******************************************************************************
+* Joins the commands into one line, prefixed with @<process> for the master  *
+* CLI, which passes them on to that worker.                                  *
+******************************************************************************/
+static char *query_text(const haproxy_endpoint_t *endpoint, const char **cmds, int ncmds)
+{
+    char *text = NULL;
+    size_t text_alloc = 0, text_offset = 0;
+    int i;
+
+    for (i = 0; i < ncmds; i++)
+    {
+        if (0 != i)
+            zbx_chrcpy_alloc(&text, &text_alloc, &text_offset, ';');
+
+        if (0 != endpoint->process)
+            zbx_snprintf_alloc(&text, &text_alloc, &text_offset, "@%d ", endpoint->process);
+
+        zbx_strcpy_alloc(&text, &text_alloc, &text_offset, cmds[i]);
+    }
+
+    return text;
+}
+
+/******************************************************************************
+* Counts a request in the statistics of its commands.                        *
+******************************************************************************/
+static void query_stats(const haproxy_endpoint_t *endpoint, const char **cmds, int ncmds, int ret,
+                        const size_t *lens, double elapsed)
+{
+    haproxy_modstats_t *stats;
+    int i;
+
+    for (i = 0; i < ncmds; i++)
+    {
+        stats = haproxy_modstats_get(endpoint, cmds[i]);
+
+        haproxy_modstats_add(stats, HAPROXY_MODSTATS_REQUESTS, 1);
+        haproxy_modstats_latency(stats, elapsed);
+
+        if (SYSINFO_RET_OK == ret)
+        {
+            haproxy_modstats_add(stats, HAPROXY_MODSTATS_BYTES, lens[i]);
+        }
+        else
+        {
+            haproxy_modstats_add(stats, HAPROXY_MODSTATS_FAILURES, 1);
+
+            if (HAPROXY_RET_TIMEOUT == ret)
+                haproxy_modstats_add(stats, HAPROXY_MODSTATS_TIMEOUTS, 1);
+        }
+    }
+}
+
+/******************************************************************************
+* Sends the commands over a pooled connection in a single write, see         *
+* send_commands(). A connection that turned out to be closed by HAProxy is   *
+* reopened and the commands are sent once again. A connection whose request  *
+* timed out is closed, the rest of the response would be taken for the       *
+* response to the next command. The master CLI passes a command prefixed     *
+* with @<process> on to that worker. A response cut short by HAProxy is      *
+* counted as truncated and fails like any other closed connection.           *
+*                                                                            *
+* Return value: SYSINFO_RET_OK, HAPROXY_RET_TIMEOUT or SYSINFO_RET_FAIL      *
+******************************************************************************/
+int haproxy_query_batch(const haproxy_endpoint_t *endpoint, const char **cmds, int ncmds, size_t size_hint,
+                        char **data, size_t *offsets, size_t *lens)
+{
+    const char *__function_name = "haproxy_query_batch";
+    haproxy_conn_t *conn;
+    haproxy_modstats_t *endpoint_stats;
+    char *text;
+    int reused, i;
+    int ret = SYSINFO_RET_FAIL;
+    double start = zbx_time();
+    double deadline = (0 != conn_timeout ? start + conn_timeout : 0);
+
+    text = query_text(endpoint, cmds, ncmds);
+    endpoint_stats = haproxy_modstats_get(endpoint, NULL);
+    conn = conn_acquire(endpoint);
+
+    do
+    {
+        reused = (-1 != conn->sock);
+
+        if (reused && conn_is_stale(conn))
+        {
+            zabbix_log(LOG_LEVEL_DEBUG,
+                       "Module: %s, function: %s - Connection to %s was closed, reconnecting (%s:%d)",
+                       MODULE_NAME, __function_name, endpoint->address, __FILE__, __LINE__);
+            conn_close(conn);
+            reused = 0;
+            haproxy_modstats_add(endpoint_stats, HAPROXY_MODSTATS_RECONNECTS, 1);
+        }
+
+        if (-1 == conn->sock)
+        {
+            if (SYSINFO_RET_OK != (ret = conn_open(conn, deadline)))
+                break;
+
+            haproxy_modstats_add(endpoint_stats, HAPROXY_MODSTATS_CONNECTS, 1);
+        }
+
+        ret = send_commands(conn->sock, text, ncmds, size_hint, deadline, data, offsets, lens);
+        if (ret != SYSINFO_RET_OK)
+            conn_close(conn);
+
+        if (HAPROXY_RET_TRUNCATED == ret)
+        {
+            zabbix_log(LOG_LEVEL_DEBUG,
+                       "Module: %s, function: %s - The response to \"%s\" from %s was truncated (%s:%d)",
+                       MODULE_NAME, __function_name, text, endpoint->address, __FILE__, __LINE__);
+
+            for (i = 0; i < ncmds; i++)
+                haproxy_modstats_add(haproxy_modstats_get(endpoint, cmds[i]), HAPROXY_MODSTATS_TRUNCATED, 1);
+
+            ret = SYSINFO_RET_FAIL;
+        }
+
+        if (ret == SYSINFO_RET_FAIL && reused)
+            haproxy_modstats_add(endpoint_stats, HAPROXY_MODSTATS_RECONNECTS, 1);
+    }
+    while (ret == SYSINFO_RET_FAIL && reused);
+
+    query_stats(endpoint, cmds, ncmds, ret, lens, zbx_time() - start);
+
+    if (HAPROXY_RET_TIMEOUT == ret)
+    {
+        zabbix_log(LOG_LEVEL_DEBUG,
+                   "Module: %s, function: %s - \"%s\" to %s timed out after %d seconds (%s:%d)",
+                   MODULE_NAME, __function_name, text, endpoint->address, conn_timeout, __FILE__, __LINE__);
+    }
+
+    conn_release(conn);
+    zbx_free(text);
+
+    return ret;
+}
+
+/******************************************************************************
+* Sends a single command, see haproxy_query_batch().                         *
+*                                                                            *
+* Return value: SYSINFO_RET_OK, HAPROXY_RET_TIMEOUT or SYSINFO_RET_FAIL      *
+******************************************************************************/
+int haproxy_query(const haproxy_endpoint_t *endpoint, const char *cmd, size_t size_hint, char **data,
+                  size_t *len)
+{
+    size_t offset;
+
+    return haproxy_query_batch(endpoint, &cmd, 1, size_hint, data, &offset, len);
+}
+
+/******************************************************************************
+* Starts the exchange of the request: "prompt" over a new connection, the    *
+* command over a connection in interactive mode.                             *
+******************************************************************************/
+static void multi_exchange(multi_query_t *query, int state)
+{
+    query->state = state;
+
+    if (MULTI_PROMPT == state)
+    {
+        haproxy_exchange_init(&query->exchange, query->conn->sock, "prompt", 1, 0, &query->offset,
+                              &query->request->len);
+    }
+    else
+    {
+        haproxy_exchange_init(&query->exchange, query->conn->sock, query->text, 1, query->request->size_hint,
+                              &query->offset, &query->request->len);
+    }
+}
+
+/******************************************************************************
+* Completes the request, a connection which failed is closed (after a        *
+* timeout the rest of the response would be taken for the next one).        *
+******************************************************************************/
+static void multi_done(multi_query_t *query, int ret)
+{
+    haproxy_exchange_free(&query->exchange);
+
+    if (SYSINFO_RET_OK != ret)
+        conn_close(query->conn);
+
+    conn_release(query->conn);
+
+    query->state = MULTI_DONE;
+    query->request->ret = ret;
+
+    query_stats(query->request->endpoint, &query->request->cmd, 1, ret, &query->request->len,
+                zbx_time() - query->start);
+}
+
+/******************************************************************************
+* Opens the connection of the request or, if it is open, starts sending the  *
+* command.                                                                   *
+******************************************************************************/
+static void multi_start(multi_query_t *query)
+{
+    const char *__function_name = "multi_start";
+    haproxy_conn_t *conn = query->conn;
+    int ret;
+
+    query->reused = (-1 != conn->sock);
+
+    if (0 != query->reused && conn_is_stale(conn))
+    {
+        zabbix_log(LOG_LEVEL_DEBUG,
+                   "Module: %s, function: %s - Connection to %s was closed, reconnecting (%s:%d)",
+                   MODULE_NAME, __function_name, conn->endpoint.address, __FILE__, __LINE__);
+        conn_close(conn);
+        query->reused = 0;
+        haproxy_modstats_add(query->stats, HAPROXY_MODSTATS_RECONNECTS, 1);
+    }
+
+    if (-1 != conn->sock)
+    {
+        multi_exchange(query, MULTI_QUERY);
+        return;
+    }
+
+    if (SYSINFO_RET_FAIL == (ret = connect_start(&conn->endpoint, &conn->sock)))
+    {
+        conn->sock = -1;
+        multi_done(query, SYSINFO_RET_FAIL);
+    }
+    else if (SYSINFO_RET_OK == ret)
+        multi_exchange(query, MULTI_PROMPT);
+    else
+        query->state = MULTI_CONNECT;
+}
+
+/******************************************************************************
+* Goes on with the request once its socket is ready.                         *
+******************************************************************************/
+static void multi_step(multi_query_t *query)
+{
+    const char *__function_name = "multi_step";
+    haproxy_request_t *request = query->request;
+    int ret;
+
+    if (MULTI_CONNECT == query->state)
+    {
+        if (SYSINFO_RET_OK != connect_finish(query->conn->sock))
+        {
+            zabbix_log(LOG_LEVEL_TRACE, "Module: %s, function: %s - Cannot connect to %s: %s (%s:%d)",
+                       MODULE_NAME, __function_name, query->conn->endpoint.address, zbx_strerror(errno),
+                       __FILE__, __LINE__);
+            multi_done(query, SYSINFO_RET_FAIL);
+        }
+        else
+            multi_exchange(query, MULTI_PROMPT);
+
+        return;
+    }
+
+    if (HAPROXY_RET_AGAIN == (ret = haproxy_exchange_run(&query->exchange)))
+        return;
+
+    if (MULTI_PROMPT == query->state)
+    {
+        haproxy_exchange_free(&query->exchange);
+
+        if (SYSINFO_RET_OK != ret)
+        {
+            zabbix_log(LOG_LEVEL_DEBUG,
+                       "Module: %s, function: %s - Cannot switch to interactive mode (%s:%d)",
+                       MODULE_NAME, __function_name, __FILE__, __LINE__);
+            multi_done(query, SYSINFO_RET_FAIL);
+            return;
+        }
+
+        haproxy_modstats_add(query->stats, HAPROXY_MODSTATS_CONNECTS, 1);
+        multi_exchange(query, MULTI_QUERY);
+        return;
+    }
+
+    if (SYSINFO_RET_OK == ret)
+    {
+        request->data = haproxy_exchange_data(&query->exchange);
+
+        if (0 != query->offset)
+            memmove(request->data, request->data + query->offset, request->len + 1);
+
+        multi_done(query, SYSINFO_RET_OK);
+        return;
+    }
+
+    haproxy_exchange_free(&query->exchange);
+    conn_close(query->conn);
+
+    if (HAPROXY_RET_TRUNCATED == ret)
+    {
+        zabbix_log(LOG_LEVEL_DEBUG,
+                   "Module: %s, function: %s - The response to \"%s\" from %s was truncated (%s:%d)",
+                   MODULE_NAME, __function_name, query->text, query->conn->endpoint.address, __FILE__, __LINE__);
+        haproxy_modstats_add(haproxy_modstats_get(request->endpoint, request->cmd), HAPROXY_MODSTATS_TRUNCATED, 1);
+        ret = SYSINFO_RET_FAIL;
+    }
+
+    /* HAProxy may have closed the connection meanwhile, once more over a new one */
+    if (0 != query->reused)
+    {
+        haproxy_modstats_add(query->stats, HAPROXY_MODSTATS_RECONNECTS, 1);
+        multi_start(query);
+        return;
+    }
+
+    multi_done(query, ret);
+}
+
+/******************************************************************************
+* Sends a command to each of the endpoints at once and waits for all         *
+* responses in a single poll() loop, so the requests take as long as the     *
+* slowest of them rather than the sum of them. The connections of the pool   *
+* are used and reopened as in haproxy_query_batch(). Each request has the    *
+* item timeout of its own, the ones past it fail while the others go on.     *
+* Host names are resolved beforehand, all at once and within the timeout.    *
+* Groups of processes (procs_first) are not supported.                       *
+*                                                                            *
+* The result of request i is in requests[i].ret, on success the response is  *
+* in requests[i].data and must be freed by the caller.                       *
+******************************************************************************/
+void haproxy_query_multi(haproxy_request_t *requests, int n)
+{
+    const char *__function_name = "haproxy_query_multi";
+    multi_query_t *queries, *query;
+    const haproxy_endpoint_t **endpoints;
+    haproxy_resolve_batch_t *resolving;
+    struct pollfd *pfds;
+    int *polled;
+    double now;
+    int i, npfds, timeout_ms, ms, resolve_polled;
+
+    queries = (multi_query_t *)zbx_malloc(NULL, n * sizeof(multi_query_t));
+    pfds = (struct pollfd *)zbx_malloc(NULL, (n + 1) * sizeof(struct pollfd));
+    polled = (int *)zbx_malloc(NULL, n * sizeof(int));
+    endpoints = (const haproxy_endpoint_t **)zbx_malloc(NULL, n * sizeof(haproxy_endpoint_t *));
+
+    now = zbx_time();
+
+    for (i = 0; i < n; i++)
+    {
+        query = &queries[i];
+
+        memset(query, 0, sizeof(multi_query_t));
+        query->request = &requests[i];
+        query->request->data = NULL;
+        query->request->len = 0;
+        query->text = query_text(requests[i].endpoint, &requests[i].cmd, 1);
+        query->stats = haproxy_modstats_get(requests[i].endpoint, NULL);
+        query->start = now;
+        query->deadline = (0 != conn_timeout ? now + conn_timeout : 0);
+        query->conn = conn_acquire(requests[i].endpoint);
+
+        /* an open connection does not need the address */
+        endpoints[i] = (-1 == query->conn->sock ? requests[i].endpoint : NULL);
+    }
+
+    /* the host names are looked up at once, the lookups count against the timeout */
+    resolving = haproxy_resolve_start(endpoints, n);
+
+    for (i = 0; i < n; i++)
+    {
+        if (SUCCEED == haproxy_resolve_pending(resolving, i))
+            queries[i].state = MULTI_RESOLVE;
+        else
+            multi_start(&queries[i]);
+    }
+
+    while (1)
+    {
+        npfds = 0;
+        timeout_ms = -1;
+        resolve_polled = 0;
+        now = zbx_time();
+
+        for (i = 0; i < n; i++)
+        {
+            query = &queries[i];
+
+            if (MULTI_DONE == query->state)
+                continue;
+
+            if (0 != query->deadline && now >= query->deadline)
+            {
+                zabbix_log(LOG_LEVEL_DEBUG,
+                           "Module: %s, function: %s - \"%s\" to %s timed out after %d seconds (%s:%d)",
+                           MODULE_NAME, __function_name, query->text, query->conn->endpoint.address, conn_timeout,
+                           __FILE__, __LINE__);
+                multi_done(query, HAPROXY_RET_TIMEOUT);
+                continue;
+            }
+
+            if (MULTI_RESOLVE == query->state)
+            {
+                resolve_polled = 1;
+            }
+            else
+            {
+                pfds[npfds].fd = query->conn->sock;
+                pfds[npfds].events = (MULTI_CONNECT == query->state ? POLLOUT :
+                        haproxy_exchange_events(&query->exchange));
+                pfds[npfds].revents = 0;
+                polled[npfds++] = i;
+            }
+
+            if (0 != query->deadline)
+            {
+                ms = (int)((query->deadline - now) * 1000) + 1;
+
+                if (-1 == timeout_ms || ms < timeout_ms)
+                    timeout_ms = ms;
+            }
+        }
+
+        /* the pipe of the lookups comes last */
+        if (0 != resolve_polled)
+        {
+            pfds[npfds].fd = haproxy_resolve_fd(resolving);
+            pfds[npfds].events = POLLIN;
+            pfds[npfds].revents = 0;
+        }
+
+        if (0 == npfds + resolve_polled)
+            break;
+
+        if (-1 == poll(pfds, npfds + resolve_polled, timeout_ms))
+        {
+            if (EINTR == errno)
+                continue;
+
+            zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - poll() failed: %s (%s:%d)",
+                       MODULE_NAME, __function_name, zbx_strerror(errno), __FILE__, __LINE__);
+
+            for (i = 0; i < n; i++)
+            {
+                if (MULTI_DONE != queries[i].state)
+                    multi_done(&queries[i], SYSINFO_RET_FAIL);
+            }
+
+            break;
+        }
+
+        for (i = 0; i < npfds; i++)
+        {
+            if (0 != pfds[i].revents)
+                multi_step(&queries[polled[i]]);
+        }
+
+        if (0 != resolve_polled && 0 != pfds[npfds].revents)
+        {
+            haproxy_resolve_clear(resolving);
+
+            for (i = 0; i < n; i++)
+            {
+                if (MULTI_RESOLVE == queries[i].state && SUCCEED != haproxy_resolve_pending(resolving, i))
+                    multi_start(&queries[i]);
+            }
+        }
+    }
+
+    haproxy_resolve_release(resolving);
+
+    for (i = 0; i < n; i++)
+        zbx_free(queries[i].text);
+
+    zbx_free(endpoints);
+    zbx_free(polled);
+    zbx_free(pfds);
+    zbx_free(queries);
+}
+
+/******************************************************************************
+******************************************************************************/
+void haproxy_conn_destroy(void)
+{
+    int i;
+
+    pthread_mutex_lock(&conn_lock);
+
+    for (i = 0; i < conns_num; i++)
+    {
+        conn_close(conns[i]);
+        zbx_free(conns[i]);
+    }
+
+    zbx_free(conns);
+    conns_num = 0;
+    conns_alloc = 0;
+
+    pthread_mutex_unlock(&conn_lock);
+}
@@ -0,0 +1,235 @@
+#include "haproxy.h"
+
+/*
+    CSV splitting for show stat. Separators are searched for a block of 32
+    (AVX2) or 16 (SSE2) bytes at a time: the block is compared against ','
+    and '\n' and the comparison masks are walked bit by bit, so the cost is
+    per field rather than per byte. Other targets use the scalar loop, which
+    also handles the tail shorter than a block.
+
+    The scalar loop alone is also built as haproxy_csv_line_scalar() and
+    haproxy_csv_skip_scalar(), which parsebench -v checks the block loop
+    against.
+*/
+
+#if defined(__AVX2__)
+#    include <immintrin.h>
+#    define CSV_BLOCK    32
+#elif defined(__SSE2__)
+#    include <emmintrin.h>
+#    define CSV_BLOCK    16
+#endif
+
+#ifdef CSV_BLOCK
+/******************************************************************************
+* Bit i of the masks is set if p[i] is a comma / a newline.                  *
+******************************************************************************/
+static void csv_block_masks(const char *p, zbx_uint32_t *commas, zbx_uint32_t *newlines)
+{
+#if defined(__AVX2__)
+    __m256i block = _mm256_loadu_si256((const __m256i *)p);
+
+    *commas = (zbx_uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(',')));
+    *newlines = (zbx_uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n')));
+#else
+    __m128i block = _mm_loadu_si128((const __m128i *)p);
+
+    *commas = (zbx_uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(',')));
+    *newlines = (zbx_uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('\n')));
+#endif
+}
+#endif
+
+/******************************************************************************
+* Splits the line starting at data into fields, the fields point into the    *
+* data and are not terminated. Splitting stops after max_fields fields, the  *
+* rest of the line is skipped. Blocks are searched unless blocks is 0.       *
+*                                                                            *
+* Return value: the beginning of the next line                               *
+******************************************************************************/
+static inline const char *csv_line(const char *data, const char *end, haproxy_field_t *fields, int max_fields,
+                                   int *nfields, int blocks)
+{
+    const char *field = data, *p = data;
+    int n = 0;
+#ifdef CSV_BLOCK
+    const char *sep;
+    zbx_uint32_t commas, newlines;
+#else
+    ZBX_UNUSED(blocks);
+#endif
+
+    while (p < end)
+    {
+#ifdef CSV_BLOCK
+        if (0 != blocks && n < max_fields && p + CSV_BLOCK <= end)
+        {
+            csv_block_masks(p, &commas, &newlines);
+
+            /* only the commas before the end of the line */
+            if (0 != newlines)
+                commas &= (newlines & (~newlines + 1)) - 1;
+
+            for (; 0 != commas && n < max_fields; commas &= commas - 1)
+            {
+                sep = p + __builtin_ctz(commas);
+                fields[n].ptr = field;
+                fields[n].len = (size_t)(sep - field);
+                n++;
+                field = sep + 1;
+            }
+
+            if (n == max_fields)
+                p = field;
+            else if (0 != newlines)
+            {
+                p += __builtin_ctz(newlines);
+                break;
+            }
+            else
+                p += CSV_BLOCK;
+
+            continue;
+        }
+#endif
+        if (n == max_fields)
+        {
+            if (NULL == (p = (const char *)memchr(p, '\n', (size_t)(end - p))))
+                p = end;
+
+            field = p;
+            break;
+        }
+
+        if ('\n' == *p)
+            break;
+
+        if (',' == *p)
+        {
+            fields[n].ptr = field;
+            fields[n].len = (size_t)(p - field);
+            n++;
+            field = p + 1;
+        }
+
+        p++;
+    }
+
+    /* every line ends with a comma, the last field is empty */
+    if (p != field && n < max_fields)
+    {
+        fields[n].ptr = field;
+        fields[n].len = (size_t)(p - field);
+        n++;
+    }
+
+    *nfields = n;
+
+    return p < end ? p + 1 : end;
+}
+
+/******************************************************************************
+* Return value: the beginning of the field after n commas or NULL if there   *
+*               are less than n commas before end                            *
+******************************************************************************/
+static inline const char *csv_skip(const char *p, const char *end, int n, int blocks)
+{
+#ifdef CSV_BLOCK
+    zbx_uint32_t commas, newlines;
+    int count;
+
+    while (0 != blocks && 0 != n && p + CSV_BLOCK <= end)
+    {
+        csv_block_masks(p, &commas, &newlines);
+
+        if ((count = __builtin_popcount(commas)) < n)
+        {
+            n -= count;
+            p += CSV_BLOCK;
+            continue;
+        }
+
+        while (0 != --n)
+            commas &= commas - 1;
+
+        return p + __builtin_ctz(commas) + 1;
+    }
+#else
+    ZBX_UNUSED(blocks);
+#endif
+    while (0 != n)
+    {
+        if (NULL == (p = (const char *)memchr(p, ',', (size_t)(end - p))))
+            return NULL;
+
+        p++;
+        n--;
+    }
+
+    return p;
+}
+
+/******************************************************************************
+* See csv_line()                                                             *
+******************************************************************************/
+const char *haproxy_csv_line(const char *data, const char *end, haproxy_field_t *fields, int max_fields,
+                             int *nfields)
+{
+    return csv_line(data, end, fields, max_fields, nfields, 1);
+}
+
+/******************************************************************************
+* See csv_skip()                                                             *
+******************************************************************************/
+const char *haproxy_csv_skip(const char *p, const char *end, int n)
+{
+    return csv_skip(p, end, n, 1);
+}
+
+/******************************************************************************
+* The scalar loop only, for the checks                                       *
+******************************************************************************/
+const char *haproxy_csv_line_scalar(const char *data, const char *end, haproxy_field_t *fields, int max_fields,
+                                    int *nfields)
+{
+    return csv_line(data, end, fields, max_fields, nfields, 0);
+}
+
+/******************************************************************************
+* The scalar loop only, for the checks                                       *
+******************************************************************************/
+const char *haproxy_csv_skip_scalar(const char *p, const char *end, int n)
+{
+    return csv_skip(p, end, n, 0);
+}
+
+/******************************************************************************
+* Parses the header line into fields, the leading "# " is skipped.           *
+*                                                                            *
+* Return value: the beginning of the first row or NULL if there is no header *
+******************************************************************************/
+const char *haproxy_csv_header(const char *data, const char *end, haproxy_field_t *fields, int max_fields,
+                               int *nfields)
+{
+    if (end - data < 2 || '#' != data[0] || ' ' != data[1])
+        return NULL;
+
+    return haproxy_csv_line(data + 2, end, fields, max_fields, nfields);
+}
+
+/******************************************************************************
+* Return value: index of the named column or -1 if there is no such column   *
+******************************************************************************/
+int haproxy_csv_column(const haproxy_field_t *fields, int nfields, const char *name)
+{
+    size_t len = strlen(name);
+    int i;
+
+    for (i = 0; i < nfields; i++)
+    {
+        if (fields[i].len == len && 0 == memcmp(fields[i].ptr, name, len))
+            return i;
+    }
+
+    return -1;
+}
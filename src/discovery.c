@@ -0,0 +1,86 @@
+#include "haproxy.h"
+
+/*
+    Low-level discovery of frontends, backends and servers from show stat:
+    {"data":[{"{#PXNAME}":"http-in","{#SVNAME}":"FRONTEND","{#IID}":"2","{#SID}":"0","{#TYPE}":"frontend"},...]}
+*/
+
+static const char *type_names[] = {"frontend", "backend", "server", "listener"};
+
+/******************************************************************************
+* Copies the field into the scratch buffer to terminate it, the buffer is    *
+* reused for all fields.                                                     *
+******************************************************************************/
+static const char *field_to_str(const haproxy_field_t *field, char **buf, size_t *buf_alloc)
+{
+    size_t buf_offset = 0;
+
+    zbx_strncpy_alloc(buf, buf_alloc, &buf_offset, field->ptr, field->len);
+
+    return *buf;
+}
+
+/******************************************************************************
+* Adds an LLD row for every show stat line of the given type (see            *
+* HAPROXY_TYPE_*). The CSV is parsed in a single pass, only the fields used  *
+* in macros are copied (to terminate them).                                  *
+******************************************************************************/
+int haproxy_stat_discovery(const char *data, size_t len, int type, struct zbx_json *j)
+{
+    const char *__function_name = "haproxy_stat_discovery";
+    const char *end = data + len, *p;
+    haproxy_field_t fields[HAPROXY_CSV_MAX_FIELDS];
+    int nfields, max_fields, col_pxname, col_svname, col_iid, col_sid, col_type;
+    char *buf = NULL;
+    size_t buf_alloc = 0;
+
+    if (NULL == (p = haproxy_csv_header(data, end, fields, HAPROXY_CSV_MAX_FIELDS, &nfields)))
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - show stat header not found (%s:%d)",
+                   MODULE_NAME, __function_name, __FILE__, __LINE__);
+        return SYSINFO_RET_FAIL;
+    }
+
+    col_pxname = haproxy_csv_column(fields, nfields, "pxname");
+    col_svname = haproxy_csv_column(fields, nfields, "svname");
+    col_iid = haproxy_csv_column(fields, nfields, "iid");
+    col_sid = haproxy_csv_column(fields, nfields, "sid");
+    col_type = haproxy_csv_column(fields, nfields, "type");
+
+    if (-1 == col_pxname || -1 == col_svname || -1 == col_iid || -1 == col_sid || -1 == col_type)
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - unexpected show stat header (%s:%d)",
+                   MODULE_NAME, __function_name, __FILE__, __LINE__);
+        return SYSINFO_RET_FAIL;
+    }
+
+    /* the rest of a line is not split */
+    max_fields = MAX(MAX(MAX(col_pxname, col_svname), MAX(col_iid, col_sid)), col_type) + 1;
+
+    zbx_json_addarray(j, ZBX_PROTO_TAG_DATA);
+
+    while (p < end)
+    {
+        p = haproxy_csv_line(p, end, fields, max_fields, &nfields);
+
+        if (nfields <= col_type || 1 != fields[col_type].len || type != fields[col_type].ptr[0] - '0')
+            continue;
+
+        zbx_json_addobject(j, NULL);
+        zbx_json_addstring(j, "{#PXNAME}", field_to_str(&fields[col_pxname], &buf, &buf_alloc),
+                           ZBX_JSON_TYPE_STRING);
+        zbx_json_addstring(j, "{#SVNAME}", field_to_str(&fields[col_svname], &buf, &buf_alloc),
+                           ZBX_JSON_TYPE_STRING);
+        zbx_json_addstring(j, "{#IID}", field_to_str(&fields[col_iid], &buf, &buf_alloc),
+                           ZBX_JSON_TYPE_STRING);
+        zbx_json_addstring(j, "{#SID}", field_to_str(&fields[col_sid], &buf, &buf_alloc),
+                           ZBX_JSON_TYPE_STRING);
+        zbx_json_addstring(j, "{#TYPE}", type_names[type], ZBX_JSON_TYPE_STRING);
+        zbx_json_close(j);
+    }
+
+    zbx_json_close(j);
+    zbx_free(buf);
+
+    return SYSINFO_RET_OK;
+}
@@ -0,0 +1,153 @@
+#include "haproxy.h"
+
+/*
+    Lookup of field names (show stat columns, show info lines) in the static
+    tables of fields known to the module. The tables are kept in HAProxy's
+    order, so an alphabetical index is sorted once and binary searched.
+*/
+
+/******************************************************************************
+******************************************************************************/
+static int names_compare(const char *name, size_t len, const char *known)
+{
+    int cmp;
+
+    if (0 != (cmp = strncmp(known, name, len)))
+        return cmp;
+
+    return '\0' != known[len];
+}
+
+/******************************************************************************
+* Sorts the index of the table, insertion sort is fine for a hundred names   *
+* sorted once.                                                               *
+******************************************************************************/
+void haproxy_names_init(haproxy_names_t *names, const char **list, int count)
+{
+    int i, j, id;
+
+    names->list = list;
+    names->count = count;
+    names->sorted = (int *)zbx_malloc(NULL, count * sizeof(int));
+
+    for (i = 0; i < count; i++)
+    {
+        id = i;
+
+        for (j = i; 0 < j && 0 < strcmp(list[names->sorted[j - 1]], list[id]); j--)
+            names->sorted[j] = names->sorted[j - 1];
+
+        names->sorted[j] = id;
+    }
+}
+
+/******************************************************************************
+* Return value: id (index in the table) of the name or -1 if it is unknown   *
+******************************************************************************/
+int haproxy_names_find(const haproxy_names_t *names, const char *name, size_t len)
+{
+    int lo = 0, hi = names->count - 1, mid, cmp;
+
+    while (lo <= hi)
+    {
+        mid = (lo + hi) / 2;
+
+        if (0 == (cmp = names_compare(name, len, names->list[names->sorted[mid]])))
+            return names->sorted[mid];
+
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return -1;
+}
+
+/******************************************************************************
+* The integer of a double beyond the signed range, the nearest limit         *
+******************************************************************************/
+static void value_saturate(haproxy_value_t *value, int negative)
+{
+    value->i64 = (zbx_int64_t)(ZBX_MAX_UINT64 >> 1);
+
+    if (0 != negative)
+        value->i64 = -value->i64 - 1;
+}
+
+/******************************************************************************
+* Parses a value as received from HAProxy: integers and decimal fractions    *
+* are converted, anything else is kept as text only.                         *
+******************************************************************************/
+void haproxy_value_parse(const char *ptr, size_t len, haproxy_value_t *value)
+{
+    const char *p = ptr, *end = ptr + len;
+    zbx_uint64_t ui64 = 0;
+    double fraction = 0, scale = 1;
+    int negative = 0, digits = 0;
+
+    value->text.ptr = ptr;
+    value->text.len = len;
+    value->type = HAPROXY_VALUE_STR;
+
+    if (p < end && '-' == *p)
+    {
+        negative = 1;
+        p++;
+    }
+
+    for (; p < end && '0' <= *p && '9' >= *p; p++, digits++)
+    {
+        /* beyond the 20 digits of the unsigned range, kept as text */
+        if (ui64 > (ZBX_MAX_UINT64 - (zbx_uint64_t)(*p - '0')) / 10)
+            return;
+
+        ui64 = ui64 * 10 + (zbx_uint64_t)(*p - '0');
+    }
+
+    if (0 == digits)
+        return;
+
+    /* the values beyond the signed range are kept as doubles */
+    if (p == end && ui64 > (ZBX_MAX_UINT64 >> 1) + (zbx_uint64_t)negative)
+    {
+        value->type = HAPROXY_VALUE_DBL;
+        value->dbl = (double)ui64;
+
+        if (0 != negative)
+            value->dbl = -value->dbl;
+
+        value_saturate(value, negative);
+
+        return;
+    }
+
+    if (p == end)
+    {
+        value->type = HAPROXY_VALUE_INT;
+        value->i64 = (zbx_int64_t)(0 != negative ? 0 - ui64 : ui64);
+        value->dbl = (double)value->i64;
+        return;
+    }
+
+    if ('.' != *p++ || p == end)
+        return;
+
+    for (; p < end && '0' <= *p && '9' >= *p; p++)
+        fraction += (double)(*p - '0') * (scale /= 10);
+
+    if (p != end)
+        return;
+
+    value->type = HAPROXY_VALUE_DBL;
+    value->dbl = (double)ui64 + fraction;
+
+    if (0 != negative)
+        value->dbl = -value->dbl;
+
+    /* the signed limit rounds to 2^63 as a double */
+    if (value->dbl >= (double)(ZBX_MAX_UINT64 >> 1) || value->dbl < -(double)(ZBX_MAX_UINT64 >> 1))
+        value_saturate(value, negative);
+    else
+        value->i64 = (zbx_int64_t)value->dbl;
+}
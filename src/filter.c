@@ -0,0 +1,416 @@
+#include "haproxy.h"
+
+/*
+    show stat <iid> <type> <sid> - HAProxy dumps the rows of one proxy (iid)
+    or one server (sid) only, type is a mask: 1 - frontend, 2 - backend,
+    4 - servers, 8 - listeners, -1 - any.
+    https://cbonte.github.io/haproxy-dconv/1.9/management.html#9.3-show%20stat
+
+    The ids of the names are taken from a full show stat response, kept per
+    endpoint as a small "pxname,svname,iid,sid,type" CSV (the response itself
+    is dropped) and looked up by the names as they are: the map lives as long
+    as the endpoint is checked, its names are not interned (see symbol.c) so
+    that names gone from the configuration can be dropped. The ids change
+    when proxies or servers are added or removed
+    and HAProxy is reloaded, so the map is fetched again when a name is not
+    in it or a filtered response does not have the row asked for, but not
+    more often than once in min_age seconds (CacheTTL, at least 1).
+*/
+
+typedef struct
+{
+    haproxy_field_t pxname;
+    haproxy_field_t svname;
+    haproxy_field_t iid;
+    haproxy_field_t sid;
+    haproxy_field_t type;
+    zbx_uint32_t    hash;
+}
+filter_row_t;
+
+typedef struct
+{
+    haproxy_endpoint_t  endpoint;
+    char                *data;          /* pxname,svname,iid,sid,type, NULL - not fetched yet */
+    filter_row_t        *rows;          /* point into data */
+    int                 nrows;
+    int                 *buckets;       /* (pxname, svname) hash -> row index + 1 */
+    zbx_uint32_t        buckets_mask;
+    haproxy_arena_t     *arena;         /* of the rows, reused by the next map */
+    double              time;           /* when it was fetched */
+}
+filter_ids_t;
+
+static filter_ids_t **ids = NULL;
+static int ids_num = 0;
+static int ids_alloc = 0;
+static int min_age = 1;
+
+static pthread_mutex_t ids_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const int filter_fields[] = {HAPROXY_STAT_IID, HAPROXY_STAT_SID, HAPROXY_STAT_TYPE};
+
+/******************************************************************************
+******************************************************************************/
+void haproxy_filter_init(int ttl)
+{
+    min_age = MAX(ttl, 1);
+}
+
+/******************************************************************************
+* Builds the map of a full show stat response.                               *
+*                                                                            *
+* Return value: the map data or NULL if the response has no ids              *
+******************************************************************************/
+static char *filter_map(const char *data, size_t len)
+{
+    haproxy_arena_t *arena;
+    haproxy_stat_t *stat;
+    const haproxy_stat_row_t *row;
+    haproxy_field_t value;
+    char *map = NULL;
+    size_t map_alloc = 0, map_offset = 0;
+    int i, f;
+
+    arena = haproxy_arena_create(len / 4);
+
+    if (NULL == (stat = haproxy_stat_parse(data, len, arena)))
+    {
+        haproxy_arena_destroy(arena);
+        return NULL;
+    }
+
+    for (f = 0; f < (int)ARRSIZE(filter_fields); f++)
+    {
+        if (-1 == stat->column[filter_fields[f]])
+        {
+            haproxy_arena_destroy(arena);
+            return NULL;
+        }
+    }
+
+    zbx_strcpy_alloc(&map, &map_alloc, &map_offset, "# pxname,svname,iid,sid,type\n");
+
+    for (i = 0; i < stat->nrows; i++)
+    {
+        row = &stat->rows[i];
+
+        zbx_strncpy_alloc(&map, &map_alloc, &map_offset, row->pxname.ptr, row->pxname.len);
+        zbx_chrcpy_alloc(&map, &map_alloc, &map_offset, ',');
+        zbx_strncpy_alloc(&map, &map_alloc, &map_offset, row->svname.ptr, row->svname.len);
+
+        for (f = 0; f < (int)ARRSIZE(filter_fields); f++)
+        {
+            zbx_chrcpy_alloc(&map, &map_alloc, &map_offset, ',');
+
+            if (SUCCEED == haproxy_stat_value(row, stat->column[filter_fields[f]], &value))
+                zbx_strncpy_alloc(&map, &map_alloc, &map_offset, value.ptr, value.len);
+        }
+
+        zbx_chrcpy_alloc(&map, &map_alloc, &map_offset, '\n');
+    }
+
+    haproxy_arena_destroy(arena);
+
+    return map;
+}
+
+/******************************************************************************
+* FNV-1a of the names, a proxy and a server name are set apart by a '\0'     *
+******************************************************************************/
+static zbx_uint32_t filter_hash(const char *pxname, size_t pxname_len, const char *svname, size_t svname_len)
+{
+    zbx_uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < pxname_len; i++)
+        hash = (hash ^ (unsigned char)pxname[i]) * 16777619u;
+
+    hash *= 16777619u;
+
+    for (i = 0; i < svname_len; i++)
+        hash = (hash ^ (unsigned char)svname[i]) * 16777619u;
+
+    return hash;
+}
+
+/******************************************************************************
+* Splits the map of the entry into rows and hashes them by the names, open   *
+* addressing as in stat.c.                                                   *
+******************************************************************************/
+static void filter_index(filter_ids_t *entry)
+{
+    haproxy_field_t fields[5];
+    filter_row_t *row;
+    const char *line, *end = entry->data + strlen(entry->data);
+    int nfields, rows_alloc = 0, alloc, i;
+    zbx_uint32_t slot;
+
+    entry->rows = NULL;
+    entry->nrows = 0;
+
+    if (NULL == (line = haproxy_csv_header(entry->data, end, fields, (int)ARRSIZE(fields), &nfields)))
+        line = end;
+
+    while (line < end)
+    {
+        line = haproxy_csv_line(line, end, fields, (int)ARRSIZE(fields), &nfields);
+
+        if ((int)ARRSIZE(fields) != nfields)
+            continue;
+
+        if (entry->nrows == rows_alloc)
+        {
+            alloc = (0 == rows_alloc ? 64 : rows_alloc * 2);
+            entry->rows = (filter_row_t *)haproxy_arena_realloc(entry->arena, entry->rows,
+                                                                rows_alloc * sizeof(filter_row_t),
+                                                                alloc * sizeof(filter_row_t));
+            rows_alloc = alloc;
+        }
+
+        row = &entry->rows[entry->nrows++];
+        row->pxname = fields[0];
+        row->svname = fields[1];
+        row->iid = fields[2];
+        row->sid = fields[3];
+        row->type = fields[4];
+        row->hash = filter_hash(row->pxname.ptr, row->pxname.len, row->svname.ptr, row->svname.len);
+    }
+
+    entry->buckets_mask = 15;
+    while (entry->buckets_mask < (zbx_uint32_t)entry->nrows * 2)
+        entry->buckets_mask = entry->buckets_mask * 2 + 1;
+
+    entry->buckets = (int *)haproxy_arena_alloc(entry->arena, (entry->buckets_mask + 1) * sizeof(int));
+    memset(entry->buckets, 0, (entry->buckets_mask + 1) * sizeof(int));
+
+    for (i = 0; i < entry->nrows; i++)
+    {
+        for (slot = entry->rows[i].hash & entry->buckets_mask; 0 != entry->buckets[slot];
+                slot = (slot + 1) & entry->buckets_mask)
+        {
+            ;
+        }
+
+        entry->buckets[slot] = i + 1;
+    }
+}
+
+/******************************************************************************
+* Return value: the row of the proxy/server or NULL if there is no such row  *
+******************************************************************************/
+static const filter_row_t *filter_find(const filter_ids_t *entry, const char *pxname, const char *svname)
+{
+    const filter_row_t *row;
+    size_t pxname_len = strlen(pxname), svname_len = strlen(svname);
+    zbx_uint32_t hash, slot;
+
+    hash = filter_hash(pxname, pxname_len, svname, svname_len);
+
+    for (slot = hash & entry->buckets_mask; 0 != entry->buckets[slot]; slot = (slot + 1) & entry->buckets_mask)
+    {
+        row = &entry->rows[entry->buckets[slot] - 1];
+
+        if (row->hash == hash && row->pxname.len == pxname_len && row->svname.len == svname_len &&
+                0 == memcmp(row->pxname.ptr, pxname, pxname_len) && 0 == memcmp(row->svname.ptr, svname, svname_len))
+        {
+            return row;
+        }
+    }
+
+    return NULL;
+}
+
+/******************************************************************************
+* Fetches the map of the endpoint, the lock is released meanwhile.           *
+*                                                                            *
+* Return value: SYSINFO_RET_OK, SYSINFO_RET_FAIL or HAPROXY_RET_TIMEOUT      *
+******************************************************************************/
+static int filter_fetch(filter_ids_t *entry)
+{
+    const char *__function_name = "filter_fetch";
+    haproxy_endpoint_t endpoint = entry->endpoint;
+    char *data = NULL, *map;
+    size_t len;
+    double now;
+    int ret;
+
+    pthread_mutex_unlock(&ids_lock);
+
+    now = zbx_time();
+    ret = haproxy_fetch(&endpoint, "show stat", 0, &data, &len);
+    map = (SYSINFO_RET_OK == ret ? filter_map(data, len) : NULL);
+    zbx_free(data);
+
+    pthread_mutex_lock(&ids_lock);
+
+    if (SYSINFO_RET_OK != ret)
+        return ret;
+
+    if (NULL == map)
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - no iid/sid in show stat of %s (%s:%d)",
+                   MODULE_NAME, __function_name, endpoint.address, __FILE__, __LINE__);
+        return SYSINFO_RET_FAIL;
+    }
+
+    /* a concurrent fetch has completed first */
+    if (entry->time > now)
+    {
+        zbx_free(map);
+        return SYSINFO_RET_OK;
+    }
+
+    if (NULL == entry->arena)
+        entry->arena = haproxy_arena_create(0);
+    else
+        haproxy_arena_reset(entry->arena);
+
+    zbx_free(entry->data);
+    entry->data = map;
+    filter_index(entry);
+    entry->time = now;
+
+    return SYSINFO_RET_OK;
+}
+
+/******************************************************************************
+******************************************************************************/
+static filter_ids_t *filter_entry(const haproxy_endpoint_t *endpoint)
+{
+    filter_ids_t *entry;
+    int i;
+
+    for (i = 0; i < ids_num; i++)
+    {
+        if (haproxy_endpoint_equal(&ids[i]->endpoint, endpoint))
+            return ids[i];
+    }
+
+    if (ids_num == ids_alloc)
+    {
+        ids_alloc = (0 == ids_alloc ? 8 : ids_alloc * 2);
+        ids = (filter_ids_t **)zbx_realloc(ids, ids_alloc * sizeof(filter_ids_t *));
+    }
+
+    entry = (filter_ids_t *)zbx_malloc(NULL, sizeof(filter_ids_t));
+    memset(entry, 0, sizeof(filter_ids_t));
+    entry->endpoint = *endpoint;
+    ids[ids_num++] = entry;
+
+    return entry;
+}
+
+/******************************************************************************
+* Return value: the row of the server or, with an empty svname, the backend  *
+*               (or the frontend) of the proxy; NULL if there is no such row *
+******************************************************************************/
+const haproxy_stat_row_t *haproxy_stat_filter_row(const haproxy_stat_t *stat, const char *pxname,
+                                                  const char *svname)
+{
+    const haproxy_stat_row_t *row;
+
+    if ('\0' != *svname)
+        return haproxy_stat_find(stat, pxname, svname);
+
+    if (NULL == (row = haproxy_stat_find(stat, pxname, "BACKEND")))
+        row = haproxy_stat_find(stat, pxname, "FRONTEND");
+
+    return row;
+}
+
+/******************************************************************************
+* Return value: the filtered command of the row or NULL                      *
+******************************************************************************/
+static char *filter_lookup(const filter_ids_t *entry, const char *pxname, const char *svname)
+{
+    const filter_row_t *row;
+
+    if (NULL == entry->data)
+        return NULL;
+
+    /* the backend or else the frontend of a proxy, see haproxy_stat_filter_row() */
+    if ('\0' != *svname)
+        row = filter_find(entry, pxname, svname);
+    else if (NULL == (row = filter_find(entry, pxname, "BACKEND")))
+        row = filter_find(entry, pxname, "FRONTEND");
+
+    if (NULL == row || 0 == row->iid.len || 0 == row->sid.len || 1 != row->type.len || '0' > row->type.ptr[0] ||
+            '3' < row->type.ptr[0])
+    {
+        return NULL;
+    }
+
+    if ('\0' == *svname)
+        return zbx_dsprintf(NULL, "show stat %.*s -1 -1", (int)row->iid.len, row->iid.ptr);
+
+    return zbx_dsprintf(NULL, "show stat %.*s %d %.*s", (int)row->iid.len, row->iid.ptr,
+                        1 << (row->type.ptr[0] - '0'), (int)row->sid.len, row->sid.ptr);
+}
+
+/******************************************************************************
+* Gets the filtered show stat command of a proxy (empty svname) or a server. *
+* The map of the ids is fetched the first time and again if the name is not *
+* in it or stale is set (a filtered response has no such row), unless it is  *
+* fresher than min_age seconds.                                              *
+*                                                                            *
+* Return value: SYSINFO_RET_OK, SYSINFO_RET_FAIL (error set if the name is   *
+*               unknown) or HAPROXY_RET_TIMEOUT                              *
+******************************************************************************/
+int haproxy_stat_filter(const haproxy_endpoint_t *endpoint, const char *pxname, const char *svname, int stale,
+                        char **cmd, char **error)
+{
+    filter_ids_t *entry;
+    int ret = SYSINFO_RET_OK;
+
+    pthread_mutex_lock(&ids_lock);
+
+    entry = filter_entry(endpoint);
+
+    if (NULL == entry->data || (0 != stale && entry->time + min_age <= zbx_time()))
+        ret = filter_fetch(entry);
+
+    if (SYSINFO_RET_OK == ret && NULL == (*cmd = filter_lookup(entry, pxname, svname)) &&
+            0 == stale && entry->time + min_age <= zbx_time() && SYSINFO_RET_OK == (ret = filter_fetch(entry)))
+    {
+        *cmd = filter_lookup(entry, pxname, svname);
+    }
+
+    if (SYSINFO_RET_OK == ret && NULL == *cmd)
+    {
+        if ('\0' == *svname)
+            *error = zbx_dsprintf(*error, "Cannot find proxy \"%s\"", pxname);
+        else
+            *error = zbx_dsprintf(*error, "Cannot find \"%s/%s\"", pxname, svname);
+
+        ret = SYSINFO_RET_FAIL;
+    }
+
+    pthread_mutex_unlock(&ids_lock);
+
+    return ret;
+}
+
+/******************************************************************************
+******************************************************************************/
+void haproxy_filter_destroy(void)
+{
+    int i;
+
+    pthread_mutex_lock(&ids_lock);
+
+    for (i = 0; i < ids_num; i++)
+    {
+        if (NULL != ids[i]->arena)
+            haproxy_arena_destroy(ids[i]->arena);
+
+        zbx_free(ids[i]->data);
+        zbx_free(ids[i]);
+    }
+
+    zbx_free(ids);
+    ids_num = 0;
+    ids_alloc = 0;
+
+    pthread_mutex_unlock(&ids_lock);
+}
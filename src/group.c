@@ -0,0 +1,443 @@
+#include "haproxy.h"
+
+/*
+    HAProxy running with nbproc or in master-worker mode keeps statistics per
+    process: on a stats socket bound to each process ("stats socket ...
+    process N") or behind the master CLI, which passes a command prefixed
+    with @N on to worker N. An endpoint with a range of processes (see
+    haproxy_endpoint_parse) is queried at all of them at once, a thread per
+    process, so a request takes as long as the slowest process rather than
+    all of them together.
+
+    The responses are merged into a response of the same format, so a group
+    is cached, parsed and rated the same as a single process:
+    show stat - the rows of all processes, the values of a row merged by the
+                nature of the field (counters summed, maxima the highest, ...)
+    show info - the same line by line
+    Other commands are not merged. The values of one process are available
+    with @N as usual.
+*/
+
+typedef struct
+{
+    haproxy_endpoint_t  endpoint;
+    const char          *cmd;
+    size_t              size_hint;
+    int                 ret;
+    char                *data;
+    size_t              len;
+}
+group_request_t;
+
+/******************************************************************************
+* Gets the endpoint of one process of the group: the socket of the process   *
+* or the master CLI with commands prefixed with @<process>.                  *
+******************************************************************************/
+int haproxy_endpoint_member(const haproxy_endpoint_t *group, int process, haproxy_endpoint_t *member)
+{
+    const char *star;
+    char *address;
+    int ret;
+
+    if (NULL == (star = strchr(group->address, '*')))
+    {
+        *member = *group;
+        member->process = process;
+        member->procs_first = 0;
+        member->procs_last = 0;
+
+        return SYSINFO_RET_OK;
+    }
+
+    address = zbx_dsprintf(NULL, "%.*s%d%s", (int)(star - group->address), group->address, process, star + 1);
+    ret = haproxy_endpoint_parse(address, member);
+    zbx_free(address);
+
+    return ret;
+}
+
+/******************************************************************************
+******************************************************************************/
+static void *group_query(void *arg)
+{
+    group_request_t *request = (group_request_t *)arg;
+
+    request->ret = haproxy_query(&request->endpoint, request->cmd, request->size_hint, &request->data,
+                                 &request->len);
+
+    return NULL;
+}
+
+/******************************************************************************
+* Appends the values of a field in the responses of the processes merged by  *
+* the nature of the field. Empty values (no such row in the process) are     *
+* skipped, text is taken from the first process.                             *
+******************************************************************************/
+static void merge_values(int nature, const haproxy_field_t *values, int n, char **out, size_t *out_alloc,
+                         size_t *out_offset)
+{
+    const haproxy_field_t *first = NULL;
+    haproxy_value_t value;
+    zbx_int64_t i64 = 0;
+    double dbl = 0;
+    int i, count = 0, integer = 1;
+
+    for (i = 0; i < n; i++)
+    {
+        if (0 == values[i].len)
+            continue;
+
+        if (NULL == first)
+            first = &values[i];
+
+        if (HAPROXY_NATURE_OUTPUT == nature)
+            break;
+
+        haproxy_value_parse(values[i].ptr, values[i].len, &value);
+
+        if (HAPROXY_VALUE_STR == value.type)
+        {
+            nature = HAPROXY_NATURE_OUTPUT;
+            break;
+        }
+
+        if (HAPROXY_VALUE_DBL == value.type)
+            integer = 0;
+
+        if (0 == count++)
+        {
+            i64 = value.i64;
+            dbl = value.dbl;
+            continue;
+        }
+
+        switch (nature)
+        {
+            case HAPROXY_NATURE_MAX:
+            case HAPROXY_NATURE_DURATION:
+                i64 = MAX(i64, value.i64);
+                dbl = MAX(dbl, value.dbl);
+                break;
+            case HAPROXY_NATURE_AGE:
+                i64 = MIN(i64, value.i64);
+                dbl = MIN(dbl, value.dbl);
+                break;
+            default:
+                i64 += value.i64;
+                dbl += value.dbl;
+        }
+    }
+
+    if (NULL == first)
+        return;
+
+    if (HAPROXY_NATURE_OUTPUT == nature)
+        zbx_strncpy_alloc(out, out_alloc, out_offset, first->ptr, first->len);
+    else if (HAPROXY_NATURE_AVG == nature && 0 != integer)
+        zbx_snprintf_alloc(out, out_alloc, out_offset, ZBX_FS_I64, (zbx_int64_t)floor(dbl / count + 0.5));
+    else if (HAPROXY_NATURE_AVG == nature)
+        zbx_snprintf_alloc(out, out_alloc, out_offset, ZBX_FS_DBL, dbl / count);
+    else if (0 != integer)
+        zbx_snprintf_alloc(out, out_alloc, out_offset, ZBX_FS_I64, i64);
+    else
+        zbx_snprintf_alloc(out, out_alloc, out_offset, ZBX_FS_DBL, dbl);
+}
+
+/******************************************************************************
+* Merges show stat responses: the header of the first process, the rows in   *
+* the order they are first seen, a field of a row merged over the processes  *
+* having the row.                                                            *
+*                                                                            *
+* Return value: the merged response or NULL if a response is not show stat  *
+******************************************************************************/
+static char *stat_merge(const group_request_t *requests, int n, size_t *len)
+{
+    haproxy_stat_t *stats[HAPROXY_PROCS_MAX];
+    haproxy_field_t header[HAPROXY_CSV_MAX_FIELDS], values[HAPROXY_PROCS_MAX], *fields;
+    int ids[HAPROXY_CSV_MAX_FIELDS], nfields[HAPROXY_PROCS_MAX], *columns = NULL;
+    const haproxy_stat_row_t *row, *rows[HAPROXY_PROCS_MAX];
+    haproxy_arena_t *arena;
+    char *out = NULL;
+    size_t out_alloc = 0, out_offset = 0;
+    int i, j, k, r, c, ncolumns, nheader, id;
+
+    /* the indexes of all processes, released at once */
+    arena = haproxy_arena_create(n * requests[0].len / 4);
+
+    for (i = 0; i < n; i++)
+    {
+        if (NULL == (stats[i] = haproxy_stat_parse(requests[i].data, requests[i].len, arena)))
+            goto out;
+    }
+
+    haproxy_csv_line(stats[0]->header, stats[0]->header + stats[0]->header_len, header, HAPROXY_CSV_MAX_FIELDS,
+                     &ncolumns);
+
+    for (c = 0; c < ncolumns; c++)
+        ids[c] = -1;
+
+    for (id = 0; id < HAPROXY_STAT_FIELD_COUNT; id++)
+    {
+        if (-1 != stats[0]->column[id])
+            ids[stats[0]->column[id]] = id;
+    }
+
+    /* column of every field of the first process in each response */
+    columns = (int *)zbx_malloc(NULL, n * ncolumns * sizeof(int));
+    fields = (haproxy_field_t *)zbx_malloc(NULL, n * HAPROXY_CSV_MAX_FIELDS * sizeof(haproxy_field_t));
+
+    for (i = 0; i < n; i++)
+    {
+        haproxy_csv_line(stats[i]->header, stats[i]->header + stats[i]->header_len, fields,
+                         HAPROXY_CSV_MAX_FIELDS, &nheader);
+
+        for (c = 0; c < ncolumns; c++)
+        {
+            columns[i * ncolumns + c] = (-1 != ids[c] ? stats[i]->column[ids[c]] : -1);
+
+            if (-1 != ids[c])
+                continue;
+
+            /* a field this module does not know */
+            for (k = 0; k < nheader; k++)
+            {
+                if (fields[k].len == header[c].len && 0 == memcmp(fields[k].ptr, header[c].ptr, header[c].len))
+                {
+                    columns[i * ncolumns + c] = k;
+                    break;
+                }
+            }
+        }
+    }
+
+    zbx_strcpy_alloc(&out, &out_alloc, &out_offset, "# ");
+    zbx_strncpy_alloc(&out, &out_alloc, &out_offset, stats[0]->header, stats[0]->header_len);
+
+    for (i = 0; i < n; i++)
+    {
+        for (r = 0; r < stats[i]->nrows; r++)
+        {
+            row = &stats[i]->rows[r];
+
+            /* merged with the process it was first seen in */
+            for (j = 0; j < i && NULL == haproxy_stat_find_row(stats[j], row); j++)
+                ;
+
+            if (j != i)
+                continue;
+
+            for (j = 0; j < n; j++)
+            {
+                rows[j] = (j < i ? NULL : j == i ? row : haproxy_stat_find_row(stats[j], row));
+                nfields[j] = 0;
+
+                if (NULL != rows[j])
+                {
+                    haproxy_csv_line(rows[j]->line, rows[j]->line + rows[j]->len,
+                                     &fields[j * HAPROXY_CSV_MAX_FIELDS], HAPROXY_CSV_MAX_FIELDS, &nfields[j]);
+                }
+            }
+
+            for (c = 0; c < ncolumns; c++)
+            {
+                for (j = 0; j < n; j++)
+                {
+                    k = columns[j * ncolumns + c];
+
+                    if (-1 != k && k < nfields[j])
+                        values[j] = fields[j * HAPROXY_CSV_MAX_FIELDS + k];
+                    else
+                        values[j].len = 0;
+                }
+
+                merge_values(-1 != ids[c] ? haproxy_stat_field_nature(ids[c]) : HAPROXY_NATURE_OUTPUT, values,
+                             n, &out, &out_alloc, &out_offset);
+                zbx_chrcpy_alloc(&out, &out_alloc, &out_offset, ',');
+            }
+
+            zbx_chrcpy_alloc(&out, &out_alloc, &out_offset, '\n');
+        }
+    }
+
+    zbx_chrcpy_alloc(&out, &out_alloc, &out_offset, '\n');
+    *len = out_offset;
+
+    zbx_free(fields);
+out:
+    zbx_free(columns);
+    haproxy_arena_destroy(arena);
+
+    return out;
+}
+
+/******************************************************************************
+* Merges show info responses line by line, in the order of the first one.    *
+*                                                                            *
+* Return value: the merged response or NULL if a response is not show info  *
+******************************************************************************/
+static char *info_merge(const group_request_t *requests, int n, size_t *len)
+{
+    haproxy_info_t *infos[HAPROXY_PROCS_MAX];
+    const haproxy_info_line_t *line, *other;
+    haproxy_field_t values[HAPROXY_PROCS_MAX];
+    haproxy_arena_t *arena;
+    int *ids = NULL, i, j, k, l, id;
+    char *out = NULL;
+    size_t out_alloc = 0, out_offset = 0;
+
+    arena = haproxy_arena_create(0);
+
+    for (i = 0; i < n; i++)
+    {
+        if (NULL == (infos[i] = haproxy_info_parse(requests[i].data, requests[i].len, arena)))
+            goto out;
+    }
+
+    ids = (int *)zbx_malloc(NULL, infos[0]->nlines * sizeof(int));
+
+    for (l = 0; l < infos[0]->nlines; l++)
+        ids[l] = -1;
+
+    for (id = 0; id < HAPROXY_INFO_FIELD_COUNT; id++)
+    {
+        if (-1 != infos[0]->index[id])
+            ids[infos[0]->index[id]] = id;
+    }
+
+    for (l = 0; l < infos[0]->nlines; l++)
+    {
+        line = &infos[0]->lines[l];
+
+        for (j = 0; j < n; j++)
+        {
+            other = NULL;
+
+            if (-1 != ids[l] && -1 != infos[j]->index[ids[l]])
+                other = &infos[j]->lines[infos[j]->index[ids[l]]];
+
+            /* a field this module does not know */
+            for (k = 0; -1 == ids[l] && NULL == other && k < infos[j]->nlines; k++)
+            {
+                if (infos[j]->lines[k].name.len == line->name.len &&
+                        0 == memcmp(infos[j]->lines[k].name.ptr, line->name.ptr, line->name.len))
+                {
+                    other = &infos[j]->lines[k];
+                }
+            }
+
+            if (NULL != other)
+                values[j] = other->value.text;
+            else
+                values[j].len = 0;
+        }
+
+        zbx_strncpy_alloc(&out, &out_alloc, &out_offset, line->name.ptr, line->name.len);
+        zbx_strcpy_alloc(&out, &out_alloc, &out_offset, ": ");
+        merge_values(-1 != ids[l] ? haproxy_info_field_nature(ids[l]) : HAPROXY_NATURE_OUTPUT, values, n, &out,
+                     &out_alloc, &out_offset);
+        zbx_chrcpy_alloc(&out, &out_alloc, &out_offset, '\n');
+    }
+
+    zbx_chrcpy_alloc(&out, &out_alloc, &out_offset, '\n');
+    *len = out_offset;
+out:
+    zbx_free(ids);
+    haproxy_arena_destroy(arena);
+
+    return out;
+}
+
+/******************************************************************************
+* Sends the command to the endpoint. The command is sent to all processes of *
+* a group at once and the responses are merged.                              *
+*                                                                            *
+* Return value: SYSINFO_RET_OK, HAPROXY_RET_TIMEOUT or SYSINFO_RET_FAIL      *
+******************************************************************************/
+int haproxy_fetch(const haproxy_endpoint_t *endpoint, const char *cmd, size_t size_hint, char **data,
+                  size_t *len)
+{
+    const char *__function_name = "haproxy_fetch";
+    group_request_t requests[HAPROXY_PROCS_MAX];
+    pthread_t threads[HAPROXY_PROCS_MAX];
+    int started[HAPROXY_PROCS_MAX];
+    char *(*merge)(const group_request_t *, int, size_t *);
+    int i, n, ret = SYSINFO_RET_OK;
+
+    if (0 == endpoint->procs_first)
+        return haproxy_query(endpoint, cmd, size_hint, data, len);
+
+    /* filtered ("show stat <iid> <type> <sid>") as well */
+    if (0 == strcmp(cmd, "show stat") || (0 == strncmp(cmd, "show stat ", 10) &&
+            (('0' <= cmd[10] && '9' >= cmd[10]) || '-' == cmd[10])))
+    {
+        merge = stat_merge;
+    }
+    else if (0 == strcmp(cmd, "show info"))
+        merge = info_merge;
+    else
+    {
+        zabbix_log(LOG_LEVEL_DEBUG,
+                   "Module: %s, function: %s - \"%s\" cannot be merged over processes, use @<process> (%s:%d)",
+                   MODULE_NAME, __function_name, cmd, __FILE__, __LINE__);
+        return SYSINFO_RET_FAIL;
+    }
+
+    /* haproxy_endpoint_parse() makes sure of procs_first <= procs_last */
+    if (1 > (n = endpoint->procs_last - endpoint->procs_first + 1) || HAPROXY_PROCS_MAX < n)
+        return SYSINFO_RET_FAIL;
+
+    for (i = 0; i < n; i++)
+    {
+        memset(&requests[i], 0, sizeof(group_request_t));
+        requests[i].cmd = cmd;
+        requests[i].size_hint = size_hint;
+        requests[i].ret = haproxy_endpoint_member(endpoint, endpoint->procs_first + i, &requests[i].endpoint);
+    }
+
+    /* the first process is queried by the calling thread */
+    for (i = 1; i < n; i++)
+    {
+        if (SYSINFO_RET_OK == requests[i].ret)
+            started[i] = (0 == pthread_create(&threads[i], NULL, group_query, &requests[i]));
+        else
+            started[i] = 0;
+
+        if (0 == started[i] && SYSINFO_RET_OK == requests[i].ret)
+            group_query(&requests[i]);
+    }
+
+    if (SYSINFO_RET_OK == requests[0].ret)
+        group_query(&requests[0]);
+
+    for (i = 1; i < n; i++)
+    {
+        if (0 != started[i])
+            pthread_join(threads[i], NULL);
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (SYSINFO_RET_OK == requests[i].ret)
+            continue;
+
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - \"%s\" to process %d of %s failed (%s:%d)",
+                   MODULE_NAME, __function_name, cmd, endpoint->procs_first + i, endpoint->address,
+                   __FILE__, __LINE__);
+
+        /* a timeout is reported as such */
+        if (HAPROXY_RET_TIMEOUT != ret)
+            ret = requests[i].ret;
+    }
+
+    if (SYSINFO_RET_OK == ret && NULL == (*data = merge(requests, n, len)))
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - Cannot merge \"%s\" of %s (%s:%d)",
+                   MODULE_NAME, __function_name, cmd, endpoint->address, __FILE__, __LINE__);
+        ret = SYSINFO_RET_FAIL;
+    }
+
+    for (i = 0; i < n; i++)
+        zbx_free(requests[i].data);
+
+    return ret;
+}
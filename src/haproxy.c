@@ -1,15 +1,139 @@
 #include "haproxy.h"
 
 #define ERROR        -1
-#define COMMAND_LEN  40
+#define PROMPT       "> "
+#define PROMPT_LEN   2
+/* the master CLI (master-worker mode) has its own prompt */
+#define MASTER_PROMPT        "master> "
+#define MASTER_PROMPT_LEN    8
+
+/*
+    Sockets are non-blocking, every wait for HAProxy is a poll() bounded by
+    the deadline of the request (zbx_time() based, 0 - no deadline), so a
+    stuck HAProxy costs at most the item timeout.
+
+    Connecting (connect_start) and the exchange of commands and responses
+    (haproxy_exchange_run) stop where the socket would block, so a request
+    can wait for its own socket (send_commands) or share one poll() with the
+    requests to other endpoints (haproxy_query_multi in conn.c).
+*/
+
+/******************************************************************************
+* Waits until the socket is ready for the events or the deadline passes.     *
+*                                                                            *
+* Return value: SYSINFO_RET_OK - ready (or failed, the next call tells),     *
+*               HAPROXY_RET_TIMEOUT - the deadline has passed,               *
+*               SYSINFO_RET_FAIL - poll() failed                             *
+******************************************************************************/
+static int wait_socket(int sock, short events, double deadline)
+{
+    struct pollfd pfd;
+    int timeout_ms, ret;
+
+    pfd.fd = sock;
+    pfd.events = events;
+
+    while (1)
+    {
+        if (0 == deadline)
+            timeout_ms = -1;
+        else if (0 >= (timeout_ms = (int)((deadline - zbx_time()) * 1000)))
+            return HAPROXY_RET_TIMEOUT;
+
+        pfd.revents = 0;
+
+        if (0 < (ret = poll(&pfd, 1, timeout_ms)))
+            return SYSINFO_RET_OK;
+
+        if (0 == ret)
+            return HAPROXY_RET_TIMEOUT;
+
+        if (EINTR != errno)
+            return SYSINFO_RET_FAIL;
+    }
+}
+
+/******************************************************************************
+* Switches the socket to non-blocking mode and starts connecting it.         *
+*                                                                            *
+* Return value: SYSINFO_RET_OK, HAPROXY_RET_AGAIN - in progress, the socket  *
+*               becomes writable when it is over (see connect_finish()) or   *
+*               SYSINFO_RET_FAIL                                             *
+******************************************************************************/
+static int connect_begin(int sock, const struct sockaddr *addr, socklen_t addr_len)
+{
+    if (ERROR == fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK))
+        return SYSINFO_RET_FAIL;
+
+    if (0 == connect(sock, addr, addr_len))
+        return SYSINFO_RET_OK;
+
+    if (EINPROGRESS != errno && EINTR != errno)
+        return SYSINFO_RET_FAIL;
+
+    return HAPROXY_RET_AGAIN;
+}
+
+/******************************************************************************
+* Tells whether connecting the socket succeeded, once it is writable.        *
+*                                                                            *
+* Return value: SYSINFO_RET_OK or SYSINFO_RET_FAIL                           *
+******************************************************************************/
+int connect_finish(int sock)
+{
+    int err;
+    socklen_t err_len = sizeof(err);
+
+    if (ERROR == getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &err_len))
+        return SYSINFO_RET_FAIL;
+
+    if (0 != err)
+    {
+        errno = err;
+        return SYSINFO_RET_FAIL;
+    }
+
+    return SYSINFO_RET_OK;
+}
+
+/******************************************************************************
+* Switches the socket to non-blocking mode and connects it.                  *
+*                                                                            *
+* Return value: SYSINFO_RET_OK, HAPROXY_RET_TIMEOUT or SYSINFO_RET_FAIL      *
+******************************************************************************/
+static int connect_socket(int sock, const struct sockaddr *addr, socklen_t addr_len, double deadline)
+{
+    int ret;
+
+    if (HAPROXY_RET_AGAIN != (ret = connect_begin(sock, addr, addr_len)))
+        return ret;
+
+    if (SYSINFO_RET_OK != (ret = wait_socket(sock, POLLOUT, deadline)))
+        return ret;
+
+    return connect_finish(sock);
+}
 
 /******************************************************************************
 ******************************************************************************/
-int connect_unix(const char *sockPath, int *sockOut)
+static void unix_address(const char *sockPath, struct sockaddr_storage *addr, socklen_t *addrLen)
+{
+    struct sockaddr_un *addrUn = (struct sockaddr_un *)addr;
+
+    memset(addrUn, 0, sizeof(struct sockaddr_un));
+    addrUn->sun_family = AF_UNIX;
+    zbx_strlcpy(addrUn->sun_path, sockPath, sizeof(addrUn->sun_path) - 1);
+    *addrLen = sizeof(struct sockaddr_un);
+}
+
+/******************************************************************************
+******************************************************************************/
+int connect_unix(const char *sockPath, double deadline, int *sockOut)
 {
     const char *__function_name = "connect_unix";
     int sock;
-    struct sockaddr_un addrUn;
+    struct sockaddr_storage addr;
+    socklen_t addrLen;
     int ret;
 
     sock = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -21,17 +145,18 @@ int connect_unix(const char *sockPath, int *sockOut)
         return SYSINFO_RET_FAIL;
     }
 
-    memset(&addrUn, 0, sizeof(struct sockaddr_un));
-    addrUn.sun_family = AF_UNIX;
-    zbx_strlcpy(addrUn.sun_path, sockPath, sizeof(addrUn.sun_path) - 1);
+    unix_address(sockPath, &addr, &addrLen);
 
-    ret = connect(sock, (struct sockaddr *) &addrUn, sizeof(addrUn));
-    if (ret == ERROR)
+    ret = connect_socket(sock, (struct sockaddr *) &addr, addrLen, deadline);
+    if (ret != SYSINFO_RET_OK)
     {
         zabbix_log(LOG_LEVEL_TRACE,
-                   "Module: %s, function: %s - The server is down (%s:%d)",
-                   MODULE_NAME, __function_name, __FILE__, __LINE__);
-        return SYSINFO_RET_FAIL;
+                   "Module: %s, function: %s - %s (%s:%d)",
+                   MODULE_NAME, __function_name,
+                   HAPROXY_RET_TIMEOUT == ret ? "Timeout while connecting" : "The server is down",
+                   __FILE__, __LINE__);
+        close(sock);
+        return ret;
     }
     *sockOut = sock;
 
@@ -39,15 +164,25 @@ int connect_unix(const char *sockPath, int *sockOut)
 }
 
 /******************************************************************************
+* Connects to an IPv4 or IPv6 address or a host name, see haproxy_resolve(). *
 ******************************************************************************/
-int connect_net(const char *host, int port, int *sockOut)
+int connect_net(const char *host, int port, double deadline, int *sockOut)
 {
     const char *__function_name = "connect_net";
     int sock;
-    struct sockaddr_in addrIn;
+    struct sockaddr_storage addr;
+    socklen_t addrLen;
     int ret;
 
-    sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (SYSINFO_RET_OK != haproxy_resolve(host, port, &addr, &addrLen))
+    {
+        zabbix_log(LOG_LEVEL_TRACE,
+                   "Module: %s, function: %s - Cannot resolve %s (%s:%d)",
+                   MODULE_NAME, __function_name, host, __FILE__, __LINE__);
+        return SYSINFO_RET_FAIL;
+    }
+
+    sock = socket(addr.ss_family, SOCK_STREAM, 0);
     if(sock < 0)
     {
         zabbix_log(LOG_LEVEL_TRACE,
@@ -56,18 +191,16 @@ int connect_net(const char *host, int port, int *sockOut)
         return SYSINFO_RET_FAIL;
     }
 
-    addrIn.sin_family = AF_INET;
-    addrIn.sin_port = htons(port);
-    inet_pton(AF_INET, host, &addrIn.sin_addr);
-
-    ret = connect(sock, (struct sockaddr *) &addrIn, sizeof(addrIn));
-    if (ret == ERROR)
+    ret = connect_socket(sock, (struct sockaddr *) &addr, addrLen, deadline);
+    if (ret != SYSINFO_RET_OK)
     {
         zabbix_log(LOG_LEVEL_TRACE,
-                   "Module: %s, function: %s - The server is down (%s:%d)",
-                   MODULE_NAME, __function_name, __FILE__, __LINE__);
+                   "Module: %s, function: %s - %s (%s:%d)",
+                   MODULE_NAME, __function_name,
+                   HAPROXY_RET_TIMEOUT == ret ? "Timeout while connecting" : "The server is down",
+                   __FILE__, __LINE__);
         close(sock);
-        return SYSINFO_RET_FAIL;
+        return ret;
     }
     *sockOut = sock;
 
@@ -75,35 +208,299 @@ int connect_net(const char *host, int port, int *sockOut)
 }
 
 /******************************************************************************
+* Starts connecting to the endpoint without waiting for it, see              *
+* connect_begin().                                                           *
+*                                                                            *
+* Return value: SYSINFO_RET_OK, HAPROXY_RET_AGAIN or SYSINFO_RET_FAIL        *
 ******************************************************************************/
-int send_command(int sock, char *cmd, char **data)
+int connect_start(const haproxy_endpoint_t *endpoint, int *sockOut)
 {
-    const char *__function_name = "send_command";
+    const char *__function_name = "connect_start";
+    int sock;
+    struct sockaddr_storage addr;
+    socklen_t addrLen;
     int ret;
-    char buffer[BUFSIZ];
-    char command[COMMAND_LEN];
 
-    zbx_snprintf(command, COMMAND_LEN, "%s\n", cmd);
-    ret = write(sock, command, strlen(command));
-    if (ret == ERROR)
+    if (HAPROXY_ENDPOINT_UNIX == endpoint->type)
+    {
+        unix_address(endpoint->address, &addr, &addrLen);
+    }
+    else if (SYSINFO_RET_OK != haproxy_resolve(endpoint->address, endpoint->port, &addr, &addrLen))
+    {
+        zabbix_log(LOG_LEVEL_TRACE,
+                   "Module: %s, function: %s - Cannot resolve %s (%s:%d)",
+                   MODULE_NAME, __function_name, endpoint->address, __FILE__, __LINE__);
+        return SYSINFO_RET_FAIL;
+    }
+
+    sock = socket(addr.ss_family, SOCK_STREAM, 0);
+    if(sock < 0)
     {
         zabbix_log(LOG_LEVEL_TRACE,
-                   "Module: %s, function: %s - Cannot write to socket (%s:%d)",
+                   "Module: %s, function: %s - Cannot create socket (%s:%d)",
                    MODULE_NAME, __function_name, __FILE__, __LINE__);
-        close(sock);
         return SYSINFO_RET_FAIL;
     }
-    ret = read(sock, buffer, BUFSIZ);
-    if (ret == ERROR)
+
+    if (SYSINFO_RET_FAIL == (ret = connect_begin(sock, (struct sockaddr *) &addr, addrLen)))
     {
         zabbix_log(LOG_LEVEL_TRACE,
-                   "Module: %s, function: %s - Cannot read from socket (%s:%d)",
+                   "Module: %s, function: %s - The server is down (%s:%d)",
                    MODULE_NAME, __function_name, __FILE__, __LINE__);
         close(sock);
-        return SYSINFO_RET_FAIL;
+        return ret;
+    }
+    *sockOut = sock;
+
+    return ret;
+}
+
+/******************************************************************************
+******************************************************************************/
+static int prompt_match(const char *p, size_t len, const char *prompt, size_t prompt_len)
+{
+    if (len < prompt_len)
+        return 0 == memcmp(p, prompt, len) ? -1 : 0;
+
+    return 0 == memcmp(p, prompt, prompt_len) ? (int)prompt_len : 0;
+}
+
+/******************************************************************************
+* Checks whether the line starting at p is the interactive mode prompt.      *
+*                                                                            *
+* Return value: length of the prompt, 0 - not a prompt, -1 - too little has  *
+*               been received to tell                                        *
+******************************************************************************/
+static int prompt_at(const char *p, size_t len)
+{
+    int ret;
+
+    if (0 != (ret = prompt_match(p, len, PROMPT, PROMPT_LEN)))
+        return ret;
+
+    return prompt_match(p, len, MASTER_PROMPT, MASTER_PROMPT_LEN);
+}
+
+/******************************************************************************
+* Prepares sending the commands (separated by ';') to a socket which is in   *
+* interactive ("prompt") mode and reading the responses, see                 *
+* haproxy_exchange_run(). The response to command i is going to start at     *
+* offsets[i] and take lens[i] bytes, prompts excluded.                       *
+******************************************************************************/
+void haproxy_exchange_init(haproxy_exchange_t *exchange, int sock, const char *cmds, int ncmds, size_t size_hint,
+                           size_t *offsets, size_t *lens)
+{
+    memset(exchange, 0, sizeof(haproxy_exchange_t));
+    exchange->sock = sock;
+    exchange->command = zbx_dsprintf(NULL, "%s\n", cmds);
+    exchange->command_len = strlen(exchange->command);
+    exchange->ncmds = ncmds;
+    exchange->size_hint = size_hint;
+    exchange->bol = 1;
+    exchange->offsets = offsets;
+    exchange->lens = lens;
+}
+
+/******************************************************************************
+* Sends the commands and reads the responses as far as it can be done        *
+* without blocking. HAProxy runs the commands one by one and prints the      *
+* prompt after each response, so the exchange is over at the prompt after    *
+* the last one.                                                              *
+*                                                                            *
+* The responses are read straight into one heap buffer which grows as       *
+* needed, size_hint (e.g. the size of the previous responses to the same    *
+* commands) lets it be allocated once.                                      *
+*                                                                            *
+* Return value: SYSINFO_RET_OK - all responses are in,                       *
+*               HAPROXY_RET_AGAIN - the socket would block, call again once  *
+*               it is ready for haproxy_exchange_events(),                   *
+*               HAPROXY_RET_TRUNCATED - the peer closed the connection in    *
+*               the middle of the responses or SYSINFO_RET_FAIL              *
+******************************************************************************/
+int haproxy_exchange_run(haproxy_exchange_t *exchange)
+{
+    const char *__function_name = "haproxy_exchange_run";
+    ssize_t ret;
+    int prompt_len;
+    const char *nl;
+    char *out;
+
+    while (exchange->sent < exchange->command_len)
+    {
+        ret = send(exchange->sock, exchange->command + exchange->sent, exchange->command_len - exchange->sent,
+                   MSG_NOSIGNAL);
+        if (ret == ERROR)
+        {
+            if (EINTR == errno)
+                continue;
+
+            if (EAGAIN == errno || EWOULDBLOCK == errno)
+                return HAPROXY_RET_AGAIN;
+
+            zabbix_log(LOG_LEVEL_TRACE,
+                       "Module: %s, function: %s - Cannot write to socket: %s (%s:%d)",
+                       MODULE_NAME, __function_name, zbx_strerror(errno), __FILE__, __LINE__);
+            return SYSINFO_RET_FAIL;
+        }
+        exchange->sent += (size_t)ret;
+    }
+
+    if (NULL == exchange->out)
+    {
+        /* room for the prompts and the terminating zero */
+        exchange->out_alloc = MAX(exchange->size_hint + exchange->ncmds * MASTER_PROMPT_LEN + 1, BUFSIZ);
+        exchange->out = (char *)zbx_malloc(NULL, exchange->out_alloc);
+    }
+
+    while (exchange->found < exchange->ncmds)
+    {
+        if (exchange->out_alloc - exchange->out_offset < BUFSIZ / 2)
+        {
+            exchange->out_alloc *= 2;
+            exchange->out = (char *)zbx_realloc(exchange->out, exchange->out_alloc);
+        }
+
+        out = exchange->out;
+
+        ret = read(exchange->sock, out + exchange->out_offset, exchange->out_alloc - exchange->out_offset - 1);
+        if (ret == ERROR)
+        {
+            if (EINTR == errno)
+                continue;
+
+            if (EAGAIN == errno || EWOULDBLOCK == errno)
+                return HAPROXY_RET_AGAIN;
+
+            zabbix_log(LOG_LEVEL_TRACE,
+                       "Module: %s, function: %s - Cannot read from socket: %s (%s:%d)",
+                       MODULE_NAME, __function_name, zbx_strerror(errno), __FILE__, __LINE__);
+            return SYSINFO_RET_FAIL;
+        }
+        if (ret == 0)
+        {
+            /* the peer closed the connection before sending the prompt */
+            zabbix_log(LOG_LEVEL_TRACE,
+                       "Module: %s, function: %s - Connection closed by peer after %d bytes (%s:%d)",
+                       MODULE_NAME, __function_name, (int)exchange->out_offset, __FILE__, __LINE__);
+            return 0 != exchange->out_offset ? HAPROXY_RET_TRUNCATED : SYSINFO_RET_FAIL;
+        }
+
+        exchange->out_offset += (size_t)ret;
+
+        /* the prompt is looked for at the beginning of each line received */
+        while (exchange->found < exchange->ncmds && exchange->line < exchange->out_offset)
+        {
+            if (0 != exchange->bol)
+            {
+                if (-1 == (prompt_len = prompt_at(out + exchange->line, exchange->out_offset - exchange->line)))
+                    break;
+
+                if (0 != prompt_len)
+                {
+                    exchange->offsets[exchange->found] = exchange->section;
+                    exchange->lens[exchange->found++] = exchange->line - exchange->section;
+                    exchange->line += (size_t)prompt_len;
+                    exchange->section = exchange->line;
+                    continue;
+                }
+
+                exchange->bol = 0;
+            }
+
+            if (NULL == (nl = (const char *)memchr(out + exchange->line, '\n',
+                                                   exchange->out_offset - exchange->line)))
+            {
+                exchange->line = exchange->out_offset;
+                break;
+            }
+
+            exchange->line = (size_t)(nl - out) + 1;
+            exchange->bol = 1;
+        }
     }
-    close(sock);
-    *data = buffer;
 
     return SYSINFO_RET_OK;
-}
\ No newline at end of file
+}
+
+/******************************************************************************
+* Return value: the poll() events haproxy_exchange_run() waits for           *
+******************************************************************************/
+short haproxy_exchange_events(const haproxy_exchange_t *exchange)
+{
+    return exchange->sent < exchange->command_len ? POLLOUT : POLLIN;
+}
+
+/******************************************************************************
+* Hands the responses of a completed exchange over, the caller must free     *
+* them.                                                                      *
+******************************************************************************/
+char *haproxy_exchange_data(haproxy_exchange_t *exchange)
+{
+    char *data = exchange->out;
+    int last = exchange->ncmds - 1;
+
+    data[exchange->offsets[last] + exchange->lens[last]] = '\0';
+    exchange->out = NULL;
+
+    return data;
+}
+
+/******************************************************************************
+******************************************************************************/
+void haproxy_exchange_free(haproxy_exchange_t *exchange)
+{
+    zbx_free(exchange->command);
+    zbx_free(exchange->out);
+}
+
+/******************************************************************************
+* Sends the commands (separated by ';') to a socket which is in interactive  *
+* ("prompt") mode and waits for the responses, see haproxy_exchange_run().   *
+* The socket is left open so the caller can reuse it. The response to        *
+* command i starts at offsets[i] and takes lens[i] bytes, prompts excluded.  *
+* On success *data must be freed by the caller.                              *
+*                                                                            *
+* Return value: SYSINFO_RET_OK, HAPROXY_RET_TIMEOUT - the deadline has       *
+*               passed (the socket is out of sync and must be closed),       *
+*               HAPROXY_RET_TRUNCATED - the peer closed the connection in    *
+*               the middle of the responses or SYSINFO_RET_FAIL              *
+******************************************************************************/
+int send_commands(int sock, const char *cmds, int ncmds, size_t size_hint, double deadline, char **data,
+                  size_t *offsets, size_t *lens)
+{
+    const char *__function_name = "send_commands";
+    haproxy_exchange_t exchange;
+    int ret;
+
+    haproxy_exchange_init(&exchange, sock, cmds, ncmds, size_hint, offsets, lens);
+
+    while (HAPROXY_RET_AGAIN == (ret = haproxy_exchange_run(&exchange)))
+    {
+        if (SYSINFO_RET_OK != (ret = wait_socket(sock, haproxy_exchange_events(&exchange), deadline)))
+        {
+            zabbix_log(LOG_LEVEL_TRACE,
+                       "Module: %s, function: %s - %s while %s socket after %d bytes (%s:%d)",
+                       MODULE_NAME, __function_name, HAPROXY_RET_TIMEOUT == ret ? "Timeout" : "Cannot wait",
+                       NULL == exchange.out ? "writing to" : "reading from", (int)exchange.out_offset,
+                       __FILE__, __LINE__);
+            break;
+        }
+    }
+
+    if (SYSINFO_RET_OK == ret)
+        *data = haproxy_exchange_data(&exchange);
+
+    haproxy_exchange_free(&exchange);
+
+    return ret;
+}
+
+/******************************************************************************
+* Sends a single command, see send_commands().                               *
+******************************************************************************/
+int send_command(int sock, const char *cmd, size_t size_hint, double deadline, char **data, size_t *len)
+{
+    size_t offset;
+
+    return send_commands(sock, cmd, 1, size_hint, deadline, data, &offset, len);
+}
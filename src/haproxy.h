@@ -1,7 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <math.h>
+#include <fnmatch.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <ctype.h>
+#include <netdb.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
@@ -16,6 +25,711 @@
 
 #define MODULE_NAME    "haproxy.so"
 
-int connect_unix(const char *sockPath, int *sockOut);
-int connect_net(const char *host, int port, int *sockOut);
-int send_command(int sock, char *cmd, char **data);
\ No newline at end of file
+#define HAPROXY_ENDPOINT_UNIX    1    /* stats socket bound to a UNIX path */
+#define HAPROXY_ENDPOINT_NET     2    /* stats socket bound to ip:port */
+#define HAPROXY_ADDRESS_LEN      108  /* same as sun_path */
+
+/* a request to HAProxy has not completed within the item timeout, the other */
+/* functions return SYSINFO_RET_OK / SYSINFO_RET_FAIL                        */
+#define HAPROXY_RET_TIMEOUT      2
+/* HAProxy closed the connection in the middle of a response (send_commands) */
+#define HAPROXY_RET_TRUNCATED    3
+/* the socket would block, wait for haproxy_exchange_events() (haproxy_exchange_run) */
+#define HAPROXY_RET_AGAIN        4
+
+/* show stat "type" column */
+#define HAPROXY_TYPE_FRONTEND    0
+#define HAPROXY_TYPE_BACKEND     1
+#define HAPROXY_TYPE_SERVER      2
+#define HAPROXY_TYPE_LISTENER    3
+
+#define HAPROXY_CSV_MAX_FIELDS   256
+
+/* id of no proxy or server name, see symbol.c */
+#define HAPROXY_SYMBOL_NONE      0
+
+/* processes of a group queried at once, see group.c */
+#define HAPROXY_PROCS_MAX        64
+
+/* nature of a field - how the values of several processes are merged */
+#define HAPROXY_NATURE_OUTPUT      0    /* name, state or setting - of the first process */
+#define HAPROXY_NATURE_COUNTER     1    /* sum */
+#define HAPROXY_NATURE_GAUGE       2    /* sum */
+#define HAPROXY_NATURE_RATE        3    /* sum */
+#define HAPROXY_NATURE_LIMIT       4    /* sum */
+#define HAPROXY_NATURE_MAX         5    /* highest */
+#define HAPROXY_NATURE_AVG         6    /* average */
+#define HAPROXY_NATURE_AGE         7    /* time since an event - lowest */
+#define HAPROXY_NATURE_DURATION    8    /* highest */
+
+/*
+    show stat fields known to the module, in the order of HAProxy 1.8 - 2.x
+    (later versions only append fields). A field is looked up by its id,
+    the CSV column of every id is taken from the header of each response.
+    The nature (HAPROXY_NATURE_*) follows the one of "show stat typed".
+*/
+#define HAPROXY_STAT_FIELDS \
+    STAT_FIELD(PXNAME,                  "pxname",                    OUTPUT)  \
+    STAT_FIELD(SVNAME,                  "svname",                    OUTPUT)  \
+    STAT_FIELD(QCUR,                    "qcur",                      GAUGE)   \
+    STAT_FIELD(QMAX,                    "qmax",                      MAX)     \
+    STAT_FIELD(SCUR,                    "scur",                      GAUGE)   \
+    STAT_FIELD(SMAX,                    "smax",                      MAX)     \
+    STAT_FIELD(SLIM,                    "slim",                      LIMIT)   \
+    STAT_FIELD(STOT,                    "stot",                      COUNTER) \
+    STAT_FIELD(BIN,                     "bin",                       COUNTER) \
+    STAT_FIELD(BOUT,                    "bout",                      COUNTER) \
+    STAT_FIELD(DREQ,                    "dreq",                      COUNTER) \
+    STAT_FIELD(DRESP,                   "dresp",                     COUNTER) \
+    STAT_FIELD(EREQ,                    "ereq",                      COUNTER) \
+    STAT_FIELD(ECON,                    "econ",                      COUNTER) \
+    STAT_FIELD(ERESP,                   "eresp",                     COUNTER) \
+    STAT_FIELD(WRETR,                   "wretr",                     COUNTER) \
+    STAT_FIELD(WREDIS,                  "wredis",                    COUNTER) \
+    STAT_FIELD(STATUS,                  "status",                    OUTPUT)  \
+    STAT_FIELD(WEIGHT,                  "weight",                    AVG)     \
+    STAT_FIELD(ACT,                     "act",                       AVG)     \
+    STAT_FIELD(BCK,                     "bck",                       AVG)     \
+    STAT_FIELD(CHKFAIL,                 "chkfail",                   COUNTER) \
+    STAT_FIELD(CHKDOWN,                 "chkdown",                   COUNTER) \
+    STAT_FIELD(LASTCHG,                 "lastchg",                   AGE)     \
+    STAT_FIELD(DOWNTIME,                "downtime",                  DURATION)\
+    STAT_FIELD(QLIMIT,                  "qlimit",                    LIMIT)   \
+    STAT_FIELD(PID,                     "pid",                       OUTPUT)  \
+    STAT_FIELD(IID,                     "iid",                       OUTPUT)  \
+    STAT_FIELD(SID,                     "sid",                       OUTPUT)  \
+    STAT_FIELD(THROTTLE,                "throttle",                  AVG)     \
+    STAT_FIELD(LBTOT,                   "lbtot",                     COUNTER) \
+    STAT_FIELD(TRACKED,                 "tracked",                   OUTPUT)  \
+    STAT_FIELD(TYPE,                    "type",                      OUTPUT)  \
+    STAT_FIELD(RATE,                    "rate",                      RATE)    \
+    STAT_FIELD(RATE_LIM,                "rate_lim",                  LIMIT)   \
+    STAT_FIELD(RATE_MAX,                "rate_max",                  MAX)     \
+    STAT_FIELD(CHECK_STATUS,            "check_status",              OUTPUT)  \
+    STAT_FIELD(CHECK_CODE,              "check_code",                OUTPUT)  \
+    STAT_FIELD(CHECK_DURATION,          "check_duration",            DURATION)\
+    STAT_FIELD(HRSP_1XX,                "hrsp_1xx",                  COUNTER) \
+    STAT_FIELD(HRSP_2XX,                "hrsp_2xx",                  COUNTER) \
+    STAT_FIELD(HRSP_3XX,                "hrsp_3xx",                  COUNTER) \
+    STAT_FIELD(HRSP_4XX,                "hrsp_4xx",                  COUNTER) \
+    STAT_FIELD(HRSP_5XX,                "hrsp_5xx",                  COUNTER) \
+    STAT_FIELD(HRSP_OTHER,              "hrsp_other",                COUNTER) \
+    STAT_FIELD(HANAFAIL,                "hanafail",                  COUNTER) \
+    STAT_FIELD(REQ_RATE,                "req_rate",                  RATE)    \
+    STAT_FIELD(REQ_RATE_MAX,            "req_rate_max",              MAX)     \
+    STAT_FIELD(REQ_TOT,                 "req_tot",                   COUNTER) \
+    STAT_FIELD(CLI_ABRT,                "cli_abrt",                  COUNTER) \
+    STAT_FIELD(SRV_ABRT,                "srv_abrt",                  COUNTER) \
+    STAT_FIELD(COMP_IN,                 "comp_in",                   COUNTER) \
+    STAT_FIELD(COMP_OUT,                "comp_out",                  COUNTER) \
+    STAT_FIELD(COMP_BYP,                "comp_byp",                  COUNTER) \
+    STAT_FIELD(COMP_RSP,                "comp_rsp",                  COUNTER) \
+    STAT_FIELD(LASTSESS,                "lastsess",                  AGE)     \
+    STAT_FIELD(LAST_CHK,                "last_chk",                  OUTPUT)  \
+    STAT_FIELD(LAST_AGT,                "last_agt",                  OUTPUT)  \
+    STAT_FIELD(QTIME,                   "qtime",                     AVG)     \
+    STAT_FIELD(CTIME,                   "ctime",                     AVG)     \
+    STAT_FIELD(RTIME,                   "rtime",                     AVG)     \
+    STAT_FIELD(TTIME,                   "ttime",                     AVG)     \
+    STAT_FIELD(AGENT_STATUS,            "agent_status",              OUTPUT)  \
+    STAT_FIELD(AGENT_CODE,              "agent_code",                OUTPUT)  \
+    STAT_FIELD(AGENT_DURATION,          "agent_duration",            DURATION)\
+    STAT_FIELD(CHECK_DESC,              "check_desc",                OUTPUT)  \
+    STAT_FIELD(AGENT_DESC,              "agent_desc",                OUTPUT)  \
+    STAT_FIELD(CHECK_RISE,              "check_rise",                OUTPUT)  \
+    STAT_FIELD(CHECK_FALL,              "check_fall",                OUTPUT)  \
+    STAT_FIELD(CHECK_HEALTH,            "check_health",              OUTPUT)  \
+    STAT_FIELD(AGENT_RISE,              "agent_rise",                OUTPUT)  \
+    STAT_FIELD(AGENT_FALL,              "agent_fall",                OUTPUT)  \
+    STAT_FIELD(AGENT_HEALTH,            "agent_health",              OUTPUT)  \
+    STAT_FIELD(ADDR,                    "addr",                      OUTPUT)  \
+    STAT_FIELD(COOKIE,                  "cookie",                    OUTPUT)  \
+    STAT_FIELD(MODE,                    "mode",                      OUTPUT)  \
+    STAT_FIELD(ALGO,                    "algo",                      OUTPUT)  \
+    STAT_FIELD(CONN_RATE,               "conn_rate",                 RATE)    \
+    STAT_FIELD(CONN_RATE_MAX,           "conn_rate_max",             MAX)     \
+    STAT_FIELD(CONN_TOT,                "conn_tot",                  COUNTER) \
+    STAT_FIELD(INTERCEPTED,             "intercepted",               COUNTER) \
+    STAT_FIELD(DCON,                    "dcon",                      COUNTER) \
+    STAT_FIELD(DSES,                    "dses",                      COUNTER) \
+    STAT_FIELD(WREW,                    "wrew",                      COUNTER) \
+    STAT_FIELD(CONNECT,                 "connect",                   COUNTER) \
+    STAT_FIELD(REUSE,                   "reuse",                     COUNTER) \
+    STAT_FIELD(CACHE_LOOKUPS,           "cache_lookups",             COUNTER) \
+    STAT_FIELD(CACHE_HITS,              "cache_hits",                COUNTER) \
+    STAT_FIELD(SRV_ICUR,                "srv_icur",                  GAUGE)   \
+    STAT_FIELD(SRC_ILIM,                "src_ilim",                  LIMIT)   \
+    STAT_FIELD(QTIME_MAX,               "qtime_max",                 MAX)     \
+    STAT_FIELD(CTIME_MAX,               "ctime_max",                 MAX)     \
+    STAT_FIELD(RTIME_MAX,               "rtime_max",                 MAX)     \
+    STAT_FIELD(TTIME_MAX,               "ttime_max",                 MAX)     \
+    STAT_FIELD(EINT,                    "eint",                      COUNTER) \
+    STAT_FIELD(IDLE_CONN_CUR,           "idle_conn_cur",             GAUGE)   \
+    STAT_FIELD(SAFE_CONN_CUR,           "safe_conn_cur",             GAUGE)   \
+    STAT_FIELD(USED_CONN_CUR,           "used_conn_cur",             GAUGE)   \
+    STAT_FIELD(NEED_CONN_EST,           "need_conn_est",             GAUGE)   \
+    STAT_FIELD(UWEIGHT,                 "uweight",                   AVG)     \
+    STAT_FIELD(AGG_SERVER_STATUS,       "agg_server_status",         OUTPUT)  \
+    STAT_FIELD(AGG_SERVER_CHECK_STATUS, "agg_server_check_status",   OUTPUT)  \
+    STAT_FIELD(AGG_CHECK_STATUS,        "agg_check_status",          OUTPUT)  \
+    STAT_FIELD(SRID,                    "srid",                      OUTPUT)  \
+    STAT_FIELD(SESS_OTHER,              "sess_other",                COUNTER) \
+    STAT_FIELD(H1SESS,                  "h1sess",                    COUNTER) \
+    STAT_FIELD(H2SESS,                  "h2sess",                    COUNTER) \
+    STAT_FIELD(H3SESS,                  "h3sess",                    COUNTER) \
+    STAT_FIELD(REQ_OTHER,               "req_other",                 COUNTER) \
+    STAT_FIELD(H1REQ,                   "h1req",                     COUNTER) \
+    STAT_FIELD(H2REQ,                   "h2req",                     COUNTER) \
+    STAT_FIELD(H3REQ,                   "h3req",                     COUNTER) \
+    STAT_FIELD(PROTO,                   "proto",                     OUTPUT)
+
+#define STAT_FIELD(id, name, nature)    HAPROXY_STAT_##id,
+enum
+{
+    HAPROXY_STAT_FIELDS
+    HAPROXY_STAT_FIELD_COUNT
+};
+#undef STAT_FIELD
+
+/*
+    show info fields known to the module (HAProxy 1.8 - 2.x)
+*/
+#define HAPROXY_INFO_FIELDS \
+    INFO_FIELD(NAME,                        "Name",                          OUTPUT)  \
+    INFO_FIELD(VERSION,                     "Version",                       OUTPUT)  \
+    INFO_FIELD(RELEASE_DATE,                "Release_date",                  OUTPUT)  \
+    INFO_FIELD(NBTHREAD,                    "Nbthread",                      OUTPUT)  \
+    INFO_FIELD(NBPROC,                      "Nbproc",                        OUTPUT)  \
+    INFO_FIELD(PROCESS_NUM,                 "Process_num",                   OUTPUT)  \
+    INFO_FIELD(PID,                         "Pid",                           OUTPUT)  \
+    INFO_FIELD(UPTIME,                      "Uptime",                        OUTPUT)  \
+    INFO_FIELD(UPTIME_SEC,                  "Uptime_sec",                    AGE)     \
+    INFO_FIELD(MEMMAX_MB,                   "Memmax_MB",                     LIMIT)   \
+    INFO_FIELD(POOLALLOC_MB,                "PoolAlloc_MB",                  GAUGE)   \
+    INFO_FIELD(POOLUSED_MB,                 "PoolUsed_MB",                   GAUGE)   \
+    INFO_FIELD(POOLFAILED,                  "PoolFailed",                    COUNTER) \
+    INFO_FIELD(ULIMIT_N,                    "Ulimit-n",                      LIMIT)   \
+    INFO_FIELD(MAXSOCK,                     "Maxsock",                       LIMIT)   \
+    INFO_FIELD(MAXCONN,                     "Maxconn",                       LIMIT)   \
+    INFO_FIELD(HARD_MAXCONN,                "Hard_maxconn",                  LIMIT)   \
+    INFO_FIELD(CURRCONNS,                   "CurrConns",                     GAUGE)   \
+    INFO_FIELD(CUMCONNS,                    "CumConns",                      COUNTER) \
+    INFO_FIELD(CUMREQ,                      "CumReq",                        COUNTER) \
+    INFO_FIELD(MAXSSLCONNS,                 "MaxSslConns",                   LIMIT)   \
+    INFO_FIELD(CURRSSLCONNS,                "CurrSslConns",                  GAUGE)   \
+    INFO_FIELD(CUMSSLCONNS,                 "CumSslConns",                   COUNTER) \
+    INFO_FIELD(MAXPIPES,                    "Maxpipes",                      LIMIT)   \
+    INFO_FIELD(PIPESUSED,                   "PipesUsed",                     GAUGE)   \
+    INFO_FIELD(PIPESFREE,                   "PipesFree",                     GAUGE)   \
+    INFO_FIELD(CONNRATE,                    "ConnRate",                      RATE)    \
+    INFO_FIELD(CONNRATELIMIT,               "ConnRateLimit",                 LIMIT)   \
+    INFO_FIELD(MAXCONNRATE,                 "MaxConnRate",                   MAX)     \
+    INFO_FIELD(SESSRATE,                    "SessRate",                      RATE)    \
+    INFO_FIELD(SESSRATELIMIT,               "SessRateLimit",                 LIMIT)   \
+    INFO_FIELD(MAXSESSRATE,                 "MaxSessRate",                   MAX)     \
+    INFO_FIELD(SSLRATE,                     "SslRate",                       RATE)    \
+    INFO_FIELD(SSLRATELIMIT,                "SslRateLimit",                  LIMIT)   \
+    INFO_FIELD(MAXSSLRATE,                  "MaxSslRate",                    MAX)     \
+    INFO_FIELD(SSLFRONTENDKEYRATE,          "SslFrontendKeyRate",            RATE)    \
+    INFO_FIELD(SSLFRONTENDMAXKEYRATE,       "SslFrontendMaxKeyRate",         MAX)     \
+    INFO_FIELD(SSLFRONTENDSESSIONREUSE_PCT, "SslFrontendSessionReuse_pct",   AVG)     \
+    INFO_FIELD(SSLBACKENDKEYRATE,           "SslBackendKeyRate",             RATE)    \
+    INFO_FIELD(SSLBACKENDMAXKEYRATE,        "SslBackendMaxKeyRate",          MAX)     \
+    INFO_FIELD(SSLCACHELOOKUPS,             "SslCacheLookups",               COUNTER) \
+    INFO_FIELD(SSLCACHEMISSES,              "SslCacheMisses",                COUNTER) \
+    INFO_FIELD(COMPRESSBPSIN,               "CompressBpsIn",                 RATE)    \
+    INFO_FIELD(COMPRESSBPSOUT,              "CompressBpsOut",                RATE)    \
+    INFO_FIELD(COMPRESSBPSRATELIM,          "CompressBpsRateLim",            LIMIT)   \
+    INFO_FIELD(ZLIBMEMUSAGE,                "ZlibMemUsage",                  GAUGE)   \
+    INFO_FIELD(MAXZLIBMEMUSAGE,             "MaxZlibMemUsage",               LIMIT)   \
+    INFO_FIELD(TASKS,                       "Tasks",                         GAUGE)   \
+    INFO_FIELD(RUN_QUEUE,                   "Run_queue",                     GAUGE)   \
+    INFO_FIELD(IDLE_PCT,                    "Idle_pct",                      AVG)     \
+    INFO_FIELD(NODE,                        "node",                          OUTPUT)  \
+    INFO_FIELD(DESCRIPTION,                 "description",                   OUTPUT)  \
+    INFO_FIELD(STOPPING,                    "Stopping",                      MAX)     \
+    INFO_FIELD(JOBS,                        "Jobs",                          GAUGE)   \
+    INFO_FIELD(UNSTOPPABLE_JOBS,            "Unstoppable Jobs",              GAUGE)   \
+    INFO_FIELD(LISTENERS,                   "Listeners",                     GAUGE)   \
+    INFO_FIELD(ACTIVEPEERS,                 "ActivePeers",                   GAUGE)   \
+    INFO_FIELD(CONNECTEDPEERS,              "ConnectedPeers",                GAUGE)   \
+    INFO_FIELD(DROPPEDLOGS,                 "DroppedLogs",                   COUNTER) \
+    INFO_FIELD(BUSYPOLLING,                 "BusyPolling",                   OUTPUT)  \
+    INFO_FIELD(FAILEDRESOLUTIONS,           "FailedResolutions",             COUNTER) \
+    INFO_FIELD(TOTALBYTESOUT,               "TotalBytesOut",                 COUNTER) \
+    INFO_FIELD(TOTALSPLICEDBYTESOUT,        "TotalSplicedBytesOut",          COUNTER) \
+    INFO_FIELD(BYTESOUTRATE,                "BytesOutRate",                  RATE)    \
+    INFO_FIELD(DEBUGCOMMANDSISSUED,         "DebugCommandsIssued",           COUNTER) \
+    INFO_FIELD(CUMRECVLOGS,                 "CumRecvLogs",                   COUNTER) \
+    INFO_FIELD(BUILD_INFO,                  "Build info",                    OUTPUT)  \
+    INFO_FIELD(MEMMAX_BYTES,                "Memmax_bytes",                  LIMIT)   \
+    INFO_FIELD(POOLALLOC_BYTES,             "PoolAlloc_bytes",               GAUGE)   \
+    INFO_FIELD(POOLUSED_BYTES,              "PoolUsed_bytes",                GAUGE)   \
+    INFO_FIELD(START_TIME_SEC,              "Start_time_sec",                MAX)     \
+    INFO_FIELD(TAINTED,                     "Tainted",                       OUTPUT)  \
+    INFO_FIELD(TOTALWARNINGS,               "TotalWarnings",                 COUNTER) \
+    INFO_FIELD(MAXCONNREACHED,              "MaxconnReached",                COUNTER) \
+    INFO_FIELD(BOOTTIME_MS,                 "BootTime_ms",                   DURATION)\
+    INFO_FIELD(NICED_TASKS,                 "Niced_tasks",                   GAUGE)
+
+#define INFO_FIELD(id, name, nature)    HAPROXY_INFO_##id,
+enum
+{
+    HAPROXY_INFO_FIELDS
+    HAPROXY_INFO_FIELD_COUNT
+};
+#undef INFO_FIELD
+
+/* type of a parsed value */
+#define HAPROXY_VALUE_STR    0
+#define HAPROXY_VALUE_INT    1
+#define HAPROXY_VALUE_DBL    2
+
+/* type of a value of "show stat typed" / "show info typed" as declared by HAProxy */
+#define HAPROXY_TYPED_STR    0
+#define HAPROXY_TYPED_U32    1
+#define HAPROXY_TYPED_S32    2
+#define HAPROXY_TYPED_U64    3
+#define HAPROXY_TYPED_S64    4
+#define HAPROXY_TYPED_FLT    5
+
+typedef struct
+{
+    int     type;
+    char    address[HAPROXY_ADDRESS_LEN];    /* path, IP address (IPv6 without brackets) or host name,
+                                                of a group of sockets - with '*' for the process */
+    int     port;
+    int     process;        /* master CLI: the worker commands are sent to (@<process>), 0 - none */
+    int     procs_first;    /* group of processes procs_first - procs_last, 0 - single process */
+    int     procs_last;
+}
+haproxy_endpoint_t;
+
+/* counters of haproxy_modstats_t, see modstats.c */
+#define HAPROXY_MODSTATS_REQUESTS      0
+#define HAPROXY_MODSTATS_FAILURES      1
+#define HAPROXY_MODSTATS_TIMEOUTS      2
+#define HAPROXY_MODSTATS_TRUNCATED     3
+#define HAPROXY_MODSTATS_BYTES         4
+#define HAPROXY_MODSTATS_HITS          5
+#define HAPROXY_MODSTATS_WAITS         6    /* hits after waiting for a request in flight */
+#define HAPROXY_MODSTATS_MISSES        7
+#define HAPROXY_MODSTATS_CONNECTS      8    /* of the endpoint */
+#define HAPROXY_MODSTATS_RECONNECTS    9
+#define HAPROXY_MODSTATS_COUNT         10
+
+#define HAPROXY_HISTOGRAM_BUCKETS      160
+
+/* microseconds, log scale: 4 buckets per power of two */
+typedef struct
+{
+    zbx_uint64_t    sum;
+    zbx_uint64_t    max;
+    zbx_uint64_t    buckets[HAPROXY_HISTOGRAM_BUCKETS];
+}
+haproxy_histogram_t;
+
+typedef struct
+{
+    haproxy_endpoint_t  endpoint;
+    char                *cmd;       /* NULL - the counters of the endpoint */
+    zbx_uint64_t        counters[HAPROXY_MODSTATS_COUNT];
+    haproxy_histogram_t latency;    /* of the requests */
+    haproxy_histogram_t parse;      /* of the responses */
+}
+haproxy_modstats_t;
+
+/* bump allocator, see arena.c */
+typedef struct haproxy_arena_chunk haproxy_arena_chunk_t;
+typedef struct haproxy_arena_cleanup haproxy_arena_cleanup_t;
+
+typedef struct
+{
+    haproxy_arena_chunk_t   *chunks;        /* the current one first */
+    size_t                  chunk_size;     /* of the first chunk */
+    size_t                  size;           /* of all chunks */
+    size_t                  used;
+    void                    *last;          /* the last allocation, grows in place */
+    haproxy_arena_cleanup_t *cleanups;      /* run on reset, the last registered first */
+}
+haproxy_arena_t;
+
+/* the interned names an index holds, each once, see symbol.c */
+typedef struct
+{
+    haproxy_arena_t *arena;         /* the lists are allocated in */
+    zbx_uint32_t    *ids;
+    int             num;
+    int             alloc;
+    zbx_uint32_t    *marks;         /* a bit per id, set - held */
+    zbx_uint32_t    marks_num;      /* words */
+}
+haproxy_symbols_held_t;
+
+typedef struct
+{
+    char            *data;        /* response to the command */
+    size_t          len;
+    double          time;         /* when the command was sent */
+    int             refcount;
+    /* parsed response, built on first use by haproxy_snapshot_parsed() */
+    void            *parsed;
+    haproxy_arena_t *arena;       /* the parsed response is allocated in, NULL - not parsed */
+    const void      *owner;       /* cache entry the arena goes back to, see cache.c */
+    pthread_mutex_t parsed_lock;
+    haproxy_modstats_t  *stats;   /* parsing is timed in, NULL - not timed */
+}
+haproxy_snapshot_t;
+
+/* commands sent to a non-blocking socket in interactive mode, see haproxy.c */
+typedef struct
+{
+    int     sock;
+    char    *command;       /* the commands terminated by '\n' */
+    size_t  command_len;
+    size_t  sent;
+    int     ncmds;
+    int     found;          /* responses received */
+    char    *out;           /* the responses, NULL - not reading yet */
+    size_t  out_alloc;
+    size_t  out_offset;
+    size_t  size_hint;
+    size_t  line;           /* where the prompt is looked for next */
+    int     bol;            /* line is at the beginning of a line */
+    size_t  section;        /* start of the response being received */
+    size_t  *offsets;
+    size_t  *lens;
+}
+haproxy_exchange_t;
+
+/* a command to an endpoint for haproxy_query_multi() */
+typedef struct
+{
+    const haproxy_endpoint_t    *endpoint;
+    const char                  *cmd;
+    size_t                      size_hint;
+    int                         ret;    /* SYSINFO_RET_OK, HAPROXY_RET_TIMEOUT or SYSINFO_RET_FAIL */
+    char                        *data;  /* the response, must be freed by the caller */
+    size_t                      len;
+}
+haproxy_request_t;
+
+/* host name lookups of haproxy_query_multi() in progress, see registry.c */
+typedef struct haproxy_resolve_batch haproxy_resolve_batch_t;
+
+typedef struct
+{
+    const char  *ptr;     /* not terminated, points into the response */
+    size_t      len;
+}
+haproxy_field_t;
+
+typedef struct
+{
+    const char  **list;
+    int         count;
+    int         *sorted;    /* indexes of the names in alphabetical order */
+}
+haproxy_names_t;
+
+typedef struct
+{
+    int             type;     /* HAPROXY_VALUE_* */
+    zbx_int64_t     i64;
+    double          dbl;
+    haproxy_field_t text;     /* as received, points into the response */
+}
+haproxy_value_t;
+
+typedef struct
+{
+    haproxy_field_t name;
+    haproxy_value_t value;
+    int             nature;   /* HAPROXY_NATURE_*, as reported by show info typed */
+}
+haproxy_info_line_t;
+
+typedef struct
+{
+    haproxy_info_line_t *lines;
+    int                 nlines;
+    int                 lines_alloc;
+    int                 index[HAPROXY_INFO_FIELD_COUNT];    /* field id -> line, -1 - not reported */
+    haproxy_arena_t     *arena;                             /* the lines are allocated in */
+}
+haproxy_info_t;
+
+typedef struct
+{
+    const char      *line;
+    size_t          len;
+    haproxy_field_t pxname;
+    haproxy_field_t svname;
+    zbx_uint32_t    pxname_id;    /* interned, see symbol.c */
+    zbx_uint32_t    svname_id;
+    zbx_uint32_t    hash;
+}
+haproxy_stat_row_t;
+
+typedef struct
+{
+    int                     column[HAPROXY_STAT_FIELD_COUNT];    /* -1 - not in this version */
+    const char              *header;
+    size_t                  header_len;
+    haproxy_stat_row_t      *rows;
+    int                     nrows;
+    int                     rows_alloc;
+    int                     *buckets;       /* (pxname, svname) hash -> row index + 1 */
+    zbx_uint32_t            buckets_mask;
+    haproxy_arena_t         *arena;         /* the index is allocated in */
+    haproxy_symbols_held_t  symbols;        /* the names of the rows, see symbol.c */
+}
+haproxy_stat_t;
+
+/* a field of show stat typed, the values of all rows in one array */
+typedef struct
+{
+    haproxy_field_t name;
+    int             type;       /* HAPROXY_TYPED_* of the first value, the others are converted to it */
+    int             nature;     /* HAPROXY_NATURE_* */
+    void            *values;    /* zbx_uint32_t, int, zbx_uint64_t, zbx_int64_t, double or haproxy_field_t */
+    unsigned char   *set;       /* 0 - the row has no value */
+}
+haproxy_typed_column_t;
+
+typedef struct
+{
+    haproxy_stat_t          *index;     /* rows by pxname/svname, column[] - field id -> column */
+    unsigned char           *types;     /* HAPROXY_TYPE_* of the rows */
+    haproxy_typed_column_t  *columns;   /* by field position, name.len is 0 for a position not reported */
+    int                     ncolumns;
+    int                     values_alloc;
+}
+haproxy_typed_t;
+
+typedef struct
+{
+    haproxy_field_t name;       /* empty for the total */
+    zbx_uint64_t    size;       /* bytes per entry */
+    zbx_uint64_t    allocated;
+    zbx_uint64_t    allocated_bytes;
+    zbx_uint64_t    used;
+    zbx_uint64_t    used_bytes;
+    zbx_uint64_t    failures;
+    zbx_uint64_t    users;
+}
+haproxy_pool_t;
+
+typedef struct
+{
+    haproxy_pool_t  *pools;
+    int             npools;
+    haproxy_pool_t  total;      /* sum of the pools */
+}
+haproxy_pools_t;
+
+typedef struct
+{
+    haproxy_field_t name;
+    int             offset;     /* first value in haproxy_activity_t.values */
+    int             nthreads;
+    int             integer;    /* all values are integers */
+}
+haproxy_activity_counter_t;
+
+typedef struct
+{
+    haproxy_activity_counter_t  *counters;
+    int                         ncounters;
+    double                      *values;    /* per-thread values of all counters */
+    int                         nvalues;
+    int                         values_alloc;
+    haproxy_arena_t             *arena;     /* the values are allocated in */
+}
+haproxy_activity_t;
+
+int connect_unix(const char *sockPath, double deadline, int *sockOut);
+int connect_net(const char *host, int port, double deadline, int *sockOut);
+int connect_start(const haproxy_endpoint_t *endpoint, int *sockOut);
+int connect_finish(int sock);
+void haproxy_exchange_init(haproxy_exchange_t *exchange, int sock, const char *cmds, int ncmds, size_t size_hint,
+                           size_t *offsets, size_t *lens);
+int haproxy_exchange_run(haproxy_exchange_t *exchange);
+short haproxy_exchange_events(const haproxy_exchange_t *exchange);
+char *haproxy_exchange_data(haproxy_exchange_t *exchange);
+void haproxy_exchange_free(haproxy_exchange_t *exchange);
+int send_command(int sock, const char *cmd, size_t size_hint, double deadline, char **data, size_t *len);
+int send_commands(int sock, const char *cmds, int ncmds, size_t size_hint, double deadline, char **data,
+                  size_t *offsets, size_t *lens);
+
+/* persistent connections, see conn.c */
+int haproxy_endpoint_parse(const char *param, haproxy_endpoint_t *endpoint);
+int haproxy_endpoint_equal(const haproxy_endpoint_t *a, const haproxy_endpoint_t *b);
+int haproxy_query(const haproxy_endpoint_t *endpoint, const char *cmd, size_t size_hint, char **data,
+                  size_t *len);
+int haproxy_query_batch(const haproxy_endpoint_t *endpoint, const char **cmds, int ncmds, size_t size_hint,
+                        char **data, size_t *offsets, size_t *lens);
+void haproxy_query_multi(haproxy_request_t *requests, int n);
+int haproxy_probe(const haproxy_endpoint_t *endpoint, int timeout);
+void haproxy_conn_timeout(int timeout);
+void haproxy_conn_destroy(void);
+
+/* named endpoints and resolved addresses, see registry.c */
+int haproxy_registry_add(const char *definition);
+const haproxy_endpoint_t *haproxy_registry_find(const char *name);
+void haproxy_registry_warmup(int timeout);
+void haproxy_resolve_init(int ttl);
+int haproxy_resolve(const char *host, int port, struct sockaddr_storage *addr, socklen_t *addr_len);
+haproxy_resolve_batch_t *haproxy_resolve_start(const haproxy_endpoint_t **endpoints, int n);
+int haproxy_resolve_fd(const haproxy_resolve_batch_t *batch);
+void haproxy_resolve_clear(haproxy_resolve_batch_t *batch);
+int haproxy_resolve_pending(haproxy_resolve_batch_t *batch, int i);
+void haproxy_resolve_release(haproxy_resolve_batch_t *batch);
+void haproxy_registry_destroy(void);
+
+/* groups of processes, see group.c */
+int haproxy_endpoint_member(const haproxy_endpoint_t *group, int process, haproxy_endpoint_t *member);
+int haproxy_fetch(const haproxy_endpoint_t *endpoint, const char *cmd, size_t size_hint, char **data,
+                  size_t *len);
+
+/* response cache, see cache.c */
+void haproxy_cache_init(int ttl, int refresh);
+int haproxy_cache_get(const haproxy_endpoint_t *endpoint, const char *cmd, haproxy_snapshot_t **snapshot);
+int haproxy_cache_get_pair(const haproxy_endpoint_t *endpoint, const char *cmd, haproxy_snapshot_t **snapshot,
+                           haproxy_snapshot_t **previous);
+void haproxy_cache_get_multi(const haproxy_endpoint_t *endpoints, int n, const char *cmd,
+                             haproxy_snapshot_t **snapshots, int *rets);
+void haproxy_snapshot_release(haproxy_snapshot_t *snapshot);
+char *haproxy_snapshot_detach(haproxy_snapshot_t *snapshot);
+void *haproxy_snapshot_parsed(haproxy_snapshot_t *snapshot,
+                              void *(*parse)(const char *, size_t, haproxy_arena_t *));
+void haproxy_cache_destroy(void);
+
+/* bump allocator, see arena.c */
+haproxy_arena_t *haproxy_arena_create(size_t size);
+void *haproxy_arena_alloc(haproxy_arena_t *arena, size_t size);
+void *haproxy_arena_realloc(haproxy_arena_t *arena, void *ptr, size_t old_size, size_t size);
+void haproxy_arena_cleanup(haproxy_arena_t *arena, void (*func)(void *), void *data);
+void haproxy_arena_reset(haproxy_arena_t *arena);
+void haproxy_arena_destroy(haproxy_arena_t *arena);
+
+/* interned proxy and server names, see symbol.c */
+void haproxy_symbols_hold(haproxy_symbols_held_t *held, haproxy_arena_t *arena);
+void haproxy_symbols_release(haproxy_symbols_held_t *held);
+zbx_uint32_t haproxy_symbol_intern(const char *name, size_t len, haproxy_symbols_held_t *held);
+zbx_uint32_t haproxy_symbol_find(const char *name, size_t len);
+void haproxy_symbols_destroy(void);
+
+/* the module's own statistics, see modstats.c */
+haproxy_modstats_t *haproxy_modstats_get(const haproxy_endpoint_t *endpoint, const char *cmd);
+void haproxy_modstats_add(haproxy_modstats_t *stats, int counter, zbx_uint64_t value);
+void haproxy_modstats_latency(haproxy_modstats_t *stats, double seconds);
+void haproxy_modstats_parse(haproxy_modstats_t *stats, double seconds);
+void haproxy_modstats_json(const haproxy_endpoint_t *endpoint, struct zbx_json *j);
+void haproxy_modstats_destroy(void);
+
+/* known field names and values, see fields.c */
+void haproxy_names_init(haproxy_names_t *names, const char **list, int count);
+int haproxy_names_find(const haproxy_names_t *names, const char *name, size_t len);
+void haproxy_value_parse(const char *ptr, size_t len, haproxy_value_t *value);
+
+/* CSV splitting, see csv.c */
+const char *haproxy_csv_line(const char *data, const char *end, haproxy_field_t *fields, int max_fields,
+                             int *nfields);
+const char *haproxy_csv_skip(const char *p, const char *end, int n);
+const char *haproxy_csv_line_scalar(const char *data, const char *end, haproxy_field_t *fields, int max_fields,
+                                    int *nfields);
+const char *haproxy_csv_skip_scalar(const char *p, const char *end, int n);
+const char *haproxy_csv_header(const char *data, const char *end, haproxy_field_t *fields, int max_fields,
+                               int *nfields);
+int haproxy_csv_column(const haproxy_field_t *fields, int nfields, const char *name);
+
+/* show stat index, see stat.c */
+int haproxy_stat_field_find(const char *name, size_t len);
+int haproxy_stat_field_id(const char *name);
+const char *haproxy_stat_field_name(int id);
+int haproxy_stat_field_nature(int id);
+haproxy_stat_t *haproxy_stat_create(haproxy_arena_t *arena);
+void haproxy_stat_add_row(haproxy_stat_t *stat, const char *line, size_t len, const haproxy_field_t *pxname,
+                          const haproxy_field_t *svname);
+void haproxy_stat_build_index(haproxy_stat_t *stat);
+haproxy_stat_t *haproxy_stat_parse(const char *data, size_t len, haproxy_arena_t *arena);
+const haproxy_stat_t *haproxy_stat_get(haproxy_snapshot_t *snapshot);
+const haproxy_stat_row_t *haproxy_stat_find(const haproxy_stat_t *stat, const char *pxname, const char *svname);
+const haproxy_stat_row_t *haproxy_stat_find_id(const haproxy_stat_t *stat, zbx_uint32_t pxname_id,
+                                              zbx_uint32_t svname_id);
+const haproxy_stat_row_t *haproxy_stat_find_row(const haproxy_stat_t *stat, const haproxy_stat_row_t *row);
+int haproxy_stat_column(const haproxy_stat_t *stat, const char *name);
+int haproxy_stat_value(const haproxy_stat_row_t *row, int column, haproxy_field_t *value);
+void haproxy_stat_map(const haproxy_stat_t *stat, struct zbx_json *j);
+
+/* show stat typed / show info typed, see typed.c */
+int haproxy_typed_type(const char *ptr, size_t len);
+int haproxy_typed_nature(const char *tags, size_t len);
+void haproxy_typed_value_parse(int type, const char *ptr, size_t len, haproxy_value_t *value);
+haproxy_typed_t *haproxy_typed_parse(const char *data, size_t len, haproxy_arena_t *arena);
+const haproxy_typed_t *haproxy_typed_get(haproxy_snapshot_t *snapshot);
+int haproxy_typed_column(const haproxy_typed_t *typed, const char *name);
+int haproxy_typed_value(const haproxy_typed_t *typed, int column, int row, haproxy_value_t *value);
+
+/* filtered show stat, see filter.c */
+void haproxy_filter_init(int ttl);
+const haproxy_stat_row_t *haproxy_stat_filter_row(const haproxy_stat_t *stat, const char *pxname,
+                                                  const char *svname);
+int haproxy_stat_filter(const haproxy_endpoint_t *endpoint, const char *pxname, const char *svname, int stale,
+                        char **cmd, char **error);
+void haproxy_filter_destroy(void);
+
+/* aggregates over show stat rows, see agg.c */
+int haproxy_stat_aggregate(const haproxy_stat_t *stat, const char *scope_text, const char *field,
+                           const char *mode, haproxy_value_t *result, char **error);
+int haproxy_typed_aggregate(const haproxy_typed_t *typed, const char *scope_text, const char *field,
+                            const char *mode, haproxy_value_t *result, char **error);
+
+/* low-level discovery, see discovery.c */
+int haproxy_stat_discovery(const char *data, size_t len, int type, struct zbx_json *j);
+
+/* topology fingerprint, see topology.c */
+int haproxy_topology_discovery(const haproxy_endpoint_t *endpoint, haproxy_snapshot_t *snapshot, int type,
+                               char **lld);
+int haproxy_topology_version(const haproxy_endpoint_t *endpoint, haproxy_snapshot_t *snapshot,
+                             zbx_uint64_t *version);
+int haproxy_topology_changes(const haproxy_endpoint_t *endpoint, haproxy_snapshot_t *snapshot,
+                             struct zbx_json *j);
+void haproxy_topology_destroy(void);
+
+/* show info, see info.c */
+int haproxy_info_field_nature(int id);
+haproxy_info_t *haproxy_info_parse(const char *data, size_t len, haproxy_arena_t *arena);
+haproxy_info_t *haproxy_info_parse_typed(const char *data, size_t len, haproxy_arena_t *arena);
+const haproxy_info_t *haproxy_info_get(haproxy_snapshot_t *snapshot);
+const haproxy_info_t *haproxy_info_typed_get(haproxy_snapshot_t *snapshot);
+const haproxy_value_t *haproxy_info_find(const haproxy_info_t *info, const char *name);
+void haproxy_info_json(const haproxy_info_t *info, struct zbx_json *j);
+
+/* show pools, see pools.c */
+haproxy_pools_t *haproxy_pools_parse(const char *data, size_t len, haproxy_arena_t *arena);
+const haproxy_pools_t *haproxy_pools_get(haproxy_snapshot_t *snapshot);
+const haproxy_pool_t *haproxy_pools_find(const haproxy_pools_t *pools, const char *name);
+int haproxy_pool_metric(const haproxy_pool_t *pool, const char *metric, haproxy_value_t *value);
+void haproxy_pools_discovery(const haproxy_pools_t *pools, struct zbx_json *j);
+
+/* show activity, see activity.c */
+haproxy_activity_t *haproxy_activity_parse(const char *data, size_t len, haproxy_arena_t *arena);
+const haproxy_activity_t *haproxy_activity_get(haproxy_snapshot_t *snapshot);
+const haproxy_activity_counter_t *haproxy_activity_find(const haproxy_activity_t *activity, const char *name);
+int haproxy_activity_aggregate(const double *v, int n, int integer, const char *mode, haproxy_value_t *value,
+                               char **error);
+
+/* rates of counters, see rate.c */
+int haproxy_stat_rate(const haproxy_endpoint_t *endpoint, haproxy_snapshot_t *snapshot,
+                      haproxy_snapshot_t *previous, const char *pxname, const char *svname, const char *field,
+                      double *value, char **error);
+int haproxy_info_rate(const haproxy_endpoint_t *endpoint, haproxy_snapshot_t *snapshot,
+                      haproxy_snapshot_t *previous, const char *field, double *value, char **error);
+int haproxy_typed_rate(const haproxy_endpoint_t *endpoint, haproxy_snapshot_t *snapshot,
+                       haproxy_snapshot_t *previous, const char *pxname, const char *svname, const char *field,
+                       double *value, char **error);
+int haproxy_activity_rate(const haproxy_endpoint_t *endpoint, haproxy_snapshot_t *snapshot,
+                          haproxy_snapshot_t *previous, const char *name, const char *mode,
+                          haproxy_value_t *value, char **error);
@@ -0,0 +1,275 @@
+#include "haproxy.h"
+
+/*
+    show info - one "Name: value" line per field:
+    Name: HAProxy
+    Version: 1.9.8
+    Pid: 1234
+    https://cbonte.github.io/haproxy-dconv/1.9/management.html#9.3-show%20info
+
+    The response is parsed once per snapshot, numbers are converted on the
+    way and the known fields (see haproxy.h) are indexed by their id.
+    show info typed is parsed into the same lines, see typed.c.
+*/
+
+#define INFO_FIELD(id, name, nature)    name,
+static const char *info_field_names[] = {HAPROXY_INFO_FIELDS};
+#undef INFO_FIELD
+
+#define INFO_FIELD(id, name, nature)    HAPROXY_NATURE_##nature,
+static const int info_field_natures[] = {HAPROXY_INFO_FIELDS};
+#undef INFO_FIELD
+
+static haproxy_names_t info_fields;
+static pthread_once_t info_fields_once = PTHREAD_ONCE_INIT;
+
+/******************************************************************************
+******************************************************************************/
+static void info_fields_init(void)
+{
+    haproxy_names_init(&info_fields, info_field_names, HAPROXY_INFO_FIELD_COUNT);
+}
+
+/******************************************************************************
+* Return value: HAPROXY_INFO_* id of the field or -1 if the field is unknown *
+******************************************************************************/
+static int info_field_find(const char *name, size_t len)
+{
+    pthread_once(&info_fields_once, info_fields_init);
+
+    return haproxy_names_find(&info_fields, name, len);
+}
+
+/******************************************************************************
+* Return value: HAPROXY_NATURE_* of the field                                *
+******************************************************************************/
+int haproxy_info_field_nature(int id)
+{
+    return info_field_natures[id];
+}
+
+/******************************************************************************
+******************************************************************************/
+static haproxy_info_t *info_create(haproxy_arena_t *arena)
+{
+    haproxy_info_t *info;
+    int i;
+
+    info = (haproxy_info_t *)haproxy_arena_alloc(arena, sizeof(haproxy_info_t));
+    info->arena = arena;
+    info->lines = NULL;
+    info->nlines = 0;
+    info->lines_alloc = 0;
+
+    for (i = 0; i < HAPROXY_INFO_FIELD_COUNT; i++)
+        info->index[i] = -1;
+
+    return info;
+}
+
+/******************************************************************************
+* Return value: the next line to fill, indexed if the field is known         *
+******************************************************************************/
+static haproxy_info_line_t *info_add_line(haproxy_info_t *info, const char *name, size_t len, int *id)
+{
+    haproxy_info_line_t *line;
+    int lines_alloc;
+
+    if (info->nlines == info->lines_alloc)
+    {
+        lines_alloc = (0 == info->lines_alloc ? 64 : info->lines_alloc * 2);
+        info->lines = (haproxy_info_line_t *)haproxy_arena_realloc(info->arena, info->lines,
+                                                                   info->lines_alloc * sizeof(haproxy_info_line_t),
+                                                                   lines_alloc * sizeof(haproxy_info_line_t));
+        info->lines_alloc = lines_alloc;
+    }
+
+    line = &info->lines[info->nlines];
+    line->name.ptr = name;
+    line->name.len = len;
+
+    if (-1 != (*id = info_field_find(name, len)))
+        info->index[*id] = info->nlines;
+
+    info->nlines++;
+
+    return line;
+}
+
+/******************************************************************************
+* Return value: the parsed response or NULL if there are no fields           *
+******************************************************************************/
+static haproxy_info_t *info_check(haproxy_info_t *info)
+{
+    if (0 == info->nlines)
+        return NULL;
+
+    return info;
+}
+
+/******************************************************************************
+* Parses show info output into the arena, the result points into the data so *
+* the data must outlive it.                                                  *
+*                                                                            *
+* Return value: the parsed response or NULL if there are no fields           *
+******************************************************************************/
+haproxy_info_t *haproxy_info_parse(const char *data, size_t len, haproxy_arena_t *arena)
+{
+    const char *end = data + len, *p = data, *eol, *sep, *value;
+    haproxy_info_t *info;
+    haproxy_info_line_t *line;
+    int id;
+
+    info = info_create(arena);
+
+    for (; p < end; p = eol + 1)
+    {
+        if (NULL == (eol = (const char *)memchr(p, '\n', (size_t)(end - p))))
+            eol = end;
+
+        if (NULL == (sep = (const char *)memchr(p, ':', (size_t)(eol - p))) || sep == p)
+            continue;
+
+        value = sep + 1;
+        if (value < eol && ' ' == *value)
+            value++;
+
+        line = info_add_line(info, p, (size_t)(sep - p), &id);
+        haproxy_value_parse(value, (size_t)(eol - value), &line->value);
+        line->nature = (-1 != id ? info_field_natures[id] : HAPROXY_NATURE_OUTPUT);
+    }
+
+    return info_check(info);
+}
+
+/******************************************************************************
+* Parses show info typed output, "<position>.<name>.<process>:<tags>:<type>: *
+* <value>" lines: the values are converted as declared and the nature is     *
+* taken from the tags.                                                       *
+*                                                                            *
+* Return value: the parsed response or NULL if there are no fields           *
+******************************************************************************/
+haproxy_info_t *haproxy_info_parse_typed(const char *data, size_t len, haproxy_arena_t *arena)
+{
+    const char *end = data + len, *p = data, *eol, *colon, *name, *proc, *tags, *type, *value;
+    haproxy_info_t *info;
+    haproxy_info_line_t *line;
+    int id, value_type;
+
+    info = info_create(arena);
+
+    for (; p < end; p = eol + 1)
+    {
+        if (NULL == (eol = (const char *)memchr(p, '\n', (size_t)(end - p))))
+            eol = end;
+
+        /* the name may have dots, the position and the process may not */
+        if (NULL == (colon = (const char *)memchr(p, ':', (size_t)(eol - p))) ||
+                NULL == (name = (const char *)memchr(p, '.', (size_t)(colon - p))))
+        {
+            continue;
+        }
+
+        for (proc = colon, name++; proc > name && '.' != proc[-1]; proc--)
+            ;
+
+        if (proc - 1 <= name)
+            continue;
+
+        tags = colon + 1;
+
+        if (NULL == (type = (const char *)memchr(tags, ':', (size_t)(eol - tags))) ||
+                NULL == (value = (const char *)memchr(type + 1, ':', (size_t)(eol - type - 1))) ||
+                -1 == (value_type = haproxy_typed_type(type + 1, (size_t)(value - type - 1))))
+        {
+            continue;
+        }
+
+        value++;
+        line = info_add_line(info, name, (size_t)(proc - 1 - name), &id);
+        haproxy_typed_value_parse(value_type, value, (size_t)(eol - value), &line->value);
+        line->nature = haproxy_typed_nature(tags, (size_t)(type - tags));
+    }
+
+    return info_check(info);
+}
+
+/******************************************************************************
+******************************************************************************/
+static void *info_parse(const char *data, size_t len, haproxy_arena_t *arena)
+{
+    return haproxy_info_parse(data, len, arena);
+}
+
+/******************************************************************************
+******************************************************************************/
+static void *info_parse_typed(const char *data, size_t len, haproxy_arena_t *arena)
+{
+    return haproxy_info_parse_typed(data, len, arena);
+}
+
+/******************************************************************************
+* Return value: parsed show info snapshot, it is parsed on first use and     *
+*               freed with the snapshot; NULL if it cannot be parsed         *
+******************************************************************************/
+const haproxy_info_t *haproxy_info_get(haproxy_snapshot_t *snapshot)
+{
+    return (const haproxy_info_t *)haproxy_snapshot_parsed(snapshot, info_parse);
+}
+
+/******************************************************************************
+* Return value: parsed show info typed snapshot, as haproxy_info_get()       *
+******************************************************************************/
+const haproxy_info_t *haproxy_info_typed_get(haproxy_snapshot_t *snapshot)
+{
+    return (const haproxy_info_t *)haproxy_snapshot_parsed(snapshot, info_parse_typed);
+}
+
+/******************************************************************************
+* Return value: value of the field or NULL if HAProxy did not report it      *
+******************************************************************************/
+const haproxy_value_t *haproxy_info_find(const haproxy_info_t *info, const char *name)
+{
+    size_t len = strlen(name);
+    int i, id;
+
+    if (-1 != (id = info_field_find(name, len)))
+        return -1 != info->index[id] ? &info->lines[info->index[id]].value : NULL;
+
+    /* a field added in a later HAProxy version */
+    for (i = 0; i < info->nlines; i++)
+    {
+        if (info->lines[i].name.len == len && 0 == memcmp(info->lines[i].name.ptr, name, len))
+            return &info->lines[i].value;
+    }
+
+    return NULL;
+}
+
+/******************************************************************************
+* Adds the fields as {"Name":"HAProxy","Pid":1234,...}, numbers are added    *
+* as JSON numbers.                                                           *
+******************************************************************************/
+void haproxy_info_json(const haproxy_info_t *info, struct zbx_json *j)
+{
+    const haproxy_info_line_t *line;
+    char *name = NULL, *value = NULL;
+    size_t name_alloc = 0, name_offset, value_alloc = 0, value_offset;
+    int i;
+
+    for (i = 0; i < info->nlines; i++)
+    {
+        line = &info->lines[i];
+        name_offset = 0;
+        value_offset = 0;
+
+        zbx_strncpy_alloc(&name, &name_alloc, &name_offset, line->name.ptr, line->name.len);
+        zbx_strncpy_alloc(&value, &value_alloc, &value_offset, line->value.text.ptr, line->value.text.len);
+
+        zbx_json_addstring(j, name, value,
+                           HAPROXY_VALUE_STR == line->value.type ? ZBX_JSON_TYPE_STRING : ZBX_JSON_TYPE_INT);
+    }
+
+    zbx_free(name);
+    zbx_free(value);
+}
@@ -0,0 +1,352 @@
+#include "haproxy.h"
+
+/*
+    The module's own statistics for haproxy.module.stats: per endpoint and
+    command the requests sent to HAProxy (latency, bytes read, failures,
+    timeouts, truncated responses), how the cache served the item checks
+    (hits, coalesced waits, misses) and the time spent parsing responses,
+    per endpoint the connections opened and reopened.
+
+    The counters are updated with atomic adds and the latencies are kept in
+    log scale histograms (4 buckets per power of two, microseconds), so the
+    hot path takes no lock. A record is looked up without a lock either:
+    records are only ever appended (under stats_lock) and never moved or
+    freed before zbx_module_uninit(), the count is published after the
+    record. The cache keeps the record of its entry, the lookup is done per
+    request only by conn.c.
+
+    Every agent process has its own statistics, a check reports the ones of
+    the process serving it.
+*/
+
+#define STATS_MAX    1024
+
+static haproxy_modstats_t *records[STATS_MAX];
+static int records_num = 0;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *counter_names[] = {"requests", "failures", "timeouts", "truncated", "bytes", "hits", "waits",
+                                      "misses", "connects", "reconnects"};
+
+/******************************************************************************
+* Filtered show stat commands share one record, there may be one per server. *
+******************************************************************************/
+static const char *stats_command(const char *cmd)
+{
+    if (0 == strncmp(cmd, "show stat ", 10) && (('0' <= cmd[10] && '9' >= cmd[10]) || '-' == cmd[10]))
+        return "show stat <iid> <type> <sid>";
+
+    return cmd;
+}
+
+/******************************************************************************
+******************************************************************************/
+static haproxy_modstats_t *stats_find(const haproxy_endpoint_t *endpoint, const char *cmd, int num)
+{
+    haproxy_modstats_t *stats;
+    int i;
+
+    for (i = 0; i < num; i++)
+    {
+        stats = records[i];
+
+        if ((NULL == cmd ? NULL == stats->cmd : NULL != stats->cmd && 0 == strcmp(stats->cmd, cmd)) &&
+                haproxy_endpoint_equal(&stats->endpoint, endpoint))
+        {
+            return stats;
+        }
+    }
+
+    return NULL;
+}
+
+/******************************************************************************
+* Gets the record of the command (NULL - of the endpoint), it is added the   *
+* first time.                                                                *
+*                                                                            *
+* Return value: the record or NULL if there is no room for it                *
+******************************************************************************/
+haproxy_modstats_t *haproxy_modstats_get(const haproxy_endpoint_t *endpoint, const char *cmd)
+{
+    haproxy_modstats_t *stats;
+    int num;
+
+    if (NULL != cmd)
+        cmd = stats_command(cmd);
+
+    num = __atomic_load_n(&records_num, __ATOMIC_ACQUIRE);
+
+    if (NULL != (stats = stats_find(endpoint, cmd, num)))
+        return stats;
+
+    pthread_mutex_lock(&stats_lock);
+
+    /* added meanwhile */
+    if (NULL == (stats = stats_find(endpoint, cmd, records_num)) && STATS_MAX > records_num)
+    {
+        stats = (haproxy_modstats_t *)zbx_malloc(NULL, sizeof(haproxy_modstats_t));
+        memset(stats, 0, sizeof(haproxy_modstats_t));
+        stats->endpoint = *endpoint;
+        stats->cmd = (NULL == cmd ? NULL : zbx_strdup(NULL, cmd));
+
+        records[records_num] = stats;
+        __atomic_store_n(&records_num, records_num + 1, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_unlock(&stats_lock);
+
+    return stats;
+}
+
+/******************************************************************************
+******************************************************************************/
+void haproxy_modstats_add(haproxy_modstats_t *stats, int counter, zbx_uint64_t value)
+{
+    if (NULL != stats)
+        __atomic_fetch_add(&stats->counters[counter], value, __ATOMIC_RELAXED);
+}
+
+/******************************************************************************
+* Return value: the bucket of the microseconds                               *
+******************************************************************************/
+static int histogram_bucket(zbx_uint64_t us)
+{
+    int e = 0;
+
+    if (4 > us)
+        return (int)us;
+
+    /* us >> e is 4 - 7, the bucket is 4 * (e + 1) + (us >> e) - 4 */
+    while (8 <= (us >> e))
+        e++;
+
+    return MIN(4 * e + (int)(us >> e), HAPROXY_HISTOGRAM_BUCKETS - 1);
+}
+
+/******************************************************************************
+* Return value: the middle of the bucket, microseconds                       *
+******************************************************************************/
+static zbx_uint64_t histogram_value(int bucket)
+{
+    int e;
+
+    if (4 > bucket)
+        return (zbx_uint64_t)bucket;
+
+    e = bucket / 4 - 1;
+
+    return ((zbx_uint64_t)(4 + bucket % 4) << e) + (((zbx_uint64_t)1 << e) - 1) / 2;
+}
+
+/******************************************************************************
+******************************************************************************/
+static void histogram_add(haproxy_histogram_t *histogram, double seconds)
+{
+    zbx_uint64_t us = (0 < seconds ? (zbx_uint64_t)(seconds * 1000000) : 0), max;
+
+    __atomic_fetch_add(&histogram->buckets[histogram_bucket(us)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->sum, us, __ATOMIC_RELAXED);
+
+    max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+
+    while (us > max && !__atomic_compare_exchange_n(&histogram->max, &max, us, 0, __ATOMIC_RELAXED,
+                                                    __ATOMIC_RELAXED))
+    {
+        ;
+    }
+}
+
+/******************************************************************************
+* Records the time of a request to HAProxy.                                  *
+******************************************************************************/
+void haproxy_modstats_latency(haproxy_modstats_t *stats, double seconds)
+{
+    if (NULL != stats)
+        histogram_add(&stats->latency, seconds);
+}
+
+/******************************************************************************
+* Records the time of parsing a response.                                    *
+******************************************************************************/
+void haproxy_modstats_parse(haproxy_modstats_t *stats, double seconds)
+{
+    if (NULL != stats)
+        histogram_add(&stats->parse, seconds);
+}
+
+/******************************************************************************
+* Adds {"count":...,"avg":...,"p50":...,"p95":...,"p99":...,"max":...}, the  *
+* percentiles are the middle of their bucket (within 12.5%).                 *
+******************************************************************************/
+static void histogram_json(const haproxy_histogram_t *histogram, const char *name, struct zbx_json *j)
+{
+    static const struct
+    {
+        const char  *name;
+        int         permille;
+    }
+    percentiles[] = {{"p50", 500}, {"p95", 950}, {"p99", 990}};
+    zbx_uint64_t buckets[HAPROXY_HISTOGRAM_BUCKETS], count = 0, sum, max, rank, seen;
+    char buf[MAX_ID_LEN + 1];
+    int i, p;
+
+    for (i = 0; i < HAPROXY_HISTOGRAM_BUCKETS; i++)
+    {
+        buckets[i] = __atomic_load_n(&histogram->buckets[i], __ATOMIC_RELAXED);
+        count += buckets[i];
+    }
+
+    sum = __atomic_load_n(&histogram->sum, __ATOMIC_RELAXED);
+    max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+
+    zbx_json_addobject(j, name);
+    zbx_snprintf(buf, sizeof(buf), ZBX_FS_UI64, count);
+    zbx_json_addstring(j, "count", buf, ZBX_JSON_TYPE_INT);
+    zbx_snprintf(buf, sizeof(buf), ZBX_FS_UI64, 0 == count ? 0 : sum / count);
+    zbx_json_addstring(j, "avg", buf, ZBX_JSON_TYPE_INT);
+
+    for (p = 0; p < (int)ARRSIZE(percentiles); p++)
+    {
+        rank = (count * percentiles[p].permille + 999) / 1000;
+
+        for (i = 0, seen = 0; i < HAPROXY_HISTOGRAM_BUCKETS - 1 && seen + buckets[i] < rank; i++)
+            seen += buckets[i];
+
+        zbx_snprintf(buf, sizeof(buf), ZBX_FS_UI64, 0 == count ? 0 : MIN(histogram_value(i), max));
+        zbx_json_addstring(j, percentiles[p].name, buf, ZBX_JSON_TYPE_INT);
+    }
+
+    zbx_snprintf(buf, sizeof(buf), ZBX_FS_UI64, max);
+    zbx_json_addstring(j, "max", buf, ZBX_JSON_TYPE_INT);
+    zbx_json_close(j);
+}
+
+/******************************************************************************
+******************************************************************************/
+static void counters_json(const haproxy_modstats_t *stats, int first, int last, struct zbx_json *j)
+{
+    char buf[MAX_ID_LEN + 1];
+    int c;
+
+    for (c = first; c <= last; c++)
+    {
+        zbx_snprintf(buf, sizeof(buf), ZBX_FS_UI64,
+                     NULL == stats ? 0 : __atomic_load_n(&stats->counters[c], __ATOMIC_RELAXED));
+        zbx_json_addstring(j, counter_names[c], buf, ZBX_JSON_TYPE_INT);
+    }
+}
+
+/******************************************************************************
+******************************************************************************/
+static void command_json(const haproxy_modstats_t *stats, struct zbx_json *j)
+{
+    zbx_uint64_t hits, misses;
+    char buf[MAX_ID_LEN + 1];
+
+    zbx_json_addobject(j, NULL);
+    zbx_json_addstring(j, "command", stats->cmd, ZBX_JSON_TYPE_STRING);
+    counters_json(stats, HAPROXY_MODSTATS_REQUESTS, HAPROXY_MODSTATS_MISSES, j);
+
+    hits = __atomic_load_n(&stats->counters[HAPROXY_MODSTATS_HITS], __ATOMIC_RELAXED);
+    misses = __atomic_load_n(&stats->counters[HAPROXY_MODSTATS_MISSES], __ATOMIC_RELAXED);
+    zbx_snprintf(buf, sizeof(buf), "%.3f", 0 == hits + misses ? 0 : (double)hits / (double)(hits + misses));
+    zbx_json_addstring(j, "hit_ratio", buf, ZBX_JSON_TYPE_INT);
+
+    histogram_json(&stats->latency, "latency_us", j);
+    histogram_json(&stats->parse, "parse_us", j);
+    zbx_json_close(j);
+}
+
+/******************************************************************************
+* The endpoint as given in the keys: path or host:port, then @<processes>.   *
+******************************************************************************/
+static void endpoint_text(const haproxy_endpoint_t *endpoint, char *buf, size_t size)
+{
+    size_t offset;
+
+    if (HAPROXY_ENDPOINT_NET == endpoint->type && NULL != strchr(endpoint->address, ':'))
+        offset = zbx_snprintf(buf, size, "[%s]", endpoint->address);
+    else
+        offset = zbx_strlcpy(buf, endpoint->address, size);
+
+    if (HAPROXY_ENDPOINT_NET == endpoint->type && NULL == strchr(endpoint->address, '*'))
+        offset += zbx_snprintf(buf + offset, size - offset, ":%d", endpoint->port);
+
+    if (0 != endpoint->process)
+        zbx_snprintf(buf + offset, size - offset, "@%d", endpoint->process);
+    else if (0 != endpoint->procs_first)
+        zbx_snprintf(buf + offset, size - offset, "@%d-%d", endpoint->procs_first, endpoint->procs_last);
+}
+
+/******************************************************************************
+* {"endpoints":[{"endpoint":...,"connects":...,"reconnects":...,             *
+*                "commands":[{"command":...,"requests":...,...},...]},...]}  *
+* of all endpoints or only of the one given.                                 *
+******************************************************************************/
+void haproxy_modstats_json(const haproxy_endpoint_t *endpoint, struct zbx_json *j)
+{
+    const haproxy_modstats_t *stats;
+    char buf[HAPROXY_ADDRESS_LEN + 32];
+    int num, i, k;
+
+    num = __atomic_load_n(&records_num, __ATOMIC_ACQUIRE);
+
+    zbx_json_addarray(j, "endpoints");
+
+    for (i = 0; i < num; i++)
+    {
+        stats = records[i];
+
+        if (NULL != endpoint && !haproxy_endpoint_equal(&stats->endpoint, endpoint))
+            continue;
+
+        /* each endpoint once, where it is met first */
+        for (k = 0; k < i; k++)
+        {
+            if (haproxy_endpoint_equal(&records[k]->endpoint, &stats->endpoint))
+                break;
+        }
+
+        if (k < i)
+            continue;
+
+        endpoint_text(&stats->endpoint, buf, sizeof(buf));
+
+        zbx_json_addobject(j, NULL);
+        zbx_json_addstring(j, "endpoint", buf, ZBX_JSON_TYPE_STRING);
+        counters_json(stats_find(&stats->endpoint, NULL, num), HAPROXY_MODSTATS_CONNECTS,
+                      HAPROXY_MODSTATS_RECONNECTS, j);
+        zbx_json_addarray(j, "commands");
+
+        for (k = i; k < num; k++)
+        {
+            if (NULL != records[k]->cmd && haproxy_endpoint_equal(&records[k]->endpoint, &stats->endpoint))
+                command_json(records[k], j);
+        }
+
+        zbx_json_close(j);
+        zbx_json_close(j);
+    }
+
+    zbx_json_close(j);
+}
+
+/******************************************************************************
+******************************************************************************/
+void haproxy_modstats_destroy(void)
+{
+    int i;
+
+    pthread_mutex_lock(&stats_lock);
+
+    for (i = 0; i < records_num; i++)
+    {
+        zbx_free(records[i]->cmd);
+        zbx_free(records[i]);
+    }
+
+    records_num = 0;
+
+    pthread_mutex_unlock(&stats_lock);
+}
@@ -1,4 +1,9 @@
 #include "haproxy.h"
+#include "cfg.h"
+
+#ifndef MODULE_CONFIG_FILE
+#    define MODULE_CONFIG_FILE    "/etc/zabbix/zabbix_module_haproxy.conf"
+#endif
 
 /*
 LOG_LEVEL_EMPTY   0 (none)
@@ -11,11 +16,19 @@ LOG_LEVEL_TRACE   5 (trace)
 
 static int item_timeout = 0;
 
+/* module configuration, see MODULE_CONFIG_FILE */
+static int cache_ttl = 5;
+static int refresh_interval = 0;
+static char **endpoints = NULL;
+static int resolve_ttl = 300;
+static int warmup = 0;
+
 /* 
     autodiscovery 
 */
 static int zbx_module_haproxy_frontend_autodiscovery(AGENT_REQUEST *request, AGENT_RESULT *result);
 static int zbx_module_haproxy_backend_autodiscovery(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_haproxy_server_autodiscovery(AGENT_REQUEST *request, AGENT_RESULT *result);
 
 /* 
     stat - report counters for each proxy and server 
@@ -23,6 +36,15 @@ static int zbx_module_haproxy_backend_autodiscovery(AGENT_REQUEST *request, AGEN
 */
 static int zbx_module_haproxy_stat_csv(AGENT_REQUEST *request, AGENT_RESULT *result);      /* show stat */
 static int zbx_module_haproxy_stat_json(AGENT_REQUEST *request, AGENT_RESULT *result);     /* show stat json */
+static int zbx_module_haproxy_stat_map(AGENT_REQUEST *request, AGENT_RESULT *result);      /* compact json */
+static int zbx_module_haproxy_stat(AGENT_REQUEST *request, AGENT_RESULT *result);          /* single value */
+static int zbx_module_haproxy_stat_rate(AGENT_REQUEST *request, AGENT_RESULT *result);     /* per second */
+static int zbx_module_haproxy_stat_agg(AGENT_REQUEST *request, AGENT_RESULT *result);      /* over rows */
+static int zbx_module_haproxy_stat_filter(AGENT_REQUEST *request, AGENT_RESULT *result);   /* one proxy/server */
+static int zbx_module_haproxy_stat_typed(AGENT_REQUEST *request, AGENT_RESULT *result);    /* show stat typed */
+static int zbx_module_haproxy_stat_typed_rate(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_haproxy_stat_typed_agg(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_haproxy_stat_multi(AGENT_REQUEST *request, AGENT_RESULT *result);    /* many endpoints */
 
 /* 
     info - report information about the running process
@@ -30,30 +52,74 @@ static int zbx_module_haproxy_stat_json(AGENT_REQUEST *request, AGENT_RESULT *re
 */
 static int zbx_module_haproxy_info_text(AGENT_REQUEST *request, AGENT_RESULT *result);     /* show info */
 static int zbx_module_haproxy_info_json(AGENT_REQUEST *request, AGENT_RESULT *result);     /* show info json */
+static int zbx_module_haproxy_info(AGENT_REQUEST *request, AGENT_RESULT *result);          /* single value */
+static int zbx_module_haproxy_info_rate(AGENT_REQUEST *request, AGENT_RESULT *result);     /* per second */
+static int zbx_module_haproxy_info_typed(AGENT_REQUEST *request, AGENT_RESULT *result);    /* show info typed */
 
 /* 
     pools -  report information about the memory pools usage
     https://cbonte.github.io/haproxy-dconv/1.9/management.html#show%20pools 
 */
 static int zbx_module_haproxy_pools_text(AGENT_REQUEST *request, AGENT_RESULT *result);    /* show pools */
+static int zbx_module_haproxy_pools_autodiscovery(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_haproxy_pools(AGENT_REQUEST *request, AGENT_RESULT *result);         /* single value */
 
 /* 
     activity - show per-thread activity stats (for support/developers)
     https://cbonte.github.io/haproxy-dconv/1.9/management.html#show%20activity 
 */
 static int zbx_module_haproxy_activity_text(AGENT_REQUEST *request, AGENT_RESULT *result); /* show activity */
+static int zbx_module_haproxy_activity(AGENT_REQUEST *request, AGENT_RESULT *result);      /* single value */
+static int zbx_module_haproxy_activity_rate(AGENT_REQUEST *request, AGENT_RESULT *result); /* per second */
+
+/* 
+    topology - fingerprint of the discovered frontends, backends and servers
+*/
+static int zbx_module_haproxy_topology_version(AGENT_REQUEST *request, AGENT_RESULT *result);
+static int zbx_module_haproxy_topology_changes(AGENT_REQUEST *request, AGENT_RESULT *result);
+
+/* 
+    cache - age of the responses the other keys are served from
+*/
+static int zbx_module_haproxy_cache_age(AGENT_REQUEST *request, AGENT_RESULT *result);
+
+/* 
+    module - the module's own requests, cache and parsing statistics
+*/
+static int zbx_module_haproxy_module_stats(AGENT_REQUEST *request, AGENT_RESULT *result);
 
 static ZBX_METRIC keys[] =
 /*                    KEY                       FLAG                    FUNCTION               TEST PARAMETERS */
 {
     {"haproxy.frontend.autodiscovery",  CF_HAVEPARAMS, zbx_module_haproxy_frontend_autodiscovery,  NULL},
     {"haproxy.backend.autodiscovery",   CF_HAVEPARAMS, zbx_module_haproxy_backend_autodiscovery,   NULL},
+    {"haproxy.server.autodiscovery",    CF_HAVEPARAMS, zbx_module_haproxy_server_autodiscovery,    NULL},
     {"haproxy.stat.csv",                CF_HAVEPARAMS, zbx_module_haproxy_stat_csv,                NULL},
     {"haproxy.stat.json",               CF_HAVEPARAMS, zbx_module_haproxy_stat_json,               NULL},
+    {"haproxy.stat.map",                CF_HAVEPARAMS, zbx_module_haproxy_stat_map,                NULL},
+    {"haproxy.stat",                    CF_HAVEPARAMS, zbx_module_haproxy_stat,                    NULL},
+    {"haproxy.stat.rate",               CF_HAVEPARAMS, zbx_module_haproxy_stat_rate,               NULL},
+    {"haproxy.stat.agg",                CF_HAVEPARAMS, zbx_module_haproxy_stat_agg,                NULL},
+    {"haproxy.stat.filter",             CF_HAVEPARAMS, zbx_module_haproxy_stat_filter,             NULL},
+    {"haproxy.stat.typed",              CF_HAVEPARAMS, zbx_module_haproxy_stat_typed,              NULL},
+    {"haproxy.stat.typed.rate",         CF_HAVEPARAMS, zbx_module_haproxy_stat_typed_rate,         NULL},
+    {"haproxy.stat.typed.agg",          CF_HAVEPARAMS, zbx_module_haproxy_stat_typed_agg,          NULL},
+    {"haproxy.stat.multi",              CF_HAVEPARAMS, zbx_module_haproxy_stat_multi,              NULL},
     {"haproxy.info.text",               CF_HAVEPARAMS, zbx_module_haproxy_info_text,               NULL},
     {"haproxy.info.json",               CF_HAVEPARAMS, zbx_module_haproxy_info_json,               NULL},
+    {"haproxy.info",                    CF_HAVEPARAMS, zbx_module_haproxy_info,                    NULL},
+    {"haproxy.info.rate",               CF_HAVEPARAMS, zbx_module_haproxy_info_rate,               NULL},
+    {"haproxy.info.typed",              CF_HAVEPARAMS, zbx_module_haproxy_info_typed,              NULL},
     {"haproxy.pools.text",              CF_HAVEPARAMS, zbx_module_haproxy_pools_text,              NULL},
+    {"haproxy.pools.autodiscovery",     CF_HAVEPARAMS, zbx_module_haproxy_pools_autodiscovery,     NULL},
+    {"haproxy.pools",                   CF_HAVEPARAMS, zbx_module_haproxy_pools,                   NULL},
     {"haproxy.activity.text",           CF_HAVEPARAMS, zbx_module_haproxy_activity_text,           NULL},
+    {"haproxy.activity",                CF_HAVEPARAMS, zbx_module_haproxy_activity,                NULL},
+    {"haproxy.activity.rate",           CF_HAVEPARAMS, zbx_module_haproxy_activity_rate,           NULL},
+    {"haproxy.topology.version",        CF_HAVEPARAMS, zbx_module_haproxy_topology_version,        NULL},
+    {"haproxy.topology.changes",        CF_HAVEPARAMS, zbx_module_haproxy_topology_changes,        NULL},
+    {"haproxy.cache.age",               CF_HAVEPARAMS, zbx_module_haproxy_cache_age,               NULL},
+    {"haproxy.module.stats",            CF_HAVEPARAMS, zbx_module_haproxy_module_stats,            NULL},
     {NULL}
 };
 
@@ -88,8 +154,35 @@ int zbx_module_api_version(void)
 ******************************************************************************/
 int zbx_module_init(void)
 {
+    struct cfg_line cfg[] =
+    {
+        /* PARAMETER,       VAR,                TYPE,       MANDATORY,  MIN,    MAX */
+        {"CacheTTL",        &cache_ttl,         TYPE_INT,   PARM_OPT,   0,      3600},
+        {"RefreshInterval", &refresh_interval,  TYPE_INT,   PARM_OPT,   0,      3600},
+        {"Endpoint",        &endpoints,         TYPE_MULTISTRING, PARM_OPT, 0,  0},
+        {"ResolveTTL",      &resolve_ttl,       TYPE_INT,   PARM_OPT,   0,      86400},
+        {"Warmup",          &warmup,            TYPE_INT,   PARM_OPT,   0,      30},
+        {NULL}
+    };
+    char **endpoint;
+
     srand(time(NULL));
 
+    zbx_strarr_init(&endpoints);
+    parse_cfg_file(MODULE_CONFIG_FILE, cfg, ZBX_CFG_FILE_OPTIONAL, ZBX_CFG_STRICT);
+    haproxy_cache_init(cache_ttl, refresh_interval);
+    haproxy_filter_init(cache_ttl);
+    haproxy_resolve_init(resolve_ttl);
+
+    for (endpoint = endpoints; NULL != *endpoint; endpoint++)
+        haproxy_registry_add(*endpoint);
+
+    zbx_strarr_free(endpoints);
+    endpoints = NULL;
+
+    if (0 != warmup)
+        haproxy_registry_warmup(warmup);
+
     zabbix_log(LOG_LEVEL_INFORMATION, 
                "Module: %s - built with: Zabbix: %d.%d.%d (%s:%d)",
                MODULE_NAME, ZABBIX_VERSION_MAJOR, ZABBIX_VERSION_MINOR, ZABBIX_VERSION_PATCH, 
@@ -111,6 +204,14 @@ int zbx_module_init(void)
 ******************************************************************************/
 int zbx_module_uninit(void)
 {
+    haproxy_cache_destroy();
+    haproxy_filter_destroy();
+    haproxy_topology_destroy();
+    haproxy_conn_destroy();
+    haproxy_modstats_destroy();
+    haproxy_registry_destroy();
+    haproxy_symbols_destroy();
+
     return ZBX_MODULE_OK;
 }
 
@@ -140,524 +241,1394 @@ ZBX_METRIC *zbx_module_item_list()
 void zbx_module_item_timeout(int timeout)
 {
     item_timeout = timeout;
+    haproxy_conn_timeout(timeout);
 }
 
 /******************************************************************************
+* Return value: the message of a failed request to HAProxy, to be freed      *
 ******************************************************************************/
-static int zbx_module_haproxy_frontend_autodiscovery(AGENT_REQUEST *request, AGENT_RESULT *result)
+static char *query_error(int ret)
+{
+    if (HAPROXY_RET_TIMEOUT == ret)
+        return zbx_dsprintf(NULL, "Timeout while waiting for HAProxy (%d seconds)", item_timeout);
+
+    return zbx_strdup(NULL, "Cannot send command, see log for details");
+}
+
+/******************************************************************************
+* Sets the result message of a failed request to HAProxy.                    *
+******************************************************************************/
+static void set_query_error(AGENT_RESULT *result, int ret)
+{
+    SET_MSG_RESULT(result, query_error(ret));
+}
+
+/******************************************************************************
+* Gets the response to the command and, if previous is not NULL, the one     *
+* before it. The result message is set on failure.                           *
+******************************************************************************/
+static int get_snapshot_pair(AGENT_RESULT *result, const haproxy_endpoint_t *endpoint, const char *cmd,
+                             haproxy_snapshot_t **snapshot, haproxy_snapshot_t **previous)
 {
-    const char *__function_name = "zbx_module_haproxy_frontend_autodiscovery";
-    char *sockPath = NULL;
-    char *host = NULL; 
-    char *param2 = NULL;
-    int port;
     int ret;
-    int sock;
-    char *cmd = "show stat";
-    char *data = NULL;
 
-    if (request->nparam == 0 || request->nparam > 2)
-    {
-        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid number of parameters (%s:%d)",
-                   MODULE_NAME, __function_name, __FILE__, __LINE__);
-        SET_MSG_RESULT(result, strdup("Invalid number of parameters, see log for details"));
+    if (NULL == previous)
+        ret = haproxy_cache_get(endpoint, cmd, snapshot);
+    else
+        ret = haproxy_cache_get_pair(endpoint, cmd, snapshot, previous);
 
-        return SYSINFO_RET_FAIL;
-    }
+    if (SYSINFO_RET_OK == ret)
+        return SYSINFO_RET_OK;
 
-    if (request->nparam == 1)
-    {
-        /*
-            key: haproxy.frontend.autodiscovery["/run/haproxy/stats.sock"]
-        */
-        sockPath = get_rparam(request, 0);
+    set_query_error(result, ret);
+
+    return SYSINFO_RET_FAIL;
+}
+
+/******************************************************************************
+* Gets the response to the command, the result message is set on failure.    *
+******************************************************************************/
+static int get_snapshot(AGENT_RESULT *result, const haproxy_endpoint_t *endpoint, const char *cmd,
+                        haproxy_snapshot_t **snapshot)
+{
+    return get_snapshot_pair(result, endpoint, cmd, snapshot, NULL);
+}
+
+/******************************************************************************
+* Gets show stat filtered to the proxy (empty svname) or the server, see     *
+* filter.c. A response without the row means the ids have changed, they are  *
+* looked up again once. The result message is set on failure.                *
+******************************************************************************/
+static int get_filtered_snapshot(AGENT_RESULT *result, const haproxy_endpoint_t *endpoint, const char *pxname,
+                                 const char *svname, haproxy_snapshot_t **snapshot, const haproxy_stat_t **stat)
+{
+    char *cmd = NULL, *error = NULL;
+    int stale, ret;
 
-        ret = connect_unix(sockPath, &sock);
-        if (ret != SYSINFO_RET_OK)
+    for (stale = 0; stale < 2; stale++)
+    {
+        if (SYSINFO_RET_OK != (ret = haproxy_stat_filter(endpoint, pxname, svname, stale, &cmd, &error)))
         {
-            SET_MSG_RESULT(result, strdup("Cannot connect, see log"));
+            if (NULL != error)
+                SET_MSG_RESULT(result, error);
+            else
+                set_query_error(result, ret);
+
             return SYSINFO_RET_FAIL;
         }
-    }
-    else if (request->nparam == 2)
-    {
-        /*
-            key: haproxy.frontend.autodiscovery[192.168.1.100, 9999]
-        */
-        host = get_rparam(request, 0);
-        param2 = get_rparam(request, 1);
-        port = atoi(param2);
 
-        ret = connect_net(host, port, &sock);
-        if (ret != SYSINFO_RET_OK)
-        {
-            SET_MSG_RESULT(result, strdup("Cannot connect, see log for details"));
+        ret = get_snapshot(result, endpoint, cmd, snapshot);
+        zbx_free(cmd);
+
+        if (SYSINFO_RET_OK != ret)
             return SYSINFO_RET_FAIL;
-        }
-    }
 
-    ret = send_command(sock, cmd, &data);
-    if (ret != SYSINFO_RET_OK)
-    {
-        SET_MSG_RESULT(result, strdup("Cannot send command, see log for details"));
-        return SYSINFO_RET_FAIL;
+        if (NULL != (*stat = haproxy_stat_get(*snapshot)) && NULL != haproxy_stat_filter_row(*stat, pxname, svname))
+            return SYSINFO_RET_OK;
+
+        haproxy_snapshot_release(*snapshot);
     }
 
-    SET_STR_RESULT(result, zbx_strdup(NULL, data));
-    return SYSINFO_RET_OK;
+    if ('\0' == *svname)
+        SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Cannot find proxy \"%s\"", pxname));
+    else
+        SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Cannot find \"%s/%s\"", pxname, svname));
+
+    return SYSINFO_RET_FAIL;
 }
 
 /******************************************************************************
+* Gets the stats socket from the key parameters:                             *
+*     key["/run/haproxy/stats.sock"] - UNIX socket                           *
+*     key[192.168.1.100, 9999]       - TCP socket                            *
+* the last one optionally followed by processes, see haproxy_endpoint_parse  *
 ******************************************************************************/
-static int zbx_module_haproxy_backend_autodiscovery(AGENT_REQUEST *request, AGENT_RESULT *result)
+static int get_endpoint(AGENT_REQUEST *request, haproxy_endpoint_t *endpoint, const char *function_name)
 {
-    const char *__function_name = "zbx_module_haproxy_backend_autodiscovery";
-    char *sockPath = NULL;
-    char *host = NULL; 
-    char *param2 = NULL;
-    int port;
+    char *param;
     int ret;
-    int sock;
-    char *cmd = "show stat";
-    char *data = NULL;
 
     if (request->nparam == 0 || request->nparam > 2)
     {
         zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid number of parameters (%s:%d)",
-                   MODULE_NAME, __function_name, __FILE__, __LINE__);
-        SET_MSG_RESULT(result, strdup("Invalid number of parameters, see log for details"));
-
+                   MODULE_NAME, function_name, __FILE__, __LINE__);
         return SYSINFO_RET_FAIL;
     }
 
+    /* the same as a single parameter, processes (@1-4) included */
     if (request->nparam == 1)
+        param = zbx_strdup(NULL, get_rparam(request, 0));
+    else
+        param = zbx_dsprintf(NULL, "%s:%s", get_rparam(request, 0), get_rparam(request, 1));
+
+    if (SYSINFO_RET_OK != (ret = haproxy_endpoint_parse(param, endpoint)))
     {
-        /*
-            key: haproxy.backend.autodiscovery["/run/haproxy/stats.sock"]
-        */
-        sockPath = get_rparam(request, 0);
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid endpoint \"%s\" (%s:%d)",
+                   MODULE_NAME, function_name, param, __FILE__, __LINE__);
+    }
 
-        ret = connect_unix(sockPath, &sock);
-        if (ret != SYSINFO_RET_OK)
-        {
-            SET_MSG_RESULT(result, strdup("Cannot connect, see log"));
-            return SYSINFO_RET_FAIL;
-        }
+    zbx_free(param);
+
+    return ret;
+}
+
+/******************************************************************************
+* Sends the command to the stats socket given by the key parameters and      *
+* returns the response as is.                                                *
+******************************************************************************/
+static int get_command_text(AGENT_REQUEST *request, AGENT_RESULT *result, const char *cmd,
+                            const char *function_name)
+{
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot;
+
+    if (SYSINFO_RET_OK != get_endpoint(request, &endpoint, function_name))
+    {
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
+        return SYSINFO_RET_FAIL;
+    }
+
+    if (SYSINFO_RET_OK != get_snapshot(result, &endpoint, cmd, &snapshot))
+        return SYSINFO_RET_FAIL;
+
+    SET_STR_RESULT(result, haproxy_snapshot_detach(snapshot));
+
+    return SYSINFO_RET_OK;
+}
+
+/******************************************************************************
+* Sets the result to a value taken from a response: unsigned integers and    *
+* floats are returned as numbers, anything else as a string.                 *
+******************************************************************************/
+static void set_value_result(AGENT_RESULT *result, const haproxy_field_t *value)
+{
+    char *str;
+    zbx_uint64_t ui64;
+
+    str = (char *)zbx_malloc(NULL, value->len + 1);
+    memcpy(str, value->ptr, value->len);
+    str[value->len] = '\0';
+
+    if (SUCCEED == is_uint64(str, &ui64))
+    {
+        SET_UI64_RESULT(result, ui64);
+        zbx_free(str);
     }
-    else if (request->nparam == 2)
+    else if (SUCCEED == is_double(str))
     {
-        /*
-            key: haproxy.backend.autodiscovery[192.168.1.100, 9999]
-        */
-        host = get_rparam(request, 0);
-        param2 = get_rparam(request, 1);
-        port = atoi(param2);
+        SET_DBL_RESULT(result, atof(str));
+        zbx_free(str);
+    }
+    else
+        SET_STR_RESULT(result, str);
+}
 
-        ret = connect_net(host, port, &sock);
-        if (ret != SYSINFO_RET_OK)
-        {
-            SET_MSG_RESULT(result, strdup("Cannot connect, see log for details"));
-            return SYSINFO_RET_FAIL;
-        }
+/******************************************************************************
+* Sets the result to a parsed value: integers and floats are returned as     *
+* numbers, anything else as a string.                                        *
+******************************************************************************/
+static void set_typed_result(AGENT_RESULT *result, const haproxy_value_t *value)
+{
+    char *str;
+
+    if (HAPROXY_VALUE_INT == value->type && 0 <= value->i64)
+    {
+        SET_UI64_RESULT(result, (zbx_uint64_t)value->i64);
+    }
+    else if (HAPROXY_VALUE_STR != value->type)
+    {
+        SET_DBL_RESULT(result, value->dbl);
+    }
+    else
+    {
+        str = (char *)zbx_malloc(NULL, value->text.len + 1);
+        memcpy(str, value->text.ptr, value->text.len);
+        str[value->text.len] = '\0';
+        SET_STR_RESULT(result, str);
+    }
+}
+
+/******************************************************************************
+* Returns LLD JSON with the show stat lines of the given type, the same JSON  *
+* while the topology does not change (see topology.c).                       *
+******************************************************************************/
+static int get_discovery(AGENT_REQUEST *request, AGENT_RESULT *result, int type, const char *function_name)
+{
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot;
+    char *lld;
+    int ret;
+
+    if (SYSINFO_RET_OK != get_endpoint(request, &endpoint, function_name))
+    {
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
+        return SYSINFO_RET_FAIL;
     }
 
-    ret = send_command(sock, cmd, &data);
-    if (ret != SYSINFO_RET_OK)
+    if (SYSINFO_RET_OK != get_snapshot(result, &endpoint, "show stat", &snapshot))
+        return SYSINFO_RET_FAIL;
+
+    ret = haproxy_topology_discovery(&endpoint, snapshot, type, &lld);
+    haproxy_snapshot_release(snapshot);
+
+    if (SYSINFO_RET_OK != ret)
     {
-        SET_MSG_RESULT(result, strdup("Cannot send command, see log for details"));
+        SET_MSG_RESULT(result, strdup("Cannot parse show stat output, see log for details"));
         return SYSINFO_RET_FAIL;
     }
 
-    SET_STR_RESULT(result, zbx_strdup(NULL, data));
+    SET_STR_RESULT(result, lld);
+
     return SYSINFO_RET_OK;
 }
 
+/******************************************************************************
+******************************************************************************/
+static int zbx_module_haproxy_frontend_autodiscovery(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.frontend.autodiscovery["/run/haproxy/stats.sock"]
+        key: haproxy.frontend.autodiscovery[192.168.1.100, 9999]
+    */
+    return get_discovery(request, result, HAPROXY_TYPE_FRONTEND, "zbx_module_haproxy_frontend_autodiscovery");
+}
+
+/******************************************************************************
+******************************************************************************/
+static int zbx_module_haproxy_backend_autodiscovery(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.backend.autodiscovery["/run/haproxy/stats.sock"]
+        key: haproxy.backend.autodiscovery[192.168.1.100, 9999]
+    */
+    return get_discovery(request, result, HAPROXY_TYPE_BACKEND, "zbx_module_haproxy_backend_autodiscovery");
+}
+
+/******************************************************************************
+******************************************************************************/
+static int zbx_module_haproxy_server_autodiscovery(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.server.autodiscovery["/run/haproxy/stats.sock"]
+        key: haproxy.server.autodiscovery[192.168.1.100, 9999]
+    */
+    return get_discovery(request, result, HAPROXY_TYPE_SERVER, "zbx_module_haproxy_server_autodiscovery");
+}
+
 /******************************************************************************
 ******************************************************************************/
 static int zbx_module_haproxy_stat_csv(AGENT_REQUEST *request, AGENT_RESULT *result)
 {
-    const char *__function_name = "zbx_module_haproxy_stat_csv";
-    char *sockPath = NULL;
-    char *host = NULL; 
-    char *param2 = NULL;
-    int port;
-    int ret;
-    int sock;
-    char *cmd = "show stat";
-    char *data = NULL;
+    /*
+        key: haproxy.stat.csv["/run/haproxy/stats.sock"]
+        key: haproxy.stat.csv[192.168.1.100, 9999]
+    */
+    return get_command_text(request, result, "show stat", "zbx_module_haproxy_stat_csv");
+}
 
-    if (request->nparam == 0 || request->nparam > 2)
+/******************************************************************************
+******************************************************************************/
+static int zbx_module_haproxy_stat_json(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.stat.json["/run/haproxy/stats.sock"]
+        key: haproxy.stat.json[192.168.1.100, 9999]
+    */
+    return get_command_text(request, result, "show stat json", "zbx_module_haproxy_stat_json");
+}
+
+/******************************************************************************
+* Compact JSON for dependent items: {"http-in/FRONTEND":{"scur":0,...},...}, *
+* a value is taken with $['http-in/FRONTEND'].scur                           *
+******************************************************************************/
+static int zbx_module_haproxy_stat_map(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.stat.map["/run/haproxy/stats.sock"]
+        key: haproxy.stat.map[192.168.1.100, 9999]
+    */
+    const char *__function_name = "zbx_module_haproxy_stat_map";
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot;
+    const haproxy_stat_t *stat;
+    struct zbx_json j;
+
+    if (SYSINFO_RET_OK != get_endpoint(request, &endpoint, __function_name))
+    {
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
+        return SYSINFO_RET_FAIL;
+    }
+
+    if (SYSINFO_RET_OK != get_snapshot(result, &endpoint, "show stat", &snapshot))
+        return SYSINFO_RET_FAIL;
+
+    if (NULL == (stat = haproxy_stat_get(snapshot)))
+    {
+        haproxy_snapshot_release(snapshot);
+        SET_MSG_RESULT(result, strdup("Cannot parse show stat output"));
+        return SYSINFO_RET_FAIL;
+    }
+
+    zbx_json_init(&j, ZBX_JSON_STAT_BUF_LEN);
+    haproxy_stat_map(stat, &j);
+    haproxy_snapshot_release(snapshot);
+
+    SET_STR_RESULT(result, zbx_strdup(NULL, j.buffer));
+    zbx_json_free(&j);
+
+    return SYSINFO_RET_OK;
+}
+
+/******************************************************************************
+* haproxy.stat.map of many endpoints, fetched concurrently:                  *
+*     {"endpoints":{"lb1":{"http-in/FRONTEND":{"scur":0,...},...},...},      *
+*      "errors":{"lb2":"Timeout while waiting for HAProxy (3 seconds)"}}     *
+* an endpoint which cannot be queried does not fail the others.              *
+******************************************************************************/
+static int zbx_module_haproxy_stat_multi(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.stat.multi[lb1, lb2, "/run/haproxy/stats.sock", "192.168.1.100:9999"]
+    */
+    const char *__function_name = "zbx_module_haproxy_stat_multi";
+    haproxy_endpoint_t *endpoints;
+    haproxy_snapshot_t **snapshots;
+    const haproxy_stat_t *stat;
+    struct zbx_json j;
+    char *error;
+    int *rets, i;
+
+    if (0 == request->nparam)
     {
         zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid number of parameters (%s:%d)",
                    MODULE_NAME, __function_name, __FILE__, __LINE__);
-        SET_MSG_RESULT(result, strdup("Invalid number of parameters, see log for details"));
-
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
         return SYSINFO_RET_FAIL;
     }
 
-    if (request->nparam == 1)
+    endpoints = (haproxy_endpoint_t *)zbx_malloc(NULL, request->nparam * sizeof(haproxy_endpoint_t));
+
+    for (i = 0; i < request->nparam; i++)
     {
-        /*
-            key: haproxy.stat.csv["/run/haproxy/stats.sock"]
-        */
-        sockPath = get_rparam(request, 0);
+        if (SYSINFO_RET_OK != haproxy_endpoint_parse(get_rparam(request, i), &endpoints[i]))
+        {
+            zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid endpoint \"%s\" (%s:%d)",
+                       MODULE_NAME, __function_name, get_rparam(request, i), __FILE__, __LINE__);
+            SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Invalid endpoint \"%s\"", get_rparam(request, i)));
+            zbx_free(endpoints);
+            return SYSINFO_RET_FAIL;
+        }
 
-        ret = connect_unix(sockPath, &sock);
-        if (ret != SYSINFO_RET_OK)
+        /* the processes of a group are merged by a thread each, see group.c */
+        if (0 != endpoints[i].procs_first)
         {
-            SET_MSG_RESULT(result, strdup("Cannot connect, see log"));
+            SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Groups of processes are not supported (\"%s\")",
+                                                get_rparam(request, i)));
+            zbx_free(endpoints);
             return SYSINFO_RET_FAIL;
         }
     }
-    else if (request->nparam == 2)
+
+    snapshots = (haproxy_snapshot_t **)zbx_malloc(NULL, request->nparam * sizeof(haproxy_snapshot_t *));
+    rets = (int *)zbx_malloc(NULL, request->nparam * sizeof(int));
+
+    for (i = 0; i < request->nparam; i++)
+        snapshots[i] = NULL;
+
+    haproxy_cache_get_multi(endpoints, request->nparam, "show stat", snapshots, rets);
+
+    zbx_json_init(&j, ZBX_JSON_STAT_BUF_LEN);
+    zbx_json_addobject(&j, "endpoints");
+
+    for (i = 0; i < request->nparam; i++)
     {
-        /*
-            key: haproxy.stat.csv[192.168.1.100, 9999]
-        */
-        host = get_rparam(request, 0);
-        param2 = get_rparam(request, 1);
-        port = atoi(param2);
+        if (SYSINFO_RET_OK != rets[i])
+            continue;
 
-        ret = connect_net(host, port, &sock);
-        if (ret != SYSINFO_RET_OK)
+        if (NULL == (stat = haproxy_stat_get(snapshots[i])))
         {
-            SET_MSG_RESULT(result, strdup("Cannot connect, see log for details"));
-            return SYSINFO_RET_FAIL;
+            haproxy_snapshot_release(snapshots[i]);
+            snapshots[i] = NULL;
+            continue;
         }
+
+        zbx_json_addobject(&j, get_rparam(request, i));
+        haproxy_stat_map(stat, &j);
+        zbx_json_close(&j);
     }
 
-    ret = send_command(sock, cmd, &data);
-    if (ret != SYSINFO_RET_OK)
+    zbx_json_close(&j);
+    zbx_json_addobject(&j, "errors");
+
+    for (i = 0; i < request->nparam; i++)
     {
-        SET_MSG_RESULT(result, strdup("Cannot send command, see log for details"));
-        return SYSINFO_RET_FAIL;
+        if (SYSINFO_RET_OK == rets[i] && NULL != snapshots[i])
+            continue;
+
+        if (SYSINFO_RET_OK == rets[i])
+            error = zbx_strdup(NULL, "Cannot parse show stat output");
+        else
+            error = query_error(rets[i]);
+
+        zbx_json_addstring(&j, get_rparam(request, i), error, ZBX_JSON_TYPE_STRING);
+        zbx_free(error);
+    }
+
+    zbx_json_close(&j);
+
+    for (i = 0; i < request->nparam; i++)
+    {
+        if (NULL != snapshots[i])
+            haproxy_snapshot_release(snapshots[i]);
     }
 
-    SET_STR_RESULT(result, zbx_strdup(NULL, data));
+    SET_STR_RESULT(result, zbx_strdup(NULL, j.buffer));
+    zbx_json_free(&j);
+
+    zbx_free(rets);
+    zbx_free(snapshots);
+    zbx_free(endpoints);
+
     return SYSINFO_RET_OK;
 }
 
 /******************************************************************************
 ******************************************************************************/
-static int zbx_module_haproxy_stat_json(AGENT_REQUEST *request, AGENT_RESULT *result)
+static int zbx_module_haproxy_info_text(AGENT_REQUEST *request, AGENT_RESULT *result)
 {
-    const char *__function_name = "zbx_module_haproxy_stat_json";
-    char *sockPath = NULL;
-    char *host = NULL; 
-    char *param2 = NULL;
-    int port;
-    int ret;
-    int sock;
-    char *cmd = "show stat json";
-    char *data = NULL;
+    /*
+        key: haproxy.info.text["/run/haproxy/stats.sock"]
+        key: haproxy.info.text[192.168.1.100, 9999]
+    */
+    return get_command_text(request, result, "show info", "zbx_module_haproxy_info_text");
+}
 
-    if (request->nparam == 0 || request->nparam > 2)
-    {
-        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid number of parameters (%s:%d)",
-                   MODULE_NAME, __function_name, __FILE__, __LINE__);
-        SET_MSG_RESULT(result, strdup("Invalid number of parameters, see log for details"));
+/******************************************************************************
+* The JSON is built from the parsed show info snapshot, the one shared with  *
+* haproxy.info.text and haproxy.info, rather than requested separately.      *
+******************************************************************************/
+static int zbx_module_haproxy_info_json(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.info.json["/run/haproxy/stats.sock"]
+        key: haproxy.info.json[192.168.1.100, 9999]
+    */
+    const char *__function_name = "zbx_module_haproxy_info_json";
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot;
+    const haproxy_info_t *info;
+    struct zbx_json j;
 
+    if (SYSINFO_RET_OK != get_endpoint(request, &endpoint, __function_name))
+    {
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
         return SYSINFO_RET_FAIL;
     }
 
-    if (request->nparam == 1)
-    {
-        /*
-            key: haproxy.stat.json["/run/haproxy/stats.sock"]
-        */
-        sockPath = get_rparam(request, 0);
+    if (SYSINFO_RET_OK != get_snapshot(result, &endpoint, "show info", &snapshot))
+        return SYSINFO_RET_FAIL;
 
-        ret = connect_unix(sockPath, &sock);
-        if (ret != SYSINFO_RET_OK)
-        {
-            SET_MSG_RESULT(result, strdup("Cannot connect, see log"));
-            return SYSINFO_RET_FAIL;
-        }
-    }
-    else if (request->nparam == 2)
+    if (NULL == (info = haproxy_info_get(snapshot)))
     {
-        /*
-            key: haproxy.stat.json[192.168.1.100, 9999]
-        */
-        host = get_rparam(request, 0);
-        param2 = get_rparam(request, 1);
-        port = atoi(param2);
+        haproxy_snapshot_release(snapshot);
+        SET_MSG_RESULT(result, strdup("Cannot parse show info output"));
+        return SYSINFO_RET_FAIL;
+    }
 
-        ret = connect_net(host, port, &sock);
-        if (ret != SYSINFO_RET_OK)
-        {
-            SET_MSG_RESULT(result, strdup("Cannot connect, see log for details"));
-            return SYSINFO_RET_FAIL;
-        }
+    zbx_json_init(&j, ZBX_JSON_STAT_BUF_LEN);
+    haproxy_info_json(info, &j);
+    haproxy_snapshot_release(snapshot);
+
+    SET_STR_RESULT(result, zbx_strdup(NULL, j.buffer));
+    zbx_json_free(&j);
+
+    return SYSINFO_RET_OK;
+}
+
+/******************************************************************************
+******************************************************************************/
+static int zbx_module_haproxy_pools_text(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.pools.text["/run/haproxy/stats.sock"]
+        key: haproxy.pools.text[192.168.1.100, 9999]
+    */
+    return get_command_text(request, result, "show pools", "zbx_module_haproxy_pools_text");
+}
+
+/******************************************************************************
+******************************************************************************/
+static int zbx_module_haproxy_pools_autodiscovery(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.pools.autodiscovery["/run/haproxy/stats.sock"]
+        key: haproxy.pools.autodiscovery[192.168.1.100, 9999]
+    */
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot;
+    const haproxy_pools_t *pools;
+    struct zbx_json j;
+
+    if (SYSINFO_RET_OK != get_endpoint(request, &endpoint, "zbx_module_haproxy_pools_autodiscovery"))
+    {
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
+        return SYSINFO_RET_FAIL;
     }
 
-    ret = send_command(sock, cmd, &data);
-    if (ret != SYSINFO_RET_OK)
+    if (SYSINFO_RET_OK != get_snapshot(result, &endpoint, "show pools", &snapshot))
+        return SYSINFO_RET_FAIL;
+
+    if (NULL == (pools = haproxy_pools_get(snapshot)))
     {
-        SET_MSG_RESULT(result, strdup("Cannot send command, see log for details"));
+        haproxy_snapshot_release(snapshot);
+        SET_MSG_RESULT(result, strdup("Cannot parse show pools output"));
         return SYSINFO_RET_FAIL;
     }
 
-    SET_STR_RESULT(result, zbx_strdup(NULL, data));
+    zbx_json_init(&j, ZBX_JSON_STAT_BUF_LEN);
+    haproxy_pools_discovery(pools, &j);
+    haproxy_snapshot_release(snapshot);
+
+    SET_STR_RESULT(result, zbx_strdup(NULL, j.buffer));
+    zbx_json_free(&j);
+
     return SYSINFO_RET_OK;
 }
 
 /******************************************************************************
 ******************************************************************************/
-static int zbx_module_haproxy_info_text(AGENT_REQUEST *request, AGENT_RESULT *result)
+static int zbx_module_haproxy_activity_text(AGENT_REQUEST *request, AGENT_RESULT *result)
 {
-    const char *__function_name = "zbx_module_haproxy_info_text";
-    char *sockPath = NULL;
-    char *host = NULL; 
-    char *param2 = NULL;
-    int port;
-    int ret;
-    int sock;
-    char *cmd = "show info";
-    char *data = NULL;
+    /*
+        key: haproxy.activity.text["/run/haproxy/stats.sock"]
+        key: haproxy.activity.text[192.168.1.100, 9999]
+    */
+    return get_command_text(request, result, "show activity", "zbx_module_haproxy_activity_text");
+}
 
-    if (request->nparam == 0 || request->nparam > 2)
+/******************************************************************************
+******************************************************************************/
+static int zbx_module_haproxy_stat(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.stat["/run/haproxy/stats.sock", <pxname>, <svname>, <field>]
+        key: haproxy.stat[192.168.1.100:9999, http-in, FRONTEND, scur]
+    */
+    const char *__function_name = "zbx_module_haproxy_stat";
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot;
+    const haproxy_stat_t *stat;
+    const haproxy_stat_row_t *row;
+    haproxy_field_t value;
+    const char *pxname, *svname, *field;
+    int column, ret = SYSINFO_RET_FAIL;
+
+    if (request->nparam != 4 || SYSINFO_RET_OK != haproxy_endpoint_parse(get_rparam(request, 0), &endpoint))
     {
-        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid number of parameters (%s:%d)",
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid parameters (%s:%d)",
                    MODULE_NAME, __function_name, __FILE__, __LINE__);
-        SET_MSG_RESULT(result, strdup("Invalid number of parameters, see log for details"));
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
+        return SYSINFO_RET_FAIL;
+    }
 
+    pxname = get_rparam(request, 1);
+    svname = get_rparam(request, 2);
+    field = get_rparam(request, 3);
+
+    if (SYSINFO_RET_OK != get_snapshot(result, &endpoint, "show stat", &snapshot))
         return SYSINFO_RET_FAIL;
+
+    if (NULL == (stat = haproxy_stat_get(snapshot)))
+        SET_MSG_RESULT(result, strdup("Cannot parse show stat output"));
+    else if (-1 == (column = haproxy_stat_column(stat, field)))
+        SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Unknown field \"%s\"", field));
+    else if (NULL == (row = haproxy_stat_find(stat, pxname, svname)))
+        SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Cannot find \"%s/%s\"", pxname, svname));
+    else if (SUCCEED != haproxy_stat_value(row, column, &value))
+        SET_MSG_RESULT(result, zbx_dsprintf(NULL, "No field \"%s\" in \"%s/%s\"", field, pxname, svname));
+    else
+    {
+        set_value_result(result, &value);
+        ret = SYSINFO_RET_OK;
     }
 
-    if (request->nparam == 1)
+    haproxy_snapshot_release(snapshot);
+
+    return ret;
+}
+
+/******************************************************************************
+******************************************************************************/
+static int zbx_module_haproxy_info(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.info["/run/haproxy/stats.sock", <field>]
+        key: haproxy.info[192.168.1.100:9999, CurrConns]
+    */
+    const char *__function_name = "zbx_module_haproxy_info";
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot;
+    const haproxy_info_t *info;
+    const haproxy_value_t *value;
+    const char *field;
+    int ret = SYSINFO_RET_FAIL;
+
+    if (request->nparam != 2 || SYSINFO_RET_OK != haproxy_endpoint_parse(get_rparam(request, 0), &endpoint))
     {
-        /*
-            key: haproxy.info.text["/run/haproxy/stats.sock"]
-        */
-        sockPath = get_rparam(request, 0);
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid parameters (%s:%d)",
+                   MODULE_NAME, __function_name, __FILE__, __LINE__);
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
+        return SYSINFO_RET_FAIL;
+    }
 
-        ret = connect_unix(sockPath, &sock);
-        if (ret != SYSINFO_RET_OK)
-        {
-            SET_MSG_RESULT(result, strdup("Cannot connect, see log"));
-            return SYSINFO_RET_FAIL;
-        }
+    field = get_rparam(request, 1);
+
+    if (SYSINFO_RET_OK != get_snapshot(result, &endpoint, "show info", &snapshot))
+        return SYSINFO_RET_FAIL;
+
+    if (NULL == (info = haproxy_info_get(snapshot)))
+        SET_MSG_RESULT(result, strdup("Cannot parse show info output"));
+    else if (NULL == (value = haproxy_info_find(info, field)))
+        SET_MSG_RESULT(result, zbx_dsprintf(NULL, "No field \"%s\" in show info output", field));
+    else
+    {
+        set_typed_result(result, value);
+        ret = SYSINFO_RET_OK;
     }
-    else if (request->nparam == 2)
+
+    haproxy_snapshot_release(snapshot);
+
+    return ret;
+}
+
+/******************************************************************************
+* An empty pool name selects the sum of all pools.                           *
+******************************************************************************/
+static int zbx_module_haproxy_pools(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.pools["/run/haproxy/stats.sock", <pool>, <metric>]
+        key: haproxy.pools[192.168.1.100:9999, buffer, used_bytes]
+        key: haproxy.pools[192.168.1.100:9999, , used_pct]
+    */
+    const char *__function_name = "zbx_module_haproxy_pools";
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot;
+    const haproxy_pools_t *pools;
+    const haproxy_pool_t *pool;
+    haproxy_value_t value;
+    const char *name, *metric;
+    int ret = SYSINFO_RET_FAIL;
+
+    if (request->nparam != 3 || SYSINFO_RET_OK != haproxy_endpoint_parse(get_rparam(request, 0), &endpoint))
     {
-        /*
-            key: haproxy.info.textt[192.168.1.100, 9999]
-        */
-        host = get_rparam(request, 0);
-        param2 = get_rparam(request, 1);
-        port = atoi(param2);
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid parameters (%s:%d)",
+                   MODULE_NAME, __function_name, __FILE__, __LINE__);
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
+        return SYSINFO_RET_FAIL;
+    }
 
-        ret = connect_net(host, port, &sock);
-        if (ret != SYSINFO_RET_OK)
-        {
-            SET_MSG_RESULT(result, strdup("Cannot connect, see log for details"));
-            return SYSINFO_RET_FAIL;
-        }
+    name = get_rparam(request, 1);
+    metric = get_rparam(request, 2);
+
+    if (SYSINFO_RET_OK != get_snapshot(result, &endpoint, "show pools", &snapshot))
+        return SYSINFO_RET_FAIL;
+
+    if (NULL == (pools = haproxy_pools_get(snapshot)))
+        SET_MSG_RESULT(result, strdup("Cannot parse show pools output"));
+    else if (NULL == (pool = ('\0' == *name ? &pools->total : haproxy_pools_find(pools, name))))
+        SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Cannot find pool \"%s\"", name));
+    else if (SUCCEED != haproxy_pool_metric(pool, metric, &value))
+        SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Unknown metric \"%s\"", metric));
+    else
+    {
+        set_typed_result(result, &value);
+        ret = SYSINFO_RET_OK;
     }
 
-    ret = send_command(sock, cmd, &data);
-    if (ret != SYSINFO_RET_OK)
+    haproxy_snapshot_release(snapshot);
+
+    return ret;
+}
+
+/******************************************************************************
+* Aggregates the per-thread values of a show activity counter, by default    *
+* the sum.                                                                   *
+******************************************************************************/
+static int zbx_module_haproxy_activity(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.activity["/run/haproxy/stats.sock", <counter>, <sum|max|min|avg|stddev|thread=N>]
+        key: haproxy.activity[192.168.1.100:9999, loops, stddev]
+        key: haproxy.activity[192.168.1.100:9999, fd_lock, thread=2]
+    */
+    const char *__function_name = "zbx_module_haproxy_activity";
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot;
+    const haproxy_activity_t *activity;
+    const haproxy_activity_counter_t *counter;
+    haproxy_value_t value;
+    const char *name, *mode;
+    char *error = NULL;
+    int ret = SYSINFO_RET_FAIL;
+
+    if (request->nparam < 2 || request->nparam > 3 ||
+            SYSINFO_RET_OK != haproxy_endpoint_parse(get_rparam(request, 0), &endpoint))
     {
-        SET_MSG_RESULT(result, strdup("Cannot send command, see log for details"));
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid parameters (%s:%d)",
+                   MODULE_NAME, __function_name, __FILE__, __LINE__);
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
         return SYSINFO_RET_FAIL;
     }
 
-    SET_STR_RESULT(result, zbx_strdup(NULL, data));
-    return SYSINFO_RET_OK;
+    name = get_rparam(request, 1);
+
+    if (NULL == (mode = get_rparam(request, 2)) || '\0' == *mode)
+        mode = "sum";
+
+    if (SYSINFO_RET_OK != get_snapshot(result, &endpoint, "show activity", &snapshot))
+        return SYSINFO_RET_FAIL;
+
+    if (NULL == (activity = haproxy_activity_get(snapshot)))
+        SET_MSG_RESULT(result, strdup("Cannot parse show activity output"));
+    else if (NULL == (counter = haproxy_activity_find(activity, name)))
+        SET_MSG_RESULT(result, zbx_dsprintf(NULL, "No counter \"%s\" in show activity output", name));
+    else if (SUCCEED != haproxy_activity_aggregate(activity->values + counter->offset, counter->nthreads,
+                                                   counter->integer, mode, &value, &error))
+    {
+        SET_MSG_RESULT(result, error);
+    }
+    else
+    {
+        set_typed_result(result, &value);
+        ret = SYSINFO_RET_OK;
+    }
+
+    haproxy_snapshot_release(snapshot);
+
+    return ret;
 }
 
 /******************************************************************************
+* Return value: SUCCEED if the command is one the keys of the module send,   *
+*               FAIL otherwise (the stats socket may run any command it is   *
+*               given, e.g. "disable server")                                *
 ******************************************************************************/
-static int zbx_module_haproxy_info_json(AGENT_REQUEST *request, AGENT_RESULT *result)
+static int cache_command_valid(const char *cmd)
 {
-    const char *__function_name = "zbx_module_haproxy_info_json";
-    char *sockPath = NULL;
-    char *host = NULL; 
-    char *param2 = NULL;
-    int port;
-    int ret;
-    int sock;
-    char *cmd = "show stat";
-    char *data = NULL;
+    static const char *commands[] = {"show stat", "show stat typed", "show stat json", "show info",
+            "show info typed", "show pools", "show activity", NULL};
+    int i;
 
-    if (request->nparam == 0 || request->nparam > 2)
+    for (i = 0; NULL != commands[i]; i++)
     {
-        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid number of parameters (%s:%d)",
-                   MODULE_NAME, __function_name, __FILE__, __LINE__);
-        SET_MSG_RESULT(result, strdup("Invalid number of parameters, see log for details"));
+        if (0 == strcmp(cmd, commands[i]))
+            return SUCCEED;
+    }
+
+    return FAIL;
+}
 
+/******************************************************************************
+* Returns the age in seconds of the response to the command (show stat by    *
+* default) the other keys get now.                                           *
+******************************************************************************/
+static int zbx_module_haproxy_cache_age(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.cache.age["/run/haproxy/stats.sock", <command>]
+        key: haproxy.cache.age[192.168.1.100:9999, show info]
+    */
+    const char *__function_name = "zbx_module_haproxy_cache_age";
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot;
+    const char *cmd;
+
+    if (request->nparam < 1 || request->nparam > 2 ||
+            SYSINFO_RET_OK != haproxy_endpoint_parse(get_rparam(request, 0), &endpoint))
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid parameters (%s:%d)",
+                   MODULE_NAME, __function_name, __FILE__, __LINE__);
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
         return SYSINFO_RET_FAIL;
     }
 
-    if (request->nparam == 1)
+    if (NULL == (cmd = get_rparam(request, 1)) || '\0' == *cmd)
+        cmd = "show stat";
+
+    if (SUCCEED != cache_command_valid(cmd))
     {
-        /*
-            key: haproxy.info.json["/run/haproxy/stats.sock"]
-        */
-        sockPath = get_rparam(request, 0);
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid command \"%s\" (%s:%d)",
+                   MODULE_NAME, __function_name, cmd, __FILE__, __LINE__);
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
+        return SYSINFO_RET_FAIL;
+    }
 
-        ret = connect_unix(sockPath, &sock);
-        if (ret != SYSINFO_RET_OK)
-        {
-            SET_MSG_RESULT(result, strdup("Cannot connect, see log"));
-            return SYSINFO_RET_FAIL;
-        }
+    if (SYSINFO_RET_OK != get_snapshot(result, &endpoint, cmd, &snapshot))
+        return SYSINFO_RET_FAIL;
+
+    SET_DBL_RESULT(result, zbx_time() - snapshot->time);
+    haproxy_snapshot_release(snapshot);
+
+    return SYSINFO_RET_OK;
+}
+
+/******************************************************************************
+* Returns the statistics of the requests to HAProxy, of the cache and of the *
+* parsing collected by this agent process, of all endpoints by default.      *
+******************************************************************************/
+static int zbx_module_haproxy_module_stats(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.module.stats
+        key: haproxy.module.stats["/run/haproxy/stats.sock"]
+    */
+    const char *__function_name = "zbx_module_haproxy_module_stats";
+    haproxy_endpoint_t endpoint;
+    const char *param;
+    struct zbx_json j;
+
+    if (request->nparam > 1 || (NULL != (param = get_rparam(request, 0)) && '\0' != *param &&
+            SYSINFO_RET_OK != haproxy_endpoint_parse(param, &endpoint)))
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid parameters (%s:%d)",
+                   MODULE_NAME, __function_name, __FILE__, __LINE__);
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
+        return SYSINFO_RET_FAIL;
     }
-    else if (request->nparam == 2)
+
+    zbx_json_init(&j, ZBX_JSON_STAT_BUF_LEN);
+    haproxy_modstats_json(NULL == param || '\0' == *param ? NULL : &endpoint, &j);
+
+    SET_STR_RESULT(result, zbx_strdup(NULL, j.buffer));
+    zbx_json_free(&j);
+
+    return SYSINFO_RET_OK;
+}
+
+/******************************************************************************
+******************************************************************************/
+static int zbx_module_haproxy_stat_rate(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.stat.rate["/run/haproxy/stats.sock", <pxname>, <svname>, <field>]
+        key: haproxy.stat.rate[192.168.1.100:9999, http-in, FRONTEND, req_tot]
+    */
+    const char *__function_name = "zbx_module_haproxy_stat_rate";
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot, *previous;
+    char *error = NULL;
+    double value;
+    int ret = SYSINFO_RET_FAIL;
+
+    if (request->nparam != 4 || SYSINFO_RET_OK != haproxy_endpoint_parse(get_rparam(request, 0), &endpoint))
     {
-        /*
-            key: haproxy.info.json[192.168.1.100, 9999]
-        */
-        host = get_rparam(request, 0);
-        param2 = get_rparam(request, 1);
-        port = atoi(param2);
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid parameters (%s:%d)",
+                   MODULE_NAME, __function_name, __FILE__, __LINE__);
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
+        return SYSINFO_RET_FAIL;
+    }
 
-        ret = connect_net(host, port, &sock);
-        if (ret != SYSINFO_RET_OK)
-        {
-            SET_MSG_RESULT(result, strdup("Cannot connect, see log for details"));
-            return SYSINFO_RET_FAIL;
-        }
+    if (SYSINFO_RET_OK != get_snapshot_pair(result, &endpoint, "show stat", &snapshot, &previous))
+        return SYSINFO_RET_FAIL;
+
+    if (SUCCEED == haproxy_stat_rate(&endpoint, snapshot, previous, get_rparam(request, 1), get_rparam(request, 2),
+                                     get_rparam(request, 3), &value, &error))
+    {
+        SET_DBL_RESULT(result, value);
+        ret = SYSINFO_RET_OK;
     }
+    else
+        SET_MSG_RESULT(result, error);
+
+    haproxy_snapshot_release(snapshot);
+
+    if (NULL != previous)
+        haproxy_snapshot_release(previous);
 
-    ret = send_command(sock, cmd, &data);
-    if (ret != SYSINFO_RET_OK)
+    return ret;
+}
+
+/******************************************************************************
+******************************************************************************/
+static int zbx_module_haproxy_info_rate(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.info.rate["/run/haproxy/stats.sock", <field>]
+        key: haproxy.info.rate[192.168.1.100:9999, CumReq]
+    */
+    const char *__function_name = "zbx_module_haproxy_info_rate";
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot, *previous;
+    char *error = NULL;
+    double value;
+    int ret = SYSINFO_RET_FAIL;
+
+    if (request->nparam != 2 || SYSINFO_RET_OK != haproxy_endpoint_parse(get_rparam(request, 0), &endpoint))
     {
-        SET_MSG_RESULT(result, strdup("Cannot send command, see log for details"));
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid parameters (%s:%d)",
+                   MODULE_NAME, __function_name, __FILE__, __LINE__);
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
         return SYSINFO_RET_FAIL;
     }
 
-    SET_STR_RESULT(result, zbx_strdup(NULL, data));
-    return SYSINFO_RET_OK;
+    if (SYSINFO_RET_OK != get_snapshot_pair(result, &endpoint, "show info", &snapshot, &previous))
+        return SYSINFO_RET_FAIL;
+
+    if (SUCCEED == haproxy_info_rate(&endpoint, snapshot, previous, get_rparam(request, 1), &value, &error))
+    {
+        SET_DBL_RESULT(result, value);
+        ret = SYSINFO_RET_OK;
+    }
+    else
+        SET_MSG_RESULT(result, error);
+
+    haproxy_snapshot_release(snapshot);
+
+    if (NULL != previous)
+        haproxy_snapshot_release(previous);
+
+    return ret;
 }
 
 /******************************************************************************
+* Aggregates the per-thread rates of a show activity counter, by default     *
+* the sum.                                                                   *
 ******************************************************************************/
-static int zbx_module_haproxy_pools_text(AGENT_REQUEST *request, AGENT_RESULT *result)
+static int zbx_module_haproxy_activity_rate(AGENT_REQUEST *request, AGENT_RESULT *result)
 {
-    const char *__function_name = "zbx_module_haproxy_pools_text";
-    char *sockPath = NULL;
-    char *host = NULL; 
-    char *param2 = NULL;
-    int port;
-    int ret;
-    int sock;
-    char *cmd = "show pools";
-    char *data = NULL;
+    /*
+        key: haproxy.activity.rate["/run/haproxy/stats.sock", <counter>, <sum|max|min|avg|stddev|thread=N>]
+        key: haproxy.activity.rate[192.168.1.100:9999, loops, max]
+    */
+    const char *__function_name = "zbx_module_haproxy_activity_rate";
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot, *previous;
+    haproxy_value_t value;
+    const char *mode;
+    char *error = NULL;
+    int ret = SYSINFO_RET_FAIL;
+
+    if (request->nparam < 2 || request->nparam > 3 ||
+            SYSINFO_RET_OK != haproxy_endpoint_parse(get_rparam(request, 0), &endpoint))
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid parameters (%s:%d)",
+                   MODULE_NAME, __function_name, __FILE__, __LINE__);
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
+        return SYSINFO_RET_FAIL;
+    }
 
-    if (request->nparam == 0 || request->nparam > 2)
+    if (NULL == (mode = get_rparam(request, 2)) || '\0' == *mode)
+        mode = "sum";
+
+    if (SYSINFO_RET_OK != get_snapshot_pair(result, &endpoint, "show activity", &snapshot, &previous))
+        return SYSINFO_RET_FAIL;
+
+    if (SUCCEED == haproxy_activity_rate(&endpoint, snapshot, previous, get_rparam(request, 1), mode, &value,
+                                         &error))
     {
-        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid number of parameters (%s:%d)",
+        SET_DBL_RESULT(result, value.dbl);
+        ret = SYSINFO_RET_OK;
+    }
+    else
+        SET_MSG_RESULT(result, error);
+
+    haproxy_snapshot_release(snapshot);
+
+    if (NULL != previous)
+        haproxy_snapshot_release(previous);
+
+    return ret;
+}
+
+/******************************************************************************
+* Aggregates a show stat field over the rows in the scope, see agg.c.        *
+******************************************************************************/
+static int zbx_module_haproxy_stat_agg(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.stat.agg["/run/haproxy/stats.sock", <scope>, <field>, <sum|avg|max|min|count>]
+        key: haproxy.stat.agg[192.168.1.100:9999, backends, scur, sum]
+        key: haproxy.stat.agg[192.168.1.100:9999, servers:static-*, qcur, max]
+    */
+    const char *__function_name = "zbx_module_haproxy_stat_agg";
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot;
+    const haproxy_stat_t *stat;
+    haproxy_value_t value;
+    const char *mode;
+    char *error = NULL;
+    int ret = SYSINFO_RET_FAIL;
+
+    if (request->nparam < 3 || request->nparam > 4 ||
+            SYSINFO_RET_OK != haproxy_endpoint_parse(get_rparam(request, 0), &endpoint))
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid parameters (%s:%d)",
                    MODULE_NAME, __function_name, __FILE__, __LINE__);
-        SET_MSG_RESULT(result, strdup("Invalid number of parameters, see log for details"));
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
+        return SYSINFO_RET_FAIL;
+    }
+
+    if (NULL == (mode = get_rparam(request, 3)) || '\0' == *mode)
+        mode = "sum";
 
+    if (SYSINFO_RET_OK != get_snapshot(result, &endpoint, "show stat", &snapshot))
         return SYSINFO_RET_FAIL;
+
+    if (NULL == (stat = haproxy_stat_get(snapshot)))
+        SET_MSG_RESULT(result, strdup("Cannot parse show stat output"));
+    else if (SUCCEED != haproxy_stat_aggregate(stat, get_rparam(request, 1), get_rparam(request, 2), mode, &value,
+                                               &error))
+    {
+        SET_MSG_RESULT(result, error);
+    }
+    else
+    {
+        set_typed_result(result, &value);
+        ret = SYSINFO_RET_OK;
     }
 
-    if (request->nparam == 1)
+    haproxy_snapshot_release(snapshot);
+
+    return ret;
+}
+
+/******************************************************************************
+* Only the rows of the proxy (empty svname) or the server are sent by        *
+* HAProxy: the compact JSON of haproxy.stat.map or, with a field, one value. *
+******************************************************************************/
+static int zbx_module_haproxy_stat_filter(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.stat.filter["/run/haproxy/stats.sock", <pxname>, <svname>, <field>]
+        key: haproxy.stat.filter[192.168.1.100:9999, static, , ]
+        key: haproxy.stat.filter[192.168.1.100:9999, static, srv1, scur]
+    */
+    const char *__function_name = "zbx_module_haproxy_stat_filter";
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot;
+    const haproxy_stat_t *stat;
+    const haproxy_stat_row_t *row;
+    haproxy_field_t value;
+    struct zbx_json j;
+    const char *pxname, *svname, *field;
+    int column, ret = SYSINFO_RET_FAIL;
+
+    if (request->nparam < 2 || request->nparam > 4 ||
+            SYSINFO_RET_OK != haproxy_endpoint_parse(get_rparam(request, 0), &endpoint) ||
+            '\0' == *(pxname = get_rparam(request, 1)))
     {
-        /*
-            key: haproxy.pools.text["/run/haproxy/stats.sock"]
-        */
-        sockPath = get_rparam(request, 0);
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid parameters (%s:%d)",
+                   MODULE_NAME, __function_name, __FILE__, __LINE__);
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
+        return SYSINFO_RET_FAIL;
+    }
 
-        ret = connect_unix(sockPath, &sock);
-        if (ret != SYSINFO_RET_OK)
-        {
-            SET_MSG_RESULT(result, strdup("Cannot connect, see log"));
-            return SYSINFO_RET_FAIL;
-        }
+    if (NULL == (svname = get_rparam(request, 2)))
+        svname = "";
+
+    if (NULL == (field = get_rparam(request, 3)))
+        field = "";
+
+    if (SYSINFO_RET_OK != get_filtered_snapshot(result, &endpoint, pxname, svname, &snapshot, &stat))
+        return SYSINFO_RET_FAIL;
+
+    row = haproxy_stat_filter_row(stat, pxname, svname);
+
+    if ('\0' == *field)
+    {
+        zbx_json_init(&j, ZBX_JSON_STAT_BUF_LEN);
+        haproxy_stat_map(stat, &j);
+        SET_STR_RESULT(result, zbx_strdup(NULL, j.buffer));
+        zbx_json_free(&j);
+        ret = SYSINFO_RET_OK;
     }
-    else if (request->nparam == 2)
+    else if (-1 == (column = haproxy_stat_column(stat, field)))
+        SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Unknown field \"%s\"", field));
+    else if (SUCCEED != haproxy_stat_value(row, column, &value))
+        SET_MSG_RESULT(result, zbx_dsprintf(NULL, "No field \"%s\" in \"%.*s/%.*s\"", field,
+                                            (int)row->pxname.len, row->pxname.ptr, (int)row->svname.len,
+                                            row->svname.ptr));
+    else
     {
-        /*
-            key: haproxy.pools.text[192.168.1.100, 9999]
-        */
-        host = get_rparam(request, 0);
-        param2 = get_rparam(request, 1);
-        port = atoi(param2);
+        set_value_result(result, &value);
+        ret = SYSINFO_RET_OK;
+    }
 
-        ret = connect_net(host, port, &sock);
-        if (ret != SYSINFO_RET_OK)
-        {
-            SET_MSG_RESULT(result, strdup("Cannot connect, see log for details"));
-            return SYSINFO_RET_FAIL;
-        }
+    haproxy_snapshot_release(snapshot);
+
+    return ret;
+}
+
+/******************************************************************************
+* Fingerprint of the set of frontends, backends, servers and listeners, it   *
+* changes when one is added or removed (or its iid/sid changes).             *
+******************************************************************************/
+static int zbx_module_haproxy_topology_version(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.topology.version["/run/haproxy/stats.sock"]
+        key: haproxy.topology.version[192.168.1.100, 9999]
+    */
+    const char *__function_name = "zbx_module_haproxy_topology_version";
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot;
+    zbx_uint64_t version;
+    int ret;
+
+    if (SYSINFO_RET_OK != get_endpoint(request, &endpoint, __function_name))
+    {
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
+        return SYSINFO_RET_FAIL;
     }
 
-    ret = send_command(sock, cmd, &data);
-    if (ret != SYSINFO_RET_OK)
+    if (SYSINFO_RET_OK != get_snapshot(result, &endpoint, "show stat", &snapshot))
+        return SYSINFO_RET_FAIL;
+
+    ret = haproxy_topology_version(&endpoint, snapshot, &version);
+    haproxy_snapshot_release(snapshot);
+
+    if (SYSINFO_RET_OK != ret)
     {
-        SET_MSG_RESULT(result, strdup("Cannot send command, see log for details"));
+        SET_MSG_RESULT(result, strdup("Cannot parse show stat output"));
         return SYSINFO_RET_FAIL;
     }
 
-    SET_STR_RESULT(result, zbx_strdup(NULL, data));
+    SET_UI64_RESULT(result, version);
+
     return SYSINFO_RET_OK;
 }
 
 /******************************************************************************
+* Entities added and removed by the last change of the topology:             *
+* {"version":...,"previous":...,"added":[...],"removed":[...]}               *
 ******************************************************************************/
-static int zbx_module_haproxy_activity_text(AGENT_REQUEST *request, AGENT_RESULT *result)
+static int zbx_module_haproxy_topology_changes(AGENT_REQUEST *request, AGENT_RESULT *result)
 {
-    const char *__function_name = "zbx_module_haproxy_activity_text";
-    char *sockPath = NULL;
-    char *host = NULL; 
-    char *param2 = NULL;
-    int port;
+    /*
+        key: haproxy.topology.changes["/run/haproxy/stats.sock"]
+        key: haproxy.topology.changes[192.168.1.100, 9999]
+    */
+    const char *__function_name = "zbx_module_haproxy_topology_changes";
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot;
+    struct zbx_json j;
     int ret;
-    int sock;
-    char *cmd = "show activity";
-    char *data = NULL;
 
-    if (request->nparam == 0 || request->nparam > 2)
+    if (SYSINFO_RET_OK != get_endpoint(request, &endpoint, __function_name))
     {
-        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid number of parameters (%s:%d)",
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
+        return SYSINFO_RET_FAIL;
+    }
+
+    if (SYSINFO_RET_OK != get_snapshot(result, &endpoint, "show stat", &snapshot))
+        return SYSINFO_RET_FAIL;
+
+    zbx_json_init(&j, ZBX_JSON_STAT_BUF_LEN);
+    ret = haproxy_topology_changes(&endpoint, snapshot, &j);
+    haproxy_snapshot_release(snapshot);
+
+    if (SYSINFO_RET_OK != ret)
+    {
+        zbx_json_free(&j);
+        SET_MSG_RESULT(result, strdup("Cannot parse show stat output"));
+        return SYSINFO_RET_FAIL;
+    }
+
+    SET_STR_RESULT(result, zbx_strdup(NULL, j.buffer));
+    zbx_json_free(&j);
+
+    return SYSINFO_RET_OK;
+}
+
+/******************************************************************************
+* The same as haproxy.stat from show stat typed: numbers are returned as     *
+* declared by HAProxy, not guessed from the text.                            *
+******************************************************************************/
+static int zbx_module_haproxy_stat_typed(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.stat.typed["/run/haproxy/stats.sock", <pxname>, <svname>, <field>]
+        key: haproxy.stat.typed[192.168.1.100:9999, http-in, FRONTEND, scur]
+    */
+    const char *__function_name = "zbx_module_haproxy_stat_typed";
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot;
+    const haproxy_typed_t *typed;
+    const haproxy_stat_row_t *row;
+    haproxy_value_t value;
+    const char *pxname, *svname, *field;
+    int column, ret = SYSINFO_RET_FAIL;
+
+    if (request->nparam != 4 || SYSINFO_RET_OK != haproxy_endpoint_parse(get_rparam(request, 0), &endpoint))
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid parameters (%s:%d)",
                    MODULE_NAME, __function_name, __FILE__, __LINE__);
-        SET_MSG_RESULT(result, strdup("Invalid number of parameters, see log for details"));
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
+        return SYSINFO_RET_FAIL;
+    }
 
+    pxname = get_rparam(request, 1);
+    svname = get_rparam(request, 2);
+    field = get_rparam(request, 3);
+
+    if (SYSINFO_RET_OK != get_snapshot(result, &endpoint, "show stat typed", &snapshot))
         return SYSINFO_RET_FAIL;
+
+    if (NULL == (typed = haproxy_typed_get(snapshot)))
+        SET_MSG_RESULT(result, strdup("Cannot parse show stat typed output"));
+    else if (-1 == (column = haproxy_typed_column(typed, field)))
+        SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Unknown field \"%s\"", field));
+    else if (NULL == (row = haproxy_stat_find(typed->index, pxname, svname)))
+        SET_MSG_RESULT(result, zbx_dsprintf(NULL, "Cannot find \"%s/%s\"", pxname, svname));
+    else if (SUCCEED != haproxy_typed_value(typed, column, (int)(row - typed->index->rows), &value))
+        SET_MSG_RESULT(result, zbx_dsprintf(NULL, "No field \"%s\" in \"%s/%s\"", field, pxname, svname));
+    else
+    {
+        set_typed_result(result, &value);
+        ret = SYSINFO_RET_OK;
     }
 
-    if (request->nparam == 1)
+    haproxy_snapshot_release(snapshot);
+
+    return ret;
+}
+
+/******************************************************************************
+* Counters are turned into per-second rates, rates are returned as they are, *
+* other fields are refused.                                                  *
+******************************************************************************/
+static int zbx_module_haproxy_stat_typed_rate(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.stat.typed.rate["/run/haproxy/stats.sock", <pxname>, <svname>, <field>]
+        key: haproxy.stat.typed.rate[192.168.1.100:9999, http-in, FRONTEND, req_tot]
+    */
+    const char *__function_name = "zbx_module_haproxy_stat_typed_rate";
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot, *previous;
+    char *error = NULL;
+    double value;
+    int ret = SYSINFO_RET_FAIL;
+
+    if (request->nparam != 4 || SYSINFO_RET_OK != haproxy_endpoint_parse(get_rparam(request, 0), &endpoint))
     {
-        /*
-            key: haproxy.activity.text["/run/haproxy/stats.sock"]
-        */
-        sockPath = get_rparam(request, 0);
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid parameters (%s:%d)",
+                   MODULE_NAME, __function_name, __FILE__, __LINE__);
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
+        return SYSINFO_RET_FAIL;
+    }
 
-        ret = connect_unix(sockPath, &sock);
-        if (ret != SYSINFO_RET_OK)
-        {
-            SET_MSG_RESULT(result, strdup("Cannot connect, see log"));
-            return SYSINFO_RET_FAIL;
-        }
+    if (SYSINFO_RET_OK != get_snapshot_pair(result, &endpoint, "show stat typed", &snapshot, &previous))
+        return SYSINFO_RET_FAIL;
+
+    if (SUCCEED == haproxy_typed_rate(&endpoint, snapshot, previous, get_rparam(request, 1), get_rparam(request, 2),
+                                      get_rparam(request, 3), &value, &error))
+    {
+        SET_DBL_RESULT(result, value);
+        ret = SYSINFO_RET_OK;
     }
-    else if (request->nparam == 2)
+    else
+        SET_MSG_RESULT(result, error);
+
+    haproxy_snapshot_release(snapshot);
+
+    if (NULL != previous)
+        haproxy_snapshot_release(previous);
+
+    return ret;
+}
+
+/******************************************************************************
+******************************************************************************/
+static int zbx_module_haproxy_stat_typed_agg(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.stat.typed.agg["/run/haproxy/stats.sock", <scope>, <field>, <sum|avg|max|min|count>]
+        key: haproxy.stat.typed.agg[192.168.1.100:9999, servers:static-*, qcur, max]
+    */
+    const char *__function_name = "zbx_module_haproxy_stat_typed_agg";
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot;
+    const haproxy_typed_t *typed;
+    haproxy_value_t value;
+    const char *mode;
+    char *error = NULL;
+    int ret = SYSINFO_RET_FAIL;
+
+    if (request->nparam < 3 || request->nparam > 4 ||
+            SYSINFO_RET_OK != haproxy_endpoint_parse(get_rparam(request, 0), &endpoint))
     {
-        /*
-            key: haproxy.activity.text[192.168.1.100, 9999]
-        */
-        host = get_rparam(request, 0);
-        param2 = get_rparam(request, 1);
-        port = atoi(param2);
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid parameters (%s:%d)",
+                   MODULE_NAME, __function_name, __FILE__, __LINE__);
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
+        return SYSINFO_RET_FAIL;
+    }
 
-        ret = connect_net(host, port, &sock);
-        if (ret != SYSINFO_RET_OK)
-        {
-            SET_MSG_RESULT(result, strdup("Cannot connect, see log for details"));
-            return SYSINFO_RET_FAIL;
-        }
+    if (NULL == (mode = get_rparam(request, 3)) || '\0' == *mode)
+        mode = "sum";
+
+    if (SYSINFO_RET_OK != get_snapshot(result, &endpoint, "show stat typed", &snapshot))
+        return SYSINFO_RET_FAIL;
+
+    if (NULL == (typed = haproxy_typed_get(snapshot)))
+        SET_MSG_RESULT(result, strdup("Cannot parse show stat typed output"));
+    else if (SUCCEED != haproxy_typed_aggregate(typed, get_rparam(request, 1), get_rparam(request, 2), mode,
+                                                &value, &error))
+    {
+        SET_MSG_RESULT(result, error);
+    }
+    else
+    {
+        set_typed_result(result, &value);
+        ret = SYSINFO_RET_OK;
     }
 
-    ret = send_command(sock, cmd, &data);
-    if (ret != SYSINFO_RET_OK)
+    haproxy_snapshot_release(snapshot);
+
+    return ret;
+}
+
+/******************************************************************************
+******************************************************************************/
+static int zbx_module_haproxy_info_typed(AGENT_REQUEST *request, AGENT_RESULT *result)
+{
+    /*
+        key: haproxy.info.typed["/run/haproxy/stats.sock", <field>]
+        key: haproxy.info.typed[192.168.1.100:9999, CurrConns]
+    */
+    const char *__function_name = "zbx_module_haproxy_info_typed";
+    haproxy_endpoint_t endpoint;
+    haproxy_snapshot_t *snapshot;
+    const haproxy_info_t *info;
+    const haproxy_value_t *value;
+    const char *field;
+    int ret = SYSINFO_RET_FAIL;
+
+    if (request->nparam != 2 || SYSINFO_RET_OK != haproxy_endpoint_parse(get_rparam(request, 0), &endpoint))
     {
-        SET_MSG_RESULT(result, strdup("Cannot send command, see log for details"));
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - invalid parameters (%s:%d)",
+                   MODULE_NAME, __function_name, __FILE__, __LINE__);
+        SET_MSG_RESULT(result, strdup("Invalid parameters, see log for details"));
         return SYSINFO_RET_FAIL;
     }
 
-    SET_STR_RESULT(result, zbx_strdup(NULL, data));
-    return SYSINFO_RET_OK;
+    field = get_rparam(request, 1);
+
+    if (SYSINFO_RET_OK != get_snapshot(result, &endpoint, "show info typed", &snapshot))
+        return SYSINFO_RET_FAIL;
+
+    if (NULL == (info = haproxy_info_typed_get(snapshot)))
+        SET_MSG_RESULT(result, strdup("Cannot parse show info typed output"));
+    else if (NULL == (value = haproxy_info_find(info, field)))
+        SET_MSG_RESULT(result, zbx_dsprintf(NULL, "No field \"%s\" in show info typed output", field));
+    else
+    {
+        set_typed_result(result, value);
+        ret = SYSINFO_RET_OK;
+    }
+
+    haproxy_snapshot_release(snapshot);
+
+    return ret;
 }
@@ -0,0 +1,259 @@
+#include "haproxy.h"
+
+/*
+    show pools - one line per memory pool and the total:
+    Dumping pools usage. Use SIGQUIT to flush them.
+      - Pool cache_st (16 bytes) : 0 allocated (0 bytes), 0 used, 0 failures, 2 users, @0x55d1c8a2b0c0=00 [SHARED]
+      - Pool buffer (16384 bytes) : 3 allocated (49152 bytes), 2 used (~1 by thread caches), needed_avg 1, 0 failures, 1 users, @0x55d1c8a2b180=02 [SHARED]
+    Total: 22 pools, 1207472 bytes allocated, 1150000 used.
+    https://cbonte.github.io/haproxy-dconv/1.9/management.html#9.3-show%20pools
+
+    The counters after the colon are taken by the word following each number,
+    so fields added by later versions (needed_avg, thread caches) are skipped.
+*/
+
+#define POOL_PREFIX        "- Pool "
+#define POOL_PREFIX_LEN    (sizeof(POOL_PREFIX) - 1)
+
+static const struct
+{
+    const char  *name;
+    size_t      offset;
+}
+pool_metrics[] =
+{
+    {"size",            offsetof(haproxy_pool_t, size)},
+    {"allocated",       offsetof(haproxy_pool_t, allocated)},
+    {"allocated_bytes", offsetof(haproxy_pool_t, allocated_bytes)},
+    {"used",            offsetof(haproxy_pool_t, used)},
+    {"used_bytes",      offsetof(haproxy_pool_t, used_bytes)},
+    {"failures",        offsetof(haproxy_pool_t, failures)},
+    {"users",           offsetof(haproxy_pool_t, users)},
+    {NULL}
+};
+
+/******************************************************************************
+* Parses an unsigned number, p is moved past it.                             *
+******************************************************************************/
+static int parse_uint(const char **p, const char *end, zbx_uint64_t *value)
+{
+    const char *start = *p;
+
+    *value = 0;
+
+    for (; *p < end && '0' <= **p && '9' >= **p; (*p)++)
+        *value = *value * 10 + (zbx_uint64_t)(**p - '0');
+
+    return start != *p ? SUCCEED : FAIL;
+}
+
+/******************************************************************************
+* Return value: 1 if the text at p starts with the word                      *
+******************************************************************************/
+static int starts_with(const char *p, const char *end, const char *word)
+{
+    size_t len = strlen(word);
+
+    return (size_t)(end - p) >= len && 0 == memcmp(p, word, len);
+}
+
+/******************************************************************************
+* Parses "Pool <name> (<size> bytes) : <counters>" into the pool record.     *
+******************************************************************************/
+static int parse_pool(const char *p, const char *end, haproxy_pool_t *pool)
+{
+    const char *sep;
+    zbx_uint64_t value;
+
+    memset(pool, 0, sizeof(haproxy_pool_t));
+
+    if (NULL == (sep = (const char *)memchr(p, ' ', (size_t)(end - p))))
+        return FAIL;
+
+    pool->name.ptr = p;
+    pool->name.len = (size_t)(sep - p);
+    p = sep + 1;
+
+    if (!starts_with(p, end, "(") || (p++, SUCCEED != parse_uint(&p, end, &pool->size)))
+        return FAIL;
+
+    if (NULL == (sep = (const char *)memchr(p, ':', (size_t)(end - p))))
+        return FAIL;
+
+    for (p = sep + 1; p < end; p++)
+    {
+        if (' ' == *p || ',' == *p || SUCCEED != parse_uint(&p, end, &value))
+            continue;
+
+        if (starts_with(p, end, " allocated"))
+        {
+            pool->allocated = value;
+
+            /* " allocated (<bytes> bytes)" */
+            p += sizeof(" allocated (") - 1;
+            if (p < end)
+                parse_uint(&p, end, &pool->allocated_bytes);
+        }
+        else if (starts_with(p, end, " used"))
+            pool->used = value;
+        else if (starts_with(p, end, " failures"))
+            pool->failures = value;
+        else if (starts_with(p, end, " users"))
+            pool->users = value;
+
+        /* skip the rest of the item, e.g. "(~1 by thread caches)" */
+        if (NULL == (p = (const char *)memchr(p, ',', (size_t)(end - p))))
+            break;
+    }
+
+    pool->used_bytes = pool->used * pool->size;
+
+    return SUCCEED;
+}
+
+/******************************************************************************
+* Parses show pools output into the arena, the result points into the data   *
+* so the data must outlive it.                                               *
+*                                                                            *
+* Return value: the parsed response or NULL if there are no pools            *
+******************************************************************************/
+haproxy_pools_t *haproxy_pools_parse(const char *data, size_t len, haproxy_arena_t *arena)
+{
+    const char *end = data + len, *p = data, *eol, *line;
+    haproxy_pools_t *pools;
+    haproxy_pool_t *pool;
+    int nlines = 1;
+
+    /* a pool per line at most */
+    for (line = data; NULL != (line = (const char *)memchr(line, '\n', (size_t)(end - line))); line++)
+        nlines++;
+
+    pools = (haproxy_pools_t *)haproxy_arena_alloc(arena, sizeof(haproxy_pools_t));
+    memset(pools, 0, sizeof(haproxy_pools_t));
+    pools->pools = (haproxy_pool_t *)haproxy_arena_alloc(arena, nlines * sizeof(haproxy_pool_t));
+
+    for (; p < end; p = eol + 1)
+    {
+        if (NULL == (eol = (const char *)memchr(p, '\n', (size_t)(end - p))))
+            eol = end;
+
+        for (line = p; line < eol && ' ' == *line; line++)
+            ;
+
+        if (!starts_with(line, eol, POOL_PREFIX))
+            continue;
+
+        pool = &pools->pools[pools->npools];
+
+        if (SUCCEED != parse_pool(line + POOL_PREFIX_LEN, eol, pool))
+            continue;
+
+        pools->total.allocated += pool->allocated;
+        pools->total.allocated_bytes += pool->allocated_bytes;
+        pools->total.used += pool->used;
+        pools->total.used_bytes += pool->used_bytes;
+        pools->total.failures += pool->failures;
+        pools->total.users += pool->users;
+        pools->npools++;
+    }
+
+    if (0 == pools->npools)
+        return NULL;
+
+    return pools;
+}
+
+/******************************************************************************
+******************************************************************************/
+static void *pools_parse(const char *data, size_t len, haproxy_arena_t *arena)
+{
+    return haproxy_pools_parse(data, len, arena);
+}
+
+/******************************************************************************
+* Return value: parsed show pools snapshot, it is parsed on first use and    *
+*               freed with the snapshot; NULL if it cannot be parsed         *
+******************************************************************************/
+const haproxy_pools_t *haproxy_pools_get(haproxy_snapshot_t *snapshot)
+{
+    return (const haproxy_pools_t *)haproxy_snapshot_parsed(snapshot, pools_parse);
+}
+
+/******************************************************************************
+* Return value: the pool or NULL if there is no such pool                    *
+******************************************************************************/
+const haproxy_pool_t *haproxy_pools_find(const haproxy_pools_t *pools, const char *name)
+{
+    size_t len = strlen(name);
+    int i;
+
+    for (i = 0; i < pools->npools; i++)
+    {
+        if (pools->pools[i].name.len == len && 0 == memcmp(pools->pools[i].name.ptr, name, len))
+            return &pools->pools[i];
+    }
+
+    return NULL;
+}
+
+/******************************************************************************
+* Gets a counter of the pool by its name (size, allocated, allocated_bytes,  *
+* used, used_bytes, failures, users) or used_pct - used_bytes in percent of  *
+* allocated_bytes.                                                           *
+*                                                                            *
+* Return value: SUCCEED - the metric is known, FAIL - otherwise              *
+******************************************************************************/
+int haproxy_pool_metric(const haproxy_pool_t *pool, const char *metric, haproxy_value_t *value)
+{
+    int i;
+
+    memset(value, 0, sizeof(haproxy_value_t));
+
+    if (0 == strcmp(metric, "used_pct"))
+    {
+        value->type = HAPROXY_VALUE_DBL;
+        value->dbl = 0 != pool->allocated_bytes ? 100.0 * pool->used_bytes / pool->allocated_bytes : 0;
+        return SUCCEED;
+    }
+
+    for (i = 0; NULL != pool_metrics[i].name; i++)
+    {
+        if (0 == strcmp(pool_metrics[i].name, metric))
+        {
+            value->type = HAPROXY_VALUE_INT;
+            value->i64 = (zbx_int64_t)*(const zbx_uint64_t *)((const char *)pool + pool_metrics[i].offset);
+            return SUCCEED;
+        }
+    }
+
+    return FAIL;
+}
+
+/******************************************************************************
+* Adds LLD rows {"{#POOL}":"buffer","{#SIZE}":"16384"} for every pool.       *
+******************************************************************************/
+void haproxy_pools_discovery(const haproxy_pools_t *pools, struct zbx_json *j)
+{
+    const haproxy_pool_t *pool;
+    char *name = NULL, size[MAX_ID_LEN];
+    size_t name_alloc = 0, name_offset;
+    int i;
+
+    zbx_json_addarray(j, ZBX_PROTO_TAG_DATA);
+
+    for (i = 0; i < pools->npools; i++)
+    {
+        pool = &pools->pools[i];
+        name_offset = 0;
+        zbx_strncpy_alloc(&name, &name_alloc, &name_offset, pool->name.ptr, pool->name.len);
+        zbx_snprintf(size, sizeof(size), ZBX_FS_UI64, pool->size);
+
+        zbx_json_addobject(j, NULL);
+        zbx_json_addstring(j, "{#POOL}", name, ZBX_JSON_TYPE_STRING);
+        zbx_json_addstring(j, "{#SIZE}", size, ZBX_JSON_TYPE_STRING);
+        zbx_json_close(j);
+    }
+
+    zbx_json_close(j);
+    zbx_free(name);
+}
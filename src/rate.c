@@ -0,0 +1,368 @@
+#include "haproxy.h"
+
+/*
+    Per-second rates of counters, from the current and the previous snapshot
+    of a response (see haproxy_cache_get_pair).
+
+    HAProxy counters start from zero with the process (restart, reload). The
+    start of the process is taken from Uptime_sec of show info: if it is
+    later than the previous snapshot, the counters are divided by the time
+    since the start rather than subtracted, so a reload does not make a
+    spike. The same is done for the first rate, when there is no previous
+    snapshot yet. A counter lower than its previous value (clear counters)
+    is divided by the interval.
+
+    Fields of show stat typed are told apart by their nature: counters are
+    divided by the time, rates are per second already and returned as they
+    are, anything else (gauges, limits...) has no rate.
+
+    The proxy and the server are looked up by the ids of their names (see
+    symbol.c), the names are resolved once for both snapshots.
+*/
+
+/******************************************************************************
+* Return value: start of the HAProxy process (zbx_time() based) or 0 if it   *
+*               is unknown                                                   *
+******************************************************************************/
+static double process_start(const haproxy_endpoint_t *endpoint)
+{
+    haproxy_snapshot_t *snapshot;
+    const haproxy_info_t *info;
+    const haproxy_value_t *uptime;
+    double start = 0;
+
+    if (SYSINFO_RET_OK != haproxy_cache_get(endpoint, "show info", &snapshot))
+        return 0;
+
+    if (NULL != (info = haproxy_info_get(snapshot)) && NULL != (uptime = haproxy_info_find(info, "Uptime_sec")) &&
+            HAPROXY_VALUE_INT == uptime->type)
+    {
+        /* Uptime_sec is truncated */
+        start = snapshot->time - (double)uptime->i64 - 1;
+    }
+
+    haproxy_snapshot_release(snapshot);
+
+    return start;
+}
+
+/******************************************************************************
+* Gets the time the counters of the snapshot have been counting: since the   *
+* previous snapshot or since the process start (reset is set then).          *
+*                                                                            *
+* Return value: SUCCEED or FAIL if neither is known                          *
+******************************************************************************/
+static int rate_window(const haproxy_endpoint_t *endpoint, const haproxy_snapshot_t *snapshot,
+                       const haproxy_snapshot_t *previous, double *seconds, int *reset, char **error)
+{
+    double start;
+
+    start = process_start(endpoint);
+
+    if (NULL != previous && start <= previous->time)
+    {
+        *seconds = snapshot->time - previous->time;
+        *reset = 0;
+    }
+    else if (0 != start)
+    {
+        *seconds = snapshot->time - start;
+        *reset = 1;
+    }
+    else
+    {
+        *error = zbx_strdup(*error, "No previous value and no show info Uptime_sec to compute the rate");
+        return FAIL;
+    }
+
+    if (0 >= *seconds)
+    {
+        *error = zbx_strdup(*error, "Cannot compute the rate over zero interval");
+        return FAIL;
+    }
+
+    return SUCCEED;
+}
+
+/******************************************************************************
+******************************************************************************/
+static double rate(double current, double previous, double seconds, int reset)
+{
+    if (0 != reset || current < previous)
+        return current / seconds;
+
+    return (current - previous) / seconds;
+}
+
+/******************************************************************************
+* Return value: SUCCEED - the field is a number, FAIL - otherwise            *
+******************************************************************************/
+static int value_number(const haproxy_value_t *value, double *number)
+{
+    switch (value->type)
+    {
+        case HAPROXY_VALUE_INT:
+            *number = (double)value->i64;
+            return SUCCEED;
+        case HAPROXY_VALUE_DBL:
+            *number = value->dbl;
+            return SUCCEED;
+        default:
+            return FAIL;
+    }
+}
+
+/******************************************************************************
+* Return value: the row of the proxy/server or NULL if there is no such row, *
+*               ids are the ids of the names, looked up on first use         *
+******************************************************************************/
+static const haproxy_stat_row_t *rate_row(const haproxy_stat_t *stat, const char *pxname, const char *svname,
+                                          zbx_uint32_t *ids)
+{
+    if (HAPROXY_SYMBOL_NONE == ids[0] || HAPROXY_SYMBOL_NONE == ids[1])
+    {
+        ids[0] = haproxy_symbol_find(pxname, strlen(pxname));
+        ids[1] = haproxy_symbol_find(svname, strlen(svname));
+    }
+
+    return haproxy_stat_find_id(stat, ids[0], ids[1]);
+}
+
+/******************************************************************************
+* Gets a show stat value as a number.                                        *
+******************************************************************************/
+static int stat_number(haproxy_snapshot_t *snapshot, const char *pxname, const char *svname, zbx_uint32_t *ids,
+                       const char *field, double *number, char **error)
+{
+    const haproxy_stat_t *stat;
+    const haproxy_stat_row_t *row;
+    haproxy_field_t text;
+    haproxy_value_t value;
+    int column;
+
+    if (NULL == (stat = haproxy_stat_get(snapshot)))
+        *error = zbx_strdup(*error, "Cannot parse show stat output");
+    else if (-1 == (column = haproxy_stat_column(stat, field)))
+        *error = zbx_dsprintf(*error, "Unknown field \"%s\"", field);
+    else if (NULL == (row = rate_row(stat, pxname, svname, ids)))
+        *error = zbx_dsprintf(*error, "Cannot find \"%s/%s\"", pxname, svname);
+    else if (SUCCEED != haproxy_stat_value(row, column, &text))
+        *error = zbx_dsprintf(*error, "No field \"%s\" in \"%s/%s\"", field, pxname, svname);
+    else
+    {
+        haproxy_value_parse(text.ptr, text.len, &value);
+
+        if (SUCCEED == value_number(&value, number))
+            return SUCCEED;
+
+        *error = zbx_dsprintf(*error, "Field \"%s\" of \"%s/%s\" is not a number", field, pxname, svname);
+    }
+
+    return FAIL;
+}
+
+/******************************************************************************
+* Gets a show stat typed value as a number with the nature of its field.     *
+******************************************************************************/
+static int typed_number(haproxy_snapshot_t *snapshot, const char *pxname, const char *svname, zbx_uint32_t *ids,
+                        const char *field, double *number, int *nature, char **error)
+{
+    const haproxy_typed_t *typed;
+    const haproxy_stat_row_t *row;
+    haproxy_value_t value;
+    int column;
+
+    if (NULL == (typed = haproxy_typed_get(snapshot)))
+        *error = zbx_strdup(*error, "Cannot parse show stat typed output");
+    else if (-1 == (column = haproxy_typed_column(typed, field)))
+        *error = zbx_dsprintf(*error, "Unknown field \"%s\"", field);
+    else if (NULL == (row = rate_row(typed->index, pxname, svname, ids)))
+        *error = zbx_dsprintf(*error, "Cannot find \"%s/%s\"", pxname, svname);
+    else if (SUCCEED != haproxy_typed_value(typed, column, (int)(row - typed->index->rows), &value))
+        *error = zbx_dsprintf(*error, "No field \"%s\" in \"%s/%s\"", field, pxname, svname);
+    else if (SUCCEED != value_number(&value, number))
+        *error = zbx_dsprintf(*error, "Field \"%s\" of \"%s/%s\" is not a number", field, pxname, svname);
+    else
+    {
+        *nature = typed->columns[column].nature;
+        return SUCCEED;
+    }
+
+    return FAIL;
+}
+
+/******************************************************************************
+* Gets a show info value as a number.                                        *
+******************************************************************************/
+static int info_number(haproxy_snapshot_t *snapshot, const char *field, double *number, char **error)
+{
+    const haproxy_info_t *info;
+    const haproxy_value_t *value;
+
+    if (NULL == (info = haproxy_info_get(snapshot)))
+        *error = zbx_strdup(*error, "Cannot parse show info output");
+    else if (NULL == (value = haproxy_info_find(info, field)))
+        *error = zbx_dsprintf(*error, "No field \"%s\" in show info output", field);
+    else if (SUCCEED != value_number(value, number))
+        *error = zbx_dsprintf(*error, "Field \"%s\" is not a number", field);
+    else
+        return SUCCEED;
+
+    return FAIL;
+}
+
+/******************************************************************************
+* Per-second rate of a show stat counter.                                    *
+*                                                                            *
+* Return value: SUCCEED or FAIL with the error set                           *
+******************************************************************************/
+int haproxy_stat_rate(const haproxy_endpoint_t *endpoint, haproxy_snapshot_t *snapshot,
+                      haproxy_snapshot_t *previous, const char *pxname, const char *svname, const char *field,
+                      double *value, char **error)
+{
+    double seconds, current, last = 0;
+    zbx_uint32_t ids[2] = {HAPROXY_SYMBOL_NONE, HAPROXY_SYMBOL_NONE};
+    int reset;
+
+    if (SUCCEED != stat_number(snapshot, pxname, svname, ids, field, &current, error))
+        return FAIL;
+
+    if (SUCCEED != rate_window(endpoint, snapshot, previous, &seconds, &reset, error))
+        return FAIL;
+
+    /* a server added since */
+    if (0 == reset && SUCCEED != stat_number(previous, pxname, svname, ids, field, &last, error))
+    {
+        zbx_free(*error);
+        reset = 1;
+    }
+
+    *value = rate(current, last, seconds, reset);
+
+    return SUCCEED;
+}
+
+/******************************************************************************
+* Per-second rate of a show stat typed counter or the value of a rate.       *
+*                                                                            *
+* Return value: SUCCEED or FAIL with the error set                           *
+******************************************************************************/
+int haproxy_typed_rate(const haproxy_endpoint_t *endpoint, haproxy_snapshot_t *snapshot,
+                       haproxy_snapshot_t *previous, const char *pxname, const char *svname, const char *field,
+                       double *value, char **error)
+{
+    double seconds, current, last = 0;
+    zbx_uint32_t ids[2] = {HAPROXY_SYMBOL_NONE, HAPROXY_SYMBOL_NONE};
+    int reset, nature;
+
+    if (SUCCEED != typed_number(snapshot, pxname, svname, ids, field, &current, &nature, error))
+        return FAIL;
+
+    if (HAPROXY_NATURE_RATE == nature)
+    {
+        *value = current;
+        return SUCCEED;
+    }
+
+    if (HAPROXY_NATURE_COUNTER != nature)
+    {
+        *error = zbx_dsprintf(*error, "Field \"%s\" is not a counter", field);
+        return FAIL;
+    }
+
+    if (SUCCEED != rate_window(endpoint, snapshot, previous, &seconds, &reset, error))
+        return FAIL;
+
+    if (0 == reset && SUCCEED != typed_number(previous, pxname, svname, ids, field, &last, &nature, error))
+    {
+        zbx_free(*error);
+        reset = 1;
+    }
+
+    *value = rate(current, last, seconds, reset);
+
+    return SUCCEED;
+}
+
+/******************************************************************************
+* Per-second rate of a show info counter (CumConns, CumReq, ...).            *
+*                                                                            *
+* Return value: SUCCEED or FAIL with the error set                           *
+******************************************************************************/
+int haproxy_info_rate(const haproxy_endpoint_t *endpoint, haproxy_snapshot_t *snapshot,
+                      haproxy_snapshot_t *previous, const char *field, double *value, char **error)
+{
+    double seconds, current, last = 0;
+    int reset;
+
+    if (SUCCEED != info_number(snapshot, field, &current, error))
+        return FAIL;
+
+    if (SUCCEED != rate_window(endpoint, snapshot, previous, &seconds, &reset, error))
+        return FAIL;
+
+    if (0 == reset && SUCCEED != info_number(previous, field, &last, error))
+    {
+        zbx_free(*error);
+        reset = 1;
+    }
+
+    *value = rate(current, last, seconds, reset);
+
+    return SUCCEED;
+}
+
+/******************************************************************************
+* Per-second rates of a show activity counter, per thread, aggregated as by  *
+* haproxy_activity_aggregate().                                              *
+*                                                                            *
+* Return value: SUCCEED or FAIL with the error set                           *
+******************************************************************************/
+int haproxy_activity_rate(const haproxy_endpoint_t *endpoint, haproxy_snapshot_t *snapshot,
+                          haproxy_snapshot_t *previous, const char *name, const char *mode,
+                          haproxy_value_t *value, char **error)
+{
+    const haproxy_activity_t *activity, *last_activity = NULL;
+    const haproxy_activity_counter_t *counter, *last = NULL;
+    const double *v, *last_v = NULL;
+    double seconds, *rates;
+    int reset, i, ret;
+
+    if (NULL == (activity = haproxy_activity_get(snapshot)))
+    {
+        *error = zbx_strdup(*error, "Cannot parse show activity output");
+        return FAIL;
+    }
+
+    if (NULL == (counter = haproxy_activity_find(activity, name)))
+    {
+        *error = zbx_dsprintf(*error, "No counter \"%s\" in show activity output", name);
+        return FAIL;
+    }
+
+    if (SUCCEED != rate_window(endpoint, snapshot, previous, &seconds, &reset, error))
+        return FAIL;
+
+    /* the number of threads has changed with a reload */
+    if (0 == reset && (NULL == (last_activity = haproxy_activity_get(previous)) ||
+            NULL == (last = haproxy_activity_find(last_activity, name)) || last->nthreads != counter->nthreads))
+    {
+        reset = 1;
+    }
+
+    v = activity->values + counter->offset;
+
+    if (0 == reset)
+        last_v = last_activity->values + last->offset;
+
+    rates = (double *)zbx_malloc(NULL, counter->nthreads * sizeof(double));
+
+    for (i = 0; i < counter->nthreads; i++)
+        rates[i] = rate(v[i], 0 == reset ? last_v[i] : 0, seconds, reset);
+
+    ret = haproxy_activity_aggregate(rates, counter->nthreads, 0, mode, value, error);
+
+    zbx_free(rates);
+
+    return ret;
+}
@@ -0,0 +1,583 @@
+#include "haproxy.h"
+
+/*
+    Named endpoints and resolved addresses.
+
+    Endpoint=<name>,<socket> lines of the module configuration name the stats
+    sockets, the keys can then be given the name instead of the socket:
+    haproxy.stat[lb1, http-in, FRONTEND, scur]. The registry is filled in
+    zbx_module_init() before the agent forks its processes and is read-only
+    afterwards, so it is looked up without a lock.
+
+    TCP endpoints may be given by an IPv4 or IPv6 address or by a host name.
+    The address is resolved with getaddrinfo() when first connecting and kept
+    for ResolveTTL seconds, a failed lookup is not repeated for RESOLVE_RETRY
+    seconds and the last address is used while the name cannot be resolved.
+    The named endpoints are resolved in zbx_module_init(), so the agent
+    processes inherit the addresses and do not look them up on their own.
+
+    haproxy_resolve_start() looks up the addresses of several endpoints at
+    once, a thread per host name, without waiting for them: each completed
+    lookup writes to a pipe haproxy_query_multi() polls along with its
+    sockets, so an endpoint is connected to as soon as its name is resolved
+    and a slow name server costs no more than the timeout of the requests.
+    A lookup the requests gave up on completes in its thread and fills the
+    cache for the next time. The threads are counted, the cache is not freed
+    before the last one is done.
+*/
+
+#define RESOLVE_RETRY    5
+
+typedef struct
+{
+    char                *name;
+    haproxy_endpoint_t  endpoint;
+}
+registry_entry_t;
+
+typedef struct
+{
+    char                    host[HAPROXY_ADDRESS_LEN];
+    int                     port;
+    struct sockaddr_storage addr;
+    socklen_t               addr_len;       /* 0 - not resolved */
+    double                  resolved;       /* last successful lookup */
+    double                  failed;         /* last failed lookup, 0 - none since the last success */
+}
+resolve_entry_t;
+
+static registry_entry_t **registry = NULL;
+static int registry_num = 0;
+static int registry_alloc = 0;
+
+static resolve_entry_t **resolved = NULL;
+static int resolved_num = 0;
+static int resolved_alloc = 0;
+static int resolve_ttl = 300;
+
+static pthread_mutex_t resolve_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t resolve_done = PTHREAD_COND_INITIALIZER;
+static int resolve_running = 0;         /* threads of haproxy_resolve_start() */
+
+/* lookups of haproxy_resolve_start() in progress */
+typedef struct
+{
+    char    host[HAPROXY_ADDRESS_LEN];
+    int     port;
+    int     done;
+}
+resolve_job_t;
+
+/* freed by the last of the caller and the threads to be done with it */
+struct haproxy_resolve_batch
+{
+    pthread_mutex_t lock;
+    resolve_job_t   *jobs;
+    int             *job_of;        /* the job of endpoint i, -1 - none */
+    int             fds[2];         /* a byte per completed lookup */
+    int             refs;
+};
+
+typedef struct
+{
+    haproxy_resolve_batch_t *batch;
+    resolve_job_t           *job;
+}
+resolve_arg_t;
+
+/******************************************************************************
+* A name is made of letters, digits, '-', '_' and '.', never of a socket.    *
+******************************************************************************/
+static int registry_name_valid(const char *name)
+{
+    if ('\0' == *name)
+        return FAIL;
+
+    for (; '\0' != *name; name++)
+    {
+        if (0 == isalnum((unsigned char)*name) && NULL == strchr("-_.", *name))
+            return FAIL;
+    }
+
+    return SUCCEED;
+}
+
+/******************************************************************************
+* Adds an endpoint given as <name>,<socket>, e.g.                            *
+*     lb1,/run/haproxy/admin.sock                                            *
+*     lb2,[2001:db8::1]:9999                                                 *
+*     lb3,haproxy.example.com:9999                                           *
+*     workers,/run/haproxy/master.sock@1-4                                   *
+*                                                                            *
+* Return value: SUCCEED or FAIL - malformed or the name is already taken     *
+******************************************************************************/
+int haproxy_registry_add(const char *definition)
+{
+    const char *__function_name = "haproxy_registry_add";
+    registry_entry_t *entry;
+    haproxy_endpoint_t endpoint;
+    const char *comma, *address;
+    char *name;
+
+    if (NULL == (comma = strchr(definition, ',')))
+    {
+        zabbix_log(LOG_LEVEL_WARNING, "Module: %s, function: %s - Endpoint \"%s\" is not <name>,<socket> (%s:%d)",
+                   MODULE_NAME, __function_name, definition, __FILE__, __LINE__);
+        return FAIL;
+    }
+
+    name = zbx_dsprintf(NULL, "%.*s", (int)(comma - definition), definition);
+    zbx_lrtrim(name, " ");
+
+    for (address = comma + 1; ' ' == *address; address++)
+        ;
+
+    if (SUCCEED != registry_name_valid(name) || NULL != haproxy_registry_find(name) ||
+            SYSINFO_RET_OK != haproxy_endpoint_parse(address, &endpoint))
+    {
+        zabbix_log(LOG_LEVEL_WARNING, "Module: %s, function: %s - Invalid or duplicate endpoint \"%s\" (%s:%d)",
+                   MODULE_NAME, __function_name, definition, __FILE__, __LINE__);
+        zbx_free(name);
+        return FAIL;
+    }
+
+    if (registry_num == registry_alloc)
+    {
+        registry_alloc = (0 == registry_alloc ? 8 : registry_alloc * 2);
+        registry = (registry_entry_t **)zbx_realloc(registry, registry_alloc * sizeof(registry_entry_t *));
+    }
+
+    entry = (registry_entry_t *)zbx_malloc(NULL, sizeof(registry_entry_t));
+    entry->name = name;
+    entry->endpoint = endpoint;
+    registry[registry_num++] = entry;
+
+    /* the processes of a group of TCP sockets are resolved when connecting */
+    if (HAPROXY_ENDPOINT_NET == endpoint.type && NULL == strchr(endpoint.address, '*'))
+    {
+        struct sockaddr_storage addr;
+        socklen_t addr_len;
+
+        if (SYSINFO_RET_OK != haproxy_resolve(endpoint.address, endpoint.port, &addr, &addr_len))
+        {
+            zabbix_log(LOG_LEVEL_WARNING, "Module: %s, function: %s - Cannot resolve %s of endpoint %s yet (%s:%d)",
+                       MODULE_NAME, __function_name, endpoint.address, entry->name, __FILE__, __LINE__);
+        }
+    }
+
+    return SUCCEED;
+}
+
+/******************************************************************************
+* Return value: the endpoint of the name or NULL if there is none            *
+******************************************************************************/
+const haproxy_endpoint_t *haproxy_registry_find(const char *name)
+{
+    int i;
+
+    for (i = 0; i < registry_num; i++)
+    {
+        if (0 == strcmp(registry[i]->name, name))
+            return &registry[i]->endpoint;
+    }
+
+    return NULL;
+}
+
+/******************************************************************************
+* Connects to every named endpoint and switches it to interactive mode, the  *
+* endpoints which do not answer are logged. The connections are not kept:    *
+* the agent forks its processes after zbx_module_init() and a connection     *
+* must not be shared by them.                                                *
+******************************************************************************/
+void haproxy_registry_warmup(int timeout)
+{
+    const char *__function_name = "haproxy_registry_warmup";
+    haproxy_endpoint_t member;
+    int i;
+
+    for (i = 0; i < registry_num; i++)
+    {
+        /* a group is checked by its first process */
+        if (0 != registry[i]->endpoint.procs_first)
+        {
+            if (SYSINFO_RET_OK != haproxy_endpoint_member(&registry[i]->endpoint,
+                                                          registry[i]->endpoint.procs_first, &member))
+            {
+                continue;
+            }
+        }
+        else
+            member = registry[i]->endpoint;
+
+        if (SYSINFO_RET_OK != haproxy_probe(&member, timeout))
+        {
+            zabbix_log(LOG_LEVEL_WARNING, "Module: %s, function: %s - Endpoint %s does not answer (%s:%d)",
+                       MODULE_NAME, __function_name, registry[i]->name, __FILE__, __LINE__);
+        }
+        else
+        {
+            zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - Endpoint %s is up (%s:%d)",
+                       MODULE_NAME, __function_name, registry[i]->name, __FILE__, __LINE__);
+        }
+    }
+}
+
+/******************************************************************************
+******************************************************************************/
+void haproxy_resolve_init(int ttl)
+{
+    resolve_ttl = ttl;
+}
+
+/******************************************************************************
+* Must be called with resolve_lock held.                                     *
+******************************************************************************/
+static resolve_entry_t *resolve_entry_get(const char *host, int port)
+{
+    resolve_entry_t *entry;
+    int i;
+
+    for (i = 0; i < resolved_num; i++)
+    {
+        entry = resolved[i];
+
+        if (entry->port == port && 0 == strcmp(entry->host, host))
+            return entry;
+    }
+
+    if (resolved_num == resolved_alloc)
+    {
+        resolved_alloc = (0 == resolved_alloc ? 8 : resolved_alloc * 2);
+        resolved = (resolve_entry_t **)zbx_realloc(resolved, resolved_alloc * sizeof(resolve_entry_t *));
+    }
+
+    entry = (resolve_entry_t *)zbx_malloc(NULL, sizeof(resolve_entry_t));
+    memset(entry, 0, sizeof(resolve_entry_t));
+    zbx_strlcpy(entry->host, host, sizeof(entry->host));
+    entry->port = port;
+    resolved[resolved_num++] = entry;
+
+    return entry;
+}
+
+/******************************************************************************
+* Return value: SUCCEED if the address is to be looked up, FAIL if the last  *
+*               one or the last failure stands, must be called with          *
+*               resolve_lock held                                            *
+******************************************************************************/
+static int resolve_due(const resolve_entry_t *entry, double now)
+{
+    if (0 != entry->addr_len && (0 == resolve_ttl ? 0 : now - entry->resolved < resolve_ttl))
+        return FAIL;
+
+    if (0 != entry->failed && now - entry->failed < RESOLVE_RETRY)
+        return FAIL;
+
+    return SUCCEED;
+}
+
+/******************************************************************************
+* Gets the address of an IPv4 or IPv6 address or a host name and a port,     *
+* see the comment at the top.                                                *
+*                                                                            *
+* Return value: SYSINFO_RET_OK or SYSINFO_RET_FAIL - cannot be resolved      *
+******************************************************************************/
+int haproxy_resolve(const char *host, int port, struct sockaddr_storage *addr, socklen_t *addr_len)
+{
+    const char *__function_name = "haproxy_resolve";
+    resolve_entry_t *entry;
+    struct addrinfo hints, *ai = NULL;
+    char service[16];
+    double now = zbx_time();
+    int err;
+
+    pthread_mutex_lock(&resolve_lock);
+
+    entry = resolve_entry_get(host, port);
+
+    if (SUCCEED != resolve_due(entry, now))
+        goto out;
+
+    /* the lookup may take long, other endpoints are not held up meanwhile */
+    pthread_mutex_unlock(&resolve_lock);
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+    zbx_snprintf(service, sizeof(service), "%d", port);
+
+    err = getaddrinfo(host, service, &hints, &ai);
+
+    pthread_mutex_lock(&resolve_lock);
+
+    /* a failed lookup is retried after RESOLVE_RETRY, not after ResolveTTL */
+    if (0 != err)
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - Cannot resolve %s: %s (%s:%d)",
+                   MODULE_NAME, __function_name, host, gai_strerror(err), __FILE__, __LINE__);
+        entry->failed = now;
+    }
+    else
+    {
+        memcpy(&entry->addr, ai->ai_addr, ai->ai_addrlen);
+        entry->addr_len = (socklen_t)ai->ai_addrlen;
+        entry->resolved = now;
+        entry->failed = 0;
+        freeaddrinfo(ai);
+    }
+out:
+    if (0 != entry->addr_len)
+    {
+        memcpy(addr, &entry->addr, entry->addr_len);
+        *addr_len = entry->addr_len;
+    }
+
+    err = (0 != entry->addr_len ? SYSINFO_RET_OK : SYSINFO_RET_FAIL);
+
+    pthread_mutex_unlock(&resolve_lock);
+
+    return err;
+}
+
+/******************************************************************************
+******************************************************************************/
+static void resolve_batch_unref(haproxy_resolve_batch_t *batch)
+{
+    int refs;
+
+    pthread_mutex_lock(&batch->lock);
+    refs = --batch->refs;
+    pthread_mutex_unlock(&batch->lock);
+
+    if (0 != refs)
+        return;
+
+    close(batch->fds[0]);
+    close(batch->fds[1]);
+    pthread_mutex_destroy(&batch->lock);
+    zbx_free(batch->job_of);
+    zbx_free(batch->jobs);
+    zbx_free(batch);
+}
+
+/******************************************************************************
+******************************************************************************/
+static void *resolve_thread(void *data)
+{
+    const char *__function_name = "resolve_thread";
+    resolve_arg_t *arg = (resolve_arg_t *)data;
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    char byte = 0;
+
+    haproxy_resolve(arg->job->host, arg->job->port, &addr, &addr_len);
+
+    pthread_mutex_lock(&arg->batch->lock);
+    arg->job->done = 1;
+
+    if (1 != write(arg->batch->fds[1], &byte, 1))
+    {
+        zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - Cannot signal the lookup of %s: %s (%s:%d)",
+                   MODULE_NAME, __function_name, arg->job->host, zbx_strerror(errno), __FILE__, __LINE__);
+    }
+
+    pthread_mutex_unlock(&arg->batch->lock);
+
+    resolve_batch_unref(arg->batch);
+    zbx_free(arg);
+
+    pthread_mutex_lock(&resolve_lock);
+
+    if (0 == --resolve_running)
+        pthread_cond_broadcast(&resolve_done);
+
+    pthread_mutex_unlock(&resolve_lock);
+
+    return NULL;
+}
+
+/******************************************************************************
+* Starts resolving the host names of the TCP endpoints which are due for a   *
+* lookup (NULL endpoints are skipped), see the comment at the top. The       *
+* addresses go to the cache of haproxy_resolve(), connecting finds them      *
+* there.                                                                     *
+*                                                                            *
+* Return value: the lookups in progress, see haproxy_resolve_pending(), or   *
+*               NULL if there are none                                       *
+******************************************************************************/
+haproxy_resolve_batch_t *haproxy_resolve_start(const haproxy_endpoint_t **endpoints, int n)
+{
+    const char *__function_name = "haproxy_resolve_start";
+    haproxy_resolve_batch_t *batch;
+    resolve_arg_t *arg;
+    pthread_t thread;
+    int i, j, njobs = 0;
+    double now = zbx_time();
+
+    batch = (haproxy_resolve_batch_t *)zbx_malloc(NULL, sizeof(haproxy_resolve_batch_t));
+    batch->jobs = (resolve_job_t *)zbx_malloc(NULL, n * sizeof(resolve_job_t));
+    batch->job_of = (int *)zbx_malloc(NULL, n * sizeof(int));
+
+    /* a job per host name and port due for a lookup */
+    pthread_mutex_lock(&resolve_lock);
+
+    for (i = 0; i < n; i++)
+    {
+        batch->job_of[i] = -1;
+
+        if (NULL == endpoints[i] || HAPROXY_ENDPOINT_NET != endpoints[i]->type ||
+                SUCCEED != resolve_due(resolve_entry_get(endpoints[i]->address, endpoints[i]->port), now))
+        {
+            continue;
+        }
+
+        for (j = 0; j < njobs; j++)
+        {
+            if (batch->jobs[j].port == endpoints[i]->port && 0 == strcmp(batch->jobs[j].host, endpoints[i]->address))
+                break;
+        }
+
+        if (j == njobs)
+        {
+            zbx_strlcpy(batch->jobs[j].host, endpoints[i]->address, sizeof(batch->jobs[j].host));
+            batch->jobs[j].port = endpoints[i]->port;
+            batch->jobs[j].done = 0;
+            njobs++;
+        }
+
+        batch->job_of[i] = j;
+    }
+
+    /* counted before the threads start, see haproxy_registry_destroy() */
+    resolve_running += njobs;
+
+    pthread_mutex_unlock(&resolve_lock);
+
+    if (0 == njobs || -1 == pipe2(batch->fds, O_NONBLOCK | O_CLOEXEC))
+    {
+        /* nothing to wait for, connecting looks the names up if need be */
+        if (0 != njobs)
+        {
+            zabbix_log(LOG_LEVEL_DEBUG, "Module: %s, function: %s - Cannot create a pipe: %s (%s:%d)",
+                       MODULE_NAME, __function_name, zbx_strerror(errno), __FILE__, __LINE__);
+
+            pthread_mutex_lock(&resolve_lock);
+
+            if (0 == (resolve_running -= njobs))
+                pthread_cond_broadcast(&resolve_done);
+
+            pthread_mutex_unlock(&resolve_lock);
+        }
+
+        zbx_free(batch->job_of);
+        zbx_free(batch->jobs);
+        zbx_free(batch);
+
+        return NULL;
+    }
+
+    pthread_mutex_init(&batch->lock, NULL);
+    batch->refs = njobs + 1;
+
+    for (j = 0; j < njobs; j++)
+    {
+        arg = (resolve_arg_t *)zbx_malloc(NULL, sizeof(resolve_arg_t));
+        arg->batch = batch;
+        arg->job = &batch->jobs[j];
+
+        if (0 == pthread_create(&thread, NULL, resolve_thread, arg))
+            pthread_detach(thread);
+        else
+            resolve_thread(arg);
+    }
+
+    return batch;
+}
+
+/******************************************************************************
+* Return value: the descriptor to poll for POLLIN, readable once a lookup    *
+*               has completed                                                *
+******************************************************************************/
+int haproxy_resolve_fd(const haproxy_resolve_batch_t *batch)
+{
+    return batch->fds[0];
+}
+
+/******************************************************************************
+* Empties the pipe once it is readable, before haproxy_resolve_pending() is  *
+* asked about the endpoints: a lookup completing afterwards makes it         *
+* readable again.                                                            *
+******************************************************************************/
+void haproxy_resolve_clear(haproxy_resolve_batch_t *batch)
+{
+    char bytes[64];
+
+    while (0 < read(batch->fds[0], bytes, sizeof(bytes)))
+        ;
+}
+
+/******************************************************************************
+* Return value: SUCCEED if the name of endpoint i is still being looked up,  *
+*               FAIL otherwise                                               *
+******************************************************************************/
+int haproxy_resolve_pending(haproxy_resolve_batch_t *batch, int i)
+{
+    int ret;
+
+    if (NULL == batch || -1 == batch->job_of[i])
+        return FAIL;
+
+    pthread_mutex_lock(&batch->lock);
+    ret = (0 == batch->jobs[batch->job_of[i]].done ? SUCCEED : FAIL);
+    pthread_mutex_unlock(&batch->lock);
+
+    return ret;
+}
+
+/******************************************************************************
+* The lookups still in progress complete without the caller.                 *
+******************************************************************************/
+void haproxy_resolve_release(haproxy_resolve_batch_t *batch)
+{
+    if (NULL != batch)
+        resolve_batch_unref(batch);
+}
+
+/******************************************************************************
+* Waits for the lookups still in progress, their threads are detached.       *
+******************************************************************************/
+void haproxy_registry_destroy(void)
+{
+    int i;
+
+    /* the lookups the requests gave up on write to the cache when done */
+    pthread_mutex_lock(&resolve_lock);
+
+    while (0 != resolve_running)
+        pthread_cond_wait(&resolve_done, &resolve_lock);
+
+    pthread_mutex_unlock(&resolve_lock);
+
+    for (i = 0; i < registry_num; i++)
+    {
+        zbx_free(registry[i]->name);
+        zbx_free(registry[i]);
+    }
+
+    zbx_free(registry);
+    registry_num = 0;
+    registry_alloc = 0;
+
+    pthread_mutex_lock(&resolve_lock);
+
+    for (i = 0; i < resolved_num; i++)
+        zbx_free(resolved[i]);
+
+    zbx_free(resolved);
+    resolved_num = 0;
+    resolved_alloc = 0;
+
+    pthread_mutex_unlock(&resolve_lock);
+}
@@ -0,0 +1,378 @@
+#include "haproxy.h"
+
+/*
+    show stat - CSV, the first line is the header:
+    # pxname,svname,qcur,qmax,scur,smax,slim,stot,...
+    https://cbonte.github.io/haproxy-dconv/1.9/management.html#9.1
+
+    Index of a show stat response, built once per snapshot: the known fields
+    (see haproxy.h) are mapped to their CSV columns and the rows are hashed
+    by (pxname, svname). The names are interned (see symbol.c), the rows are
+    hashed and compared by their ids; the index holds the names until its
+    arena is reset. The index is allocated in the arena of the snapshot, so
+    it takes no malloc() once the arena has grown to size.
+*/
+
+#define STAT_FIELD(id, name, nature)    name,
+static const char *stat_field_names[] = {HAPROXY_STAT_FIELDS};
+#undef STAT_FIELD
+
+#define STAT_FIELD(id, name, nature)    HAPROXY_NATURE_##nature,
+static const int stat_field_natures[] = {HAPROXY_STAT_FIELDS};
+#undef STAT_FIELD
+
+static haproxy_names_t stat_fields;
+static pthread_once_t stat_fields_once = PTHREAD_ONCE_INIT;
+
+/******************************************************************************
+******************************************************************************/
+static void stat_fields_init(void)
+{
+    haproxy_names_init(&stat_fields, stat_field_names, HAPROXY_STAT_FIELD_COUNT);
+}
+
+/******************************************************************************
+* Return value: HAPROXY_STAT_* id of the field or -1 if the field is unknown *
+******************************************************************************/
+int haproxy_stat_field_find(const char *name, size_t len)
+{
+    pthread_once(&stat_fields_once, stat_fields_init);
+
+    return haproxy_names_find(&stat_fields, name, len);
+}
+
+/******************************************************************************
+******************************************************************************/
+int haproxy_stat_field_id(const char *name)
+{
+    return haproxy_stat_field_find(name, strlen(name));
+}
+
+/******************************************************************************
+******************************************************************************/
+const char *haproxy_stat_field_name(int id)
+{
+    return stat_field_names[id];
+}
+
+/******************************************************************************
+* Return value: HAPROXY_NATURE_* of the field                                *
+******************************************************************************/
+int haproxy_stat_field_nature(int id)
+{
+    return stat_field_natures[id];
+}
+
+/******************************************************************************
+* Mixes the ids of pxname and svname (the murmur3 finalizer)                 *
+******************************************************************************/
+static zbx_uint32_t stat_row_hash(zbx_uint32_t pxname_id, zbx_uint32_t svname_id)
+{
+    zbx_uint32_t hash = pxname_id * 0x9e3779b1u ^ svname_id;
+
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+/******************************************************************************
+* Lets the names of the rows go once the arena of the index is reset.        *
+******************************************************************************/
+static void stat_release(void *data)
+{
+    haproxy_symbols_release(&((haproxy_stat_t *)data)->symbols);
+}
+
+/******************************************************************************
+* Return value: an empty index in the arena, filled with                     *
+*               haproxy_stat_add_row() and haproxy_stat_build_index()        *
+******************************************************************************/
+haproxy_stat_t *haproxy_stat_create(haproxy_arena_t *arena)
+{
+    haproxy_stat_t *stat;
+    int i;
+
+    stat = (haproxy_stat_t *)haproxy_arena_alloc(arena, sizeof(haproxy_stat_t));
+    memset(stat, 0, sizeof(haproxy_stat_t));
+    stat->arena = arena;
+    haproxy_symbols_hold(&stat->symbols, arena);
+    haproxy_arena_cleanup(arena, stat_release, stat);
+
+    for (i = 0; i < HAPROXY_STAT_FIELD_COUNT; i++)
+        stat->column[i] = -1;
+
+    return stat;
+}
+
+/******************************************************************************
+******************************************************************************/
+void haproxy_stat_add_row(haproxy_stat_t *stat, const char *line, size_t len, const haproxy_field_t *pxname,
+                         const haproxy_field_t *svname)
+{
+    haproxy_stat_row_t *row;
+    int rows_alloc;
+
+    if (stat->nrows == stat->rows_alloc)
+    {
+        rows_alloc = (0 == stat->rows_alloc ? 64 : stat->rows_alloc * 2);
+        stat->rows = (haproxy_stat_row_t *)haproxy_arena_realloc(stat->arena, stat->rows,
+                                                                 stat->rows_alloc * sizeof(haproxy_stat_row_t),
+                                                                 rows_alloc * sizeof(haproxy_stat_row_t));
+        stat->rows_alloc = rows_alloc;
+    }
+
+    row = &stat->rows[stat->nrows++];
+    row->line = line;
+    row->len = len;
+    row->pxname = *pxname;
+    row->svname = *svname;
+
+    /* the rows of a proxy follow each other, its name is interned once */
+    if (1 < stat->nrows && row[-1].pxname.len == pxname->len &&
+            0 == memcmp(row[-1].pxname.ptr, pxname->ptr, pxname->len))
+    {
+        row->pxname_id = row[-1].pxname_id;
+    }
+    else
+        row->pxname_id = haproxy_symbol_intern(pxname->ptr, pxname->len, &stat->symbols);
+
+    row->svname_id = haproxy_symbol_intern(svname->ptr, svname->len, &stat->symbols);
+    row->hash = stat_row_hash(row->pxname_id, row->svname_id);
+}
+
+/******************************************************************************
+* Open addressing, the table is at least twice as large as the number of     *
+* rows. Bucket values are row indexes + 1, 0 - empty bucket.                 *
+******************************************************************************/
+void haproxy_stat_build_index(haproxy_stat_t *stat)
+{
+    int i;
+    zbx_uint32_t slot;
+
+    stat->buckets_mask = 15;
+    while (stat->buckets_mask < (zbx_uint32_t)stat->nrows * 2)
+        stat->buckets_mask = stat->buckets_mask * 2 + 1;
+
+    stat->buckets = (int *)haproxy_arena_alloc(stat->arena, (stat->buckets_mask + 1) * sizeof(int));
+    memset(stat->buckets, 0, (stat->buckets_mask + 1) * sizeof(int));
+
+    for (i = 0; i < stat->nrows; i++)
+    {
+        for (slot = stat->rows[i].hash & stat->buckets_mask; 0 != stat->buckets[slot];
+                slot = (slot + 1) & stat->buckets_mask)
+            ;
+
+        stat->buckets[slot] = i + 1;
+    }
+}
+
+/******************************************************************************
+* Parses show stat output into an index allocated in the arena, the index    *
+* points into the data so the data must outlive it.                          *
+*                                                                            *
+* Return value: the index or NULL if the data is not show stat output        *
+******************************************************************************/
+haproxy_stat_t *haproxy_stat_parse(const char *data, size_t len, haproxy_arena_t *arena)
+{
+    const char *end = data + len, *p, *line;
+    haproxy_field_t fields[HAPROXY_CSV_MAX_FIELDS];
+    haproxy_stat_t *stat;
+    int nfields, i, id;
+
+    if (NULL == (p = haproxy_csv_header(data, end, fields, HAPROXY_CSV_MAX_FIELDS, &nfields)))
+        return NULL;
+
+    stat = haproxy_stat_create(arena);
+    stat->header = fields[0].ptr;
+    stat->header_len = (size_t)(p - fields[0].ptr);
+
+    for (i = 0; i < nfields; i++)
+    {
+        if (-1 != (id = haproxy_stat_field_find(fields[i].ptr, fields[i].len)))
+            stat->column[id] = i;
+    }
+
+    if (0 != stat->column[HAPROXY_STAT_PXNAME] || 1 != stat->column[HAPROXY_STAT_SVNAME])
+        return NULL;
+
+    while (p < end)
+    {
+        line = p;
+        p = haproxy_csv_line(line, end, fields, 2, &nfields);
+
+        if (2 == nfields)
+            haproxy_stat_add_row(stat, line, (size_t)(p - line), &fields[0], &fields[1]);
+    }
+
+    haproxy_stat_build_index(stat);
+
+    return stat;
+}
+
+/******************************************************************************
+******************************************************************************/
+static void *stat_parse(const char *data, size_t len, haproxy_arena_t *arena)
+{
+    return haproxy_stat_parse(data, len, arena);
+}
+
+/******************************************************************************
+* Return value: index of the show stat snapshot, it is built on first use    *
+*               and freed with the snapshot; NULL if it cannot be parsed     *
+******************************************************************************/
+const haproxy_stat_t *haproxy_stat_get(haproxy_snapshot_t *snapshot)
+{
+    return (const haproxy_stat_t *)haproxy_snapshot_parsed(snapshot, stat_parse);
+}
+
+/******************************************************************************
+* Return value: the row of the interned names (see symbol.c) or NULL if      *
+*               there is no such row                                         *
+******************************************************************************/
+const haproxy_stat_row_t *haproxy_stat_find_id(const haproxy_stat_t *stat, zbx_uint32_t pxname_id,
+                                              zbx_uint32_t svname_id)
+{
+    zbx_uint32_t hash, slot;
+    const haproxy_stat_row_t *row;
+
+    hash = stat_row_hash(pxname_id, svname_id);
+
+    for (slot = hash & stat->buckets_mask; 0 != stat->buckets[slot]; slot = (slot + 1) & stat->buckets_mask)
+    {
+        row = &stat->rows[stat->buckets[slot] - 1];
+
+        if (row->pxname_id == pxname_id && row->svname_id == svname_id)
+            return row;
+    }
+
+    return NULL;
+}
+
+/******************************************************************************
+* Return value: the row of the proxy/server or NULL if there is no such row  *
+******************************************************************************/
+const haproxy_stat_row_t *haproxy_stat_find(const haproxy_stat_t *stat, const char *pxname, const char *svname)
+{
+    zbx_uint32_t pxname_id, svname_id;
+
+    /* a name no response has had is in no row */
+    if (HAPROXY_SYMBOL_NONE == (pxname_id = haproxy_symbol_find(pxname, strlen(pxname))) ||
+            HAPROXY_SYMBOL_NONE == (svname_id = haproxy_symbol_find(svname, strlen(svname))))
+    {
+        return NULL;
+    }
+
+    return haproxy_stat_find_id(stat, pxname_id, svname_id);
+}
+
+/******************************************************************************
+* Return value: the row of the same proxy/server as the row of another       *
+*               response or NULL if there is no such row                     *
+******************************************************************************/
+const haproxy_stat_row_t *haproxy_stat_find_row(const haproxy_stat_t *stat, const haproxy_stat_row_t *row)
+{
+    return haproxy_stat_find_id(stat, row->pxname_id, row->svname_id);
+}
+
+/******************************************************************************
+* Return value: CSV column of the field (HAPROXY_STAT_* id or the header     *
+*               name of a field this module does not know) or -1             *
+******************************************************************************/
+int haproxy_stat_column(const haproxy_stat_t *stat, const char *name)
+{
+    haproxy_field_t fields[HAPROXY_CSV_MAX_FIELDS];
+    int id, nfields;
+
+    if (-1 != (id = haproxy_stat_field_id(name)))
+        return stat->column[id];
+
+    haproxy_csv_line(stat->header, stat->header + stat->header_len, fields, HAPROXY_CSV_MAX_FIELDS, &nfields);
+
+    return haproxy_csv_column(fields, nfields, name);
+}
+
+/******************************************************************************
+* Gets the value in the given column of the row.                             *
+*                                                                            *
+* Return value: SUCCEED - the row has the column, FAIL - otherwise           *
+******************************************************************************/
+int haproxy_stat_value(const haproxy_stat_row_t *row, int column, haproxy_field_t *value)
+{
+    const char *p, *end = row->line + row->len;
+
+    if (NULL == (p = haproxy_csv_skip(row->line, end, column)))
+        return FAIL;
+
+    value->ptr = p;
+
+    while (p < end && ',' != *p && '\n' != *p)
+        p++;
+
+    value->len = (size_t)(p - value->ptr);
+
+    return SUCCEED;
+}
+
+/******************************************************************************
+* Adds the rows as {"<pxname>/<svname>":{"<field>":<value>,...},...}, only   *
+* the numeric fields are added, empty and text ones are left out.            *
+******************************************************************************/
+void haproxy_stat_map(const haproxy_stat_t *stat, struct zbx_json *j)
+{
+    haproxy_field_t header[HAPROXY_CSV_MAX_FIELDS], fields[HAPROXY_CSV_MAX_FIELDS];
+    const haproxy_stat_row_t *row;
+    haproxy_value_t value;
+    char **names, *key = NULL, *text = NULL;
+    size_t key_alloc = 0, key_offset, text_alloc = 0, text_offset;
+    int ncolumns, nfields, i, c;
+
+    haproxy_csv_line(stat->header, stat->header + stat->header_len, header, HAPROXY_CSV_MAX_FIELDS, &ncolumns);
+
+    names = (char **)zbx_malloc(NULL, ncolumns * sizeof(char *));
+
+    for (c = 0; c < ncolumns; c++)
+        names[c] = zbx_dsprintf(NULL, "%.*s", (int)header[c].len, header[c].ptr);
+
+    for (i = 0; i < stat->nrows; i++)
+    {
+        row = &stat->rows[i];
+
+        key_offset = 0;
+        zbx_strncpy_alloc(&key, &key_alloc, &key_offset, row->pxname.ptr, row->pxname.len);
+        zbx_chrcpy_alloc(&key, &key_alloc, &key_offset, '/');
+        zbx_strncpy_alloc(&key, &key_alloc, &key_offset, row->svname.ptr, row->svname.len);
+
+        zbx_json_addobject(j, key);
+
+        haproxy_csv_line(row->line, row->line + row->len, fields, ncolumns, &nfields);
+
+        /* pxname and svname are in the key */
+        for (c = 2; c < nfields; c++)
+        {
+            if (0 == fields[c].len)
+                continue;
+
+            haproxy_value_parse(fields[c].ptr, fields[c].len, &value);
+
+            if (HAPROXY_VALUE_STR == value.type)
+                continue;
+
+            text_offset = 0;
+            zbx_strncpy_alloc(&text, &text_alloc, &text_offset, fields[c].ptr, fields[c].len);
+            zbx_json_addstring(j, names[c], text, ZBX_JSON_TYPE_INT);
+        }
+
+        zbx_json_close(j);
+    }
+
+    for (c = 0; c < ncolumns; c++)
+        zbx_free(names[c]);
+
+    zbx_free(names);
+    zbx_free(key);
+    zbx_free(text);
+}
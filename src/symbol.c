@@ -0,0 +1,358 @@
+#include "haproxy.h"
+
+/*
+    Interned proxy and server names. Every pxname and svname of the parsed
+    show stat responses is given a 32-bit id, the same one in every snapshot
+    of every endpoint, so the row indexes and the rates comparing a snapshot
+    with the previous one match rows by the ids instead of the strings.
+
+    The names of a configuration come back with every response, so most
+    lookups find the name interned already: they take the table read-locked
+    and only a new name takes it for writing.
+
+    Each name counts the indexes holding it: an index records the ids it
+    has interned, each once (haproxy_symbols_held_t, a bit per id in its
+    arena), and gives them back with haproxy_symbols_release() when its
+    arena is reset. When the table is full, the names no index holds are
+    dropped and their ids reused, so the table follows configurations whose
+    names keep changing (server-template, servers added at run time) instead
+    of growing with them, however long other indexes live. The strings are
+    kept in an arena of their own, rebuilt with the names left.
+*/
+
+#define SYMBOLS_SLOTS_MIN   256
+
+typedef struct
+{
+    zbx_uint32_t    hash;
+    zbx_uint32_t    id;      /* HAPROXY_SYMBOL_NONE - empty slot */
+}
+symbol_slot_t;
+
+typedef struct
+{
+    const char      *name;       /* not terminated, NULL - free id */
+    size_t          len;
+    zbx_uint32_t    hash;
+    zbx_uint32_t    refs;        /* indexes holding the name */
+}
+symbol_t;
+
+static symbol_slot_t *slots = NULL;
+static zbx_uint32_t slots_mask = 0;
+static symbol_t *symbols = NULL;          /* by id, symbols[0] is not used */
+static zbx_uint32_t symbols_num = 0;      /* ids given out so far + 1 */
+static zbx_uint32_t symbols_alloc = 0;
+static zbx_uint32_t symbols_live = 0;     /* names in the table */
+static zbx_uint32_t *free_ids = NULL;
+static zbx_uint32_t free_num = 0;
+static haproxy_arena_t *names = NULL;
+
+static pthread_rwlock_t symbols_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/******************************************************************************
+* Starts the names held by a new index, the lists are allocated in its arena *
+******************************************************************************/
+void haproxy_symbols_hold(haproxy_symbols_held_t *held, haproxy_arena_t *arena)
+{
+    memset(held, 0, sizeof(haproxy_symbols_held_t));
+    held->arena = arena;
+}
+
+/******************************************************************************
+* Gives the names held by an index back, before its arena is reset.          *
+******************************************************************************/
+void haproxy_symbols_release(haproxy_symbols_held_t *held)
+{
+    int i;
+
+    /* the table may be growing, the counts are updated read-locked */
+    pthread_rwlock_rdlock(&symbols_lock);
+
+    for (i = 0; i < held->num; i++)
+        __atomic_sub_fetch(&symbols[held->ids[i]].refs, 1, __ATOMIC_RELAXED);
+
+    pthread_rwlock_unlock(&symbols_lock);
+
+    held->num = 0;
+}
+
+/******************************************************************************
+* FNV-1a                                                                     *
+******************************************************************************/
+static zbx_uint32_t symbol_hash(const char *name, size_t len)
+{
+    zbx_uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+
+    return hash;
+}
+
+/******************************************************************************
+* Return value: the slot of the name or the empty slot it would take, must   *
+*               be called with symbols_lock held                             *
+******************************************************************************/
+static symbol_slot_t *symbol_slot(const char *name, size_t len, zbx_uint32_t hash)
+{
+    symbol_slot_t *slot;
+    const symbol_t *symbol;
+    zbx_uint32_t i;
+
+    for (i = hash & slots_mask; ; i = (i + 1) & slots_mask)
+    {
+        slot = &slots[i];
+
+        if (HAPROXY_SYMBOL_NONE == slot->id)
+            return slot;
+
+        symbol = &symbols[slot->id];
+
+        if (slot->hash == hash && symbol->len == len && 0 == memcmp(symbol->name, name, len))
+            return slot;
+    }
+}
+
+/******************************************************************************
+* Records the id in the names held by the index, the name counts the index   *
+* once. Must be called with symbols_lock held, for reading at least.         *
+******************************************************************************/
+static void symbol_hold(zbx_uint32_t id, haproxy_symbols_held_t *held)
+{
+    zbx_uint32_t marks_num;
+    int alloc;
+
+    if (id / 32 >= held->marks_num)
+    {
+        for (marks_num = MAX(held->marks_num, 8); id / 32 >= marks_num; )
+            marks_num *= 2;
+
+        held->marks = (zbx_uint32_t *)haproxy_arena_realloc(held->arena, held->marks,
+                                                            held->marks_num * sizeof(zbx_uint32_t),
+                                                            marks_num * sizeof(zbx_uint32_t));
+        memset(held->marks + held->marks_num, 0, (marks_num - held->marks_num) * sizeof(zbx_uint32_t));
+        held->marks_num = marks_num;
+    }
+
+    if (0 != (held->marks[id / 32] & (1u << (id % 32))))
+        return;
+
+    held->marks[id / 32] |= 1u << (id % 32);
+
+    if (held->num == held->alloc)
+    {
+        alloc = (0 == held->alloc ? 64 : held->alloc * 2);
+        held->ids = (zbx_uint32_t *)haproxy_arena_realloc(held->arena, held->ids,
+                                                          held->alloc * sizeof(zbx_uint32_t),
+                                                          alloc * sizeof(zbx_uint32_t));
+        held->alloc = alloc;
+    }
+
+    held->ids[held->num++] = id;
+
+    /* concurrent readers may hold the same name */
+    __atomic_add_fetch(&symbols[id].refs, 1, __ATOMIC_RELAXED);
+}
+
+/******************************************************************************
+* Drops the names no index holds. Must be called with symbols_lock held for  *
+* writing: the names are only taken with the lock held, a name found unheld  *
+* is not taken meanwhile.                                                    *
+*                                                                            *
+* Return value: the number of names dropped                                  *
+******************************************************************************/
+static zbx_uint32_t symbols_reclaim(void)
+{
+    haproxy_arena_t *kept;
+    symbol_t *symbol;
+    zbx_uint32_t id, dropped = 0;
+    char *copy;
+
+    for (id = 1; id < symbols_num; id++)
+    {
+        symbol = &symbols[id];
+
+        if (NULL == symbol->name || 0 != __atomic_load_n(&symbol->refs, __ATOMIC_RELAXED))
+            continue;
+
+        symbol->name = NULL;
+        free_ids[free_num++] = id;
+        dropped++;
+    }
+
+    if (0 == dropped)
+        return 0;
+
+    symbols_live -= dropped;
+
+    /* the strings left are moved to a new arena, the old one is dropped */
+    kept = haproxy_arena_create(0);
+
+    for (id = 1; id < symbols_num; id++)
+    {
+        symbol = &symbols[id];
+
+        if (NULL == symbol->name)
+            continue;
+
+        copy = (char *)haproxy_arena_alloc(kept, symbol->len);
+        memcpy(copy, symbol->name, symbol->len);
+        symbol->name = copy;
+    }
+
+    haproxy_arena_destroy(names);
+    names = kept;
+
+    return dropped;
+}
+
+/******************************************************************************
+* Reclaims what can be and sizes the table for four times the names left, it *
+* may shrink. Must be called with symbols_lock held for writing.             *
+******************************************************************************/
+static void symbols_resize(void)
+{
+    zbx_uint32_t id, j;
+
+    if (NULL != names)
+        symbols_reclaim();
+
+    zbx_free(slots);
+
+    for (slots_mask = SYMBOLS_SLOTS_MIN - 1; slots_mask + 1 < symbols_live * 4; )
+        slots_mask = slots_mask * 2 + 1;
+
+    slots = (symbol_slot_t *)zbx_malloc(NULL, (slots_mask + 1) * sizeof(symbol_slot_t));
+    memset(slots, 0, (slots_mask + 1) * sizeof(symbol_slot_t));
+
+    for (id = 1; id < symbols_num; id++)
+    {
+        if (NULL == symbols[id].name)
+            continue;
+
+        for (j = symbols[id].hash & slots_mask; HAPROXY_SYMBOL_NONE != slots[j].id; j = (j + 1) & slots_mask)
+            ;
+
+        slots[j].hash = symbols[id].hash;
+        slots[j].id = id;
+    }
+}
+
+/******************************************************************************
+* Return value: the id of the name, it is added if it is not known yet; the  *
+*               index holds it until haproxy_symbols_release()               *
+******************************************************************************/
+zbx_uint32_t haproxy_symbol_intern(const char *name, size_t len, haproxy_symbols_held_t *held)
+{
+    symbol_slot_t *slot;
+    symbol_t *symbol;
+    zbx_uint32_t hash = symbol_hash(name, len), id = HAPROXY_SYMBOL_NONE;
+    char *copy;
+
+    pthread_rwlock_rdlock(&symbols_lock);
+
+    if (NULL != slots && HAPROXY_SYMBOL_NONE != (id = symbol_slot(name, len, hash)->id))
+        symbol_hold(id, held);
+
+    pthread_rwlock_unlock(&symbols_lock);
+
+    if (HAPROXY_SYMBOL_NONE != id)
+        return id;
+
+    pthread_rwlock_wrlock(&symbols_lock);
+
+    if (NULL == slots || symbols_live * 2 >= slots_mask)
+        symbols_resize();
+
+    /* it may have been added meanwhile */
+    slot = symbol_slot(name, len, hash);
+
+    if (HAPROXY_SYMBOL_NONE == (id = slot->id))
+    {
+        if (NULL == names)
+        {
+            names = haproxy_arena_create(0);
+            symbols_num = 1;
+        }
+
+        if (0 != free_num)
+        {
+            id = free_ids[--free_num];
+        }
+        else
+        {
+            if (symbols_num >= symbols_alloc)
+            {
+                symbols_alloc = (0 == symbols_alloc ? 256 : symbols_alloc * 2);
+                symbols = (symbol_t *)zbx_realloc(symbols, symbols_alloc * sizeof(symbol_t));
+                free_ids = (zbx_uint32_t *)zbx_realloc(free_ids, symbols_alloc * sizeof(zbx_uint32_t));
+            }
+
+            id = symbols_num++;
+        }
+
+        copy = (char *)haproxy_arena_alloc(names, len);
+        memcpy(copy, name, len);
+
+        symbol = &symbols[id];
+        symbol->name = copy;
+        symbol->len = len;
+        symbol->hash = hash;
+        symbol->refs = 0;
+        symbols_live++;
+
+        slot->hash = hash;
+        slot->id = id;
+    }
+
+    symbol_hold(id, held);
+
+    pthread_rwlock_unlock(&symbols_lock);
+
+    return id;
+}
+
+/******************************************************************************
+* Return value: the id of the name or HAPROXY_SYMBOL_NONE if no index holds  *
+*               it (or it has been dropped), the name is not added           *
+******************************************************************************/
+zbx_uint32_t haproxy_symbol_find(const char *name, size_t len)
+{
+    zbx_uint32_t id = HAPROXY_SYMBOL_NONE;
+
+    pthread_rwlock_rdlock(&symbols_lock);
+
+    if (NULL != slots)
+        id = symbol_slot(name, len, symbol_hash(name, len))->id;
+
+    pthread_rwlock_unlock(&symbols_lock);
+
+    return id;
+}
+
+/******************************************************************************
+******************************************************************************/
+void haproxy_symbols_destroy(void)
+{
+    pthread_rwlock_wrlock(&symbols_lock);
+
+    zbx_free(slots);
+    zbx_free(symbols);
+    zbx_free(free_ids);
+
+    if (NULL != names)
+    {
+        haproxy_arena_destroy(names);
+        names = NULL;
+    }
+
+    slots_mask = 0;
+    symbols_num = 0;
+    symbols_alloc = 0;
+    symbols_live = 0;
+    free_num = 0;
+
+    pthread_rwlock_unlock(&symbols_lock);
+}
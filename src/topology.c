@@ -0,0 +1,436 @@
+#include "haproxy.h"
+
+/*
+    Topology of an endpoint - the set of frontends, backends, servers and
+    listeners (type, pxname, svname, iid, sid) of its show stat, the same
+    entities the discovery keys return.
+
+    The fingerprint is the sum of the (mixed) hashes of the entities, so it
+    does not depend on the order of the rows. It is computed once per show
+    stat snapshot; while it does not change the discovery keys return the
+    LLD JSON built the first time, byte for byte, rather than building it
+    again (and "Discard unchanged" preprocessing can drop it on the server).
+    When it changes, the entities are compared with the previous ones and
+    the added and removed ones are kept until the next change.
+*/
+
+typedef struct
+{
+    zbx_uint64_t    hash;
+    int             type;
+    char            *pxname;
+    char            *svname;
+    char            *iid;
+    char            *sid;
+}
+topology_entity_t;
+
+typedef struct
+{
+    haproxy_endpoint_t  endpoint;
+    double              time;           /* of the show stat snapshot the entities are taken from */
+    zbx_uint64_t        fingerprint;
+    zbx_uint64_t        previous;       /* fingerprint before the last change, 0 - none */
+    topology_entity_t   *entities;      /* sorted by hash */
+    int                 nentities;
+    topology_entity_t   *added;         /* by the last change */
+    int                 nadded;
+    topology_entity_t   *removed;
+    int                 nremoved;
+    char                *lld[4];        /* LLD JSON per HAPROXY_TYPE_*, NULL - not built yet */
+}
+topology_t;
+
+static topology_t **topologies = NULL;
+static int topologies_num = 0;
+static int topologies_alloc = 0;
+
+static pthread_mutex_t topology_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *type_names[] = {"frontend", "backend", "server", "listener"};
+
+/******************************************************************************
+******************************************************************************/
+static zbx_uint64_t entity_hash(const haproxy_field_t *fields, int nfields)
+{
+    zbx_uint64_t hash = __UINT64_C(14695981039346656037);
+    size_t i;
+    int f;
+
+    for (f = 0; f < nfields; f++)
+    {
+        for (i = 0; i < fields[f].len; i++)
+            hash = (hash ^ (unsigned char)fields[f].ptr[i]) * __UINT64_C(1099511628211);
+
+        /* separator */
+        hash = (hash ^ 0xff) * __UINT64_C(1099511628211);
+    }
+
+    return hash;
+}
+
+/******************************************************************************
+* splitmix64 finalizer, so that the sum of the hashes mixes all their bits   *
+******************************************************************************/
+static zbx_uint64_t entity_mix(zbx_uint64_t hash)
+{
+    hash = (hash ^ (hash >> 30)) * __UINT64_C(0xbf58476d1ce4e5b9);
+    hash = (hash ^ (hash >> 27)) * __UINT64_C(0x94d049bb133111eb);
+
+    return hash ^ (hash >> 31);
+}
+
+/******************************************************************************
+******************************************************************************/
+static int entity_compare(const void *a, const void *b)
+{
+    const topology_entity_t *ea = (const topology_entity_t *)a, *eb = (const topology_entity_t *)b;
+
+    if (ea->hash == eb->hash)
+        return 0;
+
+    return ea->hash < eb->hash ? -1 : 1;
+}
+
+/******************************************************************************
+******************************************************************************/
+static void entities_free(topology_entity_t *entities, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        zbx_free(entities[i].pxname);
+        zbx_free(entities[i].svname);
+        zbx_free(entities[i].iid);
+        zbx_free(entities[i].sid);
+    }
+
+    zbx_free(entities);
+}
+
+/******************************************************************************
+* Gets the fingerprint of a show stat response and, unless entities is NULL, *
+* its entities sorted by hash.                                               *
+*                                                                            *
+* Return value: SUCCEED or FAIL if the response has no iid, sid or type      *
+******************************************************************************/
+static int topology_entities(const haproxy_stat_t *stat, topology_entity_t **entities, int *nentities,
+                             zbx_uint64_t *fingerprint)
+{
+    const haproxy_stat_row_t *row;
+    topology_entity_t *entity;
+    haproxy_field_t fields[5];
+    zbx_uint64_t hash;
+    int i, f, columns[3];
+
+    columns[0] = stat->column[HAPROXY_STAT_TYPE];
+    columns[1] = stat->column[HAPROXY_STAT_IID];
+    columns[2] = stat->column[HAPROXY_STAT_SID];
+
+    if (-1 == columns[0] || -1 == columns[1] || -1 == columns[2])
+        return FAIL;
+
+    if (NULL != entities)
+    {
+        *entities = (topology_entity_t *)zbx_malloc(NULL, (stat->nrows + 1) * sizeof(topology_entity_t));
+        *nentities = 0;
+    }
+
+    *fingerprint = 0;
+
+    for (i = 0; i < stat->nrows; i++)
+    {
+        row = &stat->rows[i];
+
+        for (f = 0; f < 3; f++)
+        {
+            if (SUCCEED != haproxy_stat_value(row, columns[f], &fields[f]))
+                break;
+        }
+
+        if (3 != f || 1 != fields[0].len || '0' > fields[0].ptr[0] || '3' < fields[0].ptr[0])
+            continue;
+
+        fields[3] = row->pxname;
+        fields[4] = row->svname;
+        hash = entity_hash(fields, 5);
+        *fingerprint += entity_mix(hash);
+
+        if (NULL == entities)
+            continue;
+
+        entity = &(*entities)[(*nentities)++];
+        entity->hash = hash;
+        entity->type = fields[0].ptr[0] - '0';
+        entity->pxname = zbx_dsprintf(NULL, "%.*s", (int)row->pxname.len, row->pxname.ptr);
+        entity->svname = zbx_dsprintf(NULL, "%.*s", (int)row->svname.len, row->svname.ptr);
+        entity->iid = zbx_dsprintf(NULL, "%.*s", (int)fields[1].len, fields[1].ptr);
+        entity->sid = zbx_dsprintf(NULL, "%.*s", (int)fields[2].len, fields[2].ptr);
+    }
+
+    if (NULL != entities)
+        qsort(*entities, *nentities, sizeof(topology_entity_t), entity_compare);
+
+    return SUCCEED;
+}
+
+/******************************************************************************
+* Copies the entities of a missing from b into diff, the arrays are sorted.  *
+******************************************************************************/
+static void topology_diff(const topology_entity_t *a, int na, const topology_entity_t *b, int nb,
+                          topology_entity_t **diff, int *ndiff)
+{
+    topology_entity_t *entity;
+    int i, k = 0;
+
+    *diff = (topology_entity_t *)zbx_malloc(NULL, (na + 1) * sizeof(topology_entity_t));
+    *ndiff = 0;
+
+    for (i = 0; i < na; i++)
+    {
+        while (k < nb && b[k].hash < a[i].hash)
+            k++;
+
+        if (k < nb && b[k].hash == a[i].hash)
+            continue;
+
+        entity = &(*diff)[(*ndiff)++];
+        entity->hash = a[i].hash;
+        entity->type = a[i].type;
+        entity->pxname = zbx_strdup(NULL, a[i].pxname);
+        entity->svname = zbx_strdup(NULL, a[i].svname);
+        entity->iid = zbx_strdup(NULL, a[i].iid);
+        entity->sid = zbx_strdup(NULL, a[i].sid);
+    }
+}
+
+/******************************************************************************
+******************************************************************************/
+static topology_t *topology_find(const haproxy_endpoint_t *endpoint)
+{
+    topology_t *topology;
+    int i;
+
+    for (i = 0; i < topologies_num; i++)
+    {
+        if (haproxy_endpoint_equal(&topologies[i]->endpoint, endpoint))
+            return topologies[i];
+    }
+
+    if (topologies_num == topologies_alloc)
+    {
+        topologies_alloc = (0 == topologies_alloc ? 8 : topologies_alloc * 2);
+        topologies = (topology_t **)zbx_realloc(topologies, topologies_alloc * sizeof(topology_t *));
+    }
+
+    topology = (topology_t *)zbx_malloc(NULL, sizeof(topology_t));
+    memset(topology, 0, sizeof(topology_t));
+    topology->endpoint = *endpoint;
+    topologies[topologies_num++] = topology;
+
+    return topology;
+}
+
+/******************************************************************************
+* Brings the topology of the endpoint up to the snapshot, called with the    *
+* lock held.                                                                 *
+*                                                                            *
+* Return value: the topology or NULL if the snapshot cannot be parsed        *
+******************************************************************************/
+static topology_t *topology_update(const haproxy_endpoint_t *endpoint, haproxy_snapshot_t *snapshot)
+{
+    const haproxy_stat_t *stat;
+    topology_t *topology;
+    topology_entity_t *entities;
+    zbx_uint64_t fingerprint;
+    int nentities, i;
+
+    topology = topology_find(endpoint);
+
+    /* an older snapshot (taken before the lock) does not roll it back */
+    if (snapshot->time <= topology->time && NULL != topology->entities)
+        return topology;
+
+    /* the entities are only copied when the fingerprint changes */
+    if (NULL == (stat = haproxy_stat_get(snapshot)) ||
+            SUCCEED != topology_entities(stat, NULL, NULL, &fingerprint))
+    {
+        return NULL;
+    }
+
+    topology->time = snapshot->time;
+
+    if (NULL != topology->entities && fingerprint == topology->fingerprint)
+        return topology;
+
+    topology_entities(stat, &entities, &nentities, &fingerprint);
+
+    /* no diff against nothing */
+    if (NULL != topology->entities)
+    {
+        entities_free(topology->added, topology->nadded);
+        entities_free(topology->removed, topology->nremoved);
+        topology_diff(entities, nentities, topology->entities, topology->nentities, &topology->added,
+                      &topology->nadded);
+        topology_diff(topology->entities, topology->nentities, entities, nentities, &topology->removed,
+                      &topology->nremoved);
+        entities_free(topology->entities, topology->nentities);
+        topology->previous = topology->fingerprint;
+    }
+
+    topology->entities = entities;
+    topology->nentities = nentities;
+    topology->fingerprint = fingerprint;
+
+    for (i = 0; i < (int)ARRSIZE(topology->lld); i++)
+        zbx_free(topology->lld[i]);
+
+    return topology;
+}
+
+/******************************************************************************
+* Gets the LLD JSON of the entities of the type (see haproxy_stat_discovery) *
+* from the show stat snapshot, the one of the same topology is reused.       *
+*                                                                            *
+* Return value: SYSINFO_RET_OK or SYSINFO_RET_FAIL if it cannot be parsed    *
+******************************************************************************/
+int haproxy_topology_discovery(const haproxy_endpoint_t *endpoint, haproxy_snapshot_t *snapshot, int type,
+                               char **lld)
+{
+    topology_t *topology;
+    struct zbx_json j;
+    int ret = SYSINFO_RET_OK;
+
+    pthread_mutex_lock(&topology_lock);
+
+    if (NULL == (topology = topology_update(endpoint, snapshot)))
+        ret = SYSINFO_RET_FAIL;
+    else if (NULL != topology->lld[type])
+        *lld = zbx_strdup(NULL, topology->lld[type]);
+    else
+    {
+        zbx_json_init(&j, ZBX_JSON_STAT_BUF_LEN);
+
+        if (SYSINFO_RET_OK == (ret = haproxy_stat_discovery(snapshot->data, snapshot->len, type, &j)))
+        {
+            *lld = zbx_strdup(NULL, j.buffer);
+
+            /* not of a snapshot older than the topology */
+            if (snapshot->time == topology->time)
+                topology->lld[type] = zbx_strdup(NULL, j.buffer);
+        }
+
+        zbx_json_free(&j);
+    }
+
+    pthread_mutex_unlock(&topology_lock);
+
+    return ret;
+}
+
+/******************************************************************************
+* Gets the fingerprint of the topology of the show stat snapshot.            *
+*                                                                            *
+* Return value: SYSINFO_RET_OK or SYSINFO_RET_FAIL if it cannot be parsed    *
+******************************************************************************/
+int haproxy_topology_version(const haproxy_endpoint_t *endpoint, haproxy_snapshot_t *snapshot,
+                             zbx_uint64_t *version)
+{
+    topology_t *topology;
+    int ret = SYSINFO_RET_FAIL;
+
+    pthread_mutex_lock(&topology_lock);
+
+    if (NULL != (topology = topology_update(endpoint, snapshot)))
+    {
+        *version = topology->fingerprint;
+        ret = SYSINFO_RET_OK;
+    }
+
+    pthread_mutex_unlock(&topology_lock);
+
+    return ret;
+}
+
+/******************************************************************************
+******************************************************************************/
+static void changes_add(struct zbx_json *j, const char *name, const topology_entity_t *entities, int n)
+{
+    int i;
+
+    zbx_json_addarray(j, name);
+
+    for (i = 0; i < n; i++)
+    {
+        zbx_json_addobject(j, NULL);
+        zbx_json_addstring(j, "{#PXNAME}", entities[i].pxname, ZBX_JSON_TYPE_STRING);
+        zbx_json_addstring(j, "{#SVNAME}", entities[i].svname, ZBX_JSON_TYPE_STRING);
+        zbx_json_addstring(j, "{#IID}", entities[i].iid, ZBX_JSON_TYPE_STRING);
+        zbx_json_addstring(j, "{#SID}", entities[i].sid, ZBX_JSON_TYPE_STRING);
+        zbx_json_addstring(j, "{#TYPE}", type_names[entities[i].type], ZBX_JSON_TYPE_STRING);
+        zbx_json_close(j);
+    }
+
+    zbx_json_close(j);
+}
+
+/******************************************************************************
+* Adds the last change of the topology of the show stat snapshot:            *
+* {"version":<fingerprint>,"previous":<fingerprint>,"added":[...],           *
+* "removed":[...]}, the entities with the macros of the discovery keys.      *
+*                                                                            *
+* Return value: SYSINFO_RET_OK or SYSINFO_RET_FAIL if it cannot be parsed    *
+******************************************************************************/
+int haproxy_topology_changes(const haproxy_endpoint_t *endpoint, haproxy_snapshot_t *snapshot,
+                             struct zbx_json *j)
+{
+    topology_t *topology;
+    char buf[MAX_ID_LEN + 1];
+
+    pthread_mutex_lock(&topology_lock);
+
+    if (NULL == (topology = topology_update(endpoint, snapshot)))
+    {
+        pthread_mutex_unlock(&topology_lock);
+        return SYSINFO_RET_FAIL;
+    }
+
+    zbx_snprintf(buf, sizeof(buf), ZBX_FS_UI64, topology->fingerprint);
+    zbx_json_addstring(j, "version", buf, ZBX_JSON_TYPE_INT);
+    zbx_snprintf(buf, sizeof(buf), ZBX_FS_UI64, topology->previous);
+    zbx_json_addstring(j, "previous", buf, ZBX_JSON_TYPE_INT);
+    changes_add(j, "added", topology->added, topology->nadded);
+    changes_add(j, "removed", topology->removed, topology->nremoved);
+
+    pthread_mutex_unlock(&topology_lock);
+
+    return SYSINFO_RET_OK;
+}
+
+/******************************************************************************
+******************************************************************************/
+void haproxy_topology_destroy(void)
+{
+    int i, t;
+
+    pthread_mutex_lock(&topology_lock);
+
+    for (i = 0; i < topologies_num; i++)
+    {
+        entities_free(topologies[i]->entities, topologies[i]->nentities);
+        entities_free(topologies[i]->added, topologies[i]->nadded);
+        entities_free(topologies[i]->removed, topologies[i]->nremoved);
+
+        for (t = 0; t < (int)ARRSIZE(topologies[i]->lld); t++)
+            zbx_free(topologies[i]->lld[t]);
+
+        zbx_free(topologies[i]);
+    }
+
+    zbx_free(topologies);
+    topologies_num = 0;
+    topologies_alloc = 0;
+
+    pthread_mutex_unlock(&topology_lock);
+}
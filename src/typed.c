@@ -0,0 +1,566 @@
+#include "haproxy.h"
+
+/*
+    show stat typed - one line per field, the fields of a proxy or a server
+    are consecutive:
+    F.2.0.0.pxname.1:KNP:str:http-in
+    F.2.0.4.scur.1:MGP:u32:0
+    <objtype>.<iid>.<sid>.<position>.<name>.<process>:<tags>:<type>:<value>
+    show info typed:
+    8.Uptime_sec.1:MDP:u32:12
+    <position>.<name>.<process>:<tags>:<type>:<value>
+    https://cbonte.github.io/haproxy-dconv/1.9/management.html#9.1
+
+    The tags are origin, nature and scope, the nature tells a counter from
+    a gauge or a rate with no table of known fields. Integers are converted
+    straight into the declared width, a snapshot of show stat typed keeps
+    the values of a field for all rows in one array (a column), so a field
+    is aggregated over the rows without going through the lines again.
+*/
+
+#define TYPED_INT64_MAX    (ZBX_MAX_UINT64 >> 1)
+
+static const char *typed_types[] = {"str", "u32", "s32", "u64", "s64", "flt"};
+
+/******************************************************************************
+* Return value: HAPROXY_TYPED_* or -1 if the type is unknown                 *
+******************************************************************************/
+int haproxy_typed_type(const char *ptr, size_t len)
+{
+    int i;
+
+    for (i = 0; i < (int)ARRSIZE(typed_types); i++)
+    {
+        if (3 == len && 0 == memcmp(typed_types[i], ptr, 3))
+            return i;
+    }
+
+    return -1;
+}
+
+/******************************************************************************
+* Return value: HAPROXY_NATURE_* of the second tag, names, outputs and       *
+*               timestamps are HAPROXY_NATURE_OUTPUT                         *
+******************************************************************************/
+int haproxy_typed_nature(const char *tags, size_t len)
+{
+    if (2 > len)
+        return HAPROXY_NATURE_OUTPUT;
+
+    switch (tags[1])
+    {
+        case 'C':
+            return HAPROXY_NATURE_COUNTER;
+        case 'G':
+            return HAPROXY_NATURE_GAUGE;
+        case 'R':
+            return HAPROXY_NATURE_RATE;
+        case 'L':
+            return HAPROXY_NATURE_LIMIT;
+        case 'M':
+            return HAPROXY_NATURE_MAX;
+        case 'a':
+            return HAPROXY_NATURE_AVG;
+        case 'A':
+            return HAPROXY_NATURE_AGE;
+        case 'D':
+            return HAPROXY_NATURE_DURATION;
+        default:
+            return HAPROXY_NATURE_OUTPUT;
+    }
+}
+
+/******************************************************************************
+* Parses a value of the declared type: integers with no check for a decimal  *
+* point, floats as haproxy_value_parse(), strings are kept as text.          *
+******************************************************************************/
+void haproxy_typed_value_parse(int type, const char *ptr, size_t len, haproxy_value_t *value)
+{
+    const char *p = ptr, *end = ptr + len;
+    zbx_uint64_t ui64 = 0;
+    int negative = 0;
+
+    switch (type)
+    {
+        case HAPROXY_TYPED_U32:
+        case HAPROXY_TYPED_S32:
+        case HAPROXY_TYPED_U64:
+        case HAPROXY_TYPED_S64:
+            break;
+        case HAPROXY_TYPED_FLT:
+            haproxy_value_parse(ptr, len, value);
+            return;
+        default:
+            value->type = HAPROXY_VALUE_STR;
+            value->text.ptr = ptr;
+            value->text.len = len;
+            return;
+    }
+
+    if (p < end && '-' == *p)
+    {
+        negative = 1;
+        p++;
+    }
+
+    if (p == end)
+    {
+        haproxy_value_parse(ptr, len, value);
+        return;
+    }
+
+    for (; p < end && '0' <= *p && '9' >= *p; p++)
+        ui64 = ui64 * 10 + (zbx_uint64_t)(*p - '0');
+
+    if (p != end)
+    {
+        haproxy_value_parse(ptr, len, value);
+        return;
+    }
+
+    value->text.ptr = ptr;
+    value->text.len = len;
+
+    /* u64 above the signed range */
+    if (0 == negative && HAPROXY_TYPED_U64 == type && ui64 > TYPED_INT64_MAX)
+    {
+        value->type = HAPROXY_VALUE_DBL;
+        value->dbl = (double)ui64;
+        value->i64 = (zbx_int64_t)ui64;
+        return;
+    }
+
+    value->type = HAPROXY_VALUE_INT;
+    value->i64 = (0 != negative ? -(zbx_int64_t)ui64 : (zbx_int64_t)ui64);
+    value->dbl = (double)value->i64;
+}
+
+/******************************************************************************
+******************************************************************************/
+static size_t typed_size(int type)
+{
+    switch (type)
+    {
+        case HAPROXY_TYPED_U32:
+            return sizeof(zbx_uint32_t);
+        case HAPROXY_TYPED_S32:
+            return sizeof(int);
+        case HAPROXY_TYPED_U64:
+            return sizeof(zbx_uint64_t);
+        case HAPROXY_TYPED_S64:
+            return sizeof(zbx_int64_t);
+        case HAPROXY_TYPED_FLT:
+            return sizeof(double);
+        default:
+            return sizeof(haproxy_field_t);
+    }
+}
+
+/******************************************************************************
+* Makes room for the values of one more row in all columns.                  *
+******************************************************************************/
+static void typed_reserve(haproxy_typed_t *typed, int row)
+{
+    haproxy_arena_t *arena = typed->index->arena;
+    haproxy_typed_column_t *column;
+    int i, values_alloc;
+
+    if (row == typed->values_alloc)
+    {
+        values_alloc = (0 == typed->values_alloc ? 64 : typed->values_alloc * 2);
+        typed->types = (unsigned char *)haproxy_arena_realloc(arena, typed->types, typed->values_alloc,
+                                                              values_alloc);
+
+        for (i = 0; i < typed->ncolumns; i++)
+        {
+            column = &typed->columns[i];
+
+            if (0 == column->name.len)
+                continue;
+
+            column->values = haproxy_arena_realloc(arena, column->values,
+                                                   typed->values_alloc * typed_size(column->type),
+                                                   values_alloc * typed_size(column->type));
+            column->set = (unsigned char *)haproxy_arena_realloc(arena, column->set, typed->values_alloc,
+                                                                 values_alloc);
+        }
+
+        typed->values_alloc = values_alloc;
+    }
+
+    /* the slot of an object with no names is reused */
+    for (i = 0; i < typed->ncolumns; i++)
+    {
+        if (0 != typed->columns[i].name.len)
+            typed->columns[i].set[row] = 0;
+    }
+}
+
+/******************************************************************************
+* Return value: the column of the position, created by the first line of the *
+*               field                                                        *
+******************************************************************************/
+static haproxy_typed_column_t *typed_column(haproxy_typed_t *typed, int position, const char *name, size_t len,
+                                            int type, int nature)
+{
+    haproxy_arena_t *arena = typed->index->arena;
+    haproxy_typed_column_t *column;
+    size_t size;
+    int id;
+
+    if (position >= typed->ncolumns)
+    {
+        size = sizeof(haproxy_typed_column_t);
+        typed->columns = (haproxy_typed_column_t *)haproxy_arena_realloc(arena, typed->columns,
+                                                                         typed->ncolumns * size,
+                                                                         (position + 1) * size);
+        memset(typed->columns + typed->ncolumns, 0,
+               (position + 1 - typed->ncolumns) * sizeof(haproxy_typed_column_t));
+        typed->ncolumns = position + 1;
+    }
+
+    column = &typed->columns[position];
+
+    if (0 != column->name.len)
+        return column;
+
+    column->name.ptr = name;
+    column->name.len = len;
+    column->type = type;
+    column->nature = nature;
+    column->values = haproxy_arena_alloc(arena, typed->values_alloc * typed_size(type));
+    column->set = (unsigned char *)haproxy_arena_alloc(arena, typed->values_alloc);
+    memset(column->set, 0, typed->values_alloc);
+
+    if (-1 != (id = haproxy_stat_field_find(name, len)))
+        typed->index->column[id] = position;
+
+    return column;
+}
+
+/******************************************************************************
+* Stores a value in the row, converted to the type of the column.            *
+******************************************************************************/
+static void typed_store(haproxy_typed_column_t *column, int row, const haproxy_value_t *value)
+{
+    if (HAPROXY_TYPED_STR == column->type)
+    {
+        ((haproxy_field_t *)column->values)[row] = value->text;
+        column->set[row] = 1;
+        return;
+    }
+
+    if (HAPROXY_VALUE_STR == value->type)
+        return;
+
+    switch (column->type)
+    {
+        case HAPROXY_TYPED_U32:
+            ((zbx_uint32_t *)column->values)[row] = (zbx_uint32_t)value->i64;
+            break;
+        case HAPROXY_TYPED_S32:
+            ((int *)column->values)[row] = (int)value->i64;
+            break;
+        case HAPROXY_TYPED_U64:
+            ((zbx_uint64_t *)column->values)[row] = (zbx_uint64_t)value->i64;
+            break;
+        case HAPROXY_TYPED_S64:
+            ((zbx_int64_t *)column->values)[row] = value->i64;
+            break;
+        default:
+            ((double *)column->values)[row] = value->dbl;
+    }
+
+    column->set[row] = 1;
+}
+
+/******************************************************************************
+* Splits "<a>.<b>...:" at the dots, the last part ends at the colon.         *
+*                                                                            *
+* Return value: the colon or NULL if there are not n parts                   *
+******************************************************************************/
+static const char *typed_prefix(const char *p, const char *eol, haproxy_field_t *parts, int n)
+{
+    const char *colon;
+    int i;
+
+    if (NULL == (colon = (const char *)memchr(p, ':', (size_t)(eol - p))))
+        return NULL;
+
+    /* the name may have dots, the process may not */
+    for (i = 0; i < n - 2; i++)
+    {
+        parts[i].ptr = p;
+
+        if (NULL == (p = (const char *)memchr(p, '.', (size_t)(colon - p))))
+            return NULL;
+
+        parts[i].len = (size_t)(p++ - parts[i].ptr);
+    }
+
+    parts[n - 1].ptr = colon;
+
+    while (parts[n - 1].ptr > p && '.' != parts[n - 1].ptr[-1])
+        parts[n - 1].ptr--;
+
+    if (parts[n - 1].ptr == p)
+        return NULL;
+
+    parts[n - 1].len = (size_t)(colon - parts[n - 1].ptr);
+    parts[n - 2].ptr = p;
+    parts[n - 2].len = (size_t)(parts[n - 1].ptr - 1 - p);
+
+    return colon;
+}
+
+/******************************************************************************
+* Splits ":<tags>:<type>:<value>" following the prefix.                      *
+*                                                                            *
+* Return value: SUCCEED or FAIL if the line is malformed                     *
+******************************************************************************/
+static int typed_suffix(const char *colon, const char *eol, haproxy_field_t *tags, int *type, haproxy_field_t *value)
+{
+    const char *p = colon + 1, *sep;
+
+    if (NULL == (sep = (const char *)memchr(p, ':', (size_t)(eol - p))))
+        return FAIL;
+
+    tags->ptr = p;
+    tags->len = (size_t)(sep - p);
+    p = sep + 1;
+
+    if (NULL == (sep = (const char *)memchr(p, ':', (size_t)(eol - p))) ||
+            -1 == (*type = haproxy_typed_type(p, (size_t)(sep - p))))
+    {
+        return FAIL;
+    }
+
+    value->ptr = sep + 1;
+    value->len = (size_t)(eol - value->ptr);
+
+    return SUCCEED;
+}
+
+/******************************************************************************
+******************************************************************************/
+static int typed_number(const haproxy_field_t *field)
+{
+    size_t i;
+    int number = 0;
+
+    if (0 == field->len || 9 < field->len)
+        return -1;
+
+    for (i = 0; i < field->len; i++)
+    {
+        if ('0' > field->ptr[i] || '9' < field->ptr[i])
+            return -1;
+
+        number = number * 10 + field->ptr[i] - '0';
+    }
+
+    return number;
+}
+
+/******************************************************************************
+* Return value: HAPROXY_TYPE_* of the object type letter or -1               *
+******************************************************************************/
+static int typed_objtype(const haproxy_field_t *field)
+{
+    if (1 != field->len)
+        return -1;
+
+    switch (field->ptr[0])
+    {
+        case 'F':
+            return HAPROXY_TYPE_FRONTEND;
+        case 'B':
+            return HAPROXY_TYPE_BACKEND;
+        case 'S':
+            return HAPROXY_TYPE_SERVER;
+        case 'L':
+            return HAPROXY_TYPE_LISTENER;
+        default:
+            return -1;
+    }
+}
+
+/******************************************************************************
+* Adds the object ending at the line to the index if it has its names.       *
+******************************************************************************/
+static void typed_add_object(haproxy_typed_t *typed, int row, const char *line, const char *end)
+{
+    haproxy_typed_column_t *pxname, *svname;
+
+    if (HAPROXY_STAT_SVNAME >= typed->ncolumns)
+        return;
+
+    pxname = &typed->columns[HAPROXY_STAT_PXNAME];
+    svname = &typed->columns[HAPROXY_STAT_SVNAME];
+
+    if (HAPROXY_TYPED_STR != pxname->type || HAPROXY_TYPED_STR != svname->type || 0 == pxname->set[row] ||
+            0 == svname->set[row])
+    {
+        return;
+    }
+
+    haproxy_stat_add_row(typed->index, line, (size_t)(end - line), &((haproxy_field_t *)pxname->values)[row],
+                         &((haproxy_field_t *)svname->values)[row]);
+}
+
+/******************************************************************************
+* Parses show stat typed output into columns allocated in the arena, the     *
+* text values and the names point into the data so the data must outlive    *
+* the result.                                                                *
+*                                                                            *
+* Return value: the parsed response or NULL if there are no rows             *
+******************************************************************************/
+haproxy_typed_t *haproxy_typed_parse(const char *data, size_t len, haproxy_arena_t *arena)
+{
+    const char *end = data + len, *p, *eol, *colon, *object = NULL;
+    haproxy_field_t parts[6], tags, text;
+    haproxy_value_t value;
+    haproxy_typed_column_t *column;
+    haproxy_typed_t *typed;
+    int objtype, iid, sid, position, type, row = -1, last_objtype = -1, last_iid = -1, last_sid = -1;
+
+    typed = (haproxy_typed_t *)haproxy_arena_alloc(arena, sizeof(haproxy_typed_t));
+    memset(typed, 0, sizeof(haproxy_typed_t));
+    typed->index = haproxy_stat_create(arena);
+
+    for (p = data; p < end; p = eol + 1)
+    {
+        if (NULL == (eol = (const char *)memchr(p, '\n', (size_t)(end - p))))
+            eol = end;
+
+        if (NULL == (colon = typed_prefix(p, eol, parts, 6)) ||
+                -1 == (objtype = typed_objtype(&parts[0])) || -1 == (iid = typed_number(&parts[1])) ||
+                -1 == (sid = typed_number(&parts[2])) || -1 == (position = typed_number(&parts[3])) ||
+                HAPROXY_CSV_MAX_FIELDS <= position || 0 == parts[4].len ||
+                SUCCEED != typed_suffix(colon, eol, &tags, &type, &text))
+        {
+            continue;
+        }
+
+        /* the next proxy or server */
+        if (objtype != last_objtype || iid != last_iid || sid != last_sid)
+        {
+            if (-1 != row)
+                typed_add_object(typed, row, object, p);
+
+            row = typed->index->nrows;
+            typed_reserve(typed, row);
+            typed->types[row] = (unsigned char)objtype;
+            object = p;
+            last_objtype = objtype;
+            last_iid = iid;
+            last_sid = sid;
+        }
+
+        column = typed_column(typed, position, parts[4].ptr, parts[4].len, type,
+                              haproxy_typed_nature(tags.ptr, tags.len));
+
+        haproxy_typed_value_parse(type, text.ptr, text.len, &value);
+        typed_store(column, row, &value);
+    }
+
+    if (-1 != row)
+        typed_add_object(typed, row, object, end);
+
+    if (0 == typed->index->nrows)
+        return NULL;
+
+    haproxy_stat_build_index(typed->index);
+
+    return typed;
+}
+
+/******************************************************************************
+******************************************************************************/
+static void *typed_parse(const char *data, size_t len, haproxy_arena_t *arena)
+{
+    return haproxy_typed_parse(data, len, arena);
+}
+
+/******************************************************************************
+* Return value: parsed show stat typed snapshot, it is parsed on first use   *
+*               and freed with the snapshot; NULL if it cannot be parsed     *
+******************************************************************************/
+const haproxy_typed_t *haproxy_typed_get(haproxy_snapshot_t *snapshot)
+{
+    return (const haproxy_typed_t *)haproxy_snapshot_parsed(snapshot, typed_parse);
+}
+
+/******************************************************************************
+* Return value: column of the field or -1 if HAProxy did not report it       *
+******************************************************************************/
+int haproxy_typed_column(const haproxy_typed_t *typed, const char *name)
+{
+    size_t len = strlen(name);
+    int i, id;
+
+    if (-1 != (id = haproxy_stat_field_id(name)))
+        return typed->index->column[id];
+
+    /* a field added in a later HAProxy version */
+    for (i = 0; i < typed->ncolumns; i++)
+    {
+        if (typed->columns[i].name.len == len && 0 == memcmp(typed->columns[i].name.ptr, name, len))
+            return i;
+    }
+
+    return -1;
+}
+
+/******************************************************************************
+* Gets the value of the row (index in typed->index->rows) in the column,     *
+* numbers have no text.                                                      *
+*                                                                            *
+* Return value: SUCCEED - the row has a value, FAIL - otherwise              *
+******************************************************************************/
+int haproxy_typed_value(const haproxy_typed_t *typed, int column, int row, haproxy_value_t *value)
+{
+    const haproxy_typed_column_t *c = &typed->columns[column];
+    zbx_uint64_t ui64;
+
+    if (0 == c->set[row])
+        return FAIL;
+
+    memset(value, 0, sizeof(haproxy_value_t));
+    value->type = HAPROXY_VALUE_INT;
+
+    switch (c->type)
+    {
+        case HAPROXY_TYPED_U32:
+            value->i64 = ((const zbx_uint32_t *)c->values)[row];
+            break;
+        case HAPROXY_TYPED_S32:
+            value->i64 = ((const int *)c->values)[row];
+            break;
+        case HAPROXY_TYPED_U64:
+            if (TYPED_INT64_MAX < (ui64 = ((const zbx_uint64_t *)c->values)[row]))
+            {
+                value->type = HAPROXY_VALUE_DBL;
+                value->dbl = (double)ui64;
+                return SUCCEED;
+            }
+
+            value->i64 = (zbx_int64_t)ui64;
+            break;
+        case HAPROXY_TYPED_S64:
+            value->i64 = ((const zbx_int64_t *)c->values)[row];
+            break;
+        case HAPROXY_TYPED_FLT:
+            value->type = HAPROXY_VALUE_DBL;
+            value->dbl = ((const double *)c->values)[row];
+            return SUCCEED;
+        default:
+            value->type = HAPROXY_VALUE_STR;
+            value->text = ((const haproxy_field_t *)c->values)[row];
+            return SUCCEED;
+    }
+
+    value->dbl = (double)value->i64;
+
+    return SUCCEED;
+}